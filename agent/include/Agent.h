@@ -8,6 +8,17 @@
 #include "PolicyChecker.h"
 #include "ContentAnalyzer.h"
 #include "EventQueue.h"
+#include "AnalysisQueue.h"
+#include "AnalysisWorkerPool.h"
+#include "DirectoryWalker.h"
+#include "FileStateIndex.h"
+#include "ExcludeMatcher.h"
+#include "VerdictCache.h"
+#include "BatchReader.h"
+#include "AnalysisScheduler.h"
+#include <memory>
+
+class QThread;
 
 class Agent : public QObject
 {
@@ -29,12 +40,16 @@ private slots:
     void onFileCreated(const QString& filePath, qint64 size);
     void onFileModified(const QString& filePath, qint64 size);
     void onFileDeleted(const QString& filePath);
-    void onFileAnalyzed(const QString& filePath, bool hasViolations,
-                       const QList<PolicyMatch>& matches, qint64 size);
+    void onFileRenamed(const QString& oldPath, const QString& newPath);
+    void onAnalysisFinished(const AnalysisJob& job, const AnalysisResult& result);
+    void onAnalysisCapacity();
+    void onBaselineRead(const AnalysisJob& job);
     void onPoliciesReceived(const QJsonArray& policies);
+    void onPoliciesLoaded(int count);
     void onHeartbeatSent(bool success);
     void onEventSent(const QJsonObject& resp);
     void onNetworkError(const QString& error);
+    void onConfigChanged(const QString& key, const QVariant& value);
 
 private:
     void registerAgent();
@@ -42,23 +57,54 @@ private:
     void sendHeartbeat();
     void sendEvent(const QString& filePath, const QString& content, const QString& eventType,
                    bool isViolation, const QList<PolicyMatch>& matches);
-    void analyzeAndSendEvent(const QString& filePath, qint64 size, const QString& eventType);
+    void enqueueAnalysis(const QString& filePath, qint64 size, const QString& eventType);
 
     // !!!
     void analyzeExistingFiles(const QStringList& dirs);
-    QStringList getFilesRecursive(const QDir& dir);
-    bool shouldMonitorFile(const QString& filePath) const;
+    // Пачка файлов от обхода; generation - номер начального анализа
+    void addBaselineEntries(quint64 generation, const QVector<WalkEntry>& entries);
+    void finishBaselineWalk(quint64 generation);
+    // Прерывает идущий обход и ждет его потока
+    void cancelBaselineWalk();
+    void feedBaseline();
+    void finishBaseline();
+    bool shouldMonitorFile(const QString& filePath, qint64 size) const;
+    void applyFilterSettings();
+    void recordFileState(FileStateRecord& record, const AnalysisResult& result);
 
     QTimer* m_heartbeatTimer;
-    QHash<QString,QString> m_fileEventTypes;
     QSet<QString> m_violationFiles;
 
     ConfigManager& m_config;
     NetworkManager m_network;
     FileMonitor m_monitor;
     PolicyChecker m_checker;
-    ContentAnalyzer m_analyzer;
     EventQueue m_eventQueue;
+    AnalysisQueue m_analysisQueue;
+    VerdictCache m_verdictCache;
+    ScanCheckpoints m_scanCheckpoints;
+    AnalysisWorkerPool m_workerPool;
+    BatchReader m_batchReader;
+    DirectoryWalker m_walker;
+    FileStateIndex m_stateIndex;
+    ExcludeMatcher m_excludes;
+    qint64 m_maxFileSize;
+
+    // Начальный анализ: задания отдаются пулу по приоритету, когда в нем
+    // есть место и живые события не ждут в очереди. Небольшие файлы сначала
+    // читает BatchReader, не больше m_prefetchLimit байт
+    AnalysisScheduler m_baselineQueue;
+    int m_baselineTotal;
+    int m_baselinePending;
+    int m_baselineReading;
+    qint64 m_prefetchLimit;
+    int m_baselineSkipped;
+    // Обход начального анализа идет в своем потоке и отдает файлы пачками,
+    // не дожидаясь конца: анализ начинается с первой пачки
+    QThread* m_baselineWalk;
+    std::shared_ptr<std::atomic<bool>> m_baselineCancel;
+    quint64 m_baselineGeneration;
+    bool m_baselineWalking;
 
     QString m_serverAgentId;
 
@@ -0,0 +1,151 @@
+#ifndef ANALYSISQUEUE_H
+#define ANALYSISQUEUE_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QMetaType>
+#include <atomic>
+#include <functional>
+#include "BoundedQueue.h"
+
+// Задание на анализ содержимого файла
+struct AnalysisJob {
+    QString path;
+    qint64 size = 0;
+    QString eventType;
+    // Файл уже содержит нарушение - такие задания не вытесняются
+    bool priority = false;
+    // Время изменения по данным обхода, 0 - неизвестно
+    qint64 mtimeNs = 0;
+    // Содержимое уже прочитано (BatchReader), поток анализа файл не открывает.
+    // В файл выгрузки не попадает: выгружаются только живые события
+    bool prefetched = false;
+    QByteArray content;
+    // Файл по fstat при чтении (вместе с size и mtimeNs); 0 - не прочитан
+    quint64 device = 0;
+    quint64 inode = 0;
+};
+
+Q_DECLARE_METATYPE(AnalysisJob)
+
+// Ограниченная очередь заданий между FileMonitor и ContentAnalyzer.
+// Задания ставятся из любого потока без блокировок кольцевого буфера;
+// повторные изменения одного файла сливаются в одно задание. Таблица
+// ожидающих разбита на сегменты по хэшу пути, поэтому потоки, ставящие
+// разные файлы, друг друга не ждут.
+// При заполнении срабатывает политика переполнения: вытеснение старейшего
+// задания без нарушения или выгрузка на диск с последующей догрузкой.
+// Обработка идет квантами в цикле событий, чтобы heartbeat и ответы сети
+// не ждали окончания разбора потока файлов.
+class AnalysisQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class OverflowPolicy {
+        DropOldest,
+        Spill
+    };
+
+    struct Metrics {
+        int depth = 0;
+        int highWatermark = 0;
+        qint64 spilledPending = 0;
+        quint64 enqueued = 0;
+        quint64 merged = 0;
+        quint64 dropped = 0;
+        quint64 spilled = 0;
+        quint64 processed = 0;
+        qint64 maxWaitMs = 0;
+        qint64 avgWaitMs = 0;
+    };
+
+    using Handler = std::function<void(const AnalysisJob& job)>;
+    using Throttle = std::function<bool()>;
+
+    explicit AnalysisQueue(int capacity = 4096, QObject* parent = nullptr);
+    ~AnalysisQueue();
+
+    void setHandler(const Handler& handler) { m_handler = handler; }
+    // Пока throttle возвращает false, задания остаются в очереди;
+    // после освобождения получателя нужно вызвать wake()
+    void setThrottle(const Throttle& throttle) { m_throttle = throttle; }
+    void wake() { scheduleDrain(); }
+    void setOverflowPolicy(OverflowPolicy policy) { m_policy = policy; }
+    void setSpillFile(const QString& filePath);
+    // Максимальная длительность одного кванта обработки
+    void setTimeBudget(int msec);
+
+    static OverflowPolicy policyFromString(const QString& name);
+
+    // false, если задание отброшено из-за переполнения
+    bool enqueue(const AnalysisJob& job);
+    // Снимает ожидающее задание (файл удален или переименован)
+    bool remove(const QString& path, AnalysisJob* removed = nullptr);
+    void clear();
+
+    int capacity() const { return static_cast<int>(m_ring.capacity()); }
+    Metrics metrics() const;
+    void logMetrics(const QString& reason) const;
+
+private:
+    // В кольце лежат только пути; актуальное состояние задания - в таблице
+    // ожидающих, поэтому слияние не требует поиска по кольцу
+    struct Slot {
+        QString path;
+        qint64 enqueuedAt = 0;
+    };
+
+    // Сегмент таблицы ожидающих со своей блокировкой
+    struct PendingShard {
+        QMutex lock;
+        QHash<QString, AnalysisJob> jobs;
+    };
+    static constexpr int kPendingShards = 16;
+
+    PendingShard& shardFor(const QString& path) {
+        return m_pending[qHash(path) % kPendingShards];
+    }
+    bool takePending(const QString& path, AnalysisJob* job = nullptr);
+
+    void onDrain();
+    bool handleOverflow(const AnalysisJob& job, const Slot& slot);
+    bool evictOldest();
+    bool spill(const AnalysisJob& job);
+    void reloadSpilled();
+    void scheduleDrain();
+    void updateWatermark();
+
+    BoundedQueue<Slot> m_ring;
+    PendingShard m_pending[kPendingShards];
+    // Переполнение и файл выгрузки: только при заполненном кольце
+    mutable QMutex m_overflowLock;
+
+    Handler m_handler;
+    Throttle m_throttle;
+    OverflowPolicy m_policy;
+    std::atomic<bool> m_drainScheduled;
+    QElapsedTimer m_clock;
+    int m_timeBudget;
+    bool m_overflowing;
+
+    QString m_spillPath;
+    QFile m_spillFile;
+    qint64 m_spillReadOffset;
+    qint64 m_spilledPending;
+
+    std::atomic<int> m_highWatermark;
+    std::atomic<quint64> m_enqueued;
+    std::atomic<quint64> m_merged;
+    std::atomic<quint64> m_dropped;
+    std::atomic<quint64> m_spilled;
+    quint64 m_processed;
+    qint64 m_totalWaitMs;
+    qint64 m_maxWaitMs;
+};
+
+#endif //ANALYSISQUEUE_H
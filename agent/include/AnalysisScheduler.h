@@ -0,0 +1,62 @@
+#ifndef ANALYSISSCHEDULER_H
+#define ANALYSISSCHEDULER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+#include <QHash>
+#include <QElapsedTimer>
+#include "AnalysisQueue.h"
+
+// Очередь заданий по приоритету: раньше проверяются недавно измененные,
+// небольшие файлы с рискованными расширениями (таблицы, документы, выгрузки)
+// и файлы из путей с повышенным весом; файлы с нарушениями - первыми.
+// Ожидание повышает приоритет (старение), поэтому ни одно задание
+// не откладывается бесконечно.
+class AnalysisScheduler
+{
+public:
+    AnalysisScheduler();
+
+    // Правила "шаблон=вес": вес добавляется, если путь содержит шаблон;
+    // "~/" в начале шаблона - домашний каталог
+    void setPathWeights(const QStringList& rules);
+    // Очков приоритета за минуту ожидания
+    void setAgingRate(double pointsPerMinute) { m_agingPerMinute = qMax(0.0, pointsPerMinute); }
+
+    void push(const AnalysisJob& job);
+    // Задание с наибольшим приоритетом; очередь не должна быть пустой
+    const AnalysisJob& top() const { return m_heap.first().job; }
+    AnalysisJob pop();
+
+    bool isEmpty() const { return m_heap.isEmpty(); }
+    int size() const { return m_heap.size(); }
+    // Задания, которые еще ждали, при повторной постановке (новый начальный
+    // анализ) сохраняют накопленное ожидание
+    void clear();
+
+    // Приоритет задания без учета ожидания
+    double score(const AnalysisJob& job, qint64 nowMs) const;
+
+private:
+    struct Item {
+        double key;
+        quint64 sequence;
+        // Время постановки по m_clock, мс
+        qint64 enqueuedMs;
+        AnalysisJob job;
+    };
+
+    static bool lessUrgent(const Item& a, const Item& b);
+
+    QVector<Item> m_heap;
+    // Путь -> время постановки заданий, снятых clear()
+    QHash<QString, qint64> m_waitingSince;
+    QVector<QPair<QString, double>> m_pathWeights;
+    double m_agingPerMinute;
+    quint64 m_sequence;
+    QElapsedTimer m_clock;
+};
+
+#endif //ANALYSISSCHEDULER_H
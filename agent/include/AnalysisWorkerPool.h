@@ -0,0 +1,101 @@
+#ifndef ANALYSISWORKERPOOL_H
+#define ANALYSISWORKERPOOL_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <functional>
+#include "AnalysisQueue.h"
+#include "ContentAnalyzer.h"
+
+class QThread;
+class QTimer;
+class PolicyChecker;
+
+// Рабочий объект пула. Живет в своем потоке и владеет собственным
+// ContentAnalyzer - буферы чтения и декодирования не делятся между потоками
+class AnalysisWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AnalysisWorker(PolicyChecker* checker, QObject* parent = nullptr);
+
+    ContentAnalyzer& analyzer() { return m_analyzer; }
+
+public slots:
+    void process(const AnalysisJob& job);
+
+signals:
+    void finished(const AnalysisJob& job, const AnalysisResult& result);
+
+private:
+    ContentAnalyzer m_analyzer;
+    PolicyChecker* m_checker;
+};
+
+// Пул потоков анализа содержимого.
+// Задание направляется в поток по хэшу пути, поэтому задания одного файла
+// выполняются строго по очереди: изменение не обгонит создание.
+// Результаты возвращаются в поток пула через очередь сигналов.
+// Число активных потоков снижается, когда система загружена другими задачами.
+class AnalysisWorkerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    using AnalyzerSetup = std::function<void(ContentAnalyzer& analyzer)>;
+
+    explicit AnalysisWorkerPool(PolicyChecker* checker, QObject* parent = nullptr);
+    ~AnalysisWorkerPool();
+
+    // threadCount = 0 - по числу физических ядер минус одно
+    void start(int threadCount = 0);
+    void stop();
+    bool isRunning() const { return !m_workers.isEmpty(); }
+
+    // Настройка анализаторов всех потоков (размер выборки, потоковый режим и т.п.)
+    void configure(const AnalyzerSetup& setup);
+
+    void submit(const AnalysisJob& job);
+    // Заданий в работе достаточно, чтобы занять все активные потоки
+    bool isSaturated() const;
+
+    int threadCount() const { return m_workers.size(); }
+    int activeCount() const { return m_activeCount; }
+    int inFlight() const { return m_inFlight; }
+
+    static int physicalCoreCount();
+
+    // Сводная статистика анализаторов всех потоков, в том числе доля
+    // фрагментов больших файлов, перенесенных без повторной проверки
+    void logStats(const QString& reason) const;
+
+signals:
+    void jobFinished(const AnalysisJob& job, const AnalysisResult& result);
+    void capacityAvailable();
+
+private slots:
+    void onWorkerFinished(const AnalysisJob& job, const AnalysisResult& result);
+    void adjustForLoad();
+
+private:
+    // Поток, которому отдан путь, пока по нему есть задания в работе
+    struct PathShard {
+        int worker;
+        int pending;
+    };
+
+    int selectWorker(const QString& path) const;
+
+    PolicyChecker* m_checker;
+    QVector<QThread*> m_threads;
+    QVector<AnalysisWorker*> m_workers;
+    QHash<QString, PathShard> m_inFlightPaths;
+    AnalyzerSetup m_setup;
+    QTimer* m_loadTimer;
+    int m_activeCount;
+    int m_inFlight;
+};
+
+#endif //ANALYSISWORKERPOOL_H
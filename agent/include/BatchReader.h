@@ -0,0 +1,75 @@
+#ifndef BATCHREADER_H
+#define BATCHREADER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AnalysisQueue.h"
+
+// Пакетное чтение небольших файлов для начального анализа.
+// Держит в работе до depth операций open/read одновременно: через io_uring
+// с зарегистрированными буферами, а если ядро его не дает (старое ядро,
+// seccomp, io_uring_disabled) - пулом потоков с pread. Задержка NFS
+// перекрывается, NVMe получает глубокую очередь.
+// Прочитанное содержимое уходит с заданием в пул анализа, и поток анализа
+// не делает для файла ни одного системного вызова.
+class BatchReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BatchReader(QObject* parent = nullptr);
+    ~BatchReader();
+
+    // bufferSize - сколько байт читается от начала файла;
+    // useIoUring = false - сразу пул потоков с pread
+    bool start(int depth, qint64 bufferSize, bool useIoUring = true);
+    void stop();
+    bool isRunning() const { return m_running; }
+    bool usesIoUring() const { return m_ring != nullptr; }
+    int depth() const { return m_depth; }
+    qint64 bufferSize() const { return m_bufferSize; }
+
+    // Можно вызывать из любого потока; результат - сигнал fileRead
+    void submit(const AnalysisJob& job);
+
+    quint64 filesRead() const { return m_filesRead.load(std::memory_order_relaxed); }
+    quint64 bytesRead() const { return m_bytesRead.load(std::memory_order_relaxed); }
+    quint64 failures() const { return m_failures.load(std::memory_order_relaxed); }
+
+signals:
+    // Из потока чтения. job.prefetched = false - файл не прочитан
+    // (ошибка, файл вырос больше буфера); его прочитает поток анализа
+    void fileRead(const AnalysisJob& job);
+
+private:
+    struct Ring;
+
+    bool takeJob(AnalysisJob& job, bool wait);
+    void complete(AnalysisJob& job, const char* data, qint64 length);
+    void fail(AnalysisJob& job);
+
+    void runRing();
+    void runPread();
+
+    Ring* m_ring;
+    std::vector<std::thread> m_threads;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::deque<AnalysisJob> m_pending;
+    bool m_stopping;
+    bool m_running;
+    int m_depth;
+    qint64 m_bufferSize;
+
+    std::atomic<quint64> m_filesRead;
+    std::atomic<quint64> m_bytesRead;
+    std::atomic<quint64> m_failures;
+};
+
+#endif //BATCHREADER_H
@@ -0,0 +1,111 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Ограниченная очередь без блокировок для нескольких производителей
+// и потребителей (кольцевой буфер Д. Вьюкова).
+// Каждая ячейка хранит номер последовательности: по нему поток понимает,
+// свободна ли ячейка для записи или уже содержит значение для чтения.
+// Емкость округляется вверх до степени двойки.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_enqueuePos.store(0, std::memory_order_relaxed);
+        m_dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // false, если очередь заполнена
+    bool tryPush(T value)
+    {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // false, если очередь пуста
+    bool tryPop(T& value)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    // Приблизительно: при одновременной работе потоков значение сразу устаревает
+    size_t sizeApprox() const
+    {
+        const size_t tail = m_enqueuePos.load(std::memory_order_relaxed);
+        const size_t head = m_dequeuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+    // Позиции на разных строках кэша, чтобы производители и потребители не мешали друг другу
+    alignas(64) std::atomic<size_t> m_enqueuePos;
+    alignas(64) std::atomic<size_t> m_dequeuePos;
+};
+
+#endif //BOUNDEDQUEUE_H
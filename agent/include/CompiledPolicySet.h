@@ -0,0 +1,228 @@
+#ifndef COMPILEDPOLICYSET_H
+#define COMPILEDPOLICYSET_H
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QRegularExpression>
+#include <QHash>
+#include <QVector>
+#include <QList>
+#include <QSet>
+#include <memory>
+#include "PatternPrefilter.h"
+#include "NumericDetector.h"
+
+// Область действия политики; пустые поля не ограничивают
+struct PolicyScope {
+    // Расширения файлов без точки, в нижнем регистре
+    QStringList extensions;
+    // Классы файлов (см. FileClassifier::classExtensions). Класс выбирается
+    // по расширению; по содержимому определяется только text: к нему
+    // относится и текстовый файл с неизвестным расширением или без него
+    QStringList classes;
+    // Шаблоны пути: с "/" - полный путь, без - имя файла; * и ? как в оболочке
+    QStringList paths;
+    // Наибольший размер файла в байтах, 0 - без ограничения
+    qint64 maxFileSize = 0;
+
+    bool hasFileTypes() const { return !extensions.isEmpty() || !classes.isEmpty(); }
+    // Зависит не только от расширения: отбор при проверке каждого файла
+    bool isConditional() const { return !paths.isEmpty() || maxFileSize > 0; }
+};
+
+// Структура для хранения DLP-политики
+struct DlpPolicy {
+    int id;
+    QString name;
+    QString pattern;
+    QString severity;
+    // "regex" - регулярное выражение в pattern; иначе встроенный детектор
+    // (card, inn, snils, passport, phone), pattern - его параметры
+    QString kind = "regex";
+    PolicyScope scope;
+
+    bool isRegex() const { return kind == "regex"; }
+
+    bool isValid() const {
+        return !name.isEmpty() && (!pattern.isEmpty() || !isRegex()) && !severity.isEmpty();
+    }
+};
+
+// Структура для результата проверки
+struct PolicyMatch {
+    // id политики; -1 - неизвестен (запись журнала без policy_id)
+    int policyId = -1;
+    QString policyName;
+    QString policyPattern;
+    QString severity;
+    QString matchedContent;
+    // Позиции в символах от начала файла, а не от начала фрагмента
+    qint64 startPosition;
+    qint64 endPosition;
+
+    bool operator==(const PolicyMatch& other) const {
+        return policyName == other.policyName &&
+               policyPattern == other.policyPattern &&
+               severity == other.severity &&
+               matchedContent == other.matchedContent &&
+               startPosition == other.startPosition &&
+               endPosition == other.endPosition;
+    }
+
+    bool operator!=(const PolicyMatch& other) const {
+        return !(*this == other);
+    }
+};
+
+// Скомпилированный набор политик: выражения, объединенные группы,
+// предварительный отбор и детекторы. После создания не меняется,
+// поэтому проверки из любых потоков идут без блокировок; новый набор
+// собирается целиком и подменяет старый (см. PolicyChecker)
+class CompiledPolicySet
+{
+public:
+    // Пустой набор версии 0: политики еще не загружены
+    CompiledPolicySet();
+    // Компиляция в вызывающем потоке. Политики с неверным шаблоном
+    // или неизвестным видом в набор не входят, их id - в rejected()
+    CompiledPolicySet(const QHash<int, DlpPolicy>& policies, bool caseSensitive, int maxContentSize);
+
+    CompiledPolicySet(const CompiledPolicySet&) = delete;
+    CompiledPolicySet& operator=(const CompiledPolicySet&) = delete;
+
+    // Политики, применимые к файлу: маршрут по расширению и исключенные
+    // из него по пути или размеру
+    struct FileScope {
+        int route = 0;
+        QVector<int> excluded;
+        // Версия набора с учетом области; ключ кэшей результатов проверки файла
+        quint64 version = 0;
+    };
+
+    // Все политики набора - файл неизвестен
+    FileScope allPolicies() const;
+    // fileSize < 0 - размер неизвестен и не учитывается
+    FileScope scopeFor(QStringView filePath, qint64 fileSize) const;
+
+    // Отпечаток политик и настроек; ключ кэшей результатов проверки
+    quint64 version() const { return m_version; }
+    int policyCount() const { return m_policies.size(); }
+    const QHash<int, DlpPolicy>& policies() const { return m_policies; }
+    const QList<int>& rejected() const { return m_rejected; }
+    bool caseSensitive() const { return m_caseSensitive; }
+    int maxContentSize() const { return m_maxContentSize; }
+    // Наибольшая возможная длина совпадения среди политик, -1 - не ограничена
+    int maxMatchLength() const { return m_maxMatchLength; }
+    int maxMatchLength(const FileScope& scope) const { return m_routes.at(scope.route).maxMatchLength; }
+
+    // Проверка текста целиком (не длиннее maxContentSize) политиками области
+    QList<PolicyMatch> checkContent(QStringView content, const FileScope& scope) const;
+    // Потоковая проверка по окнам. Первые contextLength символов окна -
+    // текст перед ним: совпадения в нем не ищутся, но \b, ^ и просмотр назад
+    // видят настоящие соседние символы, а не начало строки. Совпадения ищутся
+    // с началом в следующих commitLength символах; остальное перекрытие
+    // уходит в следующее окно. lastMatchEnd исключает повторы на стыке окон
+    void checkWindow(QStringView window, qint64 windowOffset, qsizetype contextLength, qsizetype commitLength,
+                     QHash<int, qint64>& lastMatchEnd, QList<PolicyMatch>& matches, int maxMatches,
+                     const FileScope& scope) const;
+
+    // Шаблон можно проверять в объединенном выражении группы: в нем нет
+    // нумерованных ссылок и вызовов групп, \G, глаголов и режима x
+    static bool canCombine(const QString& pattern);
+
+private:
+    // Объединенное выражение группы политик: (?<dlp_p12>шаблон)|(?<dlp_p15>шаблон)|...
+    // Один проход находит самое левое совпадение любой политики группы
+    struct CombinedPattern {
+        QRegularExpression regex;
+        // Номер группы захвата и id политики, в порядке альтернатив
+        QVector<QPair<int, int>> groups;
+    };
+
+    // Политики одного класса файлов со своими группами, отбором и детекторами
+    struct Route {
+        // id применимых политик по возрастанию
+        QVector<int> policies;
+        // Выражения групп собраны при построении набора и дальше не меняются
+        QVector<CombinedPattern> policyGroups;
+        QVector<int> separatePolicies;
+        QVector<int> filteredPolicies;
+        PatternPrefilter prefilter;
+        NumericDetector detectors;
+        int maxMatchLength = 0;
+    };
+
+    // Шаблоны пути политики, объединенные в выражения
+    struct PathScope {
+        QRegularExpression path;
+        QRegularExpression name;
+        bool hasPath = false;
+        bool hasName = false;
+
+        bool matches(QStringView filePath) const;
+    };
+
+    bool compilePattern(const QString& pattern, QRegularExpression& regex) const;
+    bool compileScope(int policyId, const PolicyScope& scope);
+    void collectMatches(QStringView text, qint64 baseOffset, qsizetype start, qsizetype commitEnd,
+                        QHash<int, qint64>* lastMatchEnd, QList<PolicyMatch>& matches, int maxMatches,
+                        const FileScope& scope) const;
+    // Все совпадения одной политики; false - достигнут предел maxMatches
+    bool matchPolicy(int policyId, QStringView text, qint64 baseOffset, qsizetype start, qsizetype commitEnd,
+                     QHash<int, qint64>* lastMatchEnd, QList<PolicyMatch>& matches, int maxMatches) const;
+    // То же только для совпадений, начинающихся в окнах предварительного отбора
+    bool matchPolicyWindows(int policyId, int maxLength, const QVector<QPair<qsizetype, qsizetype>>& windows,
+                            QStringView text, qint64 baseOffset, qsizetype start,
+                            QHash<int, qint64>* lastMatchEnd, QList<PolicyMatch>& matches, int maxMatches) const;
+    void appendMatch(int policyId, const QString& content, qint64 start, qint64 end,
+                     QHash<int, qint64>* lastMatchEnd, QList<PolicyMatch>& matches) const;
+    static int estimateMaxLength(QStringView pattern, qsizetype& pos);
+
+    void computeVersion();
+    int computeMaxMatchLength(const QVector<int>& policyIds) const;
+    void buildTriggers();
+    void buildRoutes();
+    // groupIndex - выражения, уже собранные для других маршрутов, по списку id
+    int addRoute(const QVector<int>& policyIds, QHash<QString, int>& routeIndex,
+                 QHash<QString, CombinedPattern>& groupIndex);
+    void buildRoute(Route& route, QHash<QString, CombinedPattern>& groupIndex);
+    bool compileCombined(const QVector<int>& policyIds, CombinedPattern& combined) const;
+
+    QHash<int, DlpPolicy> m_policies;
+    QHash<int, QRegularExpression> m_compiledPatterns;
+    QList<int> m_rejected;
+
+    bool m_caseSensitive;
+    int m_maxContentSize;
+    quint64 m_version;
+    int m_maxMatchLength;
+    // Таблица маршрутов: у каждого класса файлов свой набор политик.
+    // Маршрут состоит из групп политик, проверяемых объединенным выражением,
+    // политик, шаблоны которых нельзя объединить (нумерованные обратные
+    // ссылки и т.п.), политик с предварительным отбором и детекторов
+    QVector<Route> m_routes;
+    // Маршрут по расширению (нижний регистр) для расширений из областей политик
+    QHash<QString, int> m_routeByExtension;
+    // Файл с известным расширением, которого нет в областях политик
+    int m_defaultRoute;
+    // Файл без расширения или с неизвестным расширением: содержимое
+    // определено как текст, применяются и политики класса text
+    int m_textRoute;
+    int m_allRoute;
+    // Расширения, к которым ограничены политики
+    QHash<int, QSet<QString>> m_scopeExtensions;
+    // Политики с классом text в области
+    QSet<int> m_textClassPolicies;
+    // Политики с ограничением по пути или размеру: в группы не входят,
+    // чтобы их можно было пропустить для отдельного файла
+    QVector<int> m_conditionalPolicies;
+    QHash<int, PathScope> m_pathScopes;
+    // Политики с обязательным символом или последовательностью цифр:
+    // проверяются только около найденных признаков, в группы не входят
+    QHash<int, PatternTrigger> m_triggers;
+};
+
+using PolicySet = std::shared_ptr<const CompiledPolicySet>;
+
+#endif //COMPILEDPOLICYSET_H
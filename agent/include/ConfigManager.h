@@ -22,6 +22,7 @@ public:
     QString agentId() const;
     QString serverUrl() const;
     QStringList monitorDirs() const;
+    QString monitorBackend() const;
     QString logLevel() const;
     QString logFile() const;
 
@@ -4,7 +4,43 @@
 #include <QObject>
 #include <QString>
 #include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QStringDecoder>
+#include <QMetaType>
+#include <atomic>
 #include "PolicyChecker.h"
+#include "FileReader.h"
+#include "VerdictCache.h"
+#include "ScanCheckpoints.h"
+#include "ContentChunker.h"
+
+// Результат анализа файла. Содержит все, что нужно для события и индекса
+// состояний, поэтому после анализа файл повторно не читается
+struct AnalysisResult {
+    QString filePath;
+    bool ok = false;
+    bool hasViolations = false;
+    bool binary = false;
+    QList<PolicyMatch> matches;
+    qint64 size = 0;
+    // Файл по fstat открытого дескриптора: проверено именно это состояние,
+    // а не то, что окажется на диске к концу анализа. 0 - неизвестно
+    quint64 device = 0;
+    quint64 inode = 0;
+    qint64 mtimeNs = 0;
+    // Начало текста файла для content_sample события
+    QString contentSample;
+    // Отпечаток прочитанных байт (FastHash)
+    quint64 contentHash = 0;
+    // Совпадения взяты из кэша вердиктов, политики не применялись
+    bool cached = false;
+    // Версия набора политик с учетом области файла; 0 - без политик
+    quint64 policyVersion = 0;
+    QString error;
+};
+
+Q_DECLARE_METATYPE(AnalysisResult)
 
 class ContentAnalyzer : public QObject
 {
@@ -14,34 +50,109 @@ public:
     explicit ContentAnalyzer(QObject* parent = nullptr);
     ~ContentAnalyzer() = default;
 
-    // Основной метод анализа файла
-    bool analyzeFile(const QString& filePath, PolicyChecker* checker = nullptr);
+    // Основной метод анализа файла; result заполняется и при ошибке
+    bool analyzeFile(const QString& filePath, PolicyChecker* checker, AnalysisResult& result);
+    // Анализ уже прочитанного начала файла (не больше размера выборки)
+    bool analyzeContent(const QString& filePath, QByteArrayView data, PolicyChecker* checker,
+                        AnalysisResult& result);
 
     // Настройки
     void setMaxFileSize(qint64 bytes) { m_maxFileSize = bytes; }
     void setSampleSize(int bytes) { m_sampleSize = bytes; }
+    // Потоковый режим: файлы больше выборки читаются целиком фрагментами
+    // с перекрытием, память не зависит от размера файла
+    void setStreaming(bool enabled) { m_streaming = enabled; }
+    void setChunkSize(qint64 bytes) { m_chunkSize = qMax<qint64>(bytes, 64 * 1024); }
+    // Предел перекрытия для шаблонов с неограниченной длиной совпадения
+    void setMaxOverlap(int chars) { m_maxOverlap = qMax(chars, 0); }
+    // Файлы больше выборки, но не больше этого размера, ищутся в кэше
+    // вердиктов по отпечатку, посчитанному отдельным проходом до разбора
+    void setCachePrepassLimit(qint64 bytes) { m_cachePrepassLimit = qMax<qint64>(bytes, 0); }
+    bool isStreaming() const { return m_streaming; }
+    // Общий для потоков анализа кэш вердиктов; nullptr - без кэша
+    void setVerdictCache(VerdictCache* cache) { m_verdictCache = cache; }
+    // Точки продолжения и разбиение измененных файлов на фрагменты;
+    // nullptr - всегда полная проверка
+    void setScanCheckpoints(ScanCheckpoints* checkpoints) { m_checkpoints = checkpoints; }
 
-    // Статистика
+    // Статистика; читается из других потоков (AnalysisWorkerPool::logStats)
     int analyzedFilesCount() const { return m_analyzedCount; }
     qint64 totalBytesRead() const { return m_totalBytesRead; }
-
-    QString readFileContent(const QString& filePath) const;
+    // Фрагменты больших файлов: проверенные и перенесенные без проверки
+    int chunksScanned() const { return m_chunksScanned; }
+    int chunksReused() const { return m_chunksReused; }
+    qint64 bytesReused() const { return m_bytesReused; }
 
 signals:
     // Результаты анализа
-    void fileAnalyzed(const QString& filePath, bool hasViolations,
-                    const QList<PolicyMatch>& matches, qint64 size);
+    void fileAnalyzed(const AnalysisResult& result);
     void analysisError(const QString& filePath, const QString& error);
 
 private:
     // Вспомогательные методы
-    bool isBinaryFile(const QString& filePath) const;
-    QStringList getTextFileExtensions() const;
+    // Декодирование UTF-8 в переиспользуемую строку без промежуточных копий
+    const QString& decodeContent(QByteArrayView data);
+    bool analyzeStream(PolicyChecker* checker, AnalysisResult& result);
+    bool analyzeData(PolicyChecker* checker, QByteArrayView data, AnalysisResult& result);
+    void selectScope(AnalysisResult& result);
+    bool fail(AnalysisResult& result, const QString& error);
+    bool skipBinary(AnalysisResult& result);
+    QString decodeSample(QByteArrayView head);
+
+    // Кэш вердиктов
+    bool cacheEnabled(PolicyChecker* checker) const;
+    bool takeCached(const VerdictCache::Key& key, PolicyChecker* checker,
+                    QByteArrayView head, AnalysisResult& result);
+    void storeVerdict(const VerdictCache::Key& key, const QList<PolicyMatch>& matches);
+    bool restoreMatchedContent(QByteArrayView head, AnalysisResult& result);
+    bool hashStream(AnalysisResult& result, VerdictCache::Key& key);
+
+    // Фрагменты прошлого разбора файла по хэшу содержимого
+    struct ChunkReuse {
+        ScanCheckpoint previous;
+        QHash<quint64, int> index;
+        int reused = 0;
+
+        // Номер фрагмента с тем же содержимым в прошлом разборе, -1 - нет
+        int find(const ContentChunk& chunk) const;
+    };
+
+    // Потоковый разбор с начала файла или с точки продолжения
+    bool scanStream(PolicyChecker* checker, AnalysisResult& result,
+                    const ScanCheckpoint* resume, const VerdictCache::Key* key);
+    bool findAppend(PolicyChecker* checker, AnalysisResult& result, ScanCheckpoint& checkpoint);
+    // Совпадения фрагмента: перенос из прошлого разбора или проверка
+    void finalizeChunk(PolicyChecker* checker, QVector<ContentChunk>& chunks, int index,
+                       qint64 textOffset, int overlap, ChunkReuse& reuse,
+                       QHash<int, qint64>& lastMatchEnd);
+    void appendDecoded(QByteArrayView bytes);
+    bool readContext(const ContentChunk& open, int overlap, qint64& textOffset);
+    bool restoreChunkContent(ContentChunk& chunk, qint64 fileSize);
+    void saveCheckpoint(PolicyChecker* checker, const AnalysisResult& result,
+                        const FastHash& hasher, const QVector<ContentChunk>& chunks);
 
     qint64 m_maxFileSize;
     int m_sampleSize;
-    int m_analyzedCount;
-    qint64 m_totalBytesRead;
+    std::atomic<int> m_analyzedCount;
+    std::atomic<qint64> m_totalBytesRead;
+    bool m_streaming;
+    qint64 m_chunkSize;
+    int m_maxOverlap;
+    qint64 m_cachePrepassLimit;
+    VerdictCache* m_verdictCache;
+    ScanCheckpoints* m_checkpoints;
+    std::atomic<int> m_chunksScanned;
+    std::atomic<int> m_chunksReused;
+    std::atomic<qint64> m_bytesReused;
+
+    FileReader m_reader;
+    QStringDecoder m_decoder;
+    QString m_text;
+    ContentChunker m_chunker;
+    // Набор политик, закрепленный на время анализа текущего файла,
+    // и политики из него, применимые к этому файлу
+    PolicySet m_policies;
+    CompiledPolicySet::FileScope m_scope;
 };
 
 #endif //CONTENTANALYZER_H
@@ -0,0 +1,45 @@
+#ifndef CONTENTCHUNKER_H
+#define CONTENTCHUNKER_H
+
+#include <QtGlobal>
+
+// Разбиение потока байт на фрагменты по содержимому (FastCDC: gear-хэш
+// с нормализацией размера). Граница зависит только от последних байт
+// перед ней, поэтому правка в середине файла меняет один-два фрагмента,
+// а остальные сохраняют прежние границы и хэши.
+// Граница не разрывает последовательность UTF-8: если символ на границе
+// не закончился в переданном блоке, граница переносится в следующий.
+class ContentChunker
+{
+public:
+    explicit ContentChunker(qint64 minSize = 16 * 1024, qint64 averageSize = 64 * 1024,
+                            qint64 maxSize = 256 * 1024);
+
+    // Начало нового потока или продолжение с известной границы
+    void reset();
+
+    // Возвращает число байт data, относящихся к текущему фрагменту;
+    // boundary = true, если на них фрагмент закончился
+    qsizetype next(const char* data, qsizetype length, bool& boundary);
+
+private:
+    // Сколько байт продолжения не хватает последнему символу перед end
+    int missingContinuation(const char* data, qsizetype end) const;
+    void keepTail(const char* data, qsizetype length);
+
+    qint64 m_minSize;
+    qint64 m_averageSize;
+    qint64 m_maxSize;
+    quint64 m_maskSmall;
+    quint64 m_maskLarge;
+
+    quint64 m_hash;
+    qint64 m_size;
+    // Граница уже найдена, ждем столько байт продолжения символа
+    int m_pendingContinuation;
+    // Последние байты прошлого блока: начало символа на стыке блоков
+    char m_tail[3];
+    int m_tailLength;
+};
+
+#endif //CONTENTCHUNKER_H
@@ -0,0 +1,59 @@
+#ifndef DIRECTORYWALKER_H
+#define DIRECTORYWALKER_H
+
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Запись, найденная при обходе, вместе с данными stat
+struct WalkEntry {
+    QString path;
+    quint64 device;
+    quint64 inode;
+    qint64 size;
+    qint64 mtimeNs;
+    qint64 ctimeNs;
+    bool isDir;
+};
+
+// Многопоточный обход дерева каталогов (getdents64 + fstatat).
+// Каждый поток держит свою очередь каталогов и забирает работу у соседей,
+// когда его очередь пуста. Записи передаются в callback по мере обнаружения,
+// без построения промежуточных списков. Рабочие потоки постоянные: создаются
+// при первом многопоточном обходе и ждут следующего.
+class DirectoryWalker
+{
+public:
+    // Вызывается из рабочих потоков; worker - индекс потока в [0, threadCount())
+    using EntryCallback = std::function<void(const WalkEntry& entry, int worker)>;
+    // Возвращает false, если каталог нужно пропустить вместе с поддеревом
+    using DirectoryFilter = std::function<bool(const QString& dirPath)>;
+
+    explicit DirectoryWalker(int threadCount = 0);
+    ~DirectoryWalker();
+
+    DirectoryWalker(const DirectoryWalker&) = delete;
+    DirectoryWalker& operator=(const DirectoryWalker&) = delete;
+
+    void setThreadCount(int count);
+    int threadCount() const { return m_threadCount; }
+
+    void setDirectoryFilter(const DirectoryFilter& filter) { m_dirFilter = filter; }
+
+    // Обходит корни и возвращает число найденных файлов. Многопоточные обходы
+    // одного экземпляра идут по очереди; один корень без рекурсии обходится
+    // в вызывающем потоке. cancelled - прервать обход из другого потока
+    qint64 walk(const QStringList& roots, const EntryCallback& callback, bool recursive = true,
+                const std::atomic<bool>* cancelled = nullptr) const;
+
+private:
+    struct Pool;
+
+    int m_threadCount;
+    DirectoryFilter m_dirFilter;
+    std::unique_ptr<Pool> m_pool;
+};
+
+#endif //DIRECTORYWALKER_H
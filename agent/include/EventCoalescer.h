@@ -0,0 +1,69 @@
+#ifndef EVENTCOALESCER_H
+#define EVENTCOALESCER_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QElapsedTimer>
+
+class QTimer;
+
+// Планировщик с объединением событий по пути.
+// Серия изменений одного файла (создание, несколько записей) сворачивается
+// в одно событие, которое выдается после периода тишины, но не позже
+// максимальной задержки от первого изменения.
+class EventCoalescer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Change : quint8 {
+        Created,
+        Modified,
+        Deleted
+    };
+
+    explicit EventCoalescer(QObject* parent = nullptr);
+
+    void setQuietPeriod(int msec);
+    void setMaxLatency(int msec);
+    int quietPeriod() const { return m_quietPeriod; }
+    int maxLatency() const { return m_maxLatency; }
+
+    void schedule(const QString& path, Change change);
+    // Возвращает true, если по пути было ожидающее событие
+    bool cancel(const QString& path);
+    void clear();
+
+    bool isPending(const QString& path) const { return m_pending.contains(path); }
+    int pendingCount() const { return m_pending.size(); }
+    quint64 receivedCount() const { return m_received; }
+    quint64 emittedCount() const { return m_emitted; }
+
+signals:
+    void changeReady(const QString& path, EventCoalescer::Change change);
+
+private slots:
+    void onTimeout();
+
+private:
+    struct Pending {
+        Change change;
+        qint64 firstSeen;
+        qint64 lastSeen;
+    };
+
+    qint64 deadline(const Pending& pending) const;
+    void rearm();
+
+    QHash<QString, Pending> m_pending;
+    QElapsedTimer m_clock;
+    QTimer* m_timer;
+    qint64 m_armedDeadline;
+    int m_quietPeriod;
+    int m_maxLatency;
+    quint64 m_received;
+    quint64 m_emitted;
+};
+
+#endif //EVENTCOALESCER_H
@@ -0,0 +1,65 @@
+#ifndef EXCLUDEMATCHER_H
+#define EXCLUDEMATCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QSet>
+#include <QRegularExpression>
+
+// Скомпилированный набор шаблонов исключения (регистр не учитывается).
+// Простые шаблоны раскладываются по таблицам: точные имена, расширения,
+// суффиксы и префиксы; остальные объединяются в одно регулярное выражение.
+// Шаблон с "/" на конце (node_modules/, .git/) исключает каталог целиком;
+// сверяются только каталоги ниже корня обхода, сам корень и его родители
+// не проверяются. После построения только читается и безопасен для
+// нескольких потоков.
+class ExcludeMatcher
+{
+public:
+    ExcludeMatcher() = default;
+    explicit ExcludeMatcher(const QStringList& patterns);
+
+    void setPatterns(const QStringList& patterns);
+    QStringList patterns() const { return m_patterns; }
+    bool hasDirectoryPatterns() const { return !m_dirs.isEmpty(); }
+    // Корни обхода (канонические пути); путь вне корней проверяется целиком
+    void setRoots(const QStringList& roots) { m_roots = roots; }
+
+    // Проверка только имени файла
+    bool matchesFileName(QStringView fileName) const;
+    // Проверка имени каталога
+    bool matchesDirectoryName(QStringView dirName) const;
+    // Имя файла и каталоги в пути ниже корня
+    bool isExcluded(const QString& filePath) const;
+    // Сам каталог или любой из его родителей ниже корня
+    bool isExcludedDirectory(const QString& dirPath) const;
+
+private:
+    struct Table {
+        QSet<QString> exact;
+        QSet<QString> extensions;
+        QStringList suffixes;
+        QStringList prefixes;
+        QRegularExpression combined;
+        bool hasCombined = false;
+
+        void clear();
+        bool isEmpty() const;
+        bool matches(QStringView name) const;
+    };
+
+    bool matchesAnyComponent(QStringView dirPath) const;
+    // Начало части пути ниже ближайшего корня; 0 - путь вне корней
+    qsizetype belowRoot(QStringView path) const;
+
+    static void addPattern(Table& table, const QString& pattern, QStringList& wildcards);
+    static void compileWildcards(Table& table, const QStringList& wildcards);
+
+    QStringList m_patterns;
+    QStringList m_roots;
+    Table m_files;
+    Table m_dirs;
+};
+
+#endif //EXCLUDEMATCHER_H
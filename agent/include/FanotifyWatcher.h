@@ -0,0 +1,65 @@
+#ifndef FANOTIFYWATCHER_H
+#define FANOTIFYWATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <vector>
+
+class QSocketNotifier;
+
+// Источник событий на основе fanotify (Linux >= 5.9, CAP_SYS_ADMIN).
+// Одна метка покрывает всю файловую систему, события фильтруются по
+// корням мониторинга в пространстве пользователя. Сигналы совпадают с InotifyWatcher.
+class FanotifyWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FanotifyWatcher(QObject* parent = nullptr);
+    ~FanotifyWatcher();
+
+    bool isValid() const { return m_fd >= 0; }
+
+    // Корни мониторинга
+    bool addRoot(const QString& directory);
+    void removeRoot(const QString& directory);
+    void removeAllRoots();
+
+    bool covers(const QString& path) const;
+    QStringList roots() const { return m_roots; }
+
+signals:
+    void entryCreated(const QString& path, bool isDir);
+    void fileWritten(const QString& path);
+    // Запись в файл, который еще открыт (журналы, растущие выгрузки)
+    void contentModified(const QString& path);
+    void entryDeleted(const QString& path, bool isDir);
+    void entryMovedFrom(const QString& path, bool isDir, quint32 cookie);
+    void entryMovedTo(const QString& path, bool isDir, quint32 cookie);
+    void queueOverflow();
+
+private slots:
+    void onReadyRead();
+
+private:
+    void processEvent(const char* data, quint32 eventLen);
+    QString resolveDirectory(quint64 fsid, const QByteArray& handle);
+    // Снимает из кэша каталог и все каталоги под ним
+    void invalidateDirectory(const QString& dirPath);
+
+    int m_fd;
+    QSocketNotifier* m_notifier;
+    QStringList m_roots;
+    QSet<quint64> m_markedFilesystems;
+    QHash<quint64, int> m_mountFds;
+    // Ключ - fsid и дескриптор каталога: дескрипторы уникальны только
+    // в пределах одной файловой системы
+    QHash<QByteArray, QString> m_dirCache;
+    std::vector<char> m_buffer;
+};
+
+#endif //FANOTIFYWATCHER_H
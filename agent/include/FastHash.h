@@ -0,0 +1,38 @@
+#ifndef FASTHASH_H
+#define FASTHASH_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QByteArrayView>
+
+// Потоковый 64-битный некриптографический хэш (алгоритм XXH64).
+// Используется для отпечатков содержимого файлов и версий наборов политик.
+class FastHash
+{
+public:
+    explicit FastHash(quint64 seed = 0);
+
+    void reset(quint64 seed = 0);
+    void addData(const void* data, qint64 length);
+    quint64 result() const;
+
+    // Состояние незавершенного отпечатка для продолжения после перезапуска.
+    // Еще не свернутые байты (последние length % 32 байт данных) в него
+    // не входят, при восстановлении их передают в pending
+    QByteArray saveState() const;
+    bool restoreState(QByteArrayView state, QByteArrayView pending);
+
+    static quint64 hash(const void* data, qint64 length, quint64 seed = 0);
+
+private:
+    quint64 m_v1;
+    quint64 m_v2;
+    quint64 m_v3;
+    quint64 m_v4;
+    quint64 m_seed;
+    quint64 m_totalLength;
+    unsigned char m_buffer[32];
+    int m_bufferSize;
+};
+
+#endif //FASTHASH_H
@@ -0,0 +1,67 @@
+#ifndef FILECLASSIFIER_H
+#define FILECLASSIFIER_H
+
+#include <QByteArrayView>
+#include <QStringView>
+#include <QStringList>
+
+// Определение типа файла по уже прочитанному началу содержимого.
+// Порядок проверок: сигнатуры форматов, расширение, затем один проход
+// по первому блоку (NUL, управляющие символы, не-ASCII) с проверкой UTF-8
+// и энтропией байт только для содержимого, не прошедшего проверку UTF-8.
+// Файл повторно не открывается, выделений памяти нет.
+class FileClassifier
+{
+public:
+    enum class Kind {
+        Text,
+        Binary
+    };
+
+    // Просматривается не больше kSniffBytes байт начала файла
+    static constexpr qsizetype kSniffBytes = 4096;
+
+    static Kind classify(QStringView filePath, QByteArrayView head);
+    static bool isBinary(QStringView filePath, QByteArrayView head) {
+        return classify(filePath, head) == Kind::Binary;
+    }
+
+    // Расширение без точки; пусто, если его нет (в том числе у ".bashrc")
+    static QStringView suffixOf(QStringView filePath);
+
+    // Расширения короткие, поэтому перебор с ранним отсевом по длине
+    // дешевле построения строки в нижнем регистре для поиска в хэше
+    template <size_t N>
+    static bool containsExtension(const QLatin1String (&table)[N], QStringView suffix) {
+        for (const QLatin1String& extension : table) {
+            if (extension.size() == suffix.size() &&
+                suffix.compare(extension, Qt::CaseInsensitive) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool isTextExtension(QStringView suffix);
+    // Расширение есть в таблицах текстовых, бинарных форматов или классов
+    static bool isKnownExtension(QStringView suffix);
+
+    // Расширения класса файлов для областей действия политик: text, code,
+    // config, web, data, spreadsheet, document. false - неизвестный класс
+    static bool classExtensions(QStringView className, QStringList& extensions);
+
+private:
+    struct ByteStats {
+        qsizetype nulCount = 0;
+        qsizetype controlCount = 0;
+        qsizetype highCount = 0;
+    };
+
+    static bool matchMagic(QByteArrayView head, Kind& kind);
+    static bool isBinaryExtension(QStringView suffix);
+    static ByteStats scanBytes(QByteArrayView block);
+    static bool isValidUtf8(QByteArrayView block);
+    static double byteEntropy(QByteArrayView block);
+};
+
+#endif //FILECLASSIFIER_H
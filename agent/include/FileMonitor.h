@@ -4,9 +4,37 @@
 #include <QObject>
 #include <QFileSystemWatcher>
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QSet>
 #include <QRegularExpression>
+#include "DirectoryWalker.h"
+#include "EventCoalescer.h"
+#include "ExcludeMatcher.h"
+#include "ScanScheduler.h"
+
+// Сведения stat, по которым определяется изменение файла.
+// Сравнение только размера пропускает правки без изменения длины
+struct FileStat {
+    qint64 size = -1;
+    qint64 mtimeNs = 0;
+    qint64 ctimeNs = 0;
+    quint64 inode = 0;
+
+    bool operator==(const FileStat& other) const {
+        return mtimeNs == other.mtimeNs && size == other.size &&
+               ctimeNs == other.ctimeNs && inode == other.inode;
+    }
+    bool operator!=(const FileStat& other) const { return !(*this == other); }
+
+    static FileStat fromEntry(const WalkEntry& entry) {
+        return FileStat{entry.size, entry.mtimeNs, entry.ctimeNs, entry.inode};
+    }
+    static bool read(const QString& filePath, FileStat& stat);
+};
 
+class QSocketNotifier;
+class InotifyWatcher;
+class FanotifyWatcher;
 
 class FileMonitor : public QObject {
     Q_OBJECT
@@ -19,8 +47,15 @@ public:
     void stopMonitoring();
     bool isMonitoring() const { return m_monitoring; }
 
+    // Источник событий: "auto" (inotify), "fanotify", "inotify" или "qt"
+    void setBackend(const QString& backend);
     void setExcludePatterns(const QStringList& patterns);
     void setCheckInterval(int msec);
+    // Проверочные сканирования ненадежно наблюдаемых каталогов:
+    // интервал растет от minMsec до maxMsec, пока изменений нет
+    void setScanPolicy(int minMsec, int maxMsec, int budgetPercent);
+    // Объединение серий событий по пути: период тишины и предельная задержка
+    void setCoalescing(int quietMsec, int maxLatencyMsec);
     void setMaxFileSize(qint64 bytes);
 
     QStringList monitoredDirectories() const;
@@ -40,32 +75,93 @@ signals:
 private slots:
     void onDirectoryChanged(const QString& path);
     void onFileChanged(const QString& path);
-    void performFullScan();
+    void onMountsChanged();
+
+    // События inotify
+    void onEntryCreated(const QString& path, bool isDir);
+    void onFileWritten(const QString& path);
+    void onContentModified(const QString& path);
+    void onEntryDeleted(const QString& path, bool isDir);
+    void onEntryMovedFrom(const QString& path, bool isDir, quint32 cookie);
+    void onEntryMovedTo(const QString& path, bool isDir, quint32 cookie);
+    void onMoveTimeout();
+    void onQueueOverflow();
+
+    void onCoalescedChange(const QString& path, EventCoalescer::Change change);
+    void onDirectorySettled(const QString& path);
 
 private:
     bool addDirectory(const QString& directory, bool recursive = true);
     void removeDirectory(const QString& directory);
 
     void addSubdirectoriesToWatcher(const QString& directory);
+    // false - каталог уже наблюдается или наблюдение не установлено
+    bool watchSubdirectory(const QString& subdirPath);
+    // Наблюдение за подкаталогами и список файлов за один обход
+    QHash<QString, FileStat> watchSubtree(const QString& directory);
+    void selectBackend();
+    template <typename Source> void connectEventSource(Source* source);
+    bool isFanotifyCovered(const QString& path) const;
+    bool watchPath(const QString& directory);
+    void scanNewDirectory(const QString& directory);
+    void forgetDirectory(const QString& directory);
+    void registerDirectory(const QString& directory);
+    void unwatchDirectories(const QString& directory);
+    bool verifyDirectory(const QString& directory, bool recursive);
+    void verifySubtree(const QString& directory);
+
+    // Переименование внутри наблюдаемых каталогов без повторного чтения содержимого
+    void renameFile(const QString& oldPath, const QString& newPath);
+    void renameDirectory(const QString& oldPath, const QString& newPath);
+
+    // Точки монтирования и сетевые файловые системы
+    QHash<QString, QString> readMountTable() const;
+    bool needsPolling(const QString& directory) const;
+    bool isOnNetworkFilesystem(const QString& directory) const;
 
     bool shouldMonitorFile(const QString& filePath) const;
-    bool isExcluded(const QString& filePath) const;
+    // checkParents = false, если каталоги пути уже проверены при обходе
+    bool shouldMonitorFile(const QString& filePath, qint64 size, bool checkParents = true) const;
+    bool isExcluded(const QString& filePath, bool checkParents = true) const;
 
-    QStringList getDirectoryFiles(const QString& directory, bool recursive = true) const;
+    // subdirs - куда собрать найденные подкаталоги
+    QHash<QString, FileStat> getDirectoryFiles(const QStringList& roots, bool recursive = true,
+                                               QStringList* subdirs = nullptr) const;
+    void applyScanResult(const QHash<QString, FileStat>& currentFiles, const QString& scopeDir = QString(),
+                         bool scopeRecursive = false);
+    void rescanDirectory(const QString& directory);
 
     QFileSystemWatcher* m_watcher;
-    QTimer* m_scanTimer;
+    InotifyWatcher* m_inotify;
+    FanotifyWatcher* m_fanotify;
+    ScanScheduler* m_scanScheduler;
+    QSocketNotifier* m_mountNotifier;
+    int m_mountInfoFd;
+    QHash<QString, QString> m_mounts;
+    EventCoalescer* m_fileEvents;
+    EventCoalescer* m_dirEvents;
+    DirectoryWalker m_walker;
     QSet<QString> m_monitoredDirs;
-    QSet<QString> m_allMonitoredFiles;
-    QHash<QString, QSet<QString>> m_dirFiles;
-    QHash<QString, qint64> m_fileSizes;
+    QStringList m_rootDirs;
+    QHash<QString, FileStat> m_fileStats;
+
+    // IN_MOVED_FROM, ожидающие парного IN_MOVED_TO с тем же cookie
+    struct PendingMove {
+        QString path;
+        bool isDir;
+        qint64 expiresAt;
+    };
+    QHash<quint32, PendingMove> m_pendingMoves;
+    QTimer* m_moveTimer;
+    QElapsedTimer m_moveClock;
 
-    QStringList m_excludePatterns;
-    QList<QRegularExpression> m_excludeRegex;
+    ExcludeMatcher m_excludes;
 
     QString m_baseDirectory;
+    QString m_backendName;
     bool m_monitoring;
     bool m_recursive;
+    bool m_useInotify;
     qint64 m_maxFileSize;
     int m_checkInterval;
 };
@@ -0,0 +1,54 @@
+#ifndef FILEREADER_H
+#define FILEREADER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QStringEncoder>
+
+// Чтение содержимого файла без промежуточных копий.
+// Данные читаются pread в переиспользуемый выровненный буфер; большие файлы
+// читаются фрагментами (readChunk), поэтому буфер не растет с размером файла.
+// Возвращаемые данные действительны до следующего open() или release().
+class FileReader
+{
+public:
+    FileReader();
+    ~FileReader();
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    // Открывает обычный файл; размер известен сразу, до чтения содержимого
+    bool open(const QString& filePath);
+    qint64 fileSize() const { return m_fileSize; }
+    // Идентификатор файла открытого дескриптора: дописанный файл остается тем же
+    quint64 device() const { return m_device; }
+    quint64 inode() const { return m_inode; }
+    // Время изменения по тому же fstat, в наносекундах
+    qint64 mtimeNs() const { return m_mtimeNs; }
+    // Читает не более maxBytes от начала файла (0 - весь файл)
+    bool read(qint64 maxBytes, QByteArrayView& data);
+    // Потоковое чтение фрагмента в тот же буфер; пустой data - конец файла
+    bool readChunk(qint64 offset, qint64 length, QByteArrayView& data);
+    void release();
+
+    int lastErrorCode() const { return m_lastErrno; }
+    QString lastError() const;
+
+private:
+    bool ensureBuffer(qint64 bytes);
+
+    int m_fd;
+    qint64 m_fileSize;
+    quint64 m_device;
+    quint64 m_inode;
+    qint64 m_mtimeNs;
+    QStringEncoder m_pathEncoder;
+    QByteArray m_pathBuffer;
+    char* m_buffer;
+    qint64 m_bufferCapacity;
+    int m_lastErrno;
+};
+
+#endif //FILEREADER_H
@@ -0,0 +1,77 @@
+#ifndef FILESTATEINDEX_H
+#define FILESTATEINDEX_H
+
+#include <QString>
+
+// Итог последнего анализа файла
+enum class ScanVerdict : quint8 {
+    Unknown   = 0,
+    Clean     = 1,
+    Violation = 2
+};
+
+// Состояние файла на момент последнего анализа
+struct FileStateRecord {
+    quint64 device = 0;
+    quint64 inode = 0;
+    qint64 size = -1;
+    qint64 mtimeNs = 0;
+    quint64 contentHash = 0;
+    quint64 policyVersion = 0;
+    ScanVerdict verdict = ScanVerdict::Unknown;
+    QString path;
+
+    // Файл не менялся с прошлого анализа и проверялся тем же набором политик
+    bool isUpToDate(const FileStateRecord& current, quint64 currentPolicyVersion) const {
+        return size == current.size && mtimeNs == current.mtimeNs &&
+               policyVersion == currentPolicyVersion && path == current.path;
+    }
+};
+
+// Индекс состояний файлов на диске, отображенный в память (mmap).
+// Хэш-таблица с открытой адресацией по ключу (dev, inode) и область путей.
+// Открытие не читает файл целиком: страницы подгружаются по мере обращения.
+class FileStateIndex
+{
+public:
+    FileStateIndex();
+    ~FileStateIndex();
+
+    bool open(const QString& filePath);
+    void close();
+    bool isOpen() const { return m_base != nullptr; }
+
+    bool lookup(quint64 device, quint64 inode, FileStateRecord& record) const;
+    bool update(const FileStateRecord& record);
+    void remove(quint64 device, quint64 inode);
+
+    // Асинхронный сброс измененных страниц на диск
+    void sync();
+    int size() const;
+
+    // Заполняет device/inode/size/mtime по stat(2)
+    static bool statFile(const QString& path, FileStateRecord& record);
+
+private:
+    struct Header;
+    struct Slot;
+
+    bool mapFile(int fd, quint64 fileSize);
+    void unmap();
+    bool initializeFile(int fd, quint32 slotCount, quint64 arenaCapacity);
+    bool grow(quint32 slotCount, quint64 arenaCapacity);
+
+    Header* header() const;
+    Slot* slotTable() const;
+    char* arena() const;
+    qint64 findSlot(quint64 device, quint64 inode, bool forInsert) const;
+    // Путь записи лежит в занятой части области путей
+    bool hasValidPath(const Slot& slot) const;
+
+    QString m_filePath;
+    int m_fd;
+    char* m_base;
+    quint64 m_mappedSize;
+};
+
+#endif //FILESTATEINDEX_H
@@ -0,0 +1,61 @@
+#ifndef INOTIFYWATCHER_H
+#define INOTIFYWATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+class QSocketNotifier;
+struct inotify_event;
+
+// Источник событий файловой системы на основе inotify (только Linux).
+// Сообщает об изменениях по конкретным путям, без пересканирования каталогов.
+class InotifyWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InotifyWatcher(QObject* parent = nullptr);
+    ~InotifyWatcher();
+
+    static bool isSupported();
+    bool isValid() const { return m_fd >= 0; }
+
+    // Управление наблюдением за каталогами
+    bool addWatch(const QString& directory);
+    void removeWatch(const QString& directory);
+    void removeWatchesUnder(const QString& directory);
+    void removeAllWatches();
+    // Каталог перемещен: дескрипторы остаются, меняются только пути
+    void renameWatches(const QString& oldDirectory, const QString& newDirectory);
+
+    bool isWatched(const QString& directory) const { return m_pathToWd.contains(directory); }
+    int watchCount() const { return m_wdToPath.size(); }
+    QStringList directories() const { return m_pathToWd.keys(); }
+
+signals:
+    void entryCreated(const QString& path, bool isDir);
+    void fileWritten(const QString& path);
+    // Запись в файл, который еще открыт (журналы, растущие выгрузки)
+    void contentModified(const QString& path);
+    void entryDeleted(const QString& path, bool isDir);
+    void entryMovedFrom(const QString& path, bool isDir, quint32 cookie);
+    void entryMovedTo(const QString& path, bool isDir, quint32 cookie);
+    void queueOverflow();
+
+private slots:
+    void onReadyRead();
+
+private:
+    void processEvent(const inotify_event* event);
+
+    int m_fd;
+    QSocketNotifier* m_notifier;
+    QHash<int, QString> m_wdToPath;
+    QHash<QString, int> m_pathToWd;
+    std::vector<char> m_buffer;
+};
+
+#endif //INOTIFYWATCHER_H
@@ -0,0 +1,114 @@
+#ifndef NUMERICDETECTOR_H
+#define NUMERICDETECTOR_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include <QPair>
+
+// Встроенные детекторы числовых персональных данных: номера карт, ИНН,
+// СНИЛС, паспорта, телефоны. Числа с разделителями выделяются одним
+// проходом SSE2 по тексту, затем проверяются контрольными суммами
+// и таблицами префиксов. Быстрее регулярных выражений по \d{N} и не
+// срабатывает на произвольные числа подходящей длины.
+class NumericDetector
+{
+public:
+    enum class Kind {
+        Card,       // Луна + префиксы BIN платежных систем
+        Inn,        // ИНН юрлица (10 цифр) или физлица (12 цифр)
+        Snils,      // СНИЛС, 11 цифр
+        Passport,   // паспорт РФ: серия и номер, 10 цифр
+        Phone       // телефон РФ: +7 или 8 и 10 цифр
+    };
+
+    // Число в тексте: [start, end) в символах
+    struct Hit {
+        int policyId;
+        qsizetype start;
+        qsizetype end;
+    };
+
+    // Наибольшая длина числа с разделителями, которое проверяют детекторы;
+    // нужна для перекрытия окон потоковой проверки
+    static constexpr int kMaxLength = 32;
+
+    NumericDetector();
+
+    // "card", "inn", "snils", "passport", "phone"
+    static bool kindFromName(const QString& name, Kind& kind);
+
+    // parameters для Card - префиксы BIN через запятую, диапазоны через
+    // дефис ("4,51-55,2200-2204"); пусто - таблица платежных систем.
+    // Для остальных видов параметров нет
+    bool addPolicy(int policyId, Kind kind, const QString& parameters);
+    void clear() { m_policies.clear(); }
+    bool isEmpty() const { return m_policies.isEmpty(); }
+
+    // Числа, начинающиеся в первых commitLength символах текста,
+    // по политикам в порядке добавления, внутри политики - по позиции
+    void scan(QStringView text, qsizetype commitLength, QVector<Hit>& hits) const;
+
+private:
+    // Префикс BIN: диапазон [low, high] из digits первых цифр и допустимые длины номера
+    struct CardPrefix {
+        int digits;
+        quint32 low;
+        quint32 high;
+        int minLength;
+        int maxLength;
+    };
+
+    struct Policy {
+        int id;
+        Kind kind;
+        QVector<CardPrefix> prefixes;
+    };
+
+    // Цифр в одном числе: самый длинный номер карты
+    static constexpr int kMaxDigits = 19;
+    // Групп цифр между разделителями в одной последовательности
+    static constexpr int kMaxGroups = 16;
+
+    // Последовательность групп цифр, разделенных пробелами, дефисами,
+    // скобками или знаком №
+    struct Token {
+        qsizetype groupStart[kMaxGroups];
+        qsizetype groupEnd[kMaxGroups];
+        // Разделители после группы, биты Separator
+        quint8 gap[kMaxGroups];
+        int groupCount = 0;
+        bool plus = false;
+    };
+
+    // Кандидат для проверки: группы [first, last] последовательности
+    struct Number {
+        char digits[kMaxDigits];
+        int count = 0;
+        int groups[kMaxGroups];
+        int groupCount = 0;
+        quint8 separators = 0;
+        bool plus = false;
+    };
+
+    static qsizetype nextDigit(const char16_t* data, qsizetype from, qsizetype size);
+    static qsizetype readToken(const char16_t* data, qsizetype from, qsizetype size, Token& token);
+    static bool isolated(const char16_t* data, qsizetype size, qsizetype start, qsizetype end);
+    static bool makeNumber(const char16_t* data, const Token& token, int first, int last, Number& number);
+
+    void matchToken(const Policy& policy, const char16_t* data, const Token& token, qsizetype commitLength,
+                    QVector<Hit>& hits) const;
+    bool matches(const Policy& policy, const Number& number) const;
+    static bool isCard(const Number& number, const QVector<CardPrefix>& prefixes);
+    static bool isInn(const Number& number);
+    static bool isSnils(const Number& number);
+    bool isPassport(const Number& number) const;
+    static bool isPhone(const Number& number);
+    static bool parsePrefixes(const QString& parameters, QVector<CardPrefix>& prefixes);
+
+    QVector<Policy> m_policies;
+    // Последние две цифры года: серия паспорта содержит год выпуска бланка
+    int m_currentYear;
+};
+
+#endif //NUMERICDETECTOR_H
@@ -0,0 +1,56 @@
+#ifndef PATTERNPREFILTER_H
+#define PATTERNPREFILTER_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include <QPair>
+
+// Обязательный признак совпадения шаблона: символ, без которого совпадение
+// невозможно (@, +, №), или непрерывная последовательность цифр
+struct PatternTrigger {
+    QChar symbol;
+    int digitRun = 0;
+    // Наибольшая длина совпадения; -1 - шаблон проверяется по всему тексту
+    // при наличии признака, без окон
+    int maxLength = -1;
+
+    bool isValid() const { return !symbol.isNull() || digitRun > 0; }
+};
+
+// Предварительный отбор текста для политик.
+// Признаки всех шаблонов ищутся за один проход SSE2 по UTF-16; регулярное
+// выражение запускается только в окнах вокруг найденных признаков, а текст
+// без признаков отбрасывается без разбора.
+class PatternPrefilter
+{
+public:
+    // Позиции найденных признаков в тексте
+    struct Hits {
+        // По индексу символа в m_symbols
+        QVector<QVector<qsizetype>> symbols;
+        // Последовательности цифр не короче наименьшей из требуемых: [начало, конец)
+        QVector<QPair<qsizetype, qsizetype>> digitRuns;
+    };
+
+    // Разбор шаблона; maxLength заполняет вызывающий.
+    // Признак берется только из обязательной части шаблона верхнего уровня
+    static PatternTrigger analyze(QStringView pattern);
+
+    void clear();
+    void add(const PatternTrigger& trigger);
+    bool isEmpty() const { return m_symbols.isEmpty() && m_minDigitRun == 0; }
+
+    void scan(QStringView text, Hits& hits) const;
+
+    // Окна [начало, конец] для начала совпадения (не дальше commitLength);
+    // false - в тексте нет признака шаблона
+    bool candidates(const PatternTrigger& trigger, const Hits& hits, qsizetype commitLength,
+                    QVector<QPair<qsizetype, qsizetype>>& windows) const;
+
+private:
+    QVector<char16_t> m_symbols;
+    int m_minDigitRun = 0;
+};
+
+#endif //PATTERNPREFILTER_H
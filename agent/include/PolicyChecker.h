@@ -4,43 +4,10 @@
 #include <QObject>
 #include <QJsonObject>
 #include <QJsonArray>
-#include <QRegularExpression>
+#include <QMutex>
 #include <QStringList>
-
-// Структура для хранения DLP-политики
-struct DlpPolicy {
-    int id;
-    QString name;
-    QString pattern;
-    QString severity;
-
-    bool isValid() const {
-        return !name.isEmpty() && !pattern.isEmpty() && !severity.isEmpty();
-    }
-};
-
-// Структура для результата проверки
-struct PolicyMatch {
-    QString policyName;
-    QString policyPattern;
-    QString severity;
-    QString matchedContent;
-    int startPosition;
-    int endPosition;
-
-    bool operator==(const PolicyMatch& other) const {
-        return policyName == other.policyName &&
-               policyPattern == other.policyPattern &&
-               severity == other.severity &&
-               matchedContent == other.matchedContent &&
-               startPosition == other.startPosition &&
-               endPosition == other.endPosition;
-    }
-
-    bool operator!=(const PolicyMatch& other) const {
-        return !(*this == other);
-    }
-};
+#include <QList>
+#include "CompiledPolicySet.h"
 
 class PolicyChecker : public QObject
 {
@@ -48,25 +15,40 @@ class PolicyChecker : public QObject
 
 public:
     explicit PolicyChecker(QObject* parent = nullptr);
-    ~PolicyChecker() = default;
+    ~PolicyChecker();
 
     // Основные методы
     bool loadPolicies(const QJsonArray& policies);
+    // Компиляция в отдельном потоке; по готовности набор публикуется
+    // и отправляется policiesLoaded. Проверки до этого идут по старому набору.
+    // Вызывающий не ждет завершения предыдущих загрузок
+    void loadPoliciesAsync(const QJsonArray& policies);
     QList<PolicyMatch> checkContent(const QString& content, const QString& filePath = "");
 
+    // Текущий набор политик. Проверка файла держит полученный указатель
+    // до конца и не видит наборов, опубликованных за это время
+    PolicySet policySet() const;
+
+    // Итог проверки файла: журнал и сигнал contentChecked
+    void reportMatches(const QString& filePath, const QList<PolicyMatch>& matches);
+    // Наибольшая возможная длина совпадения среди политик, -1 - не ограничена
+    int maxMatchLength() const { return policySet()->maxMatchLength(); }
+
     // Управление политиками
     void addPolicy(const DlpPolicy& policy);
     void removePolicy(int policyId);
     void clearPolicies();
 
     // Вспомогательные методы
-    int policyCount() const { return m_policies.size(); }
-    QList<DlpPolicy> allPolicies() const { return m_policies.values(); }
+    int policyCount() const { return policySet()->policyCount(); }
+    QList<DlpPolicy> allPolicies() const { return policySet()->policies().values(); }
+    // Отпечаток набора политик и настроек; меняется при любом изменении правил
+    quint64 policySetVersion() const { return policySet()->version(); }
 
     // Настройки
     void setCaseSensitive(bool sensitive);
     void setMaxContentSize(int bytes);
-    QString lastError() const { return m_lastError; }
+    QString lastError() const;
 
 signals:
     void policiesLoaded(int count);
@@ -76,16 +58,27 @@ signals:
 
 private:
     // Вспомогательные методы
-    bool compilePattern(const QString& pattern, QRegularExpression& regex) const;
     QString extractSample(const QString& content, int maxLength = 1000) const;
     DlpPolicy parsePolicy(const QJsonObject& json) const;
+    bool loadPolicies(const QJsonArray& policies, quint64 generation);
+    // Сборка набора из m_policies и текущих настроек и публикация; под m_updateLock
+    PolicySet rebuild();
+    void publish(const PolicySet& policies);
 
+    // Исходные политики и настройки, из которых собран текущий набор
     QHash<int, DlpPolicy> m_policies;
-    QHash<int, QRegularExpression> m_compiledPatterns;
-
     bool m_caseSensitive;
     int m_maxContentSize;
     QString m_lastError;
+    // Опубликованный набор: читается и подменяется атомарно (std::atomic_load/store),
+    // проверки не берут блокировок
+    PolicySet m_current;
+    // Номер последней загрузки: результат устаревшей фоновой компиляции отбрасывается
+    quint64 m_loadGeneration;
+    // Потоки фоновой компиляции; вызывается и обслуживается из потока объекта
+    QList<QThread*> m_loadThreads;
+    // Изменения набора выполняются по одному
+    mutable QMutex m_updateLock;
 };
 
 #endif //POLICYCHECKER_H
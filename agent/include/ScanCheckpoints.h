@@ -0,0 +1,92 @@
+#ifndef SCANCHECKPOINTS_H
+#define SCANCHECKPOINTS_H
+
+#include <QCache>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include "FastHash.h"
+#include "PolicyChecker.h"
+
+// Фрагмент содержимого (границы FastCDC) и совпадения, начинающиеся в нем.
+// Совпадение может выходить за конец фрагмента на длину перекрытия
+struct ContentChunk {
+    qint64 byteStart = 0;
+    qint64 byteLength = 0;
+    quint64 hash = 0;
+    qint64 charStart = 0;
+    qint64 charLength = 0;
+    // Позиции - в символах от начала фрагмента. У точек, загруженных
+    // из журнала, matchedContent пустой: текст берется из файла
+    QList<PolicyMatch> matches;
+};
+
+// Результат потокового анализа файла по фрагментам.
+// При изменении файла фрагменты с прежним хэшем не проверяются заново,
+// их совпадения переносятся. Если файл только дописан (тот же inode,
+// размер вырос, хвост проверенной части не изменился), префикс даже
+// не читается: разбор продолжается с начала последнего фрагмента.
+// Изменения в середине дописанного файла по хвосту не обнаруживаются -
+// это цена отказа от повторного чтения всего префикса.
+struct ScanCheckpoint {
+    quint64 device = 0;
+    quint64 inode = 0;
+    quint64 policyVersion = 0;
+
+    // Проверенная часть файла
+    qint64 scannedBytes = 0;
+    // Хэш последних tailLength байт проверенной части
+    quint64 tailHash = 0;
+    qint64 tailLength = 0;
+
+    // Состояние отпечатка всего файла: дописанные байты добавляются к нему
+    FastHash hasher;
+    // Состояние из журнала (FastHash::saveState): hasher восстанавливается
+    // при продолжении, когда прочитан хвост проверенной части
+    QByteArray hasherState;
+    QVector<ContentChunk> chunks;
+    // В журнал не пишется, как и найденный текст
+    QString contentSample;
+};
+
+// Точки продолжения по путям файлов, последние по использованию.
+// Общие для потоков анализа; один путь одновременно разбирает один поток.
+// На диске - журнал, из которого точки восстанавливаются при запуске:
+// после перезапуска агента дописанный файл тоже не читается заново.
+// Запись дописанного файла содержит только изменившиеся фрагменты
+class ScanCheckpoints
+{
+public:
+    explicit ScanCheckpoints(int capacity = 1024);
+    ~ScanCheckpoints();
+
+    // Загружает журнал и открывает его на дозапись
+    bool open(const QString& filePath);
+    // Закрывает журнал и освобождает память; журнал остается на диске
+    void close();
+
+    bool lookup(const QString& filePath, ScanCheckpoint& checkpoint) const;
+    void store(const QString& filePath, const ScanCheckpoint& checkpoint);
+    void remove(const QString& filePath);
+    void rename(const QString& oldPath, const QString& newPath);
+    void clear();
+
+private:
+    static qsizetype costOf(const ScanCheckpoint& checkpoint);
+
+    // keep - сколько первых фрагментов совпадает с прошлой записью пути
+    bool appendRecord(const QString& filePath, const ScanCheckpoint* checkpoint, int keep);
+    void applyRecord(const QByteArray& line);
+    void compact();
+
+    mutable QCache<QString, ScanCheckpoint> m_checkpoints;
+    mutable QMutex m_lock;
+    int m_capacity;
+
+    QString m_filePath;
+    QFile m_file;
+    qint64 m_fileRecords;
+};
+
+#endif //SCANCHECKPOINTS_H
@@ -0,0 +1,75 @@
+#ifndef SCANSCHEDULER_H
+#define SCANSCHEDULER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QElapsedTimer>
+#include <functional>
+
+class QTimer;
+
+// Планировщик проверочных сканирований.
+// Сканируются только каталоги с ненадежным наблюдением: опрашиваемые
+// (QFileSystemWatcher, сетевые ФС) - периодически с экспоненциальным
+// увеличением интервала, пока изменений нет; после переполнения очереди
+// событий или смены точек монтирования - однократно.
+// Работа делится на кванты так, чтобы доля времени сканирования
+// не превышала заданного бюджета.
+class ScanScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Сканирует каталог и возвращает true, если найдены изменения
+    using ScanFunction = std::function<bool(const QString& directory, bool recursive)>;
+
+    explicit ScanScheduler(QObject* parent = nullptr);
+
+    void setScanFunction(const ScanFunction& function) { m_scanFunction = function; }
+    void setIntervals(int minMsec, int maxMsec);
+    // Допустимая доля времени на сканирование, в процентах
+    void setBudget(int percent);
+
+    // Периодический опрос каталога
+    void addPolled(const QString& directory);
+    // Однократная проверка в ближайшем кванте
+    void requestScan(const QString& directory, bool recursive);
+
+    void remove(const QString& directory);
+    void removeUnder(const QString& directory);
+    void clear();
+
+    int polledCount() const { return m_polledCount; }
+    int pendingCount() const { return m_entries.size(); }
+
+private slots:
+    void onTimeout();
+
+private:
+    struct Entry {
+        bool polled = false;
+        bool once = false;
+        bool recursive = false;
+        qint64 interval = 0;
+        qint64 due = -1;
+    };
+
+    void reschedule(const QString& directory, Entry& entry, qint64 due);
+    void removeEntry(QHash<QString, Entry>::iterator it);
+    void arm();
+
+    ScanFunction m_scanFunction;
+    QHash<QString, Entry> m_entries;
+    QMultiMap<qint64, QString> m_queue;
+    QElapsedTimer m_clock;
+    QTimer* m_timer;
+    qint64 m_minInterval;
+    qint64 m_maxInterval;
+    qint64 m_resumeAt;
+    int m_budgetPercent;
+    int m_polledCount;
+};
+
+#endif //SCANSCHEDULER_H
@@ -0,0 +1,92 @@
+#ifndef VERDICTCACHE_H
+#define VERDICTCACHE_H
+
+#include <QCache>
+#include <QFile>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include "PolicyChecker.h"
+
+// Кэш вердиктов по содержимому. Одинаковые по байтам файлы (копии вложений,
+// результаты сборки) проверяются политиками один раз.
+// Ключ - отпечаток проверенных байт, их длина и версия набора политик;
+// значение - найденные совпадения: политика, позиции и важность, без
+// найденного текста (его восстанавливает вызывающий). В памяти хранятся последние записи (LRU),
+// на диске - журнал, из которого кэш восстанавливается при запуске.
+// Общий для всех потоков анализа.
+class VerdictCache
+{
+public:
+    struct Key {
+        quint64 contentHash = 0;
+        qint64 length = 0;
+        quint64 policyVersion = 0;
+
+        bool operator==(const Key& other) const {
+            return contentHash == other.contentHash && length == other.length &&
+                   policyVersion == other.policyVersion;
+        }
+    };
+
+    struct Stats {
+        int entries = 0;
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 inserts = 0;
+        qint64 bytesSaved = 0;
+    };
+
+    explicit VerdictCache(int capacity = 16384);
+    ~VerdictCache();
+
+    // Загружает журнал и открывает его на дозапись
+    bool open(const QString& filePath);
+    void close();
+
+    void setCapacity(int entries);
+    bool isEnabled() const { return m_capacity > 0; }
+
+    // matchedContent у найденных совпадений пустой
+    bool lookup(const Key& key, QList<PolicyMatch>& matches, qint64 bytesSaved);
+    void insert(const Key& key, const QList<PolicyMatch>& matches);
+
+    Stats stats() const;
+    void logStats(const QString& reason) const;
+
+    // Запись совпадения в журнал без найденного текста; общая с ScanCheckpoints
+    static QJsonObject matchToJson(const PolicyMatch& match);
+    static PolicyMatch matchFromJson(const QJsonObject& json);
+
+private:
+    struct Entry {
+        QList<PolicyMatch> matches;
+    };
+
+    void insertLocked(const Key& key, const QList<PolicyMatch>& matches);
+    bool appendRecord(const Key& key, const QList<PolicyMatch>& matches);
+    void compact();
+
+    QCache<Key, Entry> m_cache;
+    mutable QMutex m_lock;
+    int m_capacity;
+
+    QString m_filePath;
+    QFile m_file;
+    qint64 m_fileRecords;
+
+    std::atomic<quint64> m_hits;
+    std::atomic<quint64> m_misses;
+    std::atomic<quint64> m_inserts;
+    std::atomic<qint64> m_bytesSaved;
+};
+
+inline size_t qHash(const VerdictCache::Key& key, size_t seed = 0) {
+    // Отпечаток уже равномерно распределен
+    return static_cast<size_t>(key.contentHash ^ (key.policyVersion * 0x9E3779B97F4A7C15ULL) ^
+                               static_cast<quint64>(key.length)) ^ seed;
+}
+
+#endif //VERDICTCACHE_H
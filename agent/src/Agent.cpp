@@ -5,16 +5,51 @@
 #include <QDir>
 #include <QJsonDocument>
 #include <QNetworkInterface>
+#include <QThread>
+#include <limits>
+#include <utility>
+
+namespace {
+// Файлов в пачке от обхода начального анализа к циклу событий
+constexpr int kBaselineBatchSize = 512;
+}
 
 Agent::Agent(QObject* parent)
     : QObject(parent)
     , m_heartbeatTimer(new QTimer(this))
     , m_config(ConfigManager::instance())
+    , m_analysisQueue(m_config.get("analysis/queue_capacity").toInt())
+    , m_verdictCache(m_config.get("analysis/verdict_cache_size").toInt())
+    , m_scanCheckpoints(m_config.get("analysis/append_checkpoints").toInt())
+    , m_workerPool(&m_checker)
+    , m_maxFileSize(0)
+    , m_baselineTotal(0)
+    , m_baselinePending(0)
+    , m_baselineReading(0)
+    , m_prefetchLimit(0)
+    , m_baselineSkipped(0)
+    , m_baselineWalk(nullptr)
+    , m_baselineGeneration(0)
+    , m_baselineWalking(false)
     , m_running(false)
-{ LOG_DEBUG("Агент инициализирован"); }
+{
+    // Анализ вынесен из обработчиков событий: поток файлов не блокирует цикл событий
+    m_analysisQueue.setHandler([this](const AnalysisJob& job) {
+        if (QFileInfo::exists(job.path)) {
+            m_workerPool.submit(job);
+        }
+    });
+    // Пока пул занят, задания остаются в очереди и продолжают сливаться
+    m_analysisQueue.setThrottle([this]() {
+        return !m_workerPool.isSaturated();
+    });
+    LOG_DEBUG("Агент инициализирован");
+}
 
 Agent::~Agent() {
     stop();
+    // Поток обхода обращается к агенту
+    cancelBaselineWalk();
     LOG_DEBUG("Агент уничтожен");
 }
 
@@ -30,6 +65,7 @@ bool Agent::start() {
     }
 
     connect(&m_network, &NetworkManager::policiesReceived, this, &Agent::onPoliciesReceived);
+    connect(&m_checker, &PolicyChecker::policiesLoaded, this, &Agent::onPoliciesLoaded, Qt::QueuedConnection);
     connect(&m_network, &NetworkManager::heartbeatSent, this, &Agent::onHeartbeatSent);
     connect(&m_network, &NetworkManager::eventSent, this, &Agent::onEventSent);
     connect(&m_network, &NetworkManager::errorOccurred, this, &Agent::onNetworkError);
@@ -37,14 +73,66 @@ bool Agent::start() {
     connect(&m_monitor, &FileMonitor::fileCreated, this, &Agent::onFileCreated);
     connect(&m_monitor, &FileMonitor::fileModified, this, &Agent::onFileModified);
     connect(&m_monitor, &FileMonitor::fileDeleted, this, &Agent::onFileDeleted);
-    connect(&m_analyzer, &ContentAnalyzer::fileAnalyzed, this, &Agent::onFileAnalyzed);
-
+    connect(&m_monitor, &FileMonitor::fileRenamed, this, &Agent::onFileRenamed);
+    connect(&m_workerPool, &AnalysisWorkerPool::jobFinished, this, &Agent::onAnalysisFinished);
+    connect(&m_workerPool, &AnalysisWorkerPool::capacityAvailable, this, &Agent::onAnalysisCapacity);
+    connect(&m_batchReader, &BatchReader::fileRead, this, &Agent::onBaselineRead, Qt::QueuedConnection);
+    connect(&m_config, &ConfigManager::configChanged, this, &Agent::onConfigChanged);
+
+    m_monitor.setBackend(m_config.monitorBackend());
+    applyFilterSettings();
+    m_monitor.setScanPolicy(m_config.get("agent/scan_interval").toInt() * 1000,
+                            m_config.get("monitoring/scan_max_interval").toInt() * 1000,
+                            m_config.get("monitoring/scan_budget_percent").toInt());
+    m_monitor.setCoalescing(m_config.get("monitoring/quiet_period_ms").toInt(),
+                            m_config.get("monitoring/max_latency_ms").toInt());
+
+    const qint64 maxFileSize = m_config.get("agent/max_file_size").toLongLong();
+    const int sampleSize = 50000;
+    const bool streaming = m_config.get("analysis/streaming").toBool();
+    const qint64 chunkSize = m_config.get("analysis/chunk_size").toLongLong();
+    const int maxOverlap = m_config.get("analysis/max_overlap").toInt();
+    const qint64 cachePrepassLimit = m_config.get("analysis/verdict_cache_stream_limit").toLongLong();
+    VerdictCache* verdictCache = &m_verdictCache;
+    ScanCheckpoints* checkpoints = m_config.get("analysis/append_checkpoints").toInt() > 0
+        ? &m_scanCheckpoints : nullptr;
+    m_workerPool.configure([=](ContentAnalyzer& analyzer) {
+        analyzer.setMaxFileSize(maxFileSize);
+        analyzer.setSampleSize(sampleSize);
+        analyzer.setStreaming(streaming);
+        analyzer.setChunkSize(chunkSize);
+        analyzer.setMaxOverlap(maxOverlap);
+        analyzer.setCachePrepassLimit(cachePrepassLimit);
+        analyzer.setVerdictCache(verdictCache);
+        analyzer.setScanCheckpoints(checkpoints);
+    });
+    m_workerPool.start(m_config.get("analysis/worker_threads").toInt());
+
+    // Файлы не больше выборки начальный анализ читает пакетно; без потокового
+    // режима анализатор не читает файлы больше agent/max_file_size
+    m_prefetchLimit = 0;
+    const int readDepth = m_config.get("analysis/read_depth").toInt();
+    if (readDepth > 0 && m_batchReader.start(readDepth, sampleSize, m_config.get("analysis/io_uring").toBool())) {
+        m_prefetchLimit = qMin<qint64>(sampleSize, maxFileSize);
+    }
+    m_baselineQueue.setPathWeights(m_config.get("analysis/priority_paths").toStringList());
+    m_baselineQueue.setAgingRate(m_config.get("analysis/priority_aging").toDouble());
 
-    m_monitor.setExcludePatterns(m_config.get("monitoring/exclude_patterns").toStringList());
-    m_monitor.setMaxFileSize(m_config.get("agent/max_file_size").toLongLong());
+    QString stateDir = m_config.get("agent/state_dir").toString();
+    if (!m_stateIndex.open(stateDir + "/file_state.idx")) {
+        LOG_WARNING("Индекс состояний недоступен, начальный анализ будет полным");
+    }
 
-    m_analyzer.setMaxFileSize(m_config.get("agent/max_file_size").toLongLong());
-    m_analyzer.setSampleSize(50000);
+    m_analysisQueue.setOverflowPolicy(
+        AnalysisQueue::policyFromString(m_config.get("analysis/overflow_policy").toString()));
+    m_analysisQueue.setTimeBudget(m_config.get("analysis/time_budget_ms").toInt());
+    m_analysisQueue.setSpillFile(stateDir + "/analysis_spill.jsonl");
+    if (m_verdictCache.isEnabled()) {
+        m_verdictCache.open(stateDir + "/verdict_cache.jsonl");
+    }
+    if (m_config.get("analysis/append_checkpoints").toInt() > 0) {
+        m_scanCheckpoints.open(stateDir + "/scan_checkpoints.jsonl");
+    }
 
     registerAgent();
     loadPolicies();
@@ -82,6 +170,19 @@ void Agent::stop() {
 
     m_heartbeatTimer->stop();
     m_monitor.stopMonitoring();
+    m_analysisQueue.logMetrics("остановка");
+    m_analysisQueue.clear();
+    m_batchReader.stop();
+    m_workerPool.stop();
+    m_verdictCache.logStats("остановка");
+    m_verdictCache.close();
+    m_scanCheckpoints.close();
+    cancelBaselineWalk();
+    m_baselineQueue.clear();
+    m_baselineTotal = 0;
+    m_baselinePending = 0;
+    m_baselineReading = 0;
+    m_stateIndex.close();
     m_running = false;
 
     QString agentId = m_config.agentId();
@@ -136,6 +237,17 @@ void Agent::loadPolicies() {
 void Agent::sendHeartbeat() {
     QString agentId = m_config.agentId();
     LOG_DEBUG(QString("Отправка heartbeat: %1").arg(agentId));
+
+    // Глубина очереди анализа показывает, успевает ли агент за событиями
+    if (m_analysisQueue.metrics().depth > 0) {
+        m_analysisQueue.logMetrics("heartbeat");
+    }
+    if (m_verdictCache.isEnabled()) {
+        m_verdictCache.logStats("heartbeat");
+    }
+    if (m_workerPool.isRunning()) {
+        m_workerPool.logStats("heartbeat");
+    }
     m_network.sendHeartbeat(agentId);
 }
 
@@ -160,7 +272,7 @@ void Agent::sendEvent(const QString& filePath, const QString& content, const QSt
         }
     } else {
         event["is_violation"] = isViolation;
-        if (eventType == "modified" && m_violationFiles.contains(filePath)) {
+        if ((eventType == "modified" || eventType == "renamed") && m_violationFiles.contains(filePath)) {
             event["is_violation"] = true;
             event["severity"] = "high";
         }
@@ -187,18 +299,19 @@ void Agent::sendEvent(const QString& filePath, const QString& content, const QSt
 
 void Agent::onFileCreated(const QString& filePath, qint64 size) {
     LOG_INFO(QString("Файл создан: %1 (%2 байт)").arg(filePath).arg(size));
-    analyzeAndSendEvent(filePath, size, "created");
+    enqueueAnalysis(filePath, size, "created");
 }
 
 void Agent::onFileModified(const QString& filePath, qint64 size) {
     LOG_INFO(QString("Файл изменен: %1 (%2 байт)").arg(filePath).arg(size));
-    analyzeAndSendEvent(filePath, size, "modified");
+    enqueueAnalysis(filePath, size, "modified");
 }
 
 void Agent::onFileDeleted(const QString& filePath) {
     LOG_INFO(QString("Файл удален: %1").arg(filePath));
 
-    m_fileEventTypes.remove(filePath);
+    m_analysisQueue.remove(filePath);
+    m_scanCheckpoints.remove(filePath);
 
     QString content = "";
     bool hadViolation = m_violationFiles.contains(filePath);
@@ -207,31 +320,106 @@ void Agent::onFileDeleted(const QString& filePath) {
     m_violationFiles.remove(filePath);
 }
 
-void Agent::onFileAnalyzed(const QString& filePath, bool hasViolations,
-                          const QList<PolicyMatch>& matches, qint64 size) {
-    QString content = m_analyzer.readFileContent(filePath);
+void Agent::onFileRenamed(const QString& oldPath, const QString& newPath) {
+    LOG_INFO(QString("Файл переименован: %1 -> %2").arg(oldPath, newPath));
+
+    // Содержимое не менялось: вердикт переносится без повторного анализа
+    const bool hadViolation = m_violationFiles.remove(oldPath);
+    if (hadViolation) {
+        m_violationFiles.insert(newPath);
+    } else {
+        m_violationFiles.remove(newPath);
+    }
+
+    m_scanCheckpoints.rename(oldPath, newPath);
+
+    // Еще не разобранное задание анализируется уже по новому пути
+    AnalysisJob pending;
+    if (m_analysisQueue.remove(oldPath, &pending)) {
+        pending.path = newPath;
+        m_analysisQueue.enqueue(pending);
+    }
+
+    FileStateRecord current;
+    FileStateRecord stored;
+    if (m_stateIndex.isOpen() && FileStateIndex::statFile(newPath, current) &&
+        m_stateIndex.lookup(current.device, current.inode, stored) && stored.path == oldPath) {
+        stored.path = newPath;
+        m_stateIndex.update(stored);
+    }
 
-    if (content.isEmpty()) {
-        LOG_WARNING(QString("Не удалось прочитать файл для отправки: %1").arg(filePath));
-        m_fileEventTypes.remove(filePath);
+    sendEvent(newPath, QString("%1 -> %2").arg(oldPath, newPath), "renamed", hadViolation, QList<PolicyMatch>());
+}
+
+void Agent::onAnalysisFinished(const AnalysisJob& job, const AnalysisResult& result) {
+    const bool baseline = job.eventType == "baseline";
+    if (baseline) {
+        m_baselinePending = qMax(0, m_baselinePending - 1);
+    }
+
+    if (!result.ok) {
+        // Файл успели удалить - о нем сообщит onFileDeleted
+        if (!baseline && QFileInfo::exists(job.path)) {
+            LOG_WARNING(QString("Не удалось проанализировать файл: %1 (%2)").arg(job.path, result.error));
+            sendEvent(job.path, QString(), job.eventType, false, QList<PolicyMatch>());
+        }
+        feedBaseline();
         return;
     }
 
-    QString eventType = m_fileEventTypes.value(filePath, "created");
+    if (result.hasViolations) {
+        if (baseline) {
+            LOG_INFO(QString("Файл содержит чувствительную информацию: %1").arg(job.path));
+        }
+        m_violationFiles.insert(job.path);
+    } else if (job.eventType == "modified") {
+        m_violationFiles.remove(job.path);
+    }
+
+    // Запоминается состояние, которое проверено (fstat при открытии): stat
+    // после анализа записал бы как проверенную правку, сделанную во время него
+    if (result.device != 0 || result.inode != 0) {
+        FileStateRecord record;
+        record.device = result.device;
+        record.inode = result.inode;
+        record.size = result.size;
+        record.mtimeNs = result.mtimeNs;
+        record.path = job.path;
+        recordFileState(record, result);
+    }
 
-    if (hasViolations) {
-        m_violationFiles.insert(filePath);
-    } else if (eventType == "modified") {
-        m_violationFiles.remove(filePath);
+    // Начальный анализ событий не отправляет, только запоминает нарушения
+    if (!baseline) {
+        sendEvent(job.path, result.contentSample, job.eventType, result.hasViolations, result.matches);
     }
 
-    sendEvent(filePath, content, eventType, hasViolations, matches);
-    m_fileEventTypes.remove(filePath);
+    feedBaseline();
+}
+
+void Agent::onAnalysisCapacity() {
+    m_analysisQueue.wake();
+    feedBaseline();
+}
+
+void Agent::onBaselineRead(const AnalysisJob& job) {
+    m_baselineReading = qMax(0, m_baselineReading - 1);
+    // Чтение, завершившееся после остановки агента
+    if (!m_workerPool.isRunning()) {
+        return;
+    }
+
+    m_workerPool.submit(job);
+    feedBaseline();
 }
 
 void Agent::onPoliciesReceived(const QJsonArray& policies) {
-    if (m_checker.loadPolicies(policies)) {
-        LOG_INFO(QString("Политики DLP загружены: %1 шт").arg(policies.size()));
+    // Компиляция в фоне; до ее завершения файлы проверяются прежними политиками
+    m_checker.loadPoliciesAsync(policies);
+}
+
+void Agent::onPoliciesLoaded(int count) {
+    if (count > 0) {
+        LOG_INFO(QString("Политики DLP загружены: %1 шт").arg(count));
 
         // !!!
         QStringList dirs = m_config.get("monitoring/directories").toStringList();
@@ -244,6 +432,16 @@ void Agent::onPoliciesReceived(const QJsonArray& policies) {
     }
 }
 
+void Agent::onConfigChanged(const QString& key, const QVariant& value) {
+    Q_UNUSED(value);
+
+    // Шаблоны компилируются один раз на каждую версию настроек
+    if (key == "monitoring/exclude_patterns" || key == "agent/max_file_size" ||
+        key == "analysis/streaming") {
+        applyFilterSettings();
+    }
+}
+
 void Agent::onHeartbeatSent(bool success) {
     if (success) {
         LOG_DEBUG("Heartbeat подтвержден сервером");
@@ -264,86 +462,236 @@ void Agent::onNetworkError(const QString& error) {
 }
 
 
-void Agent::analyzeAndSendEvent(const QString &filePath, qint64 size, const QString &eventType) {
-    m_fileEventTypes[filePath] = eventType;
-
-    if (!m_analyzer.analyzeFile(filePath, &m_checker)) {
-        LOG_WARNING(QString("Не удалось проанализировать файл: %1").arg(filePath));
-
-        QString content = m_analyzer.readFileContent(filePath);
-        sendEvent(filePath, content, eventType, false, QList<PolicyMatch>());
-        m_fileEventTypes.remove(filePath);
-    }
+void Agent::enqueueAnalysis(const QString& filePath, qint64 size, const QString& eventType) {
+    AnalysisJob job;
+    job.path = filePath;
+    job.size = size;
+    job.eventType = eventType;
+    job.priority = m_violationFiles.contains(filePath);
+    m_analysisQueue.enqueue(job);
 }
 
 
 // !!!
 void Agent::analyzeExistingFiles(const QStringList& dirs) {
+    QStringList roots;
     for (const QString& dir : dirs) {
-        QDir directory(dir);
-        if (!directory.exists()) {
-            continue;
+        if (QDir(dir).exists()) {
+            roots.append(dir);
         }
+    }
 
-        // Рекурсивный поиск файлов
-        QStringList files = getFilesRecursive(directory);
+    // Обход прошлого начального анализа прерывается, его пачки отбрасываются по номеру
+    cancelBaselineWalk();
+    const quint64 generation = m_baselineGeneration;
+    // Задания прошлого начального анализа, еще не отданные пулу, заменяются
+    m_baselineQueue.clear();
+    m_baselineTotal = 0;
+    m_baselineSkipped = 0;
+    m_baselineWalking = true;
+
+    // Фильтры обхода - снимок текущих: настройки могут смениться во время обхода
+    const ExcludeMatcher excludes = m_excludes;
+    const qint64 maxFileSize = m_maxFileSize;
+    m_walker.setDirectoryFilter([excludes](const QString& dirPath) {
+        return !excludes.matchesDirectoryName(QStringView(dirPath).mid(dirPath.lastIndexOf('/') + 1));
+    });
+
+    const auto cancel = std::make_shared<std::atomic<bool>>(false);
+    m_baselineCancel = cancel;
+
+    // Параллельный обход с фильтрацией по stat в своем потоке; файлы уходят
+    // в цикл событий пачками по мере обнаружения, анализ - в пуле потоков
+    QThread* thread = QThread::create([this, roots, generation, cancel, excludes, maxFileSize]() {
+        const auto post = [this, generation](QVector<WalkEntry>& bucket) {
+            QMetaObject::invokeMethod(this, [this, generation, entries = std::exchange(bucket, QVector<WalkEntry>())]() {
+                addBaselineEntries(generation, entries);
+            }, Qt::QueuedConnection);
+        };
+
+        QVector<QVector<WalkEntry>> buckets(m_walker.threadCount());
+        m_walker.walk(roots, [&](const WalkEntry& entry, int worker) {
+            if (entry.isDir || entry.size > maxFileSize ||
+                excludes.matchesFileName(QStringView(entry.path).mid(entry.path.lastIndexOf('/') + 1))) {
+                return;
+            }
+            QVector<WalkEntry>& bucket = buckets[worker];
+            bucket.append(entry);
+            if (bucket.size() >= kBaselineBatchSize) {
+                post(bucket);
+            }
+        }, true, cancel.get());
 
-        for (const QString& filePath : files) {
-            if (!shouldMonitorFile(filePath)) {
-                continue;
+        for (QVector<WalkEntry>& bucket : buckets) {
+            if (!bucket.isEmpty()) {
+                post(bucket);
             }
-            LOG_DEBUG(QString("Анализ существующего файла: %1").arg(filePath));
+        }
+        QMetaObject::invokeMethod(this, [this, generation]() {
+            finishBaselineWalk(generation);
+        }, Qt::QueuedConnection);
+    });
+    thread->setObjectName("baseline-walk");
+    connect(thread, &QThread::finished, this, [this, thread]() {
+        if (m_baselineWalk == thread) {
+            m_baselineWalk = nullptr;
+        }
+        thread->deleteLater();
+    });
+    m_baselineWalk = thread;
+    thread->start(QThread::LowPriority);
+}
 
-            QString content = m_analyzer.readFileContent(filePath);
-            if (!content.isEmpty()) {
-                QList<PolicyMatch> matches = m_checker.checkContent(content, filePath);
-                bool hasViolations = !matches.isEmpty();
 
-                if (hasViolations) {
-                    LOG_INFO(QString("Файл содержит чувствительную информацию: %1").arg(filePath));
-                    m_violationFiles.insert(filePath);
-                }
+void Agent::addBaselineEntries(quint64 generation, const QVector<WalkEntry>& entries) {
+    if (generation != m_baselineGeneration) {
+        return;
+    }
+
+    // Версия зависит от области файла: маршрута по расширению и ограничений политик
+    const PolicySet policies = m_checker.policySet();
+
+    for (const WalkEntry& entry : entries) {
+        FileStateRecord current;
+        current.device = entry.device;
+        current.inode = entry.inode;
+        current.size = entry.size;
+        current.mtimeNs = entry.mtimeNs;
+        current.path = entry.path;
+
+        // Файл не менялся и проверялся теми же политиками - берем прошлый результат
+        FileStateRecord stored;
+        if (m_stateIndex.lookup(entry.device, entry.inode, stored) &&
+            stored.isUpToDate(current, policies->scopeFor(entry.path, entry.size).version)) {
+            if (stored.verdict == ScanVerdict::Violation) {
+                m_violationFiles.insert(entry.path);
             }
+            m_baselineSkipped++;
+            continue;
         }
+
+        AnalysisJob job;
+        job.path = entry.path;
+        job.size = entry.size;
+        job.eventType = "baseline";
+        job.mtimeNs = entry.mtimeNs;
+        job.priority = m_violationFiles.contains(entry.path);
+        m_baselineQueue.push(job);
+        m_baselineTotal++;
+    }
+
+    feedBaseline();
+}
+
+
+void Agent::finishBaselineWalk(quint64 generation) {
+    if (generation != m_baselineGeneration) {
+        return;
+    }
+
+    m_baselineWalking = false;
+    LOG_INFO(QString("Начальный анализ: к проверке %1 файлов, без изменений: %2")
+             .arg(m_baselineTotal).arg(m_baselineSkipped));
+
+    if (m_baselineQueue.isEmpty() && m_baselinePending == 0) {
+        finishBaseline();
+    }
+}
+
+
+void Agent::cancelBaselineWalk() {
+    if (m_baselineCancel) {
+        m_baselineCancel->store(true);
+        m_baselineCancel.reset();
+    }
+    // Прерванный обход дочитывает только текущие каталоги
+    if (m_baselineWalk) {
+        m_baselineWalk->wait();
     }
-    LOG_INFO(QString("Начальный анализ завершен. Файлов с нарушениями: %1")
-             .arg(m_violationFiles.size()));
+    // Пачки, уже стоящие в цикле событий, больше не принимаются
+    ++m_baselineGeneration;
+    m_baselineWalking = false;
 }
 
 
-QStringList Agent::getFilesRecursive(const QDir& dir) {
-    QStringList files;
+void Agent::feedBaseline() {
+    if (m_baselineTotal == 0 || !m_workerPool.isRunning()) {
+        return;
+    }
+
+    // Живые события важнее: пока они ждут в очереди, начальный анализ стоит
+    // Чтение опережает анализ не больше чем на глубину очереди чтения
+    while (!m_baselineQueue.isEmpty() && !m_workerPool.isSaturated() &&
+           m_analysisQueue.metrics().depth == 0) {
+        const bool prefetch = m_baselineQueue.top().size <= m_prefetchLimit;
+        if (prefetch && m_baselineReading >= m_batchReader.depth()) {
+            break;
+        }
 
-    QStringList entries = dir.entryList(QDir::Files | QDir::NoDotAndDotDot);
-    for (const QString& entry : entries) {
-        files.append(dir.absoluteFilePath(entry));
+        const AnalysisJob job = m_baselineQueue.pop();
+        if (prefetch) {
+            m_batchReader.submit(job);
+            m_baselineReading++;
+        } else {
+            m_workerPool.submit(job);
+        }
+        m_baselinePending++;
     }
 
-    QStringList subdirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-    for (const QString& subdir : subdirs) {
-        QDir subdirectory(dir.absoluteFilePath(subdir));
-        files.append(getFilesRecursive(subdirectory));
+    if (m_baselineQueue.isEmpty() && m_baselinePending == 0 && !m_baselineWalking) {
+        finishBaseline();
     }
-    return files;
 }
 
 
-bool Agent::shouldMonitorFile(const QString& filePath) const {
-    QFileInfo info(filePath);
+void Agent::finishBaseline() {
+    const int analyzed = m_baselineTotal;
+    m_baselineQueue.clear();
+    m_baselineTotal = 0;
+
+    m_stateIndex.sync();
+    LOG_INFO(QString("Начальный анализ завершен. Проанализировано: %1, без изменений: %2, "
+                     "файлов с нарушениями: %3")
+             .arg(analyzed).arg(m_baselineSkipped).arg(m_violationFiles.size()));
+}
+
 
-    if (info.size() > m_config.get("agent/max_file_size").toLongLong()) {
+// Запись результата анализа в индекс состояний.
+// Запись удаленного файла не удаляется: при повторном использовании inode
+// она не совпадет по пути или mtime и будет перезаписана
+void Agent::recordFileState(FileStateRecord& record, const AnalysisResult& result) {
+    if (!m_stateIndex.isOpen()) {
+        return;
+    }
+
+    record.contentHash = result.contentHash;
+    // Версия набора, которым файл действительно проверен: за время анализа
+    // мог быть опубликован новый
+    record.policyVersion = result.policyVersion;
+    record.verdict = result.hasViolations ? ScanVerdict::Violation : ScanVerdict::Clean;
+    m_stateIndex.update(record);
+}
+
+
+bool Agent::shouldMonitorFile(const QString& filePath, qint64 size) const {
+    if (size > m_maxFileSize) {
         return false;
     }
 
-    QString fileName = info.fileName();
-    QStringList excludePatterns = m_config.get("monitoring/exclude_patterns").toStringList();
+    // Каталоги пути уже отсеяны фильтром обхода
+    return !m_excludes.matchesFileName(QStringView(filePath).mid(filePath.lastIndexOf('/') + 1));
+}
 
-    for (const QString& pattern : excludePatterns) {
-        QRegularExpression regex(QRegularExpression::wildcardToRegularExpression(pattern),
-                                QRegularExpression::CaseInsensitiveOption);
-        if (regex.match(fileName).hasMatch()) {
-            return false;
-        }
+
+void Agent::applyFilterSettings() {
+    const QStringList patterns = m_config.get("monitoring/exclude_patterns").toStringList();
+    m_maxFileSize = m_config.get("agent/max_file_size").toLongLong();
+    // Потоковый анализ не держит файл в памяти, большие файлы тоже проверяются
+    if (m_config.get("analysis/streaming").toBool()) {
+        m_maxFileSize = std::numeric_limits<qint64>::max();
     }
-    return true;
-}
\ No newline at end of file
+    m_excludes.setPatterns(patterns);
+
+    m_monitor.setExcludePatterns(patterns);
+    m_monitor.setMaxFileSize(m_maxFileSize);
+}
@@ -0,0 +1,385 @@
+#include "../include/AnalysisQueue.h"
+#include "../include/Logger.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+// Сколько заданий с нарушениями можно пропустить в поисках вытесняемого
+constexpr int kEvictScanLimit = 64;
+}
+
+AnalysisQueue::AnalysisQueue(int capacity, QObject* parent)
+    : QObject(parent)
+    , m_ring(static_cast<size_t>(qMax(capacity, 16)))
+    , m_policy(OverflowPolicy::Spill)
+    , m_drainScheduled(false)
+    , m_timeBudget(20)
+    , m_overflowing(false)
+    , m_spillReadOffset(0)
+    , m_spilledPending(0)
+    , m_highWatermark(0)
+    , m_enqueued(0)
+    , m_merged(0)
+    , m_dropped(0)
+    , m_spilled(0)
+    , m_processed(0)
+    , m_totalWaitMs(0)
+    , m_maxWaitMs(0)
+{
+    m_clock.start();
+    LOG_DEBUG(QString("AnalysisQueue инициализирована, емкость: %1").arg(m_ring.capacity()));
+}
+
+AnalysisQueue::~AnalysisQueue() {
+    clear();
+}
+
+void AnalysisQueue::setSpillFile(const QString& filePath) {
+    QMutexLocker locker(&m_overflowLock);
+
+    if (m_spillFile.isOpen()) {
+        m_spillFile.close();
+    }
+    m_spillPath = filePath;
+    m_spillFile.setFileName(filePath);
+    m_spillReadOffset = 0;
+    m_spilledPending = 0;
+
+    // Задания прошлого запуска не догружаются: начальный анализ найдет эти файлы сам
+    QFile::remove(filePath);
+}
+
+void AnalysisQueue::setTimeBudget(int msec) {
+    m_timeBudget = qMax(1, msec);
+}
+
+AnalysisQueue::OverflowPolicy AnalysisQueue::policyFromString(const QString& name) {
+    if (name.compare("drop_oldest", Qt::CaseInsensitive) == 0) {
+        return OverflowPolicy::DropOldest;
+    }
+    return OverflowPolicy::Spill;
+}
+
+bool AnalysisQueue::enqueue(const AnalysisJob& job) {
+    {
+        PendingShard& shard = shardFor(job.path);
+        QMutexLocker locker(&shard.lock);
+
+        auto it = shard.jobs.find(job.path);
+        if (it != shard.jobs.end()) {
+            // Файл еще не разобран: достаточно обновить задание.
+            // Создание поглощает последующие изменения
+            if (it->eventType != "created") {
+                it->eventType = job.eventType;
+            }
+            it->size = job.size;
+            it->priority = it->priority || job.priority;
+            ++m_merged;
+            return true;
+        }
+        shard.jobs.insert(job.path, job);
+    }
+
+    const Slot slot{job.path, m_clock.elapsed()};
+    if (!m_ring.tryPush(slot)) {
+        QMutexLocker locker(&m_overflowLock);
+        if (!handleOverflow(job, slot)) {
+            takePending(job.path);
+            ++m_dropped;
+            LOG_WARNING(QString("Очередь анализа переполнена, задание отброшено: %1").arg(job.path));
+            return false;
+        }
+    }
+
+    ++m_enqueued;
+    updateWatermark();
+    scheduleDrain();
+    return true;
+}
+
+bool AnalysisQueue::remove(const QString& path, AnalysisJob* removed) {
+    // Слот в кольце остается и будет пропущен при извлечении
+    return takePending(path, removed);
+}
+
+bool AnalysisQueue::takePending(const QString& path, AnalysisJob* job) {
+    PendingShard& shard = shardFor(path);
+    QMutexLocker locker(&shard.lock);
+
+    auto it = shard.jobs.find(path);
+    if (it == shard.jobs.end()) {
+        return false;
+    }
+
+    if (job) {
+        *job = it.value();
+    }
+    shard.jobs.erase(it);
+    return true;
+}
+
+void AnalysisQueue::clear() {
+    Slot slot;
+    while (m_ring.tryPop(slot)) {
+    }
+
+    for (PendingShard& shard : m_pending) {
+        QMutexLocker shardLocker(&shard.lock);
+        shard.jobs.clear();
+    }
+
+    QMutexLocker locker(&m_overflowLock);
+    if (m_spillFile.isOpen()) {
+        m_spillFile.close();
+    }
+    if (!m_spillPath.isEmpty()) {
+        QFile::remove(m_spillPath);
+    }
+    m_spillReadOffset = 0;
+    m_spilledPending = 0;
+    m_overflowing = false;
+}
+
+AnalysisQueue::Metrics AnalysisQueue::metrics() const {
+    Metrics result;
+    result.depth = static_cast<int>(m_ring.sizeApprox());
+    result.highWatermark = m_highWatermark.load(std::memory_order_relaxed);
+    result.enqueued = m_enqueued.load(std::memory_order_relaxed);
+    result.merged = m_merged.load(std::memory_order_relaxed);
+    result.dropped = m_dropped.load(std::memory_order_relaxed);
+    result.spilled = m_spilled.load(std::memory_order_relaxed);
+    result.processed = m_processed;
+    result.maxWaitMs = m_maxWaitMs;
+    result.avgWaitMs = m_processed > 0 ? m_totalWaitMs / static_cast<qint64>(m_processed) : 0;
+
+    QMutexLocker locker(&m_overflowLock);
+    result.spilledPending = m_spilledPending;
+    return result;
+}
+
+void AnalysisQueue::logMetrics(const QString& reason) const {
+    const Metrics m = metrics();
+    LOG_INFO(QString("Очередь анализа (%1): в очереди %2 (максимум %3), на диске %4, "
+                     "поставлено %5, слито %6, отброшено %7, выгружено %8, обработано %9, "
+                     "ожидание среднее %10 мс, максимальное %11 мс")
+             .arg(reason).arg(m.depth).arg(m.highWatermark).arg(m.spilledPending)
+             .arg(m.enqueued).arg(m.merged).arg(m.dropped).arg(m.spilled).arg(m.processed)
+             .arg(m.avgWaitMs).arg(m.maxWaitMs));
+}
+
+// Вызывается под m_overflowLock
+bool AnalysisQueue::handleOverflow(const AnalysisJob& job, const Slot& slot) {
+    if (!m_overflowing) {
+        m_overflowing = true;
+        LOG_WARNING(QString("Очередь анализа заполнена (%1 заданий), включена политика переполнения: %2")
+                    .arg(m_ring.capacity())
+                    .arg(m_policy == OverflowPolicy::DropOldest ? "вытеснение" : "выгрузка на диск"));
+    }
+
+    if (m_policy == OverflowPolicy::DropOldest && evictOldest() && m_ring.tryPush(slot)) {
+        return true;
+    }
+
+    // Без файла выгрузки задание с нарушением все равно не должно потеряться
+    if (spill(job)) {
+        return true;
+    }
+    return job.priority && evictOldest() && m_ring.tryPush(slot);
+}
+
+// Вызывается под m_overflowLock
+bool AnalysisQueue::evictOldest() {
+    Slot slot;
+    for (int i = 0; i < kEvictScanLimit; ++i) {
+        if (!m_ring.tryPop(slot)) {
+            // Место освободил обработчик
+            return true;
+        }
+
+        AnalysisJob kept;
+        {
+            PendingShard& shard = shardFor(slot.path);
+            QMutexLocker locker(&shard.lock);
+            auto it = shard.jobs.find(slot.path);
+            if (it == shard.jobs.end()) {
+                // Снятое задание: слот и так был пустым
+                return true;
+            }
+
+            if (!it->priority) {
+                LOG_DEBUG(QString("Задание вытеснено из очереди анализа: %1").arg(slot.path));
+                shard.jobs.erase(it);
+                ++m_dropped;
+                return true;
+            }
+
+            // Задание с нарушением переносится в конец очереди
+            if (m_ring.tryPush(slot)) {
+                continue;
+            }
+            kept = it.value();
+            shard.jobs.erase(it);
+        }
+
+        if (!spill(kept)) {
+            ++m_dropped;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Вызывается под m_overflowLock
+bool AnalysisQueue::spill(const AnalysisJob& job) {
+    if (m_spillPath.isEmpty()) {
+        return false;
+    }
+
+    if (!m_spillFile.isOpen() && !m_spillFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        LOG_ERROR(QString("Не удалось открыть файл выгрузки очереди: %1").arg(m_spillPath));
+        return false;
+    }
+
+    QJsonObject record;
+    record["path"] = job.path;
+    record["size"] = job.size;
+    record["event_type"] = job.eventType;
+    record["priority"] = job.priority;
+
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    if (m_spillFile.write(line) != line.size()) {
+        LOG_ERROR(QString("Ошибка записи в файл выгрузки очереди: %1").arg(m_spillPath));
+        return false;
+    }
+
+    // Выгруженное задание не занимает память; повторные изменения файла
+    // до догрузки создадут новое задание, которое сольется с выгруженным
+    takePending(job.path);
+    ++m_spilledPending;
+    ++m_spilled;
+    return true;
+}
+
+void AnalysisQueue::reloadSpilled() {
+    QList<AnalysisJob> jobs;
+    {
+        QMutexLocker locker(&m_overflowLock);
+        if (m_spilledPending == 0) {
+            return;
+        }
+
+        m_spillFile.flush();
+        QFile reader(m_spillPath);
+        if (!reader.open(QIODevice::ReadOnly) || !reader.seek(m_spillReadOffset)) {
+            LOG_ERROR(QString("Не удалось прочитать файл выгрузки очереди: %1").arg(m_spillPath));
+            m_spilledPending = 0;
+            return;
+        }
+
+        // Догружается четверть емкости, чтобы новые события не упирались в переполнение
+        const int batch = static_cast<int>(m_ring.capacity() / 4);
+        while (jobs.size() < batch && !reader.atEnd()) {
+            const QByteArray line = reader.readLine();
+            const QJsonObject record = QJsonDocument::fromJson(line).object();
+            if (record.isEmpty()) {
+                continue;
+            }
+
+            AnalysisJob job;
+            job.path = record["path"].toString();
+            job.size = record["size"].toVariant().toLongLong();
+            job.eventType = record["event_type"].toString();
+            job.priority = record["priority"].toBool();
+            jobs.append(job);
+        }
+
+        m_spillReadOffset = reader.pos();
+        m_spilledPending = reader.atEnd() ? 0 : qMax<qint64>(0, m_spilledPending - jobs.size());
+        if (m_spilledPending == 0) {
+            m_spillFile.close();
+            QFile::remove(m_spillPath);
+            m_spillReadOffset = 0;
+        }
+    }
+
+    LOG_DEBUG(QString("Догружено заданий из файла выгрузки: %1").arg(jobs.size()));
+    for (const AnalysisJob& job : std::as_const(jobs)) {
+        enqueue(job);
+    }
+}
+
+void AnalysisQueue::scheduleDrain() {
+    // Из любого потока: обработка всегда идет в потоке очереди
+    if (!m_drainScheduled.exchange(true)) {
+        QMetaObject::invokeMethod(this, [this]() { onDrain(); }, Qt::QueuedConnection);
+    }
+}
+
+void AnalysisQueue::updateWatermark() {
+    const int depth = static_cast<int>(m_ring.sizeApprox());
+    int current = m_highWatermark.load(std::memory_order_relaxed);
+    while (depth > current &&
+           !m_highWatermark.compare_exchange_weak(current, depth, std::memory_order_relaxed)) {
+    }
+}
+
+void AnalysisQueue::onDrain() {
+    m_drainScheduled.store(false);
+    if (!m_handler) {
+        return;
+    }
+
+    if (m_ring.sizeApprox() < m_ring.capacity() / 2) {
+        reloadSpilled();
+    }
+
+    // Квант ограничен по времени, после него управление возвращается циклу событий
+    QElapsedTimer slice;
+    slice.start();
+
+    Slot slot;
+    bool throttled = false;
+    while (slice.elapsed() < m_timeBudget) {
+        if (m_throttle && !m_throttle()) {
+            // Получатель занят: задания ждут в кольце, где они еще сливаются
+            throttled = true;
+            break;
+        }
+        if (!m_ring.tryPop(slot)) {
+            break;
+        }
+
+        AnalysisJob job;
+        if (!takePending(slot.path, &job)) {
+            continue;
+        }
+
+        const qint64 waited = m_clock.elapsed() - slot.enqueuedAt;
+        m_totalWaitMs += waited;
+        m_maxWaitMs = qMax(m_maxWaitMs, waited);
+        ++m_processed;
+
+        m_handler(job);
+    }
+
+    bool hasSpilled;
+    bool recovered = false;
+    {
+        QMutexLocker locker(&m_overflowLock);
+        hasSpilled = m_spilledPending > 0;
+        if (!hasSpilled && m_overflowing && m_ring.sizeApprox() == 0) {
+            m_overflowing = false;
+            recovered = true;
+        }
+    }
+
+    if (throttled) {
+        return;
+    }
+    if (m_ring.sizeApprox() > 0 || hasSpilled) {
+        scheduleDrain();
+    } else if (recovered) {
+        logMetrics("переполнение разобрано");
+    }
+}
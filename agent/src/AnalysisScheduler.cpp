@@ -0,0 +1,152 @@
+#include "../include/AnalysisScheduler.h"
+#include "../include/Logger.h"
+#include "../include/FileClassifier.h"
+#include <QDateTime>
+#include <QDir>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Составляющие приоритета, в очках
+constexpr double kViolationPoints = 100;
+constexpr double kRecencyPoints = 40;
+constexpr double kRecencyHalfLifeHours = 24;
+constexpr double kSizePoints = 20;
+constexpr double kHighRiskPoints = 30;
+constexpr double kMediumRiskPoints = 15;
+constexpr double kLowRiskPoints = -20;
+
+// Форматы, в которых чаще всего оказываются персональные данные и выгрузки
+const QLatin1String kHighRiskExtensions[] = {
+    QLatin1String("csv"), QLatin1String("tsv"), QLatin1String("xls"), QLatin1String("xlsx"),
+    QLatin1String("ods"), QLatin1String("doc"), QLatin1String("docx"), QLatin1String("odt"),
+    QLatin1String("rtf"), QLatin1String("pdf"), QLatin1String("txt"), QLatin1String("sql"),
+    QLatin1String("eml"), QLatin1String("msg"), QLatin1String("vcf"), QLatin1String("json"),
+    QLatin1String("xml"), QLatin1String("pem"), QLatin1String("key"), QLatin1String("env")
+};
+
+const QLatin1String kMediumRiskExtensions[] = {
+    QLatin1String("log"), QLatin1String("md"), QLatin1String("html"), QLatin1String("htm"),
+    QLatin1String("ini"), QLatin1String("conf"), QLatin1String("cfg"), QLatin1String("yaml"),
+    QLatin1String("yml"), QLatin1String("sh"), QLatin1String("ps1"), QLatin1String("bat")
+};
+
+// Сборки, зависимости и медиа: проверяются последними
+const QLatin1String kLowRiskExtensions[] = {
+    QLatin1String("js"), QLatin1String("mjs"), QLatin1String("map"), QLatin1String("css"),
+    QLatin1String("ts"), QLatin1String("o"), QLatin1String("a"), QLatin1String("so"),
+    QLatin1String("class"), QLatin1String("pyc"), QLatin1String("png"), QLatin1String("jpg"),
+    QLatin1String("jpeg"), QLatin1String("gif"), QLatin1String("svg"), QLatin1String("woff"),
+    QLatin1String("woff2"), QLatin1String("ttf"), QLatin1String("mp3"), QLatin1String("mp4")
+};
+
+double extensionPoints(const QString& path) {
+    const QStringView suffix = FileClassifier::suffixOf(path);
+    if (suffix.isEmpty()) {
+        return 0;
+    }
+    if (FileClassifier::containsExtension(kHighRiskExtensions, suffix)) {
+        return kHighRiskPoints;
+    }
+    if (FileClassifier::containsExtension(kMediumRiskExtensions, suffix)) {
+        return kMediumRiskPoints;
+    }
+    if (FileClassifier::containsExtension(kLowRiskExtensions, suffix)) {
+        return kLowRiskPoints;
+    }
+    return 0;
+}
+}
+
+AnalysisScheduler::AnalysisScheduler()
+    : m_agingPerMinute(5)
+    , m_sequence(0)
+{
+    m_clock.start();
+}
+
+void AnalysisScheduler::setPathWeights(const QStringList& rules) {
+    m_pathWeights.clear();
+    for (const QString& rule : rules) {
+        const qsizetype separator = rule.lastIndexOf('=');
+        bool ok = false;
+        const double weight = separator > 0 ? rule.mid(separator + 1).trimmed().toDouble(&ok) : 0;
+        QString pattern = rule.left(separator).trimmed();
+        if (!ok || pattern.isEmpty()) {
+            LOG_WARNING(QString("Неверное правило приоритета пути: %1").arg(rule));
+            continue;
+        }
+        if (pattern.startsWith("~/")) {
+            pattern = QDir::homePath() + pattern.mid(1);
+        }
+        m_pathWeights.append(qMakePair(pattern, weight));
+    }
+}
+
+double AnalysisScheduler::score(const AnalysisJob& job, qint64 nowMs) const {
+    double points = job.priority ? kViolationPoints : 0;
+
+    // Свежие файлы важнее: вклад убывает вдвое за сутки
+    if (job.mtimeNs > 0) {
+        const double ageHours = qMax<qint64>(0, nowMs - job.mtimeNs / 1000000) / 3600000.0;
+        points += kRecencyPoints * std::exp2(-ageHours / kRecencyHalfLifeHours);
+    }
+
+    // Небольшие файлы проверяются быстро: 1 КБ - почти полный вклад, 1 ГБ - нулевой
+    const double sizeKb = qMax<qint64>(0, job.size) / 1024.0;
+    points += kSizePoints * qMax(0.0, 1.0 - std::log2(1.0 + sizeKb) / 20.0);
+
+    points += extensionPoints(job.path);
+
+    for (const QPair<QString, double>& rule : m_pathWeights) {
+        if (job.path.contains(rule.first)) {
+            points += rule.second;
+        }
+    }
+    return points;
+}
+
+void AnalysisScheduler::push(const AnalysisJob& job) {
+    // Задание, ждавшее в прошлом начальном анализе, ждет с того времени:
+    // иначе каждый повторный обход обнуляет старение и крупный файл
+    // с низким приоритетом снова уступает новым
+    qint64 enqueuedMs = m_clock.elapsed();
+    const auto waiting = m_waitingSince.constFind(job.path);
+    if (waiting != m_waitingSince.constEnd()) {
+        enqueuedMs = waiting.value();
+        m_waitingSince.erase(waiting);
+    }
+
+    // При выборе приоритет равен score + rate * (now - enqueued). Слагаемое
+    // rate * now одинаково для всех заданий, поэтому сравнение по
+    // score - rate * enqueued дает тот же порядок в любой момент,
+    // и кучу не нужно пересчитывать со временем
+    Item item{score(job, QDateTime::currentMSecsSinceEpoch()) - m_agingPerMinute * enqueuedMs / 60000.0,
+              m_sequence++, enqueuedMs, job};
+    m_heap.append(item);
+    std::push_heap(m_heap.begin(), m_heap.end(), lessUrgent);
+}
+
+void AnalysisScheduler::clear() {
+    m_waitingSince.clear();
+    for (const Item& item : std::as_const(m_heap)) {
+        m_waitingSince.insert(item.job.path, item.enqueuedMs);
+    }
+    m_heap.clear();
+}
+
+AnalysisJob AnalysisScheduler::pop() {
+    std::pop_heap(m_heap.begin(), m_heap.end(), lessUrgent);
+    AnalysisJob job = m_heap.last().job;
+    m_heap.removeLast();
+    return job;
+}
+
+bool AnalysisScheduler::lessUrgent(const Item& a, const Item& b) {
+    // При равном приоритете - в порядке постановки
+    if (a.key != b.key) {
+        return a.key < b.key;
+    }
+    return a.sequence > b.sequence;
+}
@@ -0,0 +1,248 @@
+#include "../include/AnalysisWorkerPool.h"
+#include "../include/Logger.h"
+#include "../include/PolicyChecker.h"
+#include <QThread>
+#include <QTimer>
+#include <QDir>
+#include <QFile>
+#include <QSet>
+
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+// Заданий в работе на поток: очередь потока не пустеет между заданиями
+constexpr int kJobsPerWorker = 4;
+constexpr int kLoadCheckIntervalMs = 10000;
+
+int readSysfsInt(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    bool ok = false;
+    const int value = file.readAll().trimmed().toInt(&ok);
+    return ok ? value : -1;
+}
+}
+
+
+AnalysisWorker::AnalysisWorker(PolicyChecker* checker, QObject* parent)
+    : QObject(parent)
+    , m_analyzer(this)
+    , m_checker(checker)
+{
+}
+
+void AnalysisWorker::process(const AnalysisJob& job) {
+    AnalysisResult result;
+    if (job.prefetched) {
+        m_analyzer.analyzeContent(job.path, job.content, m_checker, result);
+        // Состояние файла на момент чтения в BatchReader
+        result.size = job.size;
+        result.device = job.device;
+        result.inode = job.inode;
+        result.mtimeNs = job.mtimeNs;
+    } else {
+        m_analyzer.analyzeFile(job.path, m_checker, result);
+    }
+    emit finished(job, result);
+}
+
+
+AnalysisWorkerPool::AnalysisWorkerPool(PolicyChecker* checker, QObject* parent)
+    : QObject(parent)
+    , m_checker(checker)
+    , m_loadTimer(new QTimer(this))
+    , m_activeCount(0)
+    , m_inFlight(0)
+{
+    qRegisterMetaType<AnalysisJob>("AnalysisJob");
+    qRegisterMetaType<AnalysisResult>("AnalysisResult");
+
+    m_loadTimer->setInterval(kLoadCheckIntervalMs);
+    connect(m_loadTimer, &QTimer::timeout, this, &AnalysisWorkerPool::adjustForLoad);
+}
+
+AnalysisWorkerPool::~AnalysisWorkerPool() {
+    stop();
+}
+
+void AnalysisWorkerPool::start(int threadCount) {
+    if (isRunning()) {
+        return;
+    }
+
+    // Одно ядро остается циклу событий агента и остальной системе
+    const int count = threadCount > 0 ? threadCount : qMax(1, physicalCoreCount() - 1);
+
+    for (int i = 0; i < count; ++i) {
+        QThread* thread = new QThread(this);
+        thread->setObjectName(QString("analysis-%1").arg(i));
+
+        AnalysisWorker* worker = new AnalysisWorker(m_checker);
+        if (m_setup) {
+            m_setup(worker->analyzer());
+        }
+        worker->moveToThread(thread);
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+        connect(worker, &AnalysisWorker::finished, this, &AnalysisWorkerPool::onWorkerFinished,
+                Qt::QueuedConnection);
+
+        thread->start(QThread::LowPriority);
+        m_threads.append(thread);
+        m_workers.append(worker);
+    }
+
+    m_activeCount = count;
+    adjustForLoad();
+    m_loadTimer->start();
+
+    LOG_INFO(QString("Пул анализа запущен: потоков %1, активных %2").arg(count).arg(m_activeCount));
+}
+
+void AnalysisWorkerPool::stop() {
+    if (!isRunning()) {
+        return;
+    }
+
+    m_loadTimer->stop();
+    for (QThread* thread : std::as_const(m_threads)) {
+        // Прерывается только ожидание новых заданий; текущее дорабатывает
+        thread->quit();
+    }
+    for (QThread* thread : std::as_const(m_threads)) {
+        thread->wait();
+        delete thread;
+    }
+
+    m_threads.clear();
+    m_workers.clear();
+    m_inFlightPaths.clear();
+    m_inFlight = 0;
+    m_activeCount = 0;
+    LOG_INFO("Пул анализа остановлен");
+}
+
+void AnalysisWorkerPool::configure(const AnalyzerSetup& setup) {
+    m_setup = setup;
+    for (AnalysisWorker* worker : std::as_const(m_workers)) {
+        QMetaObject::invokeMethod(worker, [worker, setup]() {
+            setup(worker->analyzer());
+        }, Qt::QueuedConnection);
+    }
+}
+
+void AnalysisWorkerPool::submit(const AnalysisJob& job) {
+    if (!isRunning()) {
+        LOG_WARNING(QString("Пул анализа не запущен, задание пропущено: %1").arg(job.path));
+        return;
+    }
+
+    const int index = selectWorker(job.path);
+    PathShard& shard = m_inFlightPaths[job.path];
+    shard.worker = index;
+    shard.pending++;
+    m_inFlight++;
+
+    AnalysisWorker* worker = m_workers.at(index);
+    QMetaObject::invokeMethod(worker, [worker, job]() {
+        worker->process(job);
+    }, Qt::QueuedConnection);
+}
+
+bool AnalysisWorkerPool::isSaturated() const {
+    return m_inFlight >= m_activeCount * kJobsPerWorker;
+}
+
+int AnalysisWorkerPool::selectWorker(const QString& path) const {
+    // Путь с заданием в работе остается за тем же потоком - порядок сохраняется
+    auto it = m_inFlightPaths.constFind(path);
+    if (it != m_inFlightPaths.constEnd()) {
+        return it->worker;
+    }
+    return static_cast<int>(qHash(path) % static_cast<uint>(m_activeCount));
+}
+
+void AnalysisWorkerPool::onWorkerFinished(const AnalysisJob& job, const AnalysisResult& result) {
+    auto it = m_inFlightPaths.find(job.path);
+    if (it != m_inFlightPaths.end() && --it->pending <= 0) {
+        m_inFlightPaths.erase(it);
+    }
+
+    const bool wasSaturated = isSaturated();
+    m_inFlight = qMax(0, m_inFlight - 1);
+
+    emit jobFinished(job, result);
+
+    if (wasSaturated && !isSaturated()) {
+        emit capacityAvailable();
+    }
+}
+
+void AnalysisWorkerPool::logStats(const QString& reason) const {
+    int files = 0;
+    qint64 bytesRead = 0;
+    int chunksScanned = 0;
+    int chunksReused = 0;
+    qint64 bytesReused = 0;
+    for (AnalysisWorker* worker : m_workers) {
+        const ContentAnalyzer& analyzer = worker->analyzer();
+        files += analyzer.analyzedFilesCount();
+        bytesRead += analyzer.totalBytesRead();
+        chunksScanned += analyzer.chunksScanned();
+        chunksReused += analyzer.chunksReused();
+        bytesReused += analyzer.bytesReused();
+    }
+
+    const int chunks = chunksScanned + chunksReused;
+    const int reuseRate = chunks > 0 ? chunksReused * 100 / chunks : 0;
+    LOG_INFO(QString("Анализ (%1): файлов %2, прочитано %3 байт; фрагментов проверено %4, "
+                     "перенесено %5 (%6%), не проверено повторно %7 байт")
+             .arg(reason).arg(files).arg(bytesRead).arg(chunksScanned)
+             .arg(chunksReused).arg(reuseRate).arg(bytesReused));
+}
+
+void AnalysisWorkerPool::adjustForLoad() {
+    if (!isRunning()) {
+        return;
+    }
+
+    // Потоки не останавливаются: новые пути просто распределяются по меньшему числу
+    double load = 0;
+    int active = m_workers.size();
+    if (getloadavg(&load, 1) == 1) {
+        const int logical = QThread::idealThreadCount();
+        // Наша собственная нагрузка не должна уменьшать число потоков
+        const double foreign = load - qMin<double>(load, m_activeCount);
+        const int idle = static_cast<int>(std::floor(logical - foreign));
+        active = qBound(1, idle - 1, static_cast<int>(m_workers.size()));
+    }
+
+    if (active != m_activeCount) {
+        LOG_INFO(QString("Активных потоков анализа: %1 -> %2 (loadavg %3)")
+                 .arg(m_activeCount).arg(active).arg(load, 0, 'f', 2));
+        const bool grew = active > m_activeCount;
+        m_activeCount = active;
+        if (grew) {
+            emit capacityAvailable();
+        }
+    }
+}
+
+int AnalysisWorkerPool::physicalCoreCount() {
+    // Пары (пакет, ядро) из sysfs; логические процессоры SMT дают одну пару
+    QSet<QPair<int, int>> cores;
+    const QDir cpuDir("/sys/devices/system/cpu");
+    const QStringList cpus = cpuDir.entryList(QStringList() << "cpu[0-9]*", QDir::Dirs);
+    for (const QString& cpu : cpus) {
+        const QString topology = cpuDir.filePath(cpu) + "/topology/";
+        const int package = readSysfsInt(topology + "physical_package_id");
+        const int core = readSysfsInt(topology + "core_id");
+        if (core >= 0) {
+            cores.insert(qMakePair(package, core));
+        }
+    }
+
+    return cores.isEmpty() ? qMax(1, QThread::idealThreadCount()) : static_cast<int>(cores.size());
+}
@@ -0,0 +1,509 @@
+#include "../include/BatchReader.h"
+#include "../include/Logger.h"
+#include "../include/FileReader.h"
+#include <QFile>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define BATCHREADER_IO_URING 1
+#endif
+
+namespace {
+// Потоков pread в запасном режиме: дальше растет только число переключений
+constexpr int kMaxPreadThreads = 16;
+constexpr int kMaxDepth = 256;
+constexpr size_t kBufferAlignment = 4096;
+
+size_t alignedSize(qint64 bytes) {
+    return (static_cast<size_t>(bytes) + kBufferAlignment - 1) & ~(kBufferAlignment - 1);
+}
+
+// Состояние открытого файла до чтения: его и запомнит индекс состояний
+bool statOpened(int fd, AnalysisJob& job) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    job.device = static_cast<quint64>(st.st_dev);
+    job.inode = static_cast<quint64>(st.st_ino);
+    job.size = static_cast<qint64>(st.st_size);
+    job.mtimeNs = static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+}
+
+#ifdef BATCHREADER_IO_URING
+
+namespace {
+enum class Stage {
+    Idle,
+    Open,
+    Read
+};
+
+// Файл в работе; номер слота - user_data операции и индекс буфера
+struct Slot {
+    Stage stage = Stage::Idle;
+    AnalysisJob job;
+    QByteArray path;
+    int fd = -1;
+    bool noatime = true;
+};
+
+int ringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+}
+
+struct BatchReader::Ring {
+    int fd = -1;
+    void* sqMap = MAP_FAILED;
+    size_t sqMapSize = 0;
+    void* cqMap = MAP_FAILED;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    char* buffers = nullptr;
+    size_t bufferStride = 0;
+    // Зарегистрированные буферы: страницы закреплены один раз, а не на каждое чтение
+    bool fixedBuffers = false;
+    unsigned queued = 0;
+    std::vector<Slot> files;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqMap != MAP_FAILED && cqMap != sqMap) {
+            munmap(cqMap, cqMapSize);
+        }
+        if (sqMap != MAP_FAILED) {
+            munmap(sqMap, sqMapSize);
+        }
+        // Закрытие кольца дожидается отмены операций, после него буферы свободны
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        std::free(buffers);
+    }
+
+    bool init(int depth, qint64 bufferSize) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = ringSetup(static_cast<unsigned>(depth), &params);
+        if (fd < 0) {
+            LOG_DEBUG(QString("io_uring недоступен: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+            return false;
+        }
+
+        // OPENAT появился в 5.6; на более старых ядрах - запасной режим
+        std::vector<char> probeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+        if (ringRegister(fd, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+            probe->last_op < IORING_OP_OPENAT ||
+            !(probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) ||
+            !(probe->ops[IORING_OP_READ_FIXED].flags & IO_URING_OP_SUPPORTED)) {
+            LOG_DEBUG("io_uring без поддержки openat");
+            return false;
+        }
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap) {
+            sqMapSize = cqMapSize = qMax(sqMapSize, cqMapSize);
+        }
+
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) {
+            return false;
+        }
+        cqMap = singleMap ? sqMap
+                          : mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 fd, IORING_OFF_CQ_RING);
+        if (cqMap == MAP_FAILED) {
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sqMap);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+        char* cq = static_cast<char*>(cqMap);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // Лишний байт показывает, что файл вырос больше буфера после обхода
+        bufferStride = alignedSize(bufferSize + 1);
+        if (posix_memalign(reinterpret_cast<void**>(&buffers), kBufferAlignment, bufferStride * depth) != 0) {
+            buffers = nullptr;
+            return false;
+        }
+
+        std::vector<iovec> iovecs(depth);
+        for (int i = 0; i < depth; ++i) {
+            iovecs[i].iov_base = buffers + bufferStride * i;
+            iovecs[i].iov_len = bufferStride;
+        }
+        // Без регистрации (RLIMIT_MEMLOCK на старых ядрах) - обычное чтение в те же буферы
+        fixedBuffers = ringRegister(fd, IORING_REGISTER_BUFFERS, iovecs.data(), static_cast<unsigned>(depth)) == 0;
+
+        files.resize(depth);
+        return true;
+    }
+
+    io_uring_sqe* nextSqe(unsigned index) {
+        const unsigned tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            return nullptr;
+        }
+        io_uring_sqe* sqe = &sqes[tail & sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->user_data = index;
+        sqArray[tail & sqMask] = tail & sqMask;
+        return sqe;
+    }
+
+    void commitSqe() {
+        __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+        ++queued;
+    }
+
+    bool queueOpen(unsigned index) {
+        Slot& slot = files[index];
+        io_uring_sqe* sqe = nextSqe(index);
+        if (!sqe) {
+            return false;
+        }
+        // O_NONBLOCK: FIFO, попавший в список, не займет рабочий поток ядра
+        int flags = O_RDONLY | O_CLOEXEC | O_NONBLOCK;
+        if (slot.noatime) {
+            flags |= O_NOATIME;
+        }
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<quint64>(slot.path.constData());
+        sqe->open_flags = static_cast<quint32>(flags);
+        commitSqe();
+        slot.stage = Stage::Open;
+        return true;
+    }
+
+    bool queueRead(unsigned index, qint64 length) {
+        Slot& slot = files[index];
+        io_uring_sqe* sqe = nextSqe(index);
+        if (!sqe) {
+            return false;
+        }
+        sqe->opcode = fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = slot.fd;
+        sqe->addr = reinterpret_cast<quint64>(buffers + bufferStride * index);
+        sqe->len = static_cast<quint32>(length);
+        sqe->off = 0;
+        if (fixedBuffers) {
+            sqe->buf_index = static_cast<quint16>(index);
+        }
+        commitSqe();
+        slot.stage = Stage::Read;
+        return true;
+    }
+};
+
+#else
+
+struct BatchReader::Ring {
+};
+
+#endif
+
+
+BatchReader::BatchReader(QObject* parent)
+    : QObject(parent)
+    , m_ring(nullptr)
+    , m_stopping(false)
+    , m_running(false)
+    , m_depth(0)
+    , m_bufferSize(0)
+    , m_filesRead(0)
+    , m_bytesRead(0)
+    , m_failures(0)
+{
+    qRegisterMetaType<AnalysisJob>("AnalysisJob");
+}
+
+BatchReader::~BatchReader() {
+    stop();
+}
+
+bool BatchReader::start(int depth, qint64 bufferSize, bool useIoUring) {
+    if (m_running) {
+        return true;
+    }
+    if (depth <= 0 || bufferSize <= 0) {
+        return false;
+    }
+
+    m_depth = qMin(depth, kMaxDepth);
+    m_bufferSize = bufferSize;
+    m_stopping = false;
+
+#ifdef BATCHREADER_IO_URING
+    if (useIoUring) {
+        m_ring = new Ring;
+        if (!m_ring->init(m_depth, m_bufferSize)) {
+            delete m_ring;
+            m_ring = nullptr;
+        }
+    }
+#else
+    Q_UNUSED(useIoUring);
+#endif
+
+#ifdef BATCHREADER_IO_URING
+    if (m_ring) {
+        m_threads.emplace_back(&BatchReader::runRing, this);
+        LOG_INFO(QString("Пакетное чтение: io_uring, в работе до %1 файлов%2")
+                 .arg(m_depth).arg(m_ring->fixedBuffers ? ", буферы зарегистрированы" : ""));
+    } else
+#endif
+    {
+        const int threads = qMin(m_depth, kMaxPreadThreads);
+        for (int i = 0; i < threads; ++i) {
+            m_threads.emplace_back(&BatchReader::runPread, this);
+        }
+        LOG_INFO(QString("Пакетное чтение: pread, потоков %1").arg(threads));
+    }
+
+    m_running = true;
+    return true;
+}
+
+void BatchReader::stop() {
+    if (!m_running) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(m_lock);
+        m_stopping = true;
+        m_pending.clear();
+    }
+    m_wake.notify_all();
+
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+    delete m_ring;
+    m_ring = nullptr;
+    m_running = false;
+
+    LOG_INFO(QString("Пакетное чтение остановлено: файлов %1, байт %2, не прочитано %3")
+             .arg(filesRead()).arg(bytesRead()).arg(failures()));
+}
+
+void BatchReader::submit(const AnalysisJob& job) {
+    {
+        std::lock_guard<std::mutex> locker(m_lock);
+        if (m_stopping) {
+            return;
+        }
+        m_pending.push_back(job);
+    }
+    m_wake.notify_one();
+}
+
+bool BatchReader::takeJob(AnalysisJob& job, bool wait) {
+    std::unique_lock<std::mutex> locker(m_lock);
+    if (wait) {
+        m_wake.wait(locker, [this]() { return m_stopping || !m_pending.empty(); });
+    }
+    if (m_stopping || m_pending.empty()) {
+        return false;
+    }
+    job = std::move(m_pending.front());
+    m_pending.pop_front();
+    return true;
+}
+
+void BatchReader::complete(AnalysisJob& job, const char* data, qint64 length) {
+    if (length > m_bufferSize) {
+        // Файл вырос после обхода - его целиком прочитает поток анализа
+        job.prefetched = false;
+    } else {
+        job.content = QByteArray(data, length);
+        job.prefetched = true;
+        m_filesRead.fetch_add(1, std::memory_order_relaxed);
+        m_bytesRead.fetch_add(length, std::memory_order_relaxed);
+    }
+    emit fileRead(job);
+}
+
+void BatchReader::fail(AnalysisJob& job) {
+    // Ошибку открытия или чтения сообщит поток анализа, повторив чтение сам
+    job.prefetched = false;
+    job.device = 0;
+    job.inode = 0;
+    m_failures.fetch_add(1, std::memory_order_relaxed);
+    emit fileRead(job);
+}
+
+void BatchReader::runRing() {
+#ifdef BATCHREADER_IO_URING
+    Ring& ring = *m_ring;
+    int inFlight = 0;
+
+    for (;;) {
+        // Свободные слоты получают новые файлы; ждать заданий можно, только когда ждать нечего
+        for (unsigned i = 0; i < ring.files.size(); ++i) {
+            Slot& slot = ring.files[i];
+            if (slot.stage != Stage::Idle) {
+                continue;
+            }
+            AnalysisJob job;
+            if (!takeJob(job, inFlight == 0 && ring.queued == 0)) {
+                break;
+            }
+            slot.job = std::move(job);
+            slot.path = QFile::encodeName(slot.job.path);
+            slot.noatime = true;
+            if (!ring.queueOpen(i)) {
+                fail(slot.job);
+                slot.stage = Stage::Idle;
+                continue;
+            }
+            ++inFlight;
+        }
+
+        if (inFlight == 0) {
+            std::lock_guard<std::mutex> locker(m_lock);
+            if (m_stopping) {
+                break;
+            }
+            continue;
+        }
+
+        const int submitted = ringEnter(ring.fd, ring.queued, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            LOG_ERROR(QString("Ошибка io_uring_enter, переход на pread: %1")
+                      .arg(QString::fromLocal8Bit(strerror(errno))));
+            for (Slot& slot : ring.files) {
+                if (slot.stage != Stage::Idle) {
+                    fail(slot.job);
+                    slot.stage = Stage::Idle;
+                }
+                if (slot.fd >= 0) {
+                    ::close(slot.fd);
+                    slot.fd = -1;
+                }
+            }
+            runPread();
+            return;
+        }
+        ring.queued -= qMin(ring.queued, static_cast<unsigned>(submitted));
+
+        unsigned head = *ring.cqHead;
+        const unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+            const unsigned index = static_cast<unsigned>(cqe.user_data);
+            const int res = cqe.res;
+            Slot& slot = ring.files[index];
+
+            bool done = true;
+            if (slot.stage == Stage::Open) {
+                if (res == -EPERM && slot.noatime) {
+                    // O_NOATIME разрешен только владельцу файла
+                    slot.noatime = false;
+                    done = !ring.queueOpen(index);
+                } else if (res >= 0) {
+                    slot.fd = res;
+                    done = !statOpened(slot.fd, slot.job) || !ring.queueRead(index, m_bufferSize + 1);
+                }
+                if (done) {
+                    fail(slot.job);
+                }
+            } else if (slot.stage == Stage::Read) {
+                if (res >= 0) {
+                    complete(slot.job, ring.buffers + ring.bufferStride * index, res);
+                } else {
+                    fail(slot.job);
+                }
+            }
+
+            if (done) {
+                if (slot.fd >= 0) {
+                    ::close(slot.fd);
+                    slot.fd = -1;
+                }
+                slot.job = AnalysisJob();
+                slot.stage = Stage::Idle;
+                --inFlight;
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+#endif
+}
+
+void BatchReader::runPread() {
+    FileReader reader;
+    AnalysisJob job;
+
+    while (takeJob(job, true)) {
+        QByteArrayView data;
+        if (!reader.open(job.path) || !reader.readChunk(0, m_bufferSize + 1, data)) {
+            reader.release();
+            fail(job);
+            continue;
+        }
+        job.device = reader.device();
+        job.inode = reader.inode();
+        job.size = reader.fileSize();
+        job.mtimeNs = reader.mtimeNs();
+        complete(job, data.data(), data.size());
+        reader.release();
+    }
+}
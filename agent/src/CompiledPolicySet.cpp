@@ -0,0 +1,961 @@
+#include "../include/CompiledPolicySet.h"
+#include "../include/Logger.h"
+#include "../include/FastHash.h"
+#include "../include/FileClassifier.h"
+#include <algorithm>
+
+namespace {
+// Политик в одном объединенном выражении: размер скомпилированного
+// шаблона PCRE2 ограничен, а проход по тексту остается один на группу
+constexpr int kPoliciesPerGroup = 64;
+
+QString groupName(int policyId) {
+    return QString("dlp_p%1").arg(policyId < 0 ? QString("m%1").arg(-policyId) : QString::number(policyId));
+}
+
+// Ключ списка id: для кэша объединенных выражений и таблицы маршрутов
+QString policyIdsKey(const QVector<int>& policyIds) {
+    QString key;
+    for (int id : policyIds) {
+        key += QString::number(id);
+        key += ',';
+    }
+    return key;
+}
+
+// Конструкции, смысл которых меняется внутри объединенного выражения:
+// нумерованные ссылки и рекурсия сдвигаются на номер внешней группы,
+// \G привязан к началу поиска, глаголы (*...) и режим x действуют на весь шаблон
+const QRegularExpression& uncombinableConstructs() {
+    static const QRegularExpression re(
+        R"(\\[1-9]|\\g|\\G|\(\?[+-]?\d|\(\?R|\(\?&|\(\?P>|\(\?\||\(\*|\(\?[a-zA-Z^-]*x)");
+    Q_ASSERT(re.isValid());
+    return re;
+}
+
+// Шаблон пути в регулярное выражение: * и ? не ограничены компонентом пути,
+// [...] передается как есть, остальное экранируется
+QString globToRegex(QStringView glob) {
+    QString re;
+    for (qsizetype i = 0; i < glob.size(); ++i) {
+        const QChar c = glob.at(i);
+        if (c == '*') {
+            re += QLatin1String(".*");
+            while (i + 1 < glob.size() && glob.at(i + 1) == '*') {
+                ++i;
+            }
+        } else if (c == '?') {
+            re += '.';
+        } else if (c == '[') {
+            const qsizetype close = glob.indexOf(']', i + 1);
+            if (close < 0) {
+                re += QLatin1String("\\[");
+                continue;
+            }
+            QString set = glob.mid(i, close - i + 1).toString();
+            if (set.startsWith(QLatin1String("[!"))) {
+                set[1] = '^';
+            }
+            re += set;
+            i = close;
+        } else {
+            re += QRegularExpression::escape(QString(c));
+        }
+    }
+    return re;
+}
+
+// Просмотр вперед и привязка к концу текста (совпадение зависит от символов
+// за своим концом), \K (начало совпадения сдвигается за признак)
+const QRegularExpression& lookaheadOrEnd() {
+    static const QRegularExpression re(R"(\(\?[=!]|\(\*|\$|\\[zZK])");
+    return re;
+}
+}
+
+CompiledPolicySet::CompiledPolicySet()
+    : m_caseSensitive(false)
+    , m_maxContentSize(10 * 1024 * 1024)
+    , m_version(0)
+    , m_maxMatchLength(0)
+    , m_defaultRoute(0)
+    , m_textRoute(0)
+    , m_allRoute(0)
+{
+    m_routes.append(Route());
+}
+
+CompiledPolicySet::CompiledPolicySet(const QHash<int, DlpPolicy>& policies, bool caseSensitive,
+                                     int maxContentSize)
+    : m_caseSensitive(caseSensitive)
+    , m_maxContentSize(maxContentSize)
+    , m_version(0)
+    , m_maxMatchLength(0)
+    , m_defaultRoute(0)
+    , m_textRoute(0)
+    , m_allRoute(0)
+{
+    for (auto it = policies.constBegin(); it != policies.constEnd(); ++it) {
+        const DlpPolicy& policy = it.value();
+
+        NumericDetector::Kind kind;
+        if (!policy.isRegex() && !NumericDetector::kindFromName(policy.kind, kind)) {
+            LOG_WARNING(QString("Неизвестный вид политики %1: %2").arg(policy.name, policy.kind));
+            m_rejected.append(it.key());
+            continue;
+        }
+        if (!policy.isRegex() && !NumericDetector().addPolicy(it.key(), kind, policy.pattern)) {
+            LOG_WARNING(QString("Неверные параметры детектора для политики: %1").arg(policy.name));
+            m_rejected.append(it.key());
+            continue;
+        }
+
+        QRegularExpression regex;
+        if (policy.isRegex()) {
+            if (!compilePattern(policy.pattern, regex)) {
+                LOG_WARNING(QString("Не удалось скомпилировать паттерн для политики: %1").arg(policy.name));
+                m_rejected.append(it.key());
+                continue;
+            }
+            // JIT-компиляция сейчас, а не при первой проверке в потоке анализа
+            regex.optimize();
+        }
+        if (!compileScope(it.key(), policy.scope)) {
+            LOG_WARNING(QString("Неверная область действия политики: %1").arg(policy.name));
+            m_rejected.append(it.key());
+            continue;
+        }
+        if (policy.isRegex()) {
+            m_compiledPatterns.insert(it.key(), regex);
+        }
+        m_policies.insert(it.key(), policy);
+    }
+
+    buildTriggers();
+    buildRoutes();
+    m_maxMatchLength = m_routes.at(m_allRoute).maxMatchLength;
+    computeVersion();
+}
+
+CompiledPolicySet::FileScope CompiledPolicySet::allPolicies() const
+{
+    FileScope scope;
+    scope.route = m_allRoute;
+    scope.version = m_version;
+    return scope;
+}
+
+// Маршрут выбирается по расширению; путь и размер сверяются только
+// для политик с такими ограничениями. Файл без расширения или с расширением,
+// неизвестным FileClassifier, определен как текст по содержимому
+CompiledPolicySet::FileScope CompiledPolicySet::scopeFor(QStringView filePath, qint64 fileSize) const
+{
+    FileScope scope;
+    scope.route = m_textRoute;
+
+    const QStringView suffix = FileClassifier::suffixOf(filePath);
+    if (!suffix.isEmpty()) {
+        const auto byExtension = m_routeByExtension.isEmpty()
+            ? m_routeByExtension.constEnd() : m_routeByExtension.constFind(suffix.toString().toLower());
+        if (byExtension != m_routeByExtension.constEnd()) {
+            scope.route = byExtension.value();
+        } else if (FileClassifier::isKnownExtension(suffix)) {
+            scope.route = m_defaultRoute;
+        }
+    }
+
+    const Route& route = m_routes.at(scope.route);
+    for (int id : m_conditionalPolicies) {
+        if (!std::binary_search(route.policies.cbegin(), route.policies.cend(), id)) {
+            continue;
+        }
+        const PolicyScope& policyScope = m_policies[id].scope;
+        const bool tooLarge = policyScope.maxFileSize > 0 && fileSize > policyScope.maxFileSize;
+        const auto path = m_pathScopes.constFind(id);
+        if (tooLarge || (path != m_pathScopes.constEnd() && !path->matches(filePath))) {
+            scope.excluded.append(id);
+        }
+    }
+
+    // Без исключений файл проверяется всем маршрутом: версия общая
+    // для всех файлов маршрута
+    if (scope.route == m_allRoute && scope.excluded.isEmpty()) {
+        scope.version = m_version;
+    } else if (m_version != 0) {
+        FastHash hash;
+        hash.addData(&m_version, sizeof(m_version));
+        hash.addData(&scope.route, sizeof(scope.route));
+        hash.addData(scope.excluded.constData(), scope.excluded.size() * sizeof(int));
+        scope.version = qMax<quint64>(hash.result(), 1);
+    }
+    return scope;
+}
+
+bool CompiledPolicySet::PathScope::matches(QStringView filePath) const
+{
+    if (hasPath && path.matchView(filePath).hasMatch()) {
+        return true;
+    }
+    return hasName && name.matchView(filePath.mid(filePath.lastIndexOf(u'/') + 1)).hasMatch();
+}
+
+// Расширения области (с раскрытыми классами) и выражения шаблонов пути
+bool CompiledPolicySet::compileScope(int policyId, const PolicyScope& scope)
+{
+    if (scope.hasFileTypes()) {
+        QSet<QString> extensions;
+        for (const QString& extension : scope.extensions) {
+            extensions.insert(extension);
+        }
+        for (const QString& className : scope.classes) {
+            QStringList classExtensions;
+            if (!FileClassifier::classExtensions(className, classExtensions)) {
+                LOG_WARNING(QString("Неизвестный класс файлов: %1").arg(className));
+                return false;
+            }
+            if (className.compare(QLatin1String("text"), Qt::CaseInsensitive) == 0) {
+                m_textClassPolicies.insert(policyId);
+            }
+            for (const QString& extension : std::as_const(classExtensions)) {
+                extensions.insert(extension);
+            }
+        }
+        m_scopeExtensions.insert(policyId, extensions);
+    }
+
+    if (!scope.paths.isEmpty()) {
+        QStringList pathPatterns;
+        QStringList namePatterns;
+        for (const QString& glob : scope.paths) {
+            (glob.contains('/') ? pathPatterns : namePatterns).append(globToRegex(glob));
+        }
+
+        PathScope paths;
+        if (!pathPatterns.isEmpty()) {
+            paths.path.setPattern(QString("\\A(?:%1)\\z").arg(pathPatterns.join('|')));
+            paths.hasPath = true;
+        }
+        if (!namePatterns.isEmpty()) {
+            // Имена файлов сравниваются без учета регистра, как в exclude_patterns
+            paths.name.setPattern(QString("\\A(?:%1)\\z").arg(namePatterns.join('|')));
+            paths.name.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+            paths.hasName = true;
+        }
+        if (!paths.path.isValid() || !paths.name.isValid()) {
+            return false;
+        }
+        m_pathScopes.insert(policyId, paths);
+    }
+
+    if (scope.isConditional()) {
+        m_conditionalPolicies.append(policyId);
+    }
+    return true;
+}
+
+QList<PolicyMatch> CompiledPolicySet::checkContent(QStringView content, const FileScope& scope) const
+{
+    QList<PolicyMatch> matches;
+
+    if (content.isEmpty()) {
+        LOG_DEBUG("Пустое содержимое для проверки");
+        return matches;
+    }
+
+    const int policyCount = m_routes.at(scope.route).policies.size() - scope.excluded.size();
+    if (policyCount <= 0) {
+        LOG_DEBUG("Нет политик для проверки");
+        return matches;
+    }
+
+    // Ограничение размера проверяемого контента без копирования строки
+    if (content.size() > m_maxContentSize) {
+        content = content.left(m_maxContentSize);
+        LOG_DEBUG(QString("Содержимое обрезано до %1 байт").arg(m_maxContentSize));
+    }
+
+    LOG_DEBUG(QString("Проверка содержимого (%1 байт), политик: %2")
+             .arg(content.size()).arg(policyCount));
+
+    collectMatches(content, 0, 0, content.size(), nullptr, matches, -1, scope);
+    return matches;
+}
+
+void CompiledPolicySet::checkWindow(QStringView window, qint64 windowOffset, qsizetype contextLength,
+                                    qsizetype commitLength,
+                                    QHash<int, qint64>& lastMatchEnd, QList<PolicyMatch>& matches,
+                                    int maxMatches, const FileScope& scope) const
+{
+    collectMatches(window, windowOffset, contextLength, contextLength + commitLength, &lastMatchEnd, matches,
+                   maxMatches, scope);
+}
+
+// Совпадения ищутся с началом в [start, commitEnd). Текст до start - контекст:
+// по нему проверяются \b, ^ и просмотр назад у совпадений в начале окна
+void CompiledPolicySet::collectMatches(QStringView text, qint64 baseOffset, qsizetype start, qsizetype commitEnd,
+                                   QHash<int, qint64>* lastMatchEnd, QList<PolicyMatch>& matches,
+                                   int maxMatches, const FileScope& scope) const
+{
+    // Политики других классов файлов в маршрут не входят; исключенные
+    // по пути или размеру проверяются не в группах и пропускаются здесь
+    const Route& route = m_routes.at(scope.route);
+
+    // Детекторы числовых данных: один проход по цифрам текста на все политики
+    if (!route.detectors.isEmpty()) {
+        QVector<NumericDetector::Hit> hits;
+        route.detectors.scan(text, commitEnd, hits);
+        for (const NumericDetector::Hit& hit : std::as_const(hits)) {
+            if (maxMatches >= 0 && matches.size() >= maxMatches) {
+                return;
+            }
+            // Число, начатое в контексте, проверено предыдущим окном
+            if (hit.start < start || scope.excluded.contains(hit.policyId)) {
+                continue;
+            }
+            const qint64 matchStart = baseOffset + hit.start;
+            if (lastMatchEnd && matchStart < lastMatchEnd->value(hit.policyId, -1)) {
+                continue;
+            }
+            appendMatch(hit.policyId, text.mid(hit.start, hit.end - hit.start).toString(),
+                        matchStart, baseOffset + hit.end, lastMatchEnd, matches);
+        }
+    }
+
+    // Один проход по тексту находит признаки всех отобранных политик;
+    // политика без признака в тексте не запускается вовсе
+    if (!route.filteredPolicies.isEmpty()) {
+        PatternPrefilter::Hits hits;
+        route.prefilter.scan(text, hits);
+        QVector<QPair<qsizetype, qsizetype>> windows;
+        for (int policyId : route.filteredPolicies) {
+            if (scope.excluded.contains(policyId)) {
+                continue;
+            }
+            const PatternTrigger& trigger = m_triggers[policyId];
+            if (!route.prefilter.candidates(trigger, hits, commitEnd, windows)) {
+                continue;
+            }
+            const bool complete = trigger.maxLength < 0
+                ? matchPolicy(policyId, text, baseOffset, start, commitEnd, lastMatchEnd, matches, maxMatches)
+                : matchPolicyWindows(policyId, trigger.maxLength, windows, text, baseOffset, start,
+                                     lastMatchEnd, matches, maxMatches);
+            if (!complete) {
+                return;
+            }
+        }
+    }
+
+    for (int policyId : route.separatePolicies) {
+        if (scope.excluded.contains(policyId)) {
+            continue;
+        }
+        if (!matchPolicy(policyId, text, baseOffset, start, commitEnd, lastMatchEnd, matches, maxMatches)) {
+            return;
+        }
+    }
+
+    // Объединенное выражение находит самое левое совпадение среди политик
+    // группы. Политика этого совпадения проверяется отдельно по всему тексту,
+    // поиск тем же выражением продолжается со следующей позиции; совпадения
+    // уже проверенных политик пропускаются. В позиции, где выиграла
+    // проверенная политика, могут совпадать и непроверенные после нее
+    // в порядке альтернатив (до нее - нет: иначе выиграли бы они) - они
+    // сверяются с этой позицией по отдельности. Выражения собраны заранее,
+    // проверка ничего не компилирует и не берет блокировок
+    for (const CombinedPattern& combined : route.policyGroups) {
+        QVector<bool> checked(combined.groups.size(), false);
+        qsizetype remaining = combined.groups.size();
+        qsizetype from = start;
+
+        while (remaining > 0 && from <= text.size()) {
+            const QRegularExpressionMatch match = combined.regex.matchView(text, from);
+            if (!match.hasMatch() || match.capturedStart() >= commitEnd) {
+                break;
+            }
+            const qsizetype at = match.capturedStart();
+
+            qsizetype winner = -1;
+            for (qsizetype i = 0; i < combined.groups.size(); ++i) {
+                if (match.capturedStart(combined.groups.at(i).first) >= 0) {
+                    winner = i;
+                    break;
+                }
+            }
+            if (winner < 0) {
+                // Альтернатива не определилась - непроверенные политики по отдельности
+                for (qsizetype i = 0; i < combined.groups.size(); ++i) {
+                    if (!checked.at(i) &&
+                        !matchPolicy(combined.groups.at(i).second, text, baseOffset, start, commitEnd,
+                                     lastMatchEnd, matches, maxMatches)) {
+                        return;
+                    }
+                }
+                break;
+            }
+
+            if (checked.at(winner)) {
+                winner = -1;
+                for (qsizetype i = 0; i < combined.groups.size(); ++i) {
+                    if (checked.at(i)) {
+                        continue;
+                    }
+                    const QRegularExpression& single = m_compiledPatterns[combined.groups.at(i).second];
+                    if (single.matchView(text, at, QRegularExpression::NormalMatch,
+                                         QRegularExpression::AnchorAtOffsetMatchOption).hasMatch()) {
+                        winner = i;
+                        break;
+                    }
+                }
+            }
+
+            if (winner >= 0) {
+                if (!matchPolicy(combined.groups.at(winner).second, text, baseOffset, start, commitEnd,
+                                 lastMatchEnd, matches, maxMatches)) {
+                    return;
+                }
+                checked[winner] = true;
+                --remaining;
+                // В той же позиции могут совпадать и следующие альтернативы
+                continue;
+            }
+
+            // Суррогатная пара не разрывается
+            from = at + (at + 1 < text.size() && text.at(at).isHighSurrogate() ? 2 : 1);
+        }
+    }
+}
+
+bool CompiledPolicySet::matchPolicy(int policyId, QStringView text, qint64 baseOffset, qsizetype start,
+                                   qsizetype commitEnd, QHash<int, qint64>* lastMatchEnd,
+                                   QList<PolicyMatch>& matches, int maxMatches) const
+{
+    const QRegularExpression regex = m_compiledPatterns.value(policyId);
+    const qint64 previousEnd = lastMatchEnd ? lastMatchEnd->value(policyId, -1) : -1;
+
+    // Поиск совпадений в тексте
+    QRegularExpressionMatchIterator matchIterator = regex.globalMatchView(text, start);
+
+    while (matchIterator.hasNext()) {
+        if (maxMatches >= 0 && matches.size() >= maxMatches) {
+            return false;
+        }
+
+        QRegularExpressionMatch match = matchIterator.next();
+        if (!match.hasMatch()) {
+            continue;
+        }
+
+        // Совпадение в перекрытии будет целиком видно в следующем окне
+        if (match.capturedStart() >= commitEnd) {
+            break;
+        }
+
+        // Хвост совпадения, уже найденного в предыдущем окне
+        const qint64 matchStart = baseOffset + match.capturedStart();
+        const qint64 matchEnd = baseOffset + match.capturedEnd();
+        if (matchStart < previousEnd) {
+            continue;
+        }
+
+        appendMatch(policyId, match.captured(), matchStart, matchEnd, lastMatchEnd, matches);
+    }
+    return true;
+}
+
+void CompiledPolicySet::appendMatch(int policyId, const QString& content, qint64 start, qint64 end,
+                                QHash<int, qint64>* lastMatchEnd, QList<PolicyMatch>& matches) const
+{
+    const DlpPolicy& policy = m_policies[policyId];
+
+    PolicyMatch policyMatch;
+    policyMatch.policyId = policyId;
+    policyMatch.policyName = policy.name;
+    // У детектора вместо шаблона - вид и параметры: "card" или "card:4,51-55"
+    policyMatch.policyPattern = policy.pattern;
+    if (!policy.isRegex()) {
+        policyMatch.policyPattern = policy.pattern.isEmpty()
+            ? policy.kind : QString("%1:%2").arg(policy.kind, policy.pattern);
+    }
+    policyMatch.severity = policy.severity;
+    policyMatch.matchedContent = content;
+    policyMatch.startPosition = start;
+    policyMatch.endPosition = end;
+
+    matches.append(policyMatch);
+    if (lastMatchEnd) {
+        lastMatchEnd->insert(policyId, end);
+    }
+
+    LOG_DEBUG(QString("Найдено совпадение: %1 -> '%2'")
+             .arg(policy.name).arg(policyMatch.matchedContent));
+}
+
+// Совпадение длиной не больше maxLength, содержащее признак, начинается
+// в одном из окон, поэтому поиск в промежутках между окнами ничего не теряет.
+// Текст обрезается на символ дальше самого длинного совпадения из окна,
+// чтобы \b на конце совпадения видел следующий символ
+bool CompiledPolicySet::matchPolicyWindows(int policyId, int maxLength,
+                                       const QVector<QPair<qsizetype, qsizetype>>& windows,
+                                       QStringView text, qint64 baseOffset, qsizetype start,
+                                       QHash<int, qint64>* lastMatchEnd, QList<PolicyMatch>& matches,
+                                       int maxMatches) const
+{
+    const QRegularExpression regex = m_compiledPatterns.value(policyId);
+    const qint64 previousEnd = lastMatchEnd ? lastMatchEnd->value(policyId, -1) : -1;
+    qsizetype resume = start;
+
+    for (const QPair<qsizetype, qsizetype>& window : windows) {
+        const qsizetype from = qMax(window.first, resume);
+        if (from > window.second) {
+            continue;
+        }
+
+        const QStringView subject = text.left(qMin(text.size(), window.second + maxLength + 1));
+        QRegularExpressionMatchIterator matchIterator = regex.globalMatchView(subject, from);
+
+        while (matchIterator.hasNext()) {
+            if (maxMatches >= 0 && matches.size() >= maxMatches) {
+                return false;
+            }
+
+            QRegularExpressionMatch match = matchIterator.next();
+            if (!match.hasMatch()) {
+                continue;
+            }
+            if (match.capturedStart() > window.second) {
+                break;
+            }
+            // Шаблоны с признаком не совпадают с пустой строкой
+            resume = qMax(match.capturedEnd(), match.capturedStart() + 1);
+
+            const qint64 matchStart = baseOffset + match.capturedStart();
+            const qint64 matchEnd = baseOffset + match.capturedEnd();
+            if (matchStart < previousEnd) {
+                continue;
+            }
+
+            appendMatch(policyId, match.captured(), matchStart, matchEnd, lastMatchEnd, matches);
+        }
+    }
+    return true;
+}
+
+int CompiledPolicySet::computeMaxMatchLength(const QVector<int>& policyIds) const
+{
+    int result = 0;
+    for (int id : policyIds) {
+        const DlpPolicy& policy = m_policies[id];
+        if (!policy.isRegex()) {
+            result = qMax(result, NumericDetector::kMaxLength);
+            continue;
+        }
+        qsizetype pos = 0;
+        const int length = estimateMaxLength(policy.pattern, pos);
+        if (length < 0) {
+            return -1;
+        }
+        result = qMax(result, length);
+    }
+    return result;
+}
+
+namespace {
+// Арифметика длин, где -1 означает "не ограничено"
+int addLength(int a, int b) {
+    return (a < 0 || b < 0) ? -1 : a + b;
+}
+
+int mulLength(int a, int count) {
+    return (a < 0 || count < 0) ? -1 : a * count;
+}
+
+int maxLength(int a, int b) {
+    return (a < 0 || b < 0) ? -1 : qMax(a, b);
+}
+
+int readNumber(QStringView pattern, qsizetype& pos) {
+    int value = -1;
+    while (pos < pattern.size() && pattern.at(pos).isDigit()) {
+        value = qMax(value, 0) * 10 + pattern.at(pos).digitValue();
+        ++pos;
+    }
+    return value;
+}
+}
+
+// Верхняя оценка длины совпадения регулярного выражения (в символах).
+// Разбирается последовательность до ')' или конца шаблона с учетом '|'.
+// Квантификаторы *, + и {n,} дают неограниченную длину, как и обратные ссылки
+int CompiledPolicySet::estimateMaxLength(QStringView pattern, qsizetype& pos)
+{
+    int best = 0;
+    int current = 0;
+
+    while (pos < pattern.size()) {
+        const QChar c = pattern.at(pos);
+        if (c == ')') {
+            break;
+        }
+        if (c == '|') {
+            best = maxLength(best, current);
+            current = 0;
+            ++pos;
+            continue;
+        }
+
+        int atom = 1;
+        if (c == '(') {
+            ++pos;
+            bool zeroWidth = false;
+            if (pos < pattern.size() && pattern.at(pos) == '?') {
+                ++pos;
+                if (pos < pattern.size() && (pattern.at(pos) == '=' || pattern.at(pos) == '!')) {
+                    zeroWidth = true;
+                    ++pos;
+                } else if (pos + 1 < pattern.size() && pattern.at(pos) == '<' &&
+                           (pattern.at(pos + 1) == '=' || pattern.at(pos + 1) == '!')) {
+                    zeroWidth = true;
+                    pos += 2;
+                } else if (pos < pattern.size() && (pattern.at(pos) == '<' || pattern.at(pos) == 'P' ||
+                                                    pattern.at(pos) == '\'')) {
+                    // Именованная группа: (?<name>, (?P<name> или (?'name'
+                    const QChar close = pattern.at(pos) == '\'' ? QChar('\'') : QChar('>');
+                    ++pos;
+                    while (pos < pattern.size() && pattern.at(pos) != close) {
+                        ++pos;
+                    }
+                    ++pos;
+                } else {
+                    // Флаги (?i) или (?i:...)
+                    while (pos < pattern.size() && (pattern.at(pos).isLetter() || pattern.at(pos) == '-')) {
+                        ++pos;
+                    }
+                    if (pos < pattern.size() && pattern.at(pos) == ':') {
+                        ++pos;
+                    }
+                }
+            }
+            atom = estimateMaxLength(pattern, pos);
+            if (zeroWidth) {
+                atom = 0;
+            }
+            ++pos; // ')'
+        } else if (c == '[') {
+            // Класс символов совпадает ровно с одним символом
+            ++pos;
+            if (pos < pattern.size() && pattern.at(pos) == '^') {
+                ++pos;
+            }
+            if (pos < pattern.size() && pattern.at(pos) == ']') {
+                ++pos;
+            }
+            while (pos < pattern.size() && pattern.at(pos) != ']') {
+                pos += pattern.at(pos) == '\\' ? 2 : 1;
+            }
+            ++pos;
+        } else if (c == '\\') {
+            ++pos;
+            const QChar e = pos < pattern.size() ? pattern.at(pos) : QChar();
+            ++pos;
+            if (e.isDigit() || e == 'k' || e == 'g') {
+                atom = -1;
+            } else if (e == 'b' || e == 'B' || e == 'A' || e == 'z' || e == 'Z' || e == 'G') {
+                atom = 0;
+            } else if (pos < pattern.size() && pattern.at(pos) == '{' &&
+                       (e == 'x' || e == 'p' || e == 'P' || e == 'o')) {
+                while (pos < pattern.size() && pattern.at(pos) != '}') {
+                    ++pos;
+                }
+                ++pos;
+            }
+        } else if (c == '^' || c == '$') {
+            atom = 0;
+            ++pos;
+        } else {
+            ++pos;
+        }
+
+        // Квантификатор
+        if (pos < pattern.size()) {
+            const QChar q = pattern.at(pos);
+            if (q == '*' || q == '+') {
+                atom = -1;
+                ++pos;
+            } else if (q == '?') {
+                ++pos;
+            } else if (q == '{') {
+                qsizetype p = pos + 1;
+                const int low = readNumber(pattern, p);
+                int high = low;
+                if (p < pattern.size() && pattern.at(p) == ',') {
+                    ++p;
+                    high = readNumber(pattern, p);
+                }
+                if (low >= 0 && p < pattern.size() && pattern.at(p) == '}') {
+                    atom = mulLength(atom, high);
+                    pos = p + 1;
+                }
+            }
+            // Ленивые и захватывающие формы
+            if (pos < pattern.size() && (pattern.at(pos) == '?' || pattern.at(pos) == '+')) {
+                ++pos;
+            }
+        }
+
+        current = addLength(current, atom);
+    }
+
+    return maxLength(best, current);
+}
+
+
+// Компиляция регулярного выражения с учетом настроек
+bool CompiledPolicySet::compilePattern(const QString& pattern, QRegularExpression& regex) const
+{
+    QRegularExpression::PatternOptions options = QRegularExpression::UseUnicodePropertiesOption;
+
+    if (!m_caseSensitive) {
+        options |= QRegularExpression::CaseInsensitiveOption;
+    }
+
+    regex.setPattern(pattern);
+    regex.setPatternOptions(options);
+
+    if (!regex.isValid()) {
+        LOG_ERROR(QString("Неверное регулярное выражение: %1 (%2)")
+                 .arg(pattern).arg(regex.errorString()));
+        return false;
+    }
+
+    return true;
+}
+
+// Признаки политик для предварительного отбора.
+// Окна вокруг признака строятся по наибольшей длине совпадения; если она
+// не ограничена или совпадение зависит от текста за своим концом (просмотр
+// вперед, конец текста), политика проверяется по всему тексту, но только
+// при наличии признака
+void CompiledPolicySet::buildTriggers()
+{
+    for (auto it = m_policies.constBegin(); it != m_policies.constEnd(); ++it) {
+        if (!it->isRegex()) {
+            continue;
+        }
+        const QString& pattern = it->pattern;
+        PatternTrigger trigger = PatternPrefilter::analyze(pattern);
+        if (!trigger.isValid()) {
+            continue;
+        }
+
+        qsizetype pos = 0;
+        trigger.maxLength = estimateMaxLength(pattern, pos);
+        if (pattern.contains(lookaheadOrEnd())) {
+            trigger.maxLength = -1;
+        }
+        m_triggers.insert(it.key(), trigger);
+    }
+}
+
+
+// Таблица маршрутов. Политики без расширений в области входят во все
+// маршруты; у каждого расширения из областей свой маршрут, прочие известные
+// расширения проверяются только политиками без ограничения. Файл без
+// расширения или с неизвестным FileClassifier расширением доходит до
+// политик, только если его содержимое определено как текст, поэтому его
+// маршрут - политики без ограничения и политики класса text. Так охват
+// политики не зависит от расширений в областях других политик.
+// Расширения с одинаковым набором политик делят один маршрут
+void CompiledPolicySet::buildRoutes()
+{
+    QList<int> ids = m_policies.keys();
+    std::sort(ids.begin(), ids.end());
+    std::sort(m_conditionalPolicies.begin(), m_conditionalPolicies.end());
+
+    QSet<QString> extensions;
+    QVector<int> unscoped;
+    QVector<int> detectedText;
+    for (int id : std::as_const(ids)) {
+        const auto scoped = m_scopeExtensions.constFind(id);
+        if (scoped == m_scopeExtensions.constEnd()) {
+            unscoped.append(id);
+            detectedText.append(id);
+        } else {
+            extensions.unite(*scoped);
+            if (m_textClassPolicies.contains(id)) {
+                detectedText.append(id);
+            }
+        }
+    }
+
+    QHash<QString, int> routeIndex;
+    QHash<QString, CombinedPattern> groupIndex;
+    m_allRoute = addRoute(QVector<int>(ids.begin(), ids.end()), routeIndex, groupIndex);
+    m_defaultRoute = addRoute(unscoped, routeIndex, groupIndex);
+    m_textRoute = addRoute(detectedText, routeIndex, groupIndex);
+
+    for (const QString& extension : std::as_const(extensions)) {
+        QVector<int> policyIds;
+        for (int id : std::as_const(ids)) {
+            const auto scoped = m_scopeExtensions.constFind(id);
+            if (scoped == m_scopeExtensions.constEnd() || scoped->contains(extension)) {
+                policyIds.append(id);
+            }
+        }
+        m_routeByExtension.insert(extension, addRoute(policyIds, routeIndex, groupIndex));
+    }
+
+    if (!m_policies.isEmpty()) {
+        const Route& all = m_routes.at(m_allRoute);
+        LOG_DEBUG(QString("Политик с предварительным отбором: %1 из %2")
+                 .arg(all.filteredPolicies.size()).arg(m_policies.size()));
+        LOG_DEBUG(QString("Объединенных выражений: %1, политик по отдельности: %2")
+                 .arg(all.policyGroups.size()).arg(all.separatePolicies.size()));
+        LOG_DEBUG(QString("Маршрутов политик: %1, расширений в областях: %2, политик без ограничения: %3")
+                 .arg(m_routes.size()).arg(extensions.size()).arg(unscoped.size()));
+    }
+}
+
+
+int CompiledPolicySet::addRoute(const QVector<int>& policyIds, QHash<QString, int>& routeIndex,
+                                QHash<QString, CombinedPattern>& groupIndex)
+{
+    const QString key = policyIdsKey(policyIds);
+    const auto existing = routeIndex.constFind(key);
+    if (existing != routeIndex.constEnd()) {
+        return existing.value();
+    }
+
+    Route route;
+    route.policies = policyIds;
+    buildRoute(route, groupIndex);
+    m_routes.append(route);
+    routeIndex.insert(key, m_routes.size() - 1);
+    return m_routes.size() - 1;
+}
+
+
+// Детекторы, предварительный отбор и группы объединенных выражений маршрута
+void CompiledPolicySet::buildRoute(Route& route, QHash<QString, CombinedPattern>& groupIndex)
+{
+    QVector<int> combinable;
+    for (int id : std::as_const(route.policies)) {
+        const DlpPolicy& policy = m_policies[id];
+        NumericDetector::Kind kind;
+        if (!policy.isRegex()) {
+            if (NumericDetector::kindFromName(policy.kind, kind)) {
+                route.detectors.addPolicy(id, kind, policy.pattern);
+            }
+            continue;
+        }
+
+        const auto trigger = m_triggers.constFind(id);
+        if (trigger != m_triggers.constEnd()) {
+            route.prefilter.add(*trigger);
+            route.filteredPolicies.append(id);
+        } else if (canCombine(policy.pattern) && !policy.scope.isConditional()) {
+            combinable.append(id);
+        } else {
+            route.separatePolicies.append(id);
+        }
+    }
+
+    for (qsizetype i = 0; i < combinable.size(); i += kPoliciesPerGroup) {
+        const QVector<int> group = combinable.mid(i, kPoliciesPerGroup);
+        const QString key = policyIdsKey(group);
+        const auto existing = groupIndex.constFind(key);
+        if (existing != groupIndex.constEnd()) {
+            // Та же группа в другом маршруте: скомпилированное выражение общее
+            route.policyGroups.append(existing.value());
+            continue;
+        }
+
+        CombinedPattern combined;
+        if (!compileCombined(group, combined)) {
+            // Например, одинаковые имена групп в шаблонах разных политик
+            LOG_WARNING(QString("Объединенное выражение не скомпилировано (%1), "
+                                "политики группы проверяются по отдельности")
+                        .arg(combined.regex.errorString()));
+            route.separatePolicies.append(group);
+            continue;
+        }
+        groupIndex.insert(key, combined);
+        route.policyGroups.append(combined);
+    }
+
+    route.maxMatchLength = computeMaxMatchLength(route.policies);
+}
+
+
+bool CompiledPolicySet::compileCombined(const QVector<int>& policyIds, CombinedPattern& combined) const
+{
+    QString pattern;
+    for (int id : policyIds) {
+        if (!pattern.isEmpty()) {
+            pattern += '|';
+        }
+        pattern += QString("(?<%1>%2)").arg(groupName(id), m_policies[id].pattern);
+    }
+
+    if (!compilePattern(pattern, combined.regex)) {
+        return false;
+    }
+    // JIT-компиляция сейчас, а не при первой проверке в потоке анализа
+    combined.regex.optimize();
+
+    const QStringList names = combined.regex.namedCaptureGroups();
+    for (int id : policyIds) {
+        const qsizetype index = names.indexOf(groupName(id));
+        if (index < 0) {
+            return false;
+        }
+        combined.groups.append(qMakePair(static_cast<int>(index), id));
+    }
+    return true;
+}
+
+
+bool CompiledPolicySet::canCombine(const QString& pattern)
+{
+    // Неверное выражение ничего не находит: без проверки любой шаблон
+    // считался бы объединяемым
+    const QRegularExpression& constructs = uncombinableConstructs();
+    if (!constructs.isValid()) {
+        return false;
+    }
+    return !pattern.contains(constructs);
+}
+
+
+// Пересчет отпечатка набора политик.
+// Политики обходятся в порядке id, чтобы отпечаток не зависел от порядка в QHash
+void CompiledPolicySet::computeVersion()
+{
+    QList<int> ids = m_policies.keys();
+    std::sort(ids.begin(), ids.end());
+
+    FastHash hash;
+    const quint8 flags = m_caseSensitive ? 1 : 0;
+    hash.addData(&flags, sizeof(flags));
+    hash.addData(&m_maxContentSize, sizeof(m_maxContentSize));
+
+    for (int id : ids) {
+        const DlpPolicy& policy = m_policies[id];
+        hash.addData(&id, sizeof(id));
+        for (const QString* field : {&policy.pattern, &policy.severity, &policy.name, &policy.kind}) {
+            const qint64 length = field->size();
+            hash.addData(&length, sizeof(length));
+            hash.addData(field->constData(), length * sizeof(QChar));
+        }
+        const PolicyScope& scope = policy.scope;
+        for (const QStringList* list : {&scope.extensions, &scope.classes, &scope.paths}) {
+            const QString joined = list->join('\n');
+            const qint64 length = joined.size();
+            hash.addData(&length, sizeof(length));
+            hash.addData(joined.constData(), length * sizeof(QChar));
+        }
+        hash.addData(&scope.maxFileSize, sizeof(scope.maxFileSize));
+    }
+
+    // 0 зарезервирован для записей без проверки
+    m_version = qMax<quint64>(hash.result(), 1);
+}
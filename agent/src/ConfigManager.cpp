@@ -25,15 +25,40 @@ ConfigManager::ConfigManager(QObject *parent)
 void ConfigManager::initDefaults() {
     m_settings["agent/id"] = generateAgentId();
     m_settings["agent/hostname"] = QHostInfo::localHostName();
-    m_settings["agent/scan_interval"] = 60;
+    m_settings["agent/scan_interval"] = 300;
     m_settings["agent/max_file_size"] = 10*1024*1024;
+    m_settings["agent/state_dir"] = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
 
     m_settings["monitoring/dirs"] = QStringList()
         << QDir::homePath() + "/Documents"
         << QDir::homePath() + "/Desktop";
     m_settings["monitoring/exclude_patterns"] = QStringList()
-        << "*.tmp" << "*.log" << "*.cache";
+        << "*.tmp" << "*.log" << "*.cache" << ".git/" << "node_modules/";
     m_settings["monitoring/recursive"] = true;
+    m_settings["monitoring/backend"] = "auto";
+    m_settings["monitoring/quiet_period_ms"] = 500;
+    m_settings["monitoring/max_latency_ms"] = 5000;
+    m_settings["monitoring/scan_max_interval"] = 3600;
+    m_settings["monitoring/scan_budget_percent"] = 5;
+
+    m_settings["analysis/queue_capacity"] = 4096;
+    m_settings["analysis/overflow_policy"] = "spill";
+    m_settings["analysis/time_budget_ms"] = 20;
+    m_settings["analysis/streaming"] = true;
+    m_settings["analysis/chunk_size"] = 1024 * 1024;
+    m_settings["analysis/max_overlap"] = 4096;
+    m_settings["analysis/worker_threads"] = 0;
+    m_settings["analysis/verdict_cache_size"] = 16384;
+    m_settings["analysis/verdict_cache_stream_limit"] = 8 * 1024 * 1024;
+    m_settings["analysis/append_checkpoints"] = 1024;
+    m_settings["analysis/read_depth"] = 64;
+    m_settings["analysis/io_uring"] = true;
+    m_settings["analysis/priority_paths"] = QStringList()
+        << "~/Desktop=30"
+        << "~/Downloads=20"
+        << "node_modules/=-40"
+        << "/.cache/=-30";
+    m_settings["analysis/priority_aging"] = 5;
 
     m_settings["server/url"] = "http://127.0.0.1:8080";
     m_settings["server/heartbeat_interval"] = 300;
@@ -152,6 +177,11 @@ QStringList ConfigManager::monitorDirs() const {
 }
 
 
+QString ConfigManager::monitorBackend() const {
+    return get("monitoring/backend", "auto").toString();
+}
+
+
 QString ConfigManager::logLevel() const {
     return get("logging/level").toString();
 }
@@ -1,9 +1,29 @@
 #include "../include/ContentAnalyzer.h"
 #include "../include/Logger.h"
-#include <QFile>
-#include <QTextStream>
-#include <QMimeDatabase>
-#include <QMimeType>
+#include "../include/FastHash.h"
+#include "../include/FileClassifier.h"
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+// Предел совпадений на файл: список не растет вместе с размером файла
+constexpr int kMaxMatchesPerFile = 1000;
+// Столько символов начала файла уходит в content_sample события
+constexpr int kContentSampleChars = 1000;
+// Хвост проверенной части, по которому дописанный файл отличается от перезаписанного
+constexpr qint64 kTailHashBytes = 4096;
+
+// Набор политик закрепляется на время анализа одного файла и
+// освобождается при выходе: старый набор не живет дольше проверок
+struct PolicyPin {
+    PolicySet& set;
+    PolicyPin(PolicySet& pinned, PolicyChecker* checker) : set(pinned) {
+        set = checker ? checker->policySet() : PolicySet();
+    }
+    ~PolicyPin() { set.reset(); }
+};
+}
 
 ContentAnalyzer::ContentAnalyzer(QObject* parent)
     : QObject(parent)
@@ -11,125 +31,752 @@ ContentAnalyzer::ContentAnalyzer(QObject* parent)
     , m_sampleSize(50000) // 50KB
     , m_analyzedCount(0)
     , m_totalBytesRead(0)
+    , m_streaming(true)
+    , m_chunkSize(1024 * 1024)
+    , m_maxOverlap(4096)
+    , m_cachePrepassLimit(8 * 1024 * 1024)
+    , m_verdictCache(nullptr)
+    , m_checkpoints(nullptr)
+    , m_chunksScanned(0)
+    , m_chunksReused(0)
+    , m_bytesReused(0)
+    , m_decoder(QStringDecoder::Utf8)
 {
     LOG_DEBUG("ContentAnalyzer инициализирован");
 }
 
-bool ContentAnalyzer::analyzeFile(const QString& filePath, PolicyChecker* checker)
+bool ContentAnalyzer::analyzeFile(const QString& filePath, PolicyChecker* checker, AnalysisResult& result)
 {
-    QFileInfo fileInfo(filePath);
+    result = AnalysisResult();
+    result.filePath = filePath;
+    PolicyPin pin(m_policies, checker);
 
-    if (!fileInfo.exists()) {
-        LOG_ERROR(QString("Файл не существует: %1").arg(filePath));
-        emit analysisError(filePath, "Файл не существует");
-        return false;
+    if (!m_reader.open(filePath)) {
+        if (m_reader.lastErrorCode() == ENOENT) {
+            LOG_ERROR(QString("Файл не существует: %1").arg(filePath));
+            return fail(result, "Файл не существует");
+        }
+        LOG_ERROR(QString("Не удалось открыть файл: %1 (%2)").arg(filePath, m_reader.lastError()));
+        return fail(result, "Не удалось открыть файл");
     }
 
-    if (fileInfo.size() > m_maxFileSize) {
+    result.size = m_reader.fileSize();
+    result.device = m_reader.device();
+    result.inode = m_reader.inode();
+    result.mtimeNs = m_reader.mtimeNs();
+    selectScope(result);
+    if (m_streaming && m_sampleSize > 0 && result.size > m_sampleSize) {
+        return analyzeStream(checker, result);
+    }
+
+    if (result.size > m_maxFileSize) {
+        m_reader.release();
         LOG_DEBUG(QString("Файл слишком большой для анализа: %1 (%2 байт)")
-                 .arg(filePath).arg(fileInfo.size()));
-        emit fileAnalyzed(filePath, false, QList<PolicyMatch>(), fileInfo.size());
+                 .arg(filePath).arg(result.size));
+        result.ok = true;
+        emit fileAnalyzed(result);
         return true;
     }
 
-    if (isBinaryFile(filePath)) {
-        LOG_DEBUG(QString("Бинарный файл пропущен: %1").arg(filePath));
-        emit fileAnalyzed(filePath, false, QList<PolicyMatch>(), fileInfo.size());
+    // Читается только проверяемая часть файла
+    QByteArrayView data;
+    if (!m_reader.read(m_sampleSize > 0 ? m_sampleSize : 0, data)) {
+        LOG_WARNING(QString("Не удалось прочитать содержимое файла: %1 (%2)")
+                    .arg(filePath, m_reader.lastError()));
+        return fail(result, "Не удалось прочитать содержимое");
+    }
+
+    return analyzeData(checker, data, result);
+}
+
+bool ContentAnalyzer::analyzeContent(const QString& filePath, QByteArrayView data, PolicyChecker* checker,
+                                     AnalysisResult& result)
+{
+    result = AnalysisResult();
+    result.filePath = filePath;
+    result.size = data.size();
+    PolicyPin pin(m_policies, checker);
+    selectScope(result);
+
+    if (result.size > m_maxFileSize) {
+        LOG_DEBUG(QString("Файл слишком большой для анализа: %1 (%2 байт)")
+                 .arg(filePath).arg(result.size));
+        result.ok = true;
+        emit fileAnalyzed(result);
         return true;
     }
 
-    QString content = readFileContent(filePath);
+    return analyzeData(checker, data.first(m_sampleSize > 0 ? qMin<qsizetype>(data.size(), m_sampleSize)
+                                                            : data.size()), result);
+}
+
+bool ContentAnalyzer::analyzeData(PolicyChecker* checker, QByteArrayView data, AnalysisResult& result)
+{
+    const QString& filePath = result.filePath;
+    result.contentHash = FastHash::hash(data.data(), data.size());
+    m_totalBytesRead += data.size();
+
+    if (FileClassifier::isBinary(filePath, data)) {
+        return skipBinary(result);
+    }
+
+    // Проверяемые байты уже прочитаны целиком - отпечаток готов до разбора
+    VerdictCache::Key key;
+    if (cacheEnabled(checker)) {
+        key.contentHash = result.contentHash;
+        key.length = data.size();
+        key.policyVersion = m_scope.version;
+        if (takeCached(key, checker, data, result)) {
+            return true;
+        }
+    }
+
+    const QString& content = decodeContent(data);
+    m_reader.release();
+
     if (content.isEmpty()) {
         LOG_WARNING(QString("Не удалось прочитать содержимое файла: %1").arg(filePath));
-        emit analysisError(filePath, "Не удалось прочитать содержимое");
-        return false;
+        return fail(result, "Не удалось прочитать содержимое");
     }
 
-    LOG_DEBUG(QString("Прочитано %1 байт из файла: %2").arg(content.size()).arg(filePath));
-
-    QList<PolicyMatch> matches;
-    bool hasViolations = false;
+    LOG_DEBUG(QString("Прочитано %1 байт из файла: %2").arg(data.size()).arg(filePath));
+    result.contentSample = content.left(kContentSampleChars);
 
     if (checker) {
-        matches = checker->checkContent(content, filePath);
-        hasViolations = !matches.isEmpty();
+        result.matches = m_policies->checkContent(content, m_scope);
+        checker->reportMatches(filePath, result.matches);
+        result.hasViolations = !result.matches.isEmpty();
+        storeVerdict(key, result.matches);
     }
 
     m_analyzedCount++;
-    m_totalBytesRead += content.size();
 
-    emit fileAnalyzed(filePath, hasViolations, matches, fileInfo.size());
+    result.ok = true;
+    emit fileAnalyzed(result);
 
-    LOG_DEBUG(QString("Анализ завершен. Нарушений: %1").arg(matches.size()));
+    LOG_DEBUG(QString("Анализ завершен. Нарушений: %1").arg(result.matches.size()));
     return true;
 }
 
-QString ContentAnalyzer::readFileContent(const QString& filePath) const
+// Политики, применимые к файлу по расширению, пути и размеру
+void ContentAnalyzer::selectScope(AnalysisResult& result)
+{
+    m_scope = m_policies ? m_policies->scopeFor(result.filePath, result.size) : CompiledPolicySet::FileScope();
+    result.policyVersion = m_scope.version;
+}
+
+bool ContentAnalyzer::fail(AnalysisResult& result, const QString& error)
+{
+    m_reader.release();
+    result.error = error;
+    emit analysisError(result.filePath, error);
+    return false;
+}
+
+bool ContentAnalyzer::skipBinary(AnalysisResult& result)
+{
+    m_reader.release();
+    LOG_DEBUG(QString("Бинарный файл пропущен: %1").arg(result.filePath));
+    result.ok = true;
+    result.binary = true;
+    emit fileAnalyzed(result);
+    return true;
+}
+
+bool ContentAnalyzer::cacheEnabled(PolicyChecker* checker) const
+{
+    // Версия 0 - политики еще не загружены
+    return checker && m_verdictCache && m_verdictCache->isEnabled() && m_scope.version != 0;
+}
+
+bool ContentAnalyzer::takeCached(const VerdictCache::Key& key, PolicyChecker* checker,
+                                 QByteArrayView head, AnalysisResult& result)
 {
-    QFile file(filePath);
+    // Попадания и сэкономленные байты считает сам кэш (VerdictCache::logStats)
+    if (!m_verdictCache->lookup(key, result.matches, key.length)) {
+        return false;
+    }
+
+    if (!result.matches.isEmpty() && !restoreMatchedContent(head, result)) {
+        // Файл не дочитан до найденных позиций - проверяется заново
+        result.matches.clear();
+        return false;
+    }
+
+    if (result.contentSample.isEmpty() && !head.isEmpty()) {
+        result.contentSample = decodeSample(head);
+    }
+    m_reader.release();
+    m_analyzedCount++;
+
+    result.cached = true;
+    result.hasViolations = !result.matches.isEmpty();
+    result.ok = true;
+
+    checker->reportMatches(result.filePath, result.matches);
+    emit fileAnalyzed(result);
+
+    LOG_DEBUG(QString("Вердикт взят из кэша: %1 (нарушений: %2)")
+             .arg(result.filePath).arg(result.matches.size()));
+    return true;
+}
 
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        LOG_ERROR(QString("Не удалось открыть файл: %1 (%2)")
-                 .arg(filePath).arg(file.errorString()));
-        return QString();
+void ContentAnalyzer::storeVerdict(const VerdictCache::Key& key, const QList<PolicyMatch>& matches)
+{
+    // Файл проверен набором, версия которого в ключе, даже если за время
+    // проверки опубликован новый
+    if (key.policyVersion != 0) {
+        m_verdictCache->insert(key, matches);
     }
+}
 
-    QTextStream stream(&file);
+// Кэш вердиктов хранит только позиции совпадений. Текст берется из уже
+// прочитанных байт или из файла, который читается только до конца
+// последнего совпадения
+bool ContentAnalyzer::restoreMatchedContent(QByteArrayView head, AnalysisResult& result)
+{
+    qint64 textEnd = 0;
+    for (const PolicyMatch& match : std::as_const(result.matches)) {
+        textEnd = qMax(textEnd, match.endPosition);
+    }
 
-    QString content;
-    if (m_sampleSize > 0) {
-        content = stream.read(m_sampleSize);
+    if (!head.isEmpty()) {
+        decodeContent(head);
     } else {
-        content = stream.readAll();
+        m_decoder.resetState();
+        m_text.truncate(0);
+        qint64 offset = 0;
+        while (m_text.size() < textEnd && offset < result.size) {
+            QByteArrayView chunk;
+            if (!m_reader.readChunk(offset, qMin(m_chunkSize, result.size - offset), chunk) || chunk.isEmpty()) {
+                break;
+            }
+            appendDecoded(chunk);
+            offset += chunk.size();
+            m_totalBytesRead += chunk.size();
+        }
+    }
+    if (m_text.size() < textEnd) {
+        return false;
     }
 
-    file.close();
-    return content;
+    for (PolicyMatch& match : result.matches) {
+        match.matchedContent = m_text.mid(match.startPosition, match.endPosition - match.startPosition);
+    }
+    return true;
 }
 
-bool ContentAnalyzer::isBinaryFile(const QString& filePath) const
+QString ContentAnalyzer::decodeSample(QByteArrayView head)
 {
-    QMimeDatabase mimeDb;
-    QMimeType mimeType = mimeDb.mimeTypeForFile(filePath);
-    QString mimeName = mimeType.name();
+    // Символ UTF-8 занимает не больше 4 байт
+    return decodeContent(head.first(qMin<qsizetype>(head.size(), kContentSampleChars * 4)))
+        .left(kContentSampleChars);
+}
 
-    if (mimeName.startsWith("text/") || mimeName == "application/json" ||
-        mimeName == "application/xml") {
+bool ContentAnalyzer::hashStream(AnalysisResult& result, VerdictCache::Key& key)
+{
+    FastHash hasher;
+    qint64 offset = 0;
+
+    while (offset < result.size) {
+        QByteArrayView chunk;
+        if (!m_reader.readChunk(offset, qMin(m_chunkSize, result.size - offset), chunk)) {
+            LOG_WARNING(QString("Ошибка чтения файла: %1 (%2)").arg(result.filePath, m_reader.lastError()));
+            return fail(result, "Не удалось прочитать содержимое");
+        }
+        if (chunk.isEmpty()) {
+            break;
+        }
+
+        if (offset == 0) {
+            if (FileClassifier::isBinary(result.filePath, chunk)) {
+                result.contentHash = FastHash::hash(chunk.data(), chunk.size());
+                return skipBinary(result);
+            }
+            // Буфер чтения переиспользуется, образец берется сразу
+            result.contentSample = decodeSample(chunk);
+        }
+
+        hasher.addData(chunk.data(), chunk.size());
+        offset += chunk.size();
+        m_totalBytesRead += chunk.size();
+    }
+
+    key.contentHash = hasher.result();
+    key.length = offset;
+    return true;
+}
+
+const QString& ContentAnalyzer::decodeContent(QByteArrayView data)
+{
+    // Емкость строки сохраняется между файлами, поэтому для файлов
+    // не больше размера выборки память заново не выделяется
+    m_decoder.resetState();
+    m_text.resize(m_decoder.requiredSpace(data.size()));
+    QChar* end = m_decoder.appendToBuffer(m_text.data(), data);
+    m_text.truncate(end - m_text.constData());
+    return m_text;
+}
+
+bool ContentAnalyzer::analyzeStream(PolicyChecker* checker, AnalysisResult& result)
+{
+    // Файл только дописан: проверяется новая часть, чтение префикса не нужно
+    if (m_checkpoints && checker && m_scope.version != 0) {
+        ScanCheckpoint checkpoint;
+        if (findAppend(checker, result, checkpoint)) {
+            return scanStream(checker, result, &checkpoint, nullptr);
+        }
+        if (!result.error.isEmpty()) {
+            return false;
+        }
+    }
+
+    // Отпечаток всего файла нужен до проверки, то есть отдельным проходом
+    // чтения. Он дешев только для файлов до m_cachePrepassLimit: разбор
+    // повторно читает их из страничного кэша. Файлы больше читаются один
+    // раз, отпечаток считается во время разбора, кэш не используется
+    VerdictCache::Key key;
+    const bool useCache = cacheEnabled(checker) && result.size <= m_cachePrepassLimit;
+    if (useCache) {
+        key.policyVersion = m_scope.version;
+        if (!hashStream(result, key)) {
+            return false;
+        }
+        if (result.binary || takeCached(key, checker, QByteArrayView(), result)) {
+            return true;
+        }
+    }
+
+    return scanStream(checker, result, nullptr, useCache ? &key : nullptr);
+}
+
+bool ContentAnalyzer::findAppend(PolicyChecker* checker, AnalysisResult& result, ScanCheckpoint& checkpoint)
+{
+    if (!m_checkpoints->lookup(result.filePath, checkpoint)) {
         return false;
     }
 
-    QStringList textExtensions = getTextFileExtensions();
-    QString extension = QFileInfo(filePath).suffix().toLower();
+    if (checkpoint.device != m_reader.device() || checkpoint.inode != m_reader.inode() ||
+        checkpoint.policyVersion != m_scope.version ||
+        result.size <= checkpoint.scannedBytes) {
+        // Файл заменен, усечен или перезаписан без роста - полная проверка
+        m_checkpoints->remove(result.filePath);
+        return false;
+    }
 
-    if (textExtensions.contains(extension)) {
+    QByteArrayView tail;
+    if (!m_reader.readChunk(checkpoint.scannedBytes - checkpoint.tailLength, checkpoint.tailLength, tail)) {
+        LOG_WARNING(QString("Ошибка чтения файла: %1 (%2)").arg(result.filePath, m_reader.lastError()));
+        fail(result, "Не удалось прочитать содержимое");
         return false;
     }
+    if (tail.size() != checkpoint.tailLength ||
+        FastHash::hash(tail.data(), tail.size()) != checkpoint.tailHash) {
+        m_checkpoints->remove(result.filePath);
+        return false;
+    }
+    // Точка из журнала: несвернутые байты отпечатка - конец того же хвоста
+    if (!checkpoint.hasherState.isEmpty() &&
+        !checkpoint.hasher.restoreState(checkpoint.hasherState, tail.last(checkpoint.scannedBytes % 32))) {
+        m_checkpoints->remove(result.filePath);
+        return false;
+    }
+
+    LOG_DEBUG(QString("Файл дописан, проверяется только новая часть: %1 (%2 -> %3 байт)")
+             .arg(result.filePath).arg(checkpoint.scannedBytes).arg(result.size));
+    return true;
+}
 
-    QFile file(filePath);
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray data = file.read(1024);
-        file.close();
+bool ContentAnalyzer::scanStream(PolicyChecker* checker, AnalysisResult& result,
+                                 const ScanCheckpoint* resume, const VerdictCache::Key* key)
+{
+    const QString& filePath = result.filePath;
+    const qint64 fileSize = result.size;
 
-        int nullCount = 0;
-        for (char c : data) {
-            if (c == '\0') {
-                nullCount++;
+    // Перекрытие равно наибольшей длине совпадения: совпадение, начатое
+    // в конце фрагмента, целиком видно вместе с началом следующего
+    int overlap = checker ? m_policies->maxMatchLength(m_scope) : 0;
+    if (overlap < 0 || overlap > m_maxOverlap) {
+        overlap = m_maxOverlap;
+    }
+
+    // Прошлый разбор этого файла: фрагменты с тем же хэшем не проверяются
+    ChunkReuse reuse;
+    if (!resume && m_checkpoints && checker &&
+        m_checkpoints->lookup(filePath, reuse.previous) &&
+        reuse.previous.policyVersion == m_scope.version) {
+        reuse.index.reserve(reuse.previous.chunks.size());
+        for (int i = 0; i < reuse.previous.chunks.size(); ++i) {
+            reuse.index.insert(reuse.previous.chunks.at(i).hash, i);
+        }
+    }
+
+    QVector<ContentChunk> chunks;
+    ContentChunk open;
+    if (resume) {
+        // Дописанный файл: все фрагменты, кроме последнего, остаются как были
+        chunks = resume->chunks;
+        open.byteStart = chunks.isEmpty() ? 0 : chunks.last().byteStart;
+        open.charStart = chunks.isEmpty() ? 0 : chunks.last().charStart;
+        if (!chunks.isEmpty()) {
+            chunks.removeLast();
+        }
+        result.contentSample = resume->contentSample;
+        if (result.contentSample.isEmpty()) {
+            // Выборка в журнал не пишется - берется из начала файла
+            QByteArrayView head;
+            if (!m_reader.readChunk(0, qMin<qint64>(fileSize, kContentSampleChars * 4), head)) {
+                LOG_WARNING(QString("Ошибка чтения файла: %1 (%2)").arg(filePath, m_reader.lastError()));
+                return fail(result, "Не удалось прочитать содержимое");
+            }
+            result.contentSample = decodeSample(head);
+        }
+    }
+    int finalized = chunks.size();
+    int matchCount = 0;
+    QHash<int, qint64> lastMatchEnd;
+    for (const ContentChunk& chunk : std::as_const(chunks)) {
+        matchCount += chunk.matches.size();
+        // Совпадение из сохраненного фрагмента, заходящее в заново
+        // проверяемый, не должно быть найдено второй раз
+        for (const PolicyMatch& match : chunk.matches) {
+            const qint64 end = chunk.charStart + match.endPosition;
+            if (end > lastMatchEnd.value(match.policyId, -1)) {
+                lastMatchEnd.insert(match.policyId, end);
             }
         }
+    }
 
-        if (data.size() > 0 && (nullCount * 100 / data.size()) > 1) {
-            return true;
+    qint64 offset = open.byteStart;
+    // Позиция первого символа m_text от начала файла
+    qint64 textOffset = open.charStart;
+    // Дописанные байты продолжают отпечаток, посчитанный по проверенной части
+    FastHash hasher = resume ? resume->hasher : FastHash();
+    const qint64 hashFrom = resume ? resume->scannedBytes : 0;
+    FastHash chunkHasher;
+    bool complete = true;
+
+    LOG_DEBUG(QString("Потоковый анализ: %1 (%2 байт с позиции %3, фрагмент чтения %4, перекрытие %5)")
+             .arg(filePath).arg(fileSize).arg(offset).arg(m_chunkSize).arg(overlap));
+
+    m_chunker.reset();
+    m_decoder.resetState();
+    m_text.truncate(0);
+
+    if (open.byteStart > 0 && overlap > 0 && !readContext(open, overlap, textOffset)) {
+        return fail(result, "Не удалось прочитать содержимое");
+    }
+
+    while (offset < fileSize && complete) {
+        QByteArrayView chunk;
+        if (!m_reader.readChunk(offset, qMin(m_chunkSize, fileSize - offset), chunk)) {
+            LOG_WARNING(QString("Ошибка чтения файла: %1 (%2)").arg(filePath, m_reader.lastError()));
+            return fail(result, "Не удалось прочитать содержимое");
+        }
+        if (chunk.isEmpty()) {
+            // Файл укоротили во время чтения
+            break;
+        }
+
+        if (offset == 0 && !key && FileClassifier::isBinary(filePath, chunk)) {
+            result.contentHash = FastHash::hash(chunk.data(), chunk.size());
+            return skipBinary(result);
+        }
+
+        if (offset + chunk.size() > hashFrom) {
+            const qint64 skip = qMax<qint64>(0, hashFrom - offset);
+            hasher.addData(chunk.data() + skip, chunk.size() - skip);
+        }
+        m_totalBytesRead += chunk.size();
+
+        // В буфере остается текст еще не проверенных фрагментов и перекрытие перед ними
+        const qint64 pendingStart = finalized < chunks.size() ? chunks.at(finalized).charStart : open.charStart;
+        const qsizetype dropped = static_cast<qsizetype>(qBound<qint64>(0, pendingStart - overlap - textOffset, m_text.size()));
+        if (dropped > 0) {
+            const qsizetype keep = m_text.size() - dropped;
+            memmove(m_text.data(), m_text.constData() + dropped, keep * sizeof(QChar));
+            m_text.truncate(keep);
+            textOffset += dropped;
+        }
+
+        // Разбиение на фрагменты по содержимому; каждый декодируется отдельно
+        qsizetype pos = 0;
+        while (pos < chunk.size()) {
+            bool boundary = false;
+            const qsizetype length = m_chunker.next(chunk.data() + pos, chunk.size() - pos, boundary);
+            chunkHasher.addData(chunk.data() + pos, length);
+            appendDecoded(chunk.sliced(pos, length));
+            pos += length;
+
+            if (boundary) {
+                open.byteLength = offset + pos - open.byteStart;
+                open.charLength = textOffset + m_text.size() - open.charStart;
+                open.hash = chunkHasher.result();
+                chunks.append(open);
+
+                open = ContentChunk();
+                open.byteStart = offset + pos;
+                open.charStart = textOffset + m_text.size();
+                chunkHasher.reset();
+            }
+        }
+        offset += chunk.size();
+
+        if (textOffset == 0 && result.contentSample.isEmpty()) {
+            result.contentSample = m_text.left(kContentSampleChars);
+        }
+
+        // Последний завершенный фрагмент ждет следующего: совпадения на стыке
+        while (finalized < chunks.size() - 1) {
+            finalizeChunk(checker, chunks, finalized, textOffset, overlap, reuse, lastMatchEnd);
+            matchCount += chunks.at(finalized).matches.size();
+            ++finalized;
+            if (matchCount >= kMaxMatchesPerFile) {
+                LOG_DEBUG(QString("Достигнут предел совпадений, анализ остановлен: %1").arg(filePath));
+                complete = false;
+                break;
+            }
+        }
+    }
+
+    if (complete) {
+        if (offset > open.byteStart) {
+            open.byteLength = offset - open.byteStart;
+            open.charLength = textOffset + m_text.size() - open.charStart;
+            open.hash = chunkHasher.result();
+            chunks.append(open);
+        }
+        while (finalized < chunks.size()) {
+            finalizeChunk(checker, chunks, finalized, textOffset, overlap, reuse, lastMatchEnd);
+            ++finalized;
+        }
+    }
+
+    result.matches.clear();
+    for (int i = 0; i < finalized && result.matches.size() < kMaxMatchesPerFile; ++i) {
+        if (!restoreChunkContent(chunks[i], fileSize)) {
+            LOG_WARNING(QString("Ошибка чтения файла: %1 (%2)").arg(filePath, m_reader.lastError()));
+            return fail(result, "Не удалось прочитать содержимое");
+        }
+        const ContentChunk& contentChunk = chunks.at(i);
+        for (PolicyMatch match : contentChunk.matches) {
+            match.startPosition += contentChunk.charStart;
+            match.endPosition += contentChunk.charStart;
+            result.matches.append(match);
         }
     }
 
+    // При остановке по пределу совпадений отпечаток покрывает только прочитанное
+    result.contentHash = hasher.result();
+    result.hasViolations = !result.matches.isEmpty();
+    result.ok = true;
+
+    if (key) {
+        // Файл могли изменить между проходами: сохраняется только вердикт
+        // для тех же байт, по которым посчитан ключ
+        if (complete && offset == key->length && result.contentHash == key->contentHash) {
+            storeVerdict(*key, result.matches);
+        }
+        result.contentHash = key->contentHash;
+    }
+
+    if (m_checkpoints && checker) {
+        if (complete && offset == fileSize) {
+            saveCheckpoint(checker, result, hasher, chunks);
+        } else {
+            m_checkpoints->remove(filePath);
+        }
+    }
+
+    m_reader.release();
+    m_analyzedCount++;
+
+    if (checker) {
+        checker->reportMatches(filePath, result.matches);
+    }
+    emit fileAnalyzed(result);
+
+    LOG_DEBUG(QString("Потоковый анализ завершен. Нарушений: %1, фрагментов: %2, без повторной проверки: %3")
+             .arg(result.matches.size()).arg(chunks.size()).arg(reuse.reused));
     return true;
 }
 
-QStringList ContentAnalyzer::getTextFileExtensions() const
+void ContentAnalyzer::finalizeChunk(PolicyChecker* checker, QVector<ContentChunk>& chunks, int index,
+                                    qint64 textOffset, int overlap, ChunkReuse& reuse,
+                                    QHash<int, qint64>& lastMatchEnd)
 {
-    return QStringList()
-        << "txt" << "log" << "csv" << "json" << "xml" << "html" << "htm"
-        << "js" << "css" << "cpp" << "h" << "py" << "java" << "cs"
-        << "php" << "rb" << "go" << "rs" << "md" << "ini" << "conf"
-        << "yaml" << "yml" << "sql" << "sh" << "bat" << "ps1";
-}
\ No newline at end of file
+    if (!checker) {
+        return;
+    }
+
+    ContentChunk& chunk = chunks[index];
+    const ContentChunk* next = index + 1 < chunks.size() ? &chunks.at(index + 1) : nullptr;
+    const qint64 chunkEnd = chunk.charStart + chunk.charLength;
+    // Начало следующего фрагмента - для совпадений, выходящих за конец этого
+    const qint64 forward = next ? qMin<qint64>(overlap, next->charLength) : 0;
+
+    const int previousIndex = reuse.find(chunk);
+    if (previousIndex >= 0) {
+        // Содержимое не изменилось: совпадения переносятся без проверки.
+        // Выходящие за конец фрагмента верны, только если за ним тот же сосед
+        const bool sameNeighbour = next ? reuse.find(*next) == previousIndex + 1
+                                        : previousIndex == reuse.previous.chunks.size() - 1;
+        for (const PolicyMatch& match : reuse.previous.chunks.at(previousIndex).matches) {
+            if (match.endPosition <= chunk.charLength || sameNeighbour) {
+                chunk.matches.append(match);
+                // Следующий фрагмент не должен повторить хвост перенесенного совпадения
+                const qint64 end = chunk.charStart + match.endPosition;
+                if (end > lastMatchEnd.value(match.policyId, -1)) {
+                    lastMatchEnd.insert(match.policyId, end);
+                }
+            }
+        }
+
+        if (next && !sameNeighbour) {
+            // Стык с новым соседом проверяется заново. Совпадения, уже
+            // перенесенные из фрагмента, отсекает lastMatchEnd; новые
+            // продвигают его для следующего фрагмента
+            const qint64 back = qMin<qint64>(overlap, chunk.charLength);
+            const qint64 seamStart = chunkEnd - back;
+            const qint64 context = qMin<qint64>(overlap, seamStart - textOffset);
+            QList<PolicyMatch> found;
+            m_policies->checkWindow(QStringView(m_text).mid(seamStart - context - textOffset, context + back + forward),
+                                    seamStart - context, context, back, lastMatchEnd, found,
+                                    kMaxMatchesPerFile, m_scope);
+            for (PolicyMatch match : std::as_const(found)) {
+                if (match.endPosition > chunkEnd) {
+                    match.startPosition -= chunk.charStart;
+                    match.endPosition -= chunk.charStart;
+                    chunk.matches.append(match);
+                }
+            }
+        }
+
+        reuse.reused++;
+        m_chunksReused++;
+        m_bytesReused += chunk.byteLength;
+        return;
+    }
+
+    // Окно начинается с перекрытия перед фрагментом: в буфере оно сохраняется,
+    // и \b или просмотр назад в начале фрагмента видят предыдущий текст
+    const qint64 context = qMin<qint64>(overlap, chunk.charStart - textOffset);
+    QList<PolicyMatch> found;
+    m_policies->checkWindow(QStringView(m_text).mid(chunk.charStart - context - textOffset,
+                                                    context + chunk.charLength + forward),
+                            chunk.charStart - context, context, chunk.charLength, lastMatchEnd, found,
+                            kMaxMatchesPerFile, m_scope);
+    for (PolicyMatch& match : found) {
+        match.startPosition -= chunk.charStart;
+        match.endPosition -= chunk.charStart;
+    }
+    chunk.matches = found;
+    m_chunksScanned++;
+}
+
+// Совпадения фрагментов из журнала точек продолжения хранятся без текста:
+// он декодируется из байт фрагмента, которые читаются до конца последнего
+// совпадения. Буфер текста к этому моменту уже не нужен
+bool ContentAnalyzer::restoreChunkContent(ContentChunk& chunk, qint64 fileSize)
+{
+    qint64 textEnd = 0;
+    for (const PolicyMatch& match : std::as_const(chunk.matches)) {
+        if (match.matchedContent.isEmpty()) {
+            textEnd = qMax(textEnd, match.endPosition);
+        }
+    }
+    if (textEnd == 0) {
+        return true;
+    }
+
+    // Символ UTF-16 занимает не больше 3 байт UTF-8
+    const qint64 length = qMin(fileSize - chunk.byteStart, textEnd * 3);
+    QByteArrayView bytes;
+    if (length <= 0 || !m_reader.readChunk(chunk.byteStart, length, bytes)) {
+        return false;
+    }
+    m_totalBytesRead += bytes.size();
+    const QString& text = decodeContent(bytes);
+    if (text.size() < textEnd) {
+        return false;
+    }
+
+    for (PolicyMatch& match : chunk.matches) {
+        if (match.matchedContent.isEmpty()) {
+            match.matchedContent = text.mid(match.startPosition, match.endPosition - match.startPosition);
+        }
+    }
+    return true;
+}
+
+// Текст перед продолжаемым фрагментом: \b, просмотр назад и проверка
+// границ числа в начале фрагмента должны видеть предыдущие символы
+bool ContentAnalyzer::readContext(const ContentChunk& open, int overlap, qint64& textOffset)
+{
+    // Символ UTF-16 занимает не больше 3 байт UTF-8 (суррогатная пара - 4 на два)
+    const qint64 length = qMin<qint64>(open.byteStart, qint64(overlap) * 3);
+    QByteArrayView bytes;
+    if (!m_reader.readChunk(open.byteStart - length, length, bytes) || bytes.size() != length) {
+        LOG_WARNING(QString("Ошибка чтения файла: %1").arg(m_reader.lastError()));
+        return false;
+    }
+
+    // Начало могло попасть в середину многобайтового символа
+    qsizetype skip = 0;
+    if (length < open.byteStart) {
+        while (skip < bytes.size() && (static_cast<quint8>(bytes.at(skip)) & 0xC0) == 0x80) {
+            ++skip;
+        }
+    }
+    appendDecoded(bytes.sliced(skip));
+    m_decoder.resetState();
+
+    if (m_text.size() > overlap) {
+        m_text.remove(0, m_text.size() - overlap);
+    }
+    textOffset = open.charStart - m_text.size();
+    return true;
+}
+
+int ContentAnalyzer::ChunkReuse::find(const ContentChunk& chunk) const
+{
+    const int i = index.value(chunk.hash, -1);
+    if (i < 0) {
+        return -1;
+    }
+    const ContentChunk& stored = previous.chunks.at(i);
+    return stored.byteLength == chunk.byteLength && stored.charLength == chunk.charLength ? i : -1;
+}
+
+void ContentAnalyzer::appendDecoded(QByteArrayView bytes)
+{
+    const qsizetype size = m_text.size();
+    m_text.resize(size + m_decoder.requiredSpace(bytes.size()));
+    QChar* end = m_decoder.appendToBuffer(m_text.data() + size, bytes);
+    m_text.truncate(end - m_text.constData());
+}
+
+void ContentAnalyzer::saveCheckpoint(PolicyChecker* checker, const AnalysisResult& result,
+                                     const FastHash& hasher, const QVector<ContentChunk>& chunks)
+{
+    const qint64 endByte = result.size;
+    const qint64 tailLength = qMin(endByte, kTailHashBytes);
+
+    QByteArrayView tail;
+    if (!m_reader.readChunk(endByte - tailLength, tailLength, tail) || tail.size() != tailLength) {
+        m_checkpoints->remove(result.filePath);
+        return;
+    }
+
+    ScanCheckpoint checkpoint;
+    checkpoint.device = m_reader.device();
+    checkpoint.inode = m_reader.inode();
+    checkpoint.policyVersion = m_scope.version;
+    checkpoint.scannedBytes = endByte;
+    checkpoint.tailLength = tailLength;
+    checkpoint.tailHash = FastHash::hash(tail.data(), tail.size());
+    checkpoint.hasher = hasher;
+    checkpoint.chunks = chunks;
+    checkpoint.contentSample = result.contentSample;
+    m_checkpoints->store(result.filePath, checkpoint);
+}
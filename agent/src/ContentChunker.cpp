@@ -0,0 +1,165 @@
+#include "../include/ContentChunker.h"
+
+#include <array>
+#include <cstring>
+
+namespace {
+// Таблица gear-хэша: постоянная, иначе границы фрагментов менялись бы
+// между запусками агента
+std::array<quint64, 256> makeGearTable() {
+    std::array<quint64, 256> table{};
+    quint64 state = 0x2545F4914F6CDD1DULL;
+    for (quint64& value : table) {
+        // splitmix64
+        state += 0x9E3779B97F4A7C15ULL;
+        quint64 z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}
+
+const std::array<quint64, 256>& gearTable() {
+    static const std::array<quint64, 256> table = makeGearTable();
+    return table;
+}
+
+// Маска из старших бит: при сдвиге влево они зависят от последних 64 байт
+quint64 topBitsMask(int bits) {
+    bits = qBound(1, bits, 63);
+    return ~quint64(0) << (64 - bits);
+}
+
+int log2Floor(qint64 value) {
+    int bits = 0;
+    while (value > 1) {
+        value >>= 1;
+        ++bits;
+    }
+    return bits;
+}
+
+inline bool isContinuationByte(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+// Продолжение символа UTF-8 - не больше трех байт
+constexpr int kMaxContinuationBytes = 3;
+}
+
+ContentChunker::ContentChunker(qint64 minSize, qint64 averageSize, qint64 maxSize)
+    : m_minSize(minSize)
+    , m_averageSize(qMax(averageSize, minSize))
+    , m_maxSize(qMax(maxSize, averageSize))
+    , m_hash(0)
+    , m_size(0)
+    , m_pendingContinuation(0)
+    , m_tailLength(0)
+{
+    // Нормализация: до среднего размера граница ставится реже, после - чаще,
+    // и размеры фрагментов собираются ближе к среднему
+    const int bits = log2Floor(m_averageSize);
+    m_maskSmall = topBitsMask(bits + 2);
+    m_maskLarge = topBitsMask(bits - 2);
+}
+
+void ContentChunker::reset() {
+    m_hash = 0;
+    m_size = 0;
+    m_pendingContinuation = 0;
+    m_tailLength = 0;
+}
+
+qsizetype ContentChunker::next(const char* data, qsizetype length, bool& boundary) {
+    const std::array<quint64, 256>& gear = gearTable();
+    boundary = false;
+
+    if (m_pendingContinuation > 0) {
+        // Граница найдена в конце прошлого блока: фрагмент заканчивается
+        // после продолжения символа
+        qsizetype i = 0;
+        while (m_pendingContinuation > 0 && i < length && isContinuationByte(data[i])) {
+            --m_pendingContinuation;
+            ++i;
+        }
+        if (m_pendingContinuation > 0 && i == length) {
+            m_size += length;
+            keepTail(data, length);
+            return length;
+        }
+        boundary = true;
+        reset();
+        return i;
+    }
+
+    qsizetype i = 0;
+    while (i < length) {
+        m_hash = (m_hash << 1) + gear[static_cast<unsigned char>(data[i])];
+        ++m_size;
+        ++i;
+
+        if (m_size < m_minSize) {
+            continue;
+        }
+        const quint64 mask = m_size < m_averageSize ? m_maskSmall : m_maskLarge;
+        if ((m_hash & mask) == 0 || m_size >= m_maxSize) {
+            boundary = true;
+            break;
+        }
+    }
+
+    if (!boundary) {
+        keepTail(data, length);
+        return length;
+    }
+
+    // Хвост символа остается в этом фрагменте: фрагменты декодируются независимо
+    for (int extra = 0; extra < kMaxContinuationBytes && i < length && isContinuationByte(data[i]); ++extra) {
+        ++i;
+    }
+    if (i == length) {
+        const int missing = missingContinuation(data, i);
+        if (missing > 0) {
+            // Продолжение придет в следующем блоке (readChunk), граница - после него
+            boundary = false;
+            m_pendingContinuation = missing;
+            keepTail(data, length);
+            return length;
+        }
+    }
+    reset();
+    return i;
+}
+
+int ContentChunker::missingContinuation(const char* data, qsizetype end) const {
+    // Байты перед end с конца; у границы близко к началу блока - и хвост прошлого
+    unsigned char last[kMaxContinuationBytes + 1];
+    int count = 0;
+    for (qsizetype j = end - 1; j >= 0 && count <= kMaxContinuationBytes; --j) {
+        last[count++] = static_cast<unsigned char>(data[j]);
+    }
+    for (int j = m_tailLength - 1; j >= 0 && count <= kMaxContinuationBytes; --j) {
+        last[count++] = static_cast<unsigned char>(m_tail[j]);
+    }
+
+    for (int k = 0; k < count; ++k) {
+        const unsigned char c = last[k];
+        if ((c & 0xC0) == 0x80) {
+            continue;
+        }
+        const int sequence = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        return qMax(0, sequence - 1 - k);
+    }
+    return 0;
+}
+
+void ContentChunker::keepTail(const char* data, qsizetype length) {
+    for (qsizetype j = qMax<qsizetype>(0, length - kMaxContinuationBytes); j < length; ++j) {
+        if (m_tailLength == kMaxContinuationBytes) {
+            std::memmove(m_tail, m_tail + 1, kMaxContinuationBytes - 1);
+            --m_tailLength;
+        }
+        m_tail[m_tailLength++] = data[j];
+    }
+}
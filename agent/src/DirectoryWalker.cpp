@@ -0,0 +1,363 @@
+#include "../include/DirectoryWalker.h"
+#include "../include/Logger.h"
+#include <QFile>
+#include <QThread>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+struct LinuxDirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+constexpr size_t kDirentBufferSize = 64 * 1024;
+// Сколько каталогов может ждать в очередях с уже открытым дескриптором;
+// остальные открываются по пути, чтобы не упереться в RLIMIT_NOFILE
+constexpr int kMaxQueuedDirFds = 256;
+
+struct DirTask {
+    int fd;
+    QString path;
+};
+
+struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<DirTask> tasks;
+};
+
+struct WalkContext {
+    explicit WalkContext(int workers) : queues(workers) {}
+
+    std::vector<WorkerQueue> queues;
+    std::atomic<qint64> pending{0};
+    std::atomic<int> queuedFds{0};
+    std::atomic<qint64> files{0};
+
+    const DirectoryWalker::EntryCallback* callback = nullptr;
+    const DirectoryWalker::DirectoryFilter* dirFilter = nullptr;
+    const std::atomic<bool>* cancelled = nullptr;
+    bool recursive = true;
+};
+
+void pushTask(WalkContext& ctx, int worker, DirTask task) {
+    ctx.pending.fetch_add(1, std::memory_order_acq_rel);
+    WorkerQueue& queue = ctx.queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+}
+
+// Свою очередь поток разбирает с конца (глубина, горячий кэш dentry)
+bool popLocal(WalkContext& ctx, int worker, DirTask& task) {
+    WorkerQueue& queue = ctx.queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+// Чужие очереди - с начала, там каталоги ближе к корню и крупнее по объему работы
+bool steal(WalkContext& ctx, int worker, DirTask& task) {
+    const int count = static_cast<int>(ctx.queues.size());
+    for (int i = 1; i < count; ++i) {
+        WorkerQueue& queue = ctx.queues[(worker + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void fillEntry(WalkEntry& entry, const struct stat& st) {
+    entry.device = static_cast<quint64>(st.st_dev);
+    entry.inode = static_cast<quint64>(st.st_ino);
+    entry.size = static_cast<qint64>(st.st_size);
+    entry.mtimeNs = static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    entry.ctimeNs = static_cast<qint64>(st.st_ctim.tv_sec) * 1000000000LL + st.st_ctim.tv_nsec;
+}
+
+void processDirectory(WalkContext& ctx, int worker, DirTask& task, std::vector<char>& buffer) {
+    int dirFd = task.fd;
+    if (dirFd >= 0) {
+        ctx.queuedFds.fetch_sub(1, std::memory_order_relaxed);
+    } else {
+        dirFd = ::open(QFile::encodeName(task.path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            return;
+        }
+    }
+
+    WalkEntry entry;
+    for (;;) {
+        long bytes = syscall(SYS_getdents64, dirFd, buffer.data(), buffer.size());
+        if (bytes <= 0) {
+            break;
+        }
+
+        for (long offset = 0; offset < bytes; ) {
+            const auto* dirent = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+            offset += dirent->d_reclen;
+
+            const char* name = dirent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            unsigned char type = dirent->d_type;
+            struct stat st;
+            bool haveStat = false;
+
+            if (type == DT_UNKNOWN) {
+                if (fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                haveStat = true;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG :
+                       S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+            }
+
+            // Ссылки на файлы учитываются, по ссылкам на каталоги не спускаемся
+            if (type == DT_LNK) {
+                if (fstatat(dirFd, name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+                    continue;
+                }
+                haveStat = true;
+                type = DT_REG;
+            }
+
+            if (type == DT_DIR) {
+                if (!ctx.recursive) {
+                    continue;
+                }
+
+                QString dirPath = task.path + '/' + QFile::decodeName(name);
+                if (*ctx.dirFilter && !(*ctx.dirFilter)(dirPath)) {
+                    continue;
+                }
+
+                entry.path = dirPath;
+                entry.device = 0;
+                entry.inode = dirent->d_ino;
+                entry.size = 0;
+                entry.mtimeNs = 0;
+                entry.ctimeNs = 0;
+                entry.isDir = true;
+                (*ctx.callback)(entry, worker);
+
+                int childFd = -1;
+                if (ctx.queuedFds.fetch_add(1, std::memory_order_relaxed) < kMaxQueuedDirFds) {
+                    childFd = openat(dirFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                    if (childFd < 0) {
+                        ctx.queuedFds.fetch_sub(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                } else {
+                    ctx.queuedFds.fetch_sub(1, std::memory_order_relaxed);
+                }
+
+                pushTask(ctx, worker, DirTask{childFd, std::move(dirPath)});
+                continue;
+            }
+
+            if (type != DT_REG) {
+                continue;
+            }
+
+            if (!haveStat && fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+
+            entry.path = task.path + '/' + QFile::decodeName(name);
+            fillEntry(entry, st);
+            entry.isDir = false;
+            (*ctx.callback)(entry, worker);
+            ctx.files.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    ::close(dirFd);
+}
+
+void runWorker(WalkContext& ctx, int worker) {
+    std::vector<char> buffer(kDirentBufferSize);
+    int idleRounds = 0;
+
+    for (;;) {
+        DirTask task;
+        if (!popLocal(ctx, worker, task) && !steal(ctx, worker, task)) {
+            if (ctx.pending.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+            if (++idleRounds < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            continue;
+        }
+
+        idleRounds = 0;
+        if (ctx.cancelled && ctx.cancelled->load(std::memory_order_relaxed)) {
+            // Прерванный обход только разбирает очереди
+            if (task.fd >= 0) {
+                ctx.queuedFds.fetch_sub(1, std::memory_order_relaxed);
+                ::close(task.fd);
+            }
+        } else {
+            processDirectory(ctx, worker, task, buffer);
+        }
+        ctx.pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+}
+
+// Потоки 1..threadCount-1 обхода; поток 0 - вызывающий walk()
+struct DirectoryWalker::Pool {
+    // Многопоточный обход за раз один: потоки работают над общим контекстом
+    std::mutex walkLock;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::vector<std::thread> threads;
+    WalkContext* current = nullptr;
+    quint64 generation = 0;
+    int active = 0;
+    bool stopping = false;
+
+    void start(int threadCount) {
+        threads.reserve(threadCount - 1);
+        for (int worker = 1; worker < threadCount; ++worker) {
+            threads.emplace_back(&Pool::run, this, worker);
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> locker(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+        stopping = false;
+    }
+
+    void run(int worker) {
+        quint64 seen = 0;
+        std::unique_lock<std::mutex> locker(lock);
+        for (;;) {
+            wake.wait(locker, [this, &seen]() { return stopping || (current && generation != seen); });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            WalkContext* ctx = current;
+            ++active;
+            locker.unlock();
+
+            runWorker(*ctx, worker);
+
+            locker.lock();
+            if (--active == 0) {
+                idle.notify_all();
+            }
+        }
+    }
+};
+
+DirectoryWalker::DirectoryWalker(int threadCount)
+    : m_threadCount(1)
+    , m_pool(new Pool)
+{
+    setThreadCount(threadCount);
+}
+
+DirectoryWalker::~DirectoryWalker() {
+    m_pool->stop();
+}
+
+void DirectoryWalker::setThreadCount(int count) {
+    std::lock_guard<std::mutex> walking(m_pool->walkLock);
+    const int threads = count > 0 ? count : qMax(1, QThread::idealThreadCount());
+    if (threads != m_threadCount) {
+        // Потоки под новое число создаст следующий обход
+        m_pool->stop();
+        m_threadCount = threads;
+    }
+}
+
+qint64 DirectoryWalker::walk(const QStringList& roots, const EntryCallback& callback, bool recursive,
+                             const std::atomic<bool>* cancelled) const {
+    if (roots.isEmpty() || !callback) {
+        return 0;
+    }
+
+    // Один каталог без подкаталогов - один getdents: будить потоки дороже
+    const bool single = m_threadCount == 1 || (roots.size() == 1 && !recursive);
+    std::unique_lock<std::mutex> walking(m_pool->walkLock, std::defer_lock);
+    if (!single) {
+        walking.lock();
+    }
+
+    const int workers = single ? 1 : m_threadCount;
+    WalkContext ctx(workers);
+    ctx.callback = &callback;
+    ctx.dirFilter = &m_dirFilter;
+    ctx.cancelled = cancelled;
+    ctx.recursive = recursive;
+
+    for (int i = 0; i < roots.size(); ++i) {
+        pushTask(ctx, i % workers, DirTask{-1, roots.at(i)});
+    }
+
+    if (!single) {
+        if (m_pool->threads.empty()) {
+            m_pool->start(m_threadCount);
+        }
+        {
+            std::lock_guard<std::mutex> locker(m_pool->lock);
+            m_pool->current = &ctx;
+            ++m_pool->generation;
+        }
+        m_pool->wake.notify_all();
+    }
+
+    runWorker(ctx, 0);
+
+    if (!single) {
+        // Контекст на стеке: ждем потоки, успевшие его взять
+        std::unique_lock<std::mutex> locker(m_pool->lock);
+        m_pool->current = nullptr;
+        m_pool->idle.wait(locker, [this]() { return m_pool->active == 0; });
+    }
+
+    LOG_DEBUG(QString("Обход завершен: %1 файлов, потоков: %2")
+              .arg(ctx.files.load()).arg(workers));
+    return ctx.files.load();
+}
@@ -0,0 +1,130 @@
+#include "../include/EventCoalescer.h"
+#include "../include/Logger.h"
+#include <QTimer>
+#include <QList>
+#include <QPair>
+#include <limits>
+
+namespace {
+// Минимальный шаг таймера: не чаще нескольких срабатываний за период тишины,
+// иначе при массовом копировании каждый проход по таблице будет почти пустым
+constexpr int kMinTimerStep = 10;
+}
+
+EventCoalescer::EventCoalescer(QObject* parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+    , m_armedDeadline(0)
+    , m_quietPeriod(500)
+    , m_maxLatency(5000)
+    , m_received(0)
+    , m_emitted(0)
+{
+    m_clock.start();
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &EventCoalescer::onTimeout);
+}
+
+void EventCoalescer::setQuietPeriod(int msec) {
+    if (msec >= 0) {
+        m_quietPeriod = msec;
+        LOG_DEBUG(QString("Период тишины: %1 мс").arg(msec));
+    }
+}
+
+void EventCoalescer::setMaxLatency(int msec) {
+    if (msec >= 0) {
+        m_maxLatency = msec;
+        LOG_DEBUG(QString("Максимальная задержка события: %1 мс").arg(msec));
+    }
+}
+
+void EventCoalescer::schedule(const QString& path, Change change) {
+    const qint64 now = m_clock.elapsed();
+    m_received++;
+
+    auto it = m_pending.find(path);
+    if (it == m_pending.end()) {
+        it = m_pending.insert(path, Pending{change, now, now});
+    } else {
+        Pending& pending = it.value();
+        pending.lastSeen = now;
+
+        // Итоговое событие серии с точки зрения получателя
+        if (pending.change == Change::Created && change == Change::Deleted) {
+            // Файл появился и исчез до обработки - сообщать не о чем
+            m_pending.erase(it);
+            return;
+        } else if (pending.change == Change::Created) {
+            // Записи после создания входят в само создание
+        } else if (pending.change == Change::Deleted && change != Change::Deleted) {
+            // Файл заменен новым содержимым под тем же именем
+            pending.change = Change::Modified;
+        } else {
+            pending.change = change;
+        }
+    }
+
+    const qint64 due = deadline(it.value());
+    if (!m_timer->isActive() || due < m_armedDeadline) {
+        m_armedDeadline = due;
+        m_timer->start(static_cast<int>(qMax<qint64>(0, due - now)));
+    }
+}
+
+bool EventCoalescer::cancel(const QString& path) {
+    return m_pending.remove(path) > 0;
+}
+
+void EventCoalescer::clear() {
+    m_pending.clear();
+    m_timer->stop();
+}
+
+void EventCoalescer::onTimeout() {
+    const qint64 now = m_clock.elapsed();
+
+    // Сначала собираем готовые: обработчики сигнала могут снова вызвать schedule()
+    QList<QPair<QString, Change>> ready;
+    for (auto it = m_pending.begin(); it != m_pending.end(); ) {
+        if (deadline(it.value()) <= now) {
+            ready.append(qMakePair(it.key(), it.value().change));
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (!ready.isEmpty()) {
+        m_emitted += ready.size();
+        LOG_DEBUG(QString("Выдано событий: %1, ожидают: %2 (получено всего: %3, выдано: %4)")
+                  .arg(ready.size()).arg(m_pending.size()).arg(m_received).arg(m_emitted));
+    }
+
+    rearm();
+
+    for (const auto& item : std::as_const(ready)) {
+        emit changeReady(item.first, item.second);
+    }
+}
+
+qint64 EventCoalescer::deadline(const Pending& pending) const {
+    return qMin(pending.lastSeen + m_quietPeriod, pending.firstSeen + m_maxLatency);
+}
+
+void EventCoalescer::rearm() {
+    if (m_pending.isEmpty()) {
+        m_timer->stop();
+        return;
+    }
+
+    qint64 next = std::numeric_limits<qint64>::max();
+    for (const Pending& pending : std::as_const(m_pending)) {
+        next = qMin(next, deadline(pending));
+    }
+
+    const qint64 now = m_clock.elapsed();
+    const qint64 step = qMax(kMinTimerStep, m_quietPeriod / 4);
+    m_armedDeadline = qMax(next, now + step);
+    m_timer->start(static_cast<int>(m_armedDeadline - now));
+}
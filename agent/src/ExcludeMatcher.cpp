@@ -0,0 +1,196 @@
+#include "../include/ExcludeMatcher.h"
+#include "../include/Logger.h"
+
+namespace {
+bool hasWildcards(QStringView pattern) {
+    for (QChar ch : pattern) {
+        if (ch == '*' || ch == '?' || ch == '[') {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+ExcludeMatcher::ExcludeMatcher(const QStringList& patterns) {
+    setPatterns(patterns);
+}
+
+void ExcludeMatcher::setPatterns(const QStringList& patterns) {
+    m_patterns = patterns;
+    m_files.clear();
+    m_dirs.clear();
+
+    QStringList fileWildcards;
+    QStringList dirWildcards;
+    int dirCount = 0;
+
+    for (const QString& raw : patterns) {
+        QString pattern = raw.trimmed().toLower();
+        if (pattern.isEmpty()) {
+            continue;
+        }
+
+        if (pattern.endsWith('/')) {
+            pattern.chop(1);
+            if (!pattern.isEmpty()) {
+                addPattern(m_dirs, pattern, dirWildcards);
+                dirCount++;
+            }
+        } else {
+            addPattern(m_files, pattern, fileWildcards);
+        }
+    }
+
+    compileWildcards(m_files, fileWildcards);
+    compileWildcards(m_dirs, dirWildcards);
+
+    LOG_DEBUG(QString("Шаблоны исключения: %1, из них каталогов: %2, в общем выражении: %3")
+              .arg(patterns.size()).arg(dirCount).arg(fileWildcards.size() + dirWildcards.size()));
+}
+
+bool ExcludeMatcher::matchesFileName(QStringView fileName) const {
+    return !m_files.isEmpty() && m_files.matches(fileName);
+}
+
+bool ExcludeMatcher::matchesDirectoryName(QStringView dirName) const {
+    return !m_dirs.isEmpty() && m_dirs.matches(dirName);
+}
+
+bool ExcludeMatcher::isExcluded(const QString& filePath) const {
+    const qsizetype slash = filePath.lastIndexOf('/');
+    if (matchesFileName(QStringView(filePath).mid(slash + 1))) {
+        return true;
+    }
+    return slash > 0 && matchesAnyComponent(QStringView(filePath).left(slash));
+}
+
+bool ExcludeMatcher::isExcludedDirectory(const QString& dirPath) const {
+    return matchesAnyComponent(dirPath);
+}
+
+bool ExcludeMatcher::matchesAnyComponent(QStringView dirPath) const {
+    if (m_dirs.isEmpty()) {
+        return false;
+    }
+
+    // Каждый компонент пути ниже корня сверяется с шаблонами каталогов:
+    // корень, выбранный для мониторинга, сам по себе не исключается
+    qsizetype start = belowRoot(dirPath);
+    while (start < dirPath.size()) {
+        qsizetype end = dirPath.indexOf('/', start);
+        if (end < 0) {
+            end = dirPath.size();
+        }
+        if (end > start && m_dirs.matches(dirPath.mid(start, end - start))) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+qsizetype ExcludeMatcher::belowRoot(QStringView path) const {
+    qsizetype start = 0;
+    for (const QString& root : m_roots) {
+        const qsizetype length = root.endsWith('/') ? root.size() - 1 : root.size();
+        if (length < start || path.size() < length || !path.startsWith(QStringView(root).left(length))) {
+            continue;
+        }
+        if (path.size() == length) {
+            return path.size();
+        }
+        if (path.at(length) == '/') {
+            start = length + 1;
+        }
+    }
+    return start;
+}
+
+void ExcludeMatcher::addPattern(Table& table, const QString& pattern, QStringList& wildcards) {
+    const QStringView body = QStringView(pattern).mid(1);
+    const QStringView head = QStringView(pattern).left(pattern.size() - 1);
+
+    if (!hasWildcards(pattern)) {
+        table.exact.insert(pattern);
+    } else if (pattern.startsWith('*') && !hasWildcards(body)) {
+        // "*.tmp" - поиск по расширению в хэш-таблице, прочие суффиксы - списком
+        if (body.startsWith('.') && body.lastIndexOf('.') == 0) {
+            table.extensions.insert(body.mid(1).toString());
+        } else {
+            table.suffixes.append(body.toString());
+        }
+    } else if (pattern.endsWith('*') && !hasWildcards(head)) {
+        table.prefixes.append(head.toString());
+    } else {
+        wildcards.append(pattern);
+    }
+}
+
+void ExcludeMatcher::compileWildcards(Table& table, const QStringList& wildcards) {
+    if (wildcards.isEmpty()) {
+        return;
+    }
+
+    QStringList alternatives;
+    for (const QString& pattern : wildcards) {
+        QString regex = QRegularExpression::wildcardToRegularExpression(
+            pattern, QRegularExpression::UnanchoredWildcardConversion);
+        if (QRegularExpression(regex).isValid()) {
+            alternatives.append(regex);
+        } else {
+            LOG_WARNING(QString("Некорректный паттерн исключения: %1").arg(pattern));
+        }
+    }
+
+    if (alternatives.isEmpty()) {
+        return;
+    }
+
+    table.combined.setPattern("^(?:" + alternatives.join('|') + ")$");
+    table.combined.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+    // Компиляция сразу, а не при первом вызове из потоков обхода
+    table.combined.optimize();
+    table.hasCombined = true;
+}
+
+void ExcludeMatcher::Table::clear() {
+    exact.clear();
+    extensions.clear();
+    suffixes.clear();
+    prefixes.clear();
+    combined = QRegularExpression();
+    hasCombined = false;
+}
+
+bool ExcludeMatcher::Table::isEmpty() const {
+    return exact.isEmpty() && extensions.isEmpty() && suffixes.isEmpty() &&
+           prefixes.isEmpty() && !hasCombined;
+}
+
+bool ExcludeMatcher::Table::matches(QStringView name) const {
+    if (!exact.isEmpty() && exact.contains(name.toString().toLower())) {
+        return true;
+    }
+
+    if (!extensions.isEmpty()) {
+        const qsizetype dot = name.lastIndexOf('.');
+        if (dot >= 0 && extensions.contains(name.mid(dot + 1).toString().toLower())) {
+            return true;
+        }
+    }
+
+    for (const QString& suffix : suffixes) {
+        if (name.endsWith(suffix, Qt::CaseInsensitive)) {
+            return true;
+        }
+    }
+
+    for (const QString& prefix : prefixes) {
+        if (name.startsWith(prefix, Qt::CaseInsensitive)) {
+            return true;
+        }
+    }
+
+    return hasCombined && combined.match(name.toString()).hasMatch();
+}
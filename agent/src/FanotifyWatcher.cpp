@@ -0,0 +1,307 @@
+#include "../include/FanotifyWatcher.h"
+#include "../include/Logger.h"
+#include <QSocketNotifier>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+namespace {
+constexpr size_t kReadBufferSize = 256 * 1024;
+// Кэш путей каталогов сбрасывается целиком при переполнении
+constexpr int kMaxCachedDirs = 16384;
+
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+constexpr uint64_t kMarkMask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO |
+                               FAN_MODIFY | FAN_CLOSE_WRITE | FAN_ONDIR;
+
+quint64 packFsid(const int val[2]) {
+    return (static_cast<quint64>(static_cast<quint32>(val[0])) << 32) |
+           static_cast<quint32>(val[1]);
+}
+#endif
+}
+
+FanotifyWatcher::FanotifyWatcher(QObject* parent)
+    : QObject(parent)
+    , m_fd(-1)
+    , m_notifier(nullptr)
+{
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+    m_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC,
+                         O_RDONLY | O_LARGEFILE);
+    if (m_fd < 0) {
+        LOG_WARNING(QString("fanotify недоступен: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return;
+    }
+
+    m_buffer.resize(kReadBufferSize);
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &FanotifyWatcher::onReadyRead);
+    LOG_DEBUG("FanotifyWatcher инициализирован");
+#else
+    LOG_WARNING("fanotify не поддерживается этой сборкой");
+#endif
+}
+
+FanotifyWatcher::~FanotifyWatcher() {
+#ifdef Q_OS_LINUX
+    for (int mountFd : std::as_const(m_mountFds)) {
+        ::close(mountFd);
+    }
+    m_mountFds.clear();
+
+    if (m_fd >= 0) {
+        if (m_notifier) {
+            m_notifier->setEnabled(false);
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+bool FanotifyWatcher::addRoot(const QString& directory) {
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+    if (m_fd < 0) {
+        return false;
+    }
+
+    const QByteArray nativePath = QFile::encodeName(directory);
+    struct statfs fs;
+    if (statfs(nativePath.constData(), &fs) != 0) {
+        LOG_WARNING(QString("statfs не удался: %1").arg(directory));
+        return false;
+    }
+
+    const quint64 fsid = packFsid(fs.f_fsid.__val);
+    if (!m_markedFilesystems.contains(fsid)) {
+        if (fanotify_mark(m_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, kMarkMask,
+                          AT_FDCWD, nativePath.constData()) != 0) {
+            LOG_WARNING(QString("Не удалось установить fanotify метку на %1: %2")
+                        .arg(directory).arg(QString::fromLocal8Bit(strerror(errno))));
+            return false;
+        }
+
+        // Дескриптор нужен для open_by_handle_at при разрешении путей
+        int mountFd = ::open(nativePath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mountFd < 0) {
+            fanotify_mark(m_fd, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, kMarkMask,
+                          AT_FDCWD, nativePath.constData());
+            return false;
+        }
+
+        m_markedFilesystems.insert(fsid);
+        m_mountFds[fsid] = mountFd;
+        LOG_INFO(QString("fanotify: файловая система %1 под наблюдением").arg(directory));
+    }
+
+    if (!m_roots.contains(directory)) {
+        m_roots.append(directory);
+    }
+    return true;
+#else
+    Q_UNUSED(directory);
+    return false;
+#endif
+}
+
+void FanotifyWatcher::removeRoot(const QString& directory) {
+    // Метка файловой системы остается: события вне корней отфильтруются
+    m_roots.removeAll(directory);
+}
+
+void FanotifyWatcher::removeAllRoots() {
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+    if (m_fd >= 0) {
+        fanotify_mark(m_fd, FAN_MARK_FLUSH | FAN_MARK_FILESYSTEM, 0, AT_FDCWD, nullptr);
+    }
+    for (int mountFd : std::as_const(m_mountFds)) {
+        ::close(mountFd);
+    }
+#endif
+    m_mountFds.clear();
+    m_markedFilesystems.clear();
+    m_dirCache.clear();
+    m_roots.clear();
+}
+
+bool FanotifyWatcher::covers(const QString& path) const {
+    for (const QString& root : m_roots) {
+        if (path == root || path.startsWith(root + "/")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FanotifyWatcher::onReadyRead() {
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+    for (;;) {
+        ssize_t len = ::read(m_fd, m_buffer.data(), m_buffer.size());
+        if (len <= 0) {
+            if (len < 0 && errno != EAGAIN && errno != EINTR) {
+                LOG_ERROR(QString("Ошибка чтения fanotify: %1")
+                          .arg(QString::fromLocal8Bit(strerror(errno))));
+            }
+            break;
+        }
+
+        auto* metadata = reinterpret_cast<struct fanotify_event_metadata*>(m_buffer.data());
+        while (FAN_EVENT_OK(metadata, len)) {
+            if (metadata->vers != FANOTIFY_METADATA_VERSION) {
+                LOG_ERROR("Несовместимая версия fanotify");
+                return;
+            }
+            processEvent(reinterpret_cast<const char*>(metadata), metadata->event_len);
+            metadata = FAN_EVENT_NEXT(metadata, len);
+        }
+    }
+#endif
+}
+
+void FanotifyWatcher::processEvent(const char* data, quint32 eventLen) {
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+    const auto* metadata = reinterpret_cast<const struct fanotify_event_metadata*>(data);
+
+    if (metadata->mask & FAN_Q_OVERFLOW) {
+        LOG_WARNING("Переполнение очереди fanotify, требуется пересканирование");
+        emit queueOverflow();
+        return;
+    }
+
+    // В режиме FID за метаданными следует запись с дескриптором каталога и именем
+    const char* infoPtr = data + metadata->metadata_len;
+    const char* end = data + eventLen;
+    while (infoPtr + sizeof(struct fanotify_event_info_header) <= end) {
+        const auto* header = reinterpret_cast<const struct fanotify_event_info_header*>(infoPtr);
+        if (header->len == 0) {
+            break;
+        }
+
+        if (header->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+            const auto* fid = reinterpret_cast<const struct fanotify_event_info_fid*>(infoPtr);
+            const auto* handle = reinterpret_cast<const struct file_handle*>(fid->handle);
+            const char* name = reinterpret_cast<const char*>(handle->f_handle) + handle->handle_bytes;
+
+            if (strcmp(name, ".") == 0) {
+                return;
+            }
+
+            const QByteArray handleKey(reinterpret_cast<const char*>(handle),
+                                       sizeof(struct file_handle) + handle->handle_bytes);
+            const QString dirPath = resolveDirectory(packFsid(fid->fsid.val), handleKey);
+            if (dirPath.isEmpty()) {
+                return;
+            }
+
+            const QString path = dirPath + "/" + QFile::decodeName(name);
+            if (!covers(path)) {
+                return;
+            }
+
+            const bool isDir = metadata->mask & FAN_ONDIR;
+
+            // Переименование, перемещение или удаление каталога делает
+            // устаревшими пути его и вложенных каталогов; на месте
+            // перемещенного сюда каталога мог быть другой с тем же путем
+            if (isDir && (metadata->mask & (FAN_MOVED_FROM | FAN_MOVED_TO | FAN_DELETE))) {
+                invalidateDirectory(path);
+            }
+
+            if (metadata->mask & FAN_CREATE) {
+                emit entryCreated(path, isDir);
+            }
+            if ((metadata->mask & FAN_MODIFY) && !isDir) {
+                emit contentModified(path);
+            }
+            if (metadata->mask & FAN_CLOSE_WRITE) {
+                emit fileWritten(path);
+            }
+            if (metadata->mask & FAN_MOVED_FROM) {
+                emit entryMovedFrom(path, isDir, 0);
+            }
+            if (metadata->mask & FAN_MOVED_TO) {
+                emit entryMovedTo(path, isDir, 0);
+            }
+            if (metadata->mask & FAN_DELETE) {
+                emit entryDeleted(path, isDir);
+            }
+            return;
+        }
+
+        infoPtr += header->len;
+    }
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(eventLen);
+#endif
+}
+
+QString FanotifyWatcher::resolveDirectory(quint64 fsid, const QByteArray& handle) {
+#if defined(Q_OS_LINUX) && defined(FAN_REPORT_DFID_NAME)
+    QByteArray key(reinterpret_cast<const char*>(&fsid), sizeof(fsid));
+    key += handle;
+    auto cached = m_dirCache.constFind(key);
+    if (cached != m_dirCache.constEnd()) {
+        return cached.value();
+    }
+
+    int mountFd = m_mountFds.value(fsid, -1);
+    if (mountFd < 0) {
+        return QString();
+    }
+
+    // open_by_handle_at изменяет только буфер дескриптора, копия уже сделана
+    QByteArray handleCopy = handle;
+    int dirFd = open_by_handle_at(mountFd, reinterpret_cast<struct file_handle*>(handleCopy.data()),
+                                  O_PATH | O_CLOEXEC);
+    if (dirFd < 0) {
+        // ESTALE: каталог уже удален, событие неактуально
+        if (errno != ESTALE) {
+            LOG_DEBUG(QString("open_by_handle_at: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        }
+        return QString();
+    }
+
+    char linkPath[64];
+    char target[PATH_MAX];
+    snprintf(linkPath, sizeof(linkPath), "/proc/self/fd/%d", dirFd);
+    ssize_t targetLen = readlink(linkPath, target, sizeof(target) - 1);
+    ::close(dirFd);
+
+    if (targetLen <= 0) {
+        return QString();
+    }
+
+    const QString path = QFile::decodeName(QByteArray(target, targetLen));
+    if (m_dirCache.size() >= kMaxCachedDirs) {
+        m_dirCache.clear();
+    }
+    m_dirCache.insert(key, path);
+    return path;
+#else
+    Q_UNUSED(fsid);
+    Q_UNUSED(handle);
+    return QString();
+#endif
+}
+
+void FanotifyWatcher::invalidateDirectory(const QString& dirPath) {
+    const QString prefix = dirPath + "/";
+    for (auto it = m_dirCache.begin(); it != m_dirCache.end(); ) {
+        if (it.value() == dirPath || it.value().startsWith(prefix)) {
+            it = m_dirCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
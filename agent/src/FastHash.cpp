@@ -0,0 +1,163 @@
+#include "../include/FastHash.h"
+#include <cstring>
+
+namespace {
+constexpr quint64 kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr quint64 kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr quint64 kPrime3 = 0x165667B19E3779F9ULL;
+constexpr quint64 kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr quint64 kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline quint64 rotl(quint64 value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 read64(const unsigned char* ptr) {
+    quint64 value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline quint32 read32(const unsigned char* ptr) {
+    quint32 value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline quint64 round(quint64 acc, quint64 input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline quint64 mergeRound(quint64 acc, quint64 value) {
+    acc ^= round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+}
+
+FastHash::FastHash(quint64 seed)
+{
+    reset(seed);
+}
+
+void FastHash::reset(quint64 seed) {
+    m_seed = seed;
+    m_v1 = seed + kPrime1 + kPrime2;
+    m_v2 = seed + kPrime2;
+    m_v3 = seed;
+    m_v4 = seed - kPrime1;
+    m_totalLength = 0;
+    m_bufferSize = 0;
+}
+
+void FastHash::addData(const void* data, qint64 length) {
+    if (!data || length <= 0) {
+        return;
+    }
+
+    const auto* ptr = static_cast<const unsigned char*>(data);
+    const unsigned char* end = ptr + length;
+    m_totalLength += static_cast<quint64>(length);
+
+    // Добиваем накопленный хвост до полного блока из 32 байт
+    if (m_bufferSize > 0) {
+        int fill = qMin<qint64>(32 - m_bufferSize, length);
+        memcpy(m_buffer + m_bufferSize, ptr, fill);
+        m_bufferSize += fill;
+        ptr += fill;
+
+        if (m_bufferSize < 32) {
+            return;
+        }
+
+        m_v1 = round(m_v1, read64(m_buffer));
+        m_v2 = round(m_v2, read64(m_buffer + 8));
+        m_v3 = round(m_v3, read64(m_buffer + 16));
+        m_v4 = round(m_v4, read64(m_buffer + 24));
+        m_bufferSize = 0;
+    }
+
+    while (end - ptr >= 32) {
+        m_v1 = round(m_v1, read64(ptr));
+        m_v2 = round(m_v2, read64(ptr + 8));
+        m_v3 = round(m_v3, read64(ptr + 16));
+        m_v4 = round(m_v4, read64(ptr + 24));
+        ptr += 32;
+    }
+
+    if (ptr < end) {
+        m_bufferSize = static_cast<int>(end - ptr);
+        memcpy(m_buffer, ptr, m_bufferSize);
+    }
+}
+
+QByteArray FastHash::saveState() const {
+    const quint64 values[] = { m_v1, m_v2, m_v3, m_v4, m_seed, m_totalLength };
+    return QByteArray(reinterpret_cast<const char*>(values), sizeof(values));
+}
+
+bool FastHash::restoreState(QByteArrayView state, QByteArrayView pending) {
+    quint64 values[6];
+    if (state.size() != qsizetype(sizeof(values))) {
+        return false;
+    }
+    memcpy(values, state.data(), sizeof(values));
+    if (pending.size() != qsizetype(values[5] % 32)) {
+        return false;
+    }
+    m_v1 = values[0];
+    m_v2 = values[1];
+    m_v3 = values[2];
+    m_v4 = values[3];
+    m_seed = values[4];
+    m_totalLength = values[5];
+    m_bufferSize = static_cast<int>(pending.size());
+    memcpy(m_buffer, pending.data(), m_bufferSize);
+    return true;
+}
+
+quint64 FastHash::result() const {
+    quint64 h;
+    if (m_totalLength >= 32) {
+        h = rotl(m_v1, 1) + rotl(m_v2, 7) + rotl(m_v3, 12) + rotl(m_v4, 18);
+        h = mergeRound(h, m_v1);
+        h = mergeRound(h, m_v2);
+        h = mergeRound(h, m_v3);
+        h = mergeRound(h, m_v4);
+    } else {
+        h = m_seed + kPrime5;
+    }
+    h += m_totalLength;
+
+    const unsigned char* ptr = m_buffer;
+    const unsigned char* end = m_buffer + m_bufferSize;
+    while (end - ptr >= 8) {
+        h ^= round(0, read64(ptr));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+        ptr += 8;
+    }
+    if (end - ptr >= 4) {
+        h ^= static_cast<quint64>(read32(ptr)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        ptr += 4;
+    }
+    while (ptr < end) {
+        h ^= static_cast<quint64>(*ptr) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+        ++ptr;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+quint64 FastHash::hash(const void* data, qint64 length, quint64 seed) {
+    FastHash hasher(seed);
+    hasher.addData(data, length);
+    return hasher.result();
+}
@@ -0,0 +1,317 @@
+#include "../include/FileClassifier.h"
+#include <QString>
+#include <QtAlgorithms>
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+struct MagicEntry {
+    const char* bytes;
+    qsizetype length;
+    FileClassifier::Kind kind;
+};
+
+// Сигнатуры, которые не встречаются в начале обычного текста
+const MagicEntry kMagicTable[] = {
+    { "\xEF\xBB\xBF", 3, FileClassifier::Kind::Text },          // UTF-8 BOM
+    { "%PDF-", 5, FileClassifier::Kind::Binary },
+    { "PK\x03\x04", 4, FileClassifier::Kind::Binary },          // zip, docx, xlsx, jar
+    { "PK\x05\x06", 4, FileClassifier::Kind::Binary },
+    { "\x89PNG\r\n\x1A\n", 8, FileClassifier::Kind::Binary },
+    { "\xFF\xD8\xFF", 3, FileClassifier::Kind::Binary },        // JPEG
+    { "GIF87a", 6, FileClassifier::Kind::Binary },
+    { "GIF89a", 6, FileClassifier::Kind::Binary },
+    { "\x7F" "ELF", 4, FileClassifier::Kind::Binary },
+    { "\x1F\x8B", 2, FileClassifier::Kind::Binary },            // gzip
+    { "7z\xBC\xAF\x27\x1C", 6, FileClassifier::Kind::Binary },
+    { "Rar!\x1A\x07", 6, FileClassifier::Kind::Binary },
+    { "\xFD" "7zXZ", 5, FileClassifier::Kind::Binary },
+    { "\xD0\xCF\x11\xE0\xA1\xB1\x1A\xE1", 8, FileClassifier::Kind::Binary }, // doc, xls
+    { "\xCA\xFE\xBA\xBE", 4, FileClassifier::Kind::Binary },    // class, Mach-O fat
+    { "SQLite format 3", 15, FileClassifier::Kind::Binary },
+    { "OggS", 4, FileClassifier::Kind::Binary },
+};
+
+const QLatin1String kTextExtensions[] = {
+    QLatin1String("txt"), QLatin1String("log"), QLatin1String("csv"), QLatin1String("json"),
+    QLatin1String("xml"), QLatin1String("html"), QLatin1String("htm"), QLatin1String("js"),
+    QLatin1String("css"), QLatin1String("cpp"), QLatin1String("h"), QLatin1String("py"),
+    QLatin1String("java"), QLatin1String("cs"), QLatin1String("php"), QLatin1String("rb"),
+    QLatin1String("go"), QLatin1String("rs"), QLatin1String("md"), QLatin1String("ini"),
+    QLatin1String("conf"), QLatin1String("yaml"), QLatin1String("yml"), QLatin1String("sql"),
+    QLatin1String("sh"), QLatin1String("bat"), QLatin1String("ps1")
+};
+
+const QLatin1String kBinaryExtensions[] = {
+    QLatin1String("zip"), QLatin1String("gz"), QLatin1String("tgz"), QLatin1String("bz2"),
+    QLatin1String("xz"), QLatin1String("7z"), QLatin1String("rar"), QLatin1String("jar"),
+    QLatin1String("png"), QLatin1String("jpg"), QLatin1String("jpeg"), QLatin1String("gif"),
+    QLatin1String("bmp"), QLatin1String("ico"), QLatin1String("webp"), QLatin1String("mp3"),
+    QLatin1String("mp4"), QLatin1String("avi"), QLatin1String("mkv"), QLatin1String("mov"),
+    QLatin1String("wav"), QLatin1String("flac"), QLatin1String("ogg"), QLatin1String("exe"),
+    QLatin1String("dll"), QLatin1String("so"), QLatin1String("o"), QLatin1String("a"),
+    QLatin1String("class"), QLatin1String("pyc"), QLatin1String("iso"), QLatin1String("woff"),
+    QLatin1String("woff2"), QLatin1String("ttf"), QLatin1String("otf")
+};
+
+struct ClassEntry {
+    const char* name;
+    const char* extensions;
+};
+
+// Классы файлов для областей действия политик; расширения через пробел
+const ClassEntry kClassTable[] = {
+    { "text", "txt log md rst" },
+    { "code", "c h cpp hpp cc cxx cs java kt swift js ts jsx tsx py rb go rs php pl sh bash bat ps1 sql" },
+    { "config", "ini conf cfg yaml yml toml json xml env properties" },
+    { "web", "html htm css js xhtml" },
+    { "data", "json xml csv tsv sql" },
+    { "spreadsheet", "csv tsv xls xlsx xlsm ods" },
+    { "document", "doc docx odt rtf pdf" },
+};
+
+// Расширение в списке через пробел из таблицы классов
+bool listContains(const char* list, QStringView suffix) {
+    const QLatin1String extensions(list);
+    qsizetype start = 0;
+    while (start < extensions.size()) {
+        qsizetype end = start;
+        while (end < extensions.size() && extensions.at(end) != ' ') {
+            ++end;
+        }
+        if (end - start == suffix.size() &&
+            suffix.compare(extensions.mid(start, end - start), Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+// Доля управляющих символов (кроме пробельных), начиная с которой содержимое бинарное
+constexpr int kMaxControlPercent = 10;
+// Энтропия сжатых и зашифрованных данных близка к 8 бит на байт;
+// текст в однобайтовых кодировках (cp1251, koi8-r) - около 4-5
+constexpr double kBinaryEntropy = 7.0;
+
+inline bool isAllowedControl(unsigned char c) {
+    // \t \n \v \f \r и ESC (цветные логи)
+    return (c >= 0x09 && c <= 0x0D) || c == 0x1B;
+}
+}
+
+QStringView FileClassifier::suffixOf(QStringView filePath)
+{
+    const qsizetype slash = filePath.lastIndexOf(u'/');
+    const qsizetype dot = filePath.lastIndexOf(u'.');
+    if (dot <= slash + 1) {
+        // Нет точки или скрытый файл без расширения (".bashrc")
+        return QStringView();
+    }
+    return filePath.mid(dot + 1);
+}
+
+FileClassifier::Kind FileClassifier::classify(QStringView filePath, QByteArrayView head)
+{
+    const QByteArrayView block = head.first(qMin(head.size(), kSniffBytes));
+
+    Kind kind;
+    if (matchMagic(block, kind)) {
+        return kind;
+    }
+
+    const QStringView suffix = suffixOf(filePath);
+    if (!suffix.isEmpty()) {
+        if (isTextExtension(suffix)) {
+            return Kind::Text;
+        }
+        if (isBinaryExtension(suffix)) {
+            return Kind::Binary;
+        }
+    }
+
+    if (block.isEmpty()) {
+        return Kind::Text;
+    }
+
+    const ByteStats stats = scanBytes(block);
+    if (stats.nulCount > 0) {
+        return Kind::Binary;
+    }
+    if (stats.controlCount * 100 > block.size() * kMaxControlPercent) {
+        return Kind::Binary;
+    }
+    if (stats.highCount == 0 || isValidUtf8(block)) {
+        return Kind::Text;
+    }
+
+    // Не UTF-8: либо текст в однобайтовой кодировке, либо сжатые данные
+    return byteEntropy(block) >= kBinaryEntropy ? Kind::Binary : Kind::Text;
+}
+
+bool FileClassifier::isTextExtension(QStringView suffix)
+{
+    return containsExtension(kTextExtensions, suffix);
+}
+
+bool FileClassifier::isBinaryExtension(QStringView suffix)
+{
+    return containsExtension(kBinaryExtensions, suffix);
+}
+
+bool FileClassifier::isKnownExtension(QStringView suffix)
+{
+    if (isTextExtension(suffix) || isBinaryExtension(suffix)) {
+        return true;
+    }
+    for (const ClassEntry& entry : kClassTable) {
+        if (listContains(entry.extensions, suffix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FileClassifier::classExtensions(QStringView className, QStringList& extensions)
+{
+    for (const ClassEntry& entry : kClassTable) {
+        if (className.compare(QLatin1String(entry.name), Qt::CaseInsensitive) == 0) {
+            extensions = QString::fromLatin1(entry.extensions).split(' ');
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FileClassifier::matchMagic(QByteArrayView head, Kind& kind)
+{
+    for (const MagicEntry& entry : kMagicTable) {
+        if (head.size() >= entry.length && memcmp(head.data(), entry.bytes, entry.length) == 0) {
+            kind = entry.kind;
+            return true;
+        }
+    }
+    return false;
+}
+
+FileClassifier::ByteStats FileClassifier::scanBytes(QByteArrayView block)
+{
+    ByteStats stats;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(block.data());
+    const qsizetype size = block.size();
+    qsizetype i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i tabMinusOne = _mm_set1_epi8(0x08);
+    const __m128i crPlusOne = _mm_set1_epi8(0x0E);
+    const __m128i escape = _mm_set1_epi8(0x1B);
+
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+        const unsigned nul = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+        // Старший бит байта и есть маска не-ASCII
+        const unsigned high = static_cast<unsigned>(_mm_movemask_epi8(v));
+
+        // Сравнение знаковое: байты >= 0x80 тоже "меньше пробела", они исключаются маской high
+        const __m128i below = _mm_cmplt_epi8(v, space);
+        const __m128i whitespace = _mm_and_si128(_mm_cmpgt_epi8(v, tabMinusOne),
+                                                 _mm_cmplt_epi8(v, crPlusOne));
+        const __m128i allowed = _mm_or_si128(whitespace, _mm_cmpeq_epi8(v, escape));
+        const unsigned control = static_cast<unsigned>(_mm_movemask_epi8(_mm_andnot_si128(allowed, below)))
+                                 & ~high & ~nul;
+
+        stats.nulCount += qPopulationCount(nul);
+        stats.highCount += qPopulationCount(high);
+        stats.controlCount += qPopulationCount(control);
+    }
+#endif
+
+    for (; i < size; ++i) {
+        const unsigned char c = data[i];
+        if (c == 0) {
+            stats.nulCount++;
+        } else if (c >= 0x80) {
+            stats.highCount++;
+        } else if (c < 0x20 && !isAllowedControl(c)) {
+            stats.controlCount++;
+        }
+    }
+
+    return stats;
+}
+
+bool FileClassifier::isValidUtf8(QByteArrayView block)
+{
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(block.data());
+    const qsizetype size = block.size();
+    qsizetype i = 0;
+
+    while (i < size) {
+        const unsigned char c = data[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+
+        qsizetype length;
+        if (c >= 0xC2 && c <= 0xDF) {
+            length = 2;
+        } else if ((c & 0xF0) == 0xE0) {
+            length = 3;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            length = 4;
+        } else {
+            // Продолжение без начала, избыточные 0xC0/0xC1 и байты выше 0xF4
+            return false;
+        }
+
+        // Последовательность, обрезанная концом блока, проверяется по имеющимся байтам
+        const qsizetype available = qMin(length, size - i);
+        for (qsizetype k = 1; k < available; ++k) {
+            if ((data[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+        }
+
+        if (available > 1) {
+            const unsigned char next = data[i + 1];
+            if ((c == 0xE0 && next < 0xA0) ||      // избыточная запись
+                (c == 0xED && next >= 0xA0) ||     // суррогаты UTF-16
+                (c == 0xF0 && next < 0x90) ||      // избыточная запись
+                (c == 0xF4 && next >= 0x90)) {     // больше U+10FFFF
+                return false;
+            }
+        }
+
+        i += length;
+    }
+
+    return true;
+}
+
+double FileClassifier::byteEntropy(QByteArrayView block)
+{
+    quint32 histogram[256];
+    memset(histogram, 0, sizeof(histogram));
+    for (char c : block) {
+        histogram[static_cast<unsigned char>(c)]++;
+    }
+
+    const double total = static_cast<double>(block.size());
+    double entropy = 0.0;
+    for (quint32 count : histogram) {
+        if (count > 0) {
+            const double p = count / total;
+            entropy -= p * std::log2(p);
+        }
+    }
+    return entropy;
+}
@@ -1,30 +1,127 @@
 #include "../include/FileMonitor.h"
 #include "../include/Logger.h"
+#include "../include/InotifyWatcher.h"
+#include "../include/FanotifyWatcher.h"
 #include <QCoreApplication>
 #include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QDateTime>
+#include <QSocketNotifier>
+
+#include <sys/stat.h>
+#include <ctime>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Файловые системы, изменения на которых с других машин inotify не видит
+const QSet<QString> kNetworkFilesystems = {
+    "nfs", "nfs4", "cifs", "smb3", "smbfs", "ncpfs", "afs", "ceph", "9p",
+    "glusterfs", "lustre", "gpfs", "davfs", "fuse.sshfs", "fuse.rclone"
+};
+
+// Пара событий перемещения приходит в одном read(); без пары за это время
+// файл считается перемещенным за пределы наблюдаемых каталогов
+constexpr int kMovePairTimeoutMs = 500;
+
+QString unescapeMountPath(const QString& path) {
+    // В mountinfo пробелы и спецсимволы записаны как \040 и т.п.
+    if (!path.contains('\\')) {
+        return path;
+    }
+    QString result;
+    result.reserve(path.size());
+    for (int i = 0; i < path.size(); ++i) {
+        if (path.at(i) == '\\' && i + 3 < path.size()) {
+            bool ok = false;
+            const int code = path.mid(i + 1, 3).toInt(&ok, 8);
+            if (ok) {
+                result.append(QChar(code));
+                i += 3;
+                continue;
+            }
+        }
+        result.append(path.at(i));
+    }
+    return result;
+}
+
+// Время изменения каталога; 0 - не удалось прочитать
+qint64 directoryMtimeNs(const QString& path) {
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return 0;
+    }
+    return static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+}
 
 
 FileMonitor::FileMonitor(QObject *parent)
     : QObject(parent)
     , m_watcher(new QFileSystemWatcher(this))
-    , m_scanTimer(new QTimer(this))
+    , m_inotify(new InotifyWatcher(this))
+    , m_fanotify(nullptr)
+    , m_scanScheduler(new ScanScheduler(this))
+    , m_mountNotifier(nullptr)
+    , m_mountInfoFd(-1)
+    , m_fileEvents(new EventCoalescer(this))
+    , m_dirEvents(new EventCoalescer(this))
+    , m_moveTimer(new QTimer(this))
     , m_monitoring(false)
     , m_recursive(true)
+    , m_useInotify(false)
     , m_checkInterval(1000)
 {
-    m_scanTimer->setInterval(30000);
-    connect(m_scanTimer, &QTimer::timeout, this, &FileMonitor::performFullScan);
+    m_scanScheduler->setScanFunction([this](const QString& directory, bool recursive) {
+        return verifyDirectory(directory, recursive);
+    });
 
     connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &FileMonitor::onDirectoryChanged);
     connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &FileMonitor::onFileChanged);
+
+    // Каталоги под QFileSystemWatcher пересканируются после затихания изменений в них
+    m_dirEvents->setQuietPeriod(m_checkInterval);
+    connect(m_fileEvents, &EventCoalescer::changeReady, this, &FileMonitor::onCoalescedChange);
+    connect(m_dirEvents, &EventCoalescer::changeReady, this, &FileMonitor::onDirectorySettled);
+
+    m_moveClock.start();
+    m_moveTimer->setSingleShot(true);
+    connect(m_moveTimer, &QTimer::timeout, this, &FileMonitor::onMoveTimeout);
+
+    if (m_inotify->isValid()) {
+        connectEventSource(m_inotify);
+    }
+
+#ifdef Q_OS_LINUX
+    // Изменение таблицы монтирования сообщается через POLLPRI
+    m_mountInfoFd = ::open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (m_mountInfoFd >= 0) {
+        m_mountNotifier = new QSocketNotifier(m_mountInfoFd, QSocketNotifier::Exception, this);
+        connect(m_mountNotifier, &QSocketNotifier::activated, this, &FileMonitor::onMountsChanged);
+    }
+#endif
+
+    // Исключенные каталоги отсекаются при обходе вместе с поддеревом
+    m_walker.setDirectoryFilter([this](const QString& dirPath) {
+        return !m_excludes.matchesDirectoryName(QStringView(dirPath).mid(dirPath.lastIndexOf('/') + 1));
+    });
     LOG_DEBUG("FileMonitor инициализирован");
 }
 
 
 FileMonitor::~FileMonitor() {
     stopMonitoring();
+#ifdef Q_OS_LINUX
+    if (m_mountInfoFd >= 0) {
+        delete m_mountNotifier;
+        m_mountNotifier = nullptr;
+        ::close(m_mountInfoFd);
+    }
+#endif
     LOG_DEBUG("Мониторинг прекращен");
 }
 
@@ -37,10 +134,10 @@ bool FileMonitor::startMonitoring(const QStringList &directories, bool recursive
 
     m_baseDirectory = QDir(directories.first()).canonicalPath();
     m_recursive = recursive;
+    selectBackend();
 
-    m_dirFiles.clear();
-    m_fileSizes.clear();
-    m_allMonitoredFiles.clear();
+    m_fileStats.clear();
+    m_mounts = readMountTable();
 
     bool allAdded = true;
     for (const QString& dir : directories) {
@@ -54,24 +151,15 @@ bool FileMonitor::startMonitoring(const QStringList &directories, bool recursive
         return false;
     }
 
-    QSet<QString> initialFiles;
-    for (const QString& dir : m_monitoredDirs) {
-        QStringList files = getDirectoryFiles(dir, recursive);
-        initialFiles.unite(QSet<QString>(files.begin(), files.end()));
-    }
-
-    for (const QString& filePath : initialFiles) {
-        QFileInfo info(filePath);
-        qint64 size = info.size();
-        m_fileSizes[filePath] = size;
-        m_allMonitoredFiles.insert(filePath);
-    }
+    m_fileStats = getDirectoryFiles(m_rootDirs, recursive);
 
     m_monitoring = true;
-    m_scanTimer->start();
 
-    LOG_INFO(QString("Мониторинг запущен. Директорий: %1, Рекурсивно: %2")
-             .arg(m_monitoredDirs.size()).arg(recursive ? "да" : "нет"));
+    // С inotify/fanotify изменения приходят по конкретным путям,
+    // периодически проверяются только опрашиваемые каталоги
+    LOG_INFO(QString("Мониторинг запущен. Директорий: %1, опрашиваемых: %2, Рекурсивно: %3")
+             .arg(m_monitoredDirs.size()).arg(m_scanScheduler->polledCount())
+             .arg(recursive ? "да" : "нет"));
 
     emit monitoringStarted();
     return allAdded;
@@ -83,7 +171,15 @@ void FileMonitor::stopMonitoring() {
         return;
     }
 
-    m_scanTimer->stop();
+    m_scanScheduler->clear();
+    m_moveTimer->stop();
+    m_pendingMoves.clear();
+    m_fileEvents->clear();
+    m_dirEvents->clear();
+    m_inotify->removeAllWatches();
+    if (m_fanotify) {
+        m_fanotify->removeAllRoots();
+    }
 
     QStringList dirs = m_watcher->directories();
     QStringList files = m_watcher->files();
@@ -97,40 +193,47 @@ void FileMonitor::stopMonitoring() {
     }
 
     m_monitoredDirs.clear();
-    m_dirFiles.clear();
-    m_fileSizes.clear();
+    m_rootDirs.clear();
+    m_excludes.setRoots(m_rootDirs);
+    m_fileStats.clear();
     m_monitoring = false;
 
-    LOG_INFO("Мониторинг остановлен");
+    LOG_INFO(QString("Мониторинг остановлен. Событий получено: %1, передано после объединения: %2")
+             .arg(m_fileEvents->receivedCount()).arg(m_fileEvents->emittedCount()));
     emit monitoringStopped();
 }
 
 
 void FileMonitor::setExcludePatterns(const QStringList& patterns) {
-    m_excludePatterns = patterns;
-    m_excludeRegex.clear();
-
-    for (const QString& pattern : patterns) {
-        QString regexPattern = QRegularExpression::wildcardToRegularExpression(pattern);
-        QRegularExpression regex(regexPattern, QRegularExpression::CaseInsensitiveOption);
-        if (regex.isValid()) {
-            m_excludeRegex.append(regex);
-        } else {
-            LOG_WARNING(QString("Некорректный паттерн исключения: %1").arg(pattern));
-        }
-    }
+    m_excludes.setPatterns(patterns);
+}
+
 
-    LOG_DEBUG(QString("Установлено %1 паттернов исключения").arg(m_excludeRegex.size()));
+void FileMonitor::setBackend(const QString& backend) {
+    m_backendName = backend.trimmed().toLower();
+    LOG_DEBUG(QString("Запрошенный источник событий: %1").arg(m_backendName));
 }
 
 
 void FileMonitor::setCheckInterval(int msec) {
     if (msec > 0) {
         m_checkInterval = msec;
+        m_dirEvents->setQuietPeriod(msec);
         LOG_DEBUG(QString("Интервал проверки установлен: %1 мс").arg(m_checkInterval));
     }
 }
 
+void FileMonitor::setScanPolicy(int minMsec, int maxMsec, int budgetPercent) {
+    m_scanScheduler->setIntervals(minMsec, maxMsec);
+    m_scanScheduler->setBudget(budgetPercent);
+}
+
+void FileMonitor::setCoalescing(int quietMsec, int maxLatencyMsec) {
+    m_fileEvents->setQuietPeriod(quietMsec);
+    m_fileEvents->setMaxLatency(maxLatencyMsec);
+    m_dirEvents->setMaxLatency(maxLatencyMsec);
+}
+
 void FileMonitor::setMaxFileSize(qint64 bytes) {
     m_maxFileSize = bytes;
     LOG_DEBUG(QString("Макс. размер файла: %1 байт").arg(bytes));
@@ -152,15 +255,15 @@ bool FileMonitor::addDirectory(const QString &directory, bool recursive) {
         return false;
     }
 
-    m_monitoredDirs.insert(canonPath);
-
-    if (m_watcher->addPath(canonPath)) {
+    if (watchPath(canonPath)) {
+        registerDirectory(canonPath);
+        m_rootDirs.append(canonPath);
+        m_excludes.setRoots(m_rootDirs);
         LOG_DEBUG(QString("Директория добавлена в мониторинг: %1").arg(canonPath));
 
-        if (recursive) { addSubdirectoriesToWatcher(canonPath); }
+        if (recursive && !isFanotifyCovered(canonPath)) { addSubdirectoriesToWatcher(canonPath); }
         return true;
     } else {
-        m_monitoredDirs.remove(canonPath);
         LOG_ERROR(QString("Не удалось добавить директорию: %1").arg(canonPath));
         emit errorOccurred(QString("Не удалось добавить директорию: %1").arg(canonPath));
         return false;
@@ -172,8 +275,22 @@ void FileMonitor::removeDirectory(const QString &directory) {
     QDir dir(directory);
     QString canonPath = dir.canonicalPath();
 
-    if (m_watcher->removePath(canonPath)) {
+    bool removed = false;
+    if (m_fanotify && m_fanotify->roots().contains(canonPath)) {
+        removed = true;
+        m_fanotify->removeRoot(canonPath);
+    } else if (m_useInotify) {
+        removed = m_inotify->isWatched(canonPath);
+        m_inotify->removeWatch(canonPath);
+    } else {
+        removed = m_watcher->removePath(canonPath);
+    }
+
+    if (removed) {
         m_monitoredDirs.remove(canonPath);
+        m_scanScheduler->remove(canonPath);
+        m_rootDirs.removeAll(canonPath);
+        m_excludes.setRoots(m_rootDirs);
         LOG_DEBUG(QString("Директория удалена из мониторинга: %1").arg(canonPath));
     }
 }
@@ -181,64 +298,172 @@ void FileMonitor::removeDirectory(const QString &directory) {
 
 
 void FileMonitor::addSubdirectoriesToWatcher(const QString &directory) {
-    QDir dir(directory);
-    if (!dir.exists()) return;
+    // Обход параллельный, регистрация наблюдений - в текущем потоке
+    QVector<QStringList> found(m_walker.threadCount());
+    m_walker.walk({directory}, [&found](const WalkEntry& entry, int worker) {
+        if (entry.isDir) {
+            found[worker].append(entry.path);
+        }
+    });
+
+    for (const QStringList& subdirs : std::as_const(found)) {
+        for (const QString& subdirPath : subdirs) {
+            watchSubdirectory(subdirPath);
+        }
+    }
+}
 
-    QStringList subdirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-    for (const QString& subdir : subdirs) {
-        QString subdirPath = dir.absoluteFilePath(subdir);
-        QString canonPath = QDir(subdirPath).canonicalPath();
 
-        if (!m_monitoredDirs.contains(canonPath)) {
-            if (m_watcher->addPath(canonPath)) {
-                m_monitoredDirs.insert(canonPath);
-                LOG_DEBUG(QString("Поддиректория добавлена в мониторинг: %1").arg(canonPath));
+bool FileMonitor::watchSubdirectory(const QString &subdirPath) {
+    if (m_monitoredDirs.contains(subdirPath) || !watchPath(subdirPath)) {
+        return false;
+    }
+    registerDirectory(subdirPath);
+    LOG_DEBUG(QString("Поддиректория добавлена в мониторинг: %1").arg(subdirPath));
+    return true;
+}
+
+
+// Подкаталоги найденного дерева получают наблюдение после обхода: файл,
+// созданный в таком каталоге между его чтением и установкой наблюдения,
+// событий не дал. Поэтому каталоги, измененные с начала обхода (обычно
+// копируемые прямо сейчас), обходятся еще раз
+QHash<QString, FileStat> FileMonitor::watchSubtree(const QString &directory) {
+    QHash<QString, FileStat> files;
+    QStringList pending{directory};
+
+    while (!pending.isEmpty()) {
+        // Время изменения ядро ставит по тем же грубым часам
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        const qint64 walkStartNs = static_cast<qint64>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+
+        QStringList subdirs;
+        const QHash<QString, FileStat> found = getDirectoryFiles(pending, true, &subdirs);
+        for (auto it = found.constBegin(); it != found.constEnd(); ++it) {
+            files.insert(it.key(), it.value());
+        }
+
+        QSet<QString> changed;
+        for (const QString& subdirPath : std::as_const(subdirs)) {
+            if (watchSubdirectory(subdirPath) && directoryMtimeNs(subdirPath) >= walkStartNs) {
+                changed.insert(subdirPath);
             }
         }
 
-        addSubdirectoriesToWatcher(canonPath);
+        // Каталог внутри другого измененного обойдется вместе с ним
+        pending.clear();
+        for (const QString& subdirPath : std::as_const(changed)) {
+            bool nested = false;
+            for (qsizetype slash = subdirPath.lastIndexOf('/'); slash > 0 && !nested;
+                 slash = subdirPath.lastIndexOf('/', slash - 1)) {
+                nested = changed.contains(subdirPath.left(slash));
+            }
+            if (!nested) {
+                pending.append(subdirPath);
+            }
+        }
     }
+    return files;
 }
 
 
-QStringList FileMonitor::getDirectoryFiles(const QString &directory, bool recursive) const {
-    QStringList files;
-    QDir dir(directory);
+void FileMonitor::selectBackend() {
+    m_useInotify = m_inotify->isValid() && m_backendName != "qt";
 
-    if (!dir.exists()) {
-        return files;
+    if (m_backendName == "fanotify" && !m_fanotify) {
+        m_fanotify = new FanotifyWatcher(this);
+        if (m_fanotify->isValid()) {
+            connectEventSource(m_fanotify);
+        } else {
+            LOG_WARNING("fanotify недоступен, используется inotify/QFileSystemWatcher");
+            delete m_fanotify;
+            m_fanotify = nullptr;
+        }
     }
 
-    QStringList entries = dir.entryList(QDir::Files | QDir::NoDotAndDotDot);
-    for (const QString& entry : entries) {
-        QString filePath = dir.absoluteFilePath(entry);
-        if (shouldMonitorFile(filePath)) { files.append(filePath); }
+    LOG_INFO(QString("Источник событий: %1")
+             .arg(m_fanotify ? "fanotify" : (m_useInotify ? "inotify" : "QFileSystemWatcher")));
+}
+
+
+template <typename Source>
+void FileMonitor::connectEventSource(Source* source) {
+    connect(source, &Source::entryCreated, this, &FileMonitor::onEntryCreated);
+    connect(source, &Source::fileWritten, this, &FileMonitor::onFileWritten);
+    connect(source, &Source::contentModified, this, &FileMonitor::onContentModified);
+    connect(source, &Source::entryDeleted, this, &FileMonitor::onEntryDeleted);
+    connect(source, &Source::entryMovedFrom, this, &FileMonitor::onEntryMovedFrom);
+    connect(source, &Source::entryMovedTo, this, &FileMonitor::onEntryMovedTo);
+    connect(source, &Source::queueOverflow, this, &FileMonitor::onQueueOverflow);
+}
+
+
+bool FileMonitor::isFanotifyCovered(const QString &path) const {
+    return m_fanotify && m_fanotify->covers(path);
+}
+
+
+bool FileMonitor::watchPath(const QString &directory) {
+    // Каталоги внутри корня fanotify уже покрыты меткой файловой системы
+    if (isFanotifyCovered(directory)) {
+        return true;
+    }
+    if (m_fanotify && m_fanotify->addRoot(directory)) {
+        return true;
     }
+    if (m_useInotify) {
+        return m_inotify->addWatch(directory);
+    }
+    return m_watcher->addPath(directory);
+}
 
-    if (recursive) {
-        QStringList subdirs = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
-        for (const QString& subdir : subdirs) {
-            QString subdirPath = dir.absoluteFilePath(subdir);
-            files.append(getDirectoryFiles(subdirPath, recursive));
+
+QHash<QString, FileStat> FileMonitor::getDirectoryFiles(const QStringList &roots, bool recursive,
+                                                        QStringList *subdirs) const {
+    // Каждый поток обхода пишет в свою корзину, слияние - после завершения
+    QVector<QHash<QString, FileStat>> buckets(m_walker.threadCount());
+    QVector<QStringList> dirBuckets(subdirs ? m_walker.threadCount() : 0);
+    m_walker.walk(roots, [this, &buckets, &dirBuckets](const WalkEntry& entry, int worker) {
+        if (entry.isDir) {
+            if (!dirBuckets.isEmpty()) {
+                dirBuckets[worker].append(entry.path);
+            }
+        } else if (shouldMonitorFile(entry.path, entry.size, false)) {
+            buckets[worker].insert(entry.path, FileStat::fromEntry(entry));
         }
+    }, recursive);
+
+    for (const QStringList& found : std::as_const(dirBuckets)) {
+        subdirs->append(found);
     }
 
+    QHash<QString, FileStat> files = buckets.isEmpty() ? QHash<QString, FileStat>() : buckets.takeFirst();
+    for (const QHash<QString, FileStat>& bucket : std::as_const(buckets)) {
+        for (auto it = bucket.constBegin(); it != bucket.constEnd(); ++it) {
+            files.insert(it.key(), it.value());
+        }
+    }
     return files;
 }
 
 
 bool FileMonitor::shouldMonitorFile(const QString &filePath) const {
-    QFileInfo info(filePath);
-    if (info.size() > m_maxFileSize) {
+    return shouldMonitorFile(filePath, QFileInfo(filePath).size());
+}
+
+
+bool FileMonitor::shouldMonitorFile(const QString &filePath, qint64 size, bool checkParents) const {
+    if (size > m_maxFileSize) {
         return false;
     }
 
-    QString fileName = info.fileName();
-    if (fileName.contains("Untitled Document", Qt::CaseInsensitive)) {
+    QStringView fileName = QStringView(filePath).mid(filePath.lastIndexOf('/') + 1);
+    if (fileName.contains(u"Untitled Document", Qt::CaseInsensitive)) {
         return false;
     }
 
-    if (isExcluded(filePath)) {
+    if (isExcluded(filePath, checkParents)) {
         return false;
     }
 
@@ -246,184 +471,675 @@ bool FileMonitor::shouldMonitorFile(const QString &filePath) const {
 }
 
 
-bool FileMonitor::isExcluded(const QString &filePath) const {
-    QString fileName = QFileInfo(filePath).fileName();
+bool FileMonitor::isExcluded(const QString &filePath, bool checkParents) const {
+    const bool excluded = checkParents
+        ? m_excludes.isExcluded(filePath)
+        : m_excludes.matchesFileName(QStringView(filePath).mid(filePath.lastIndexOf('/') + 1));
 
-    for (const QRegularExpression& regex : m_excludeRegex) {
-        if (regex.match(fileName).hasMatch()) {
-            LOG_DEBUG(QString("Файл исключен: %1 (паттерн: %2)")
-                      .arg(fileName).arg(regex.pattern()));
-            return true;
-        }
+    if (excluded) {
+        LOG_DEBUG(QString("Файл исключен: %1").arg(filePath));
     }
-
-    return false;
+    return excluded;
 }
 
 
 void FileMonitor::onDirectoryChanged(const QString &path) {
     LOG_DEBUG(QString("Изменение в директории: %1").arg(path));
+    m_dirEvents->schedule(path, EventCoalescer::Change::Modified);
+}
+
 
-    static QTimer* debounceTimer = nullptr;
-    if (!debounceTimer) {
-        debounceTimer = new QTimer(this);
-        debounceTimer->setSingleShot(true);
-        debounceTimer->setInterval(m_checkInterval);
+void FileMonitor::onDirectorySettled(const QString &path) {
+    if (m_monitoring) {
+        LOG_DEBUG(QString("Обработка изменения директории: %1").arg(path));
+        rescanDirectory(path);
+    }
+}
+
+
+void FileMonitor::onFileChanged(const QString& path) {
+    LOG_DEBUG(QString("Файл изменен: %1").arg(path));
+
+    auto it = m_fileStats.find(path);
+    if (it == m_fileStats.end()) {
+        return;
+    }
+
+    FileStat current;
+    if (FileStat::read(path, current)) {
+        if (current != it.value()) {
+            it.value() = current;
+            m_fileEvents->schedule(path, EventCoalescer::Change::Modified);
+        }
+    } else {
+        m_fileStats.erase(it);
+        m_fileEvents->schedule(path, EventCoalescer::Change::Deleted);
     }
+}
 
-    if (debounceTimer->isActive()) {
-        debounceTimer->stop();
+void FileMonitor::onEntryCreated(const QString &path, bool isDir) {
+    if (!m_monitoring) {
+        return;
     }
-    debounceTimer->start();
 
-    connect(debounceTimer, &QTimer::timeout, this, [this, path]() {
-        if (m_monitoring) {
-            LOG_DEBUG(QString("Обработка изменения директории: %1").arg(path));
+    // Жесткая ссылка (ln) появляется без записи и закрытия: файл ставится
+    // в планировщик сразу, последующее закрытие сливается с созданием
+    if (!isDir) {
+        onFileWritten(path);
+        return;
+    }
+    if (!m_recursive) {
+        return;
+    }
 
-            QSet<QString> currentFiles;
-            for (const QString& dir : m_monitoredDirs) {
-                QStringList files = getDirectoryFiles(dir, m_recursive);
-                currentFiles.unite(QSet<QString>(files.begin(), files.end()));
-            }
-            QSet<QString> oldFiles = m_allMonitoredFiles;
-
-            // Новые файлы
-            QSet<QString> createdFiles = currentFiles - oldFiles;
-            for (const QString& filePath : createdFiles) {
-                QFileInfo info(filePath);
-                qint64 size = info.size();
-                m_fileSizes[filePath] = size;
-                m_allMonitoredFiles.insert(filePath);
-
-                LOG_DEBUG(QString("Файл создан: %1 (%2 байт)").arg(filePath).arg(size));
-                emit fileCreated(filePath, size);
-            }
+    LOG_DEBUG(QString("Новая директория: %1").arg(path));
+    scanNewDirectory(path);
+}
+
+
+void FileMonitor::onFileWritten(const QString &path) {
+    if (!m_monitoring) {
+        return;
+    }
+
+    FileStat current;
+    if (!FileStat::read(path, current) || !shouldMonitorFile(path, current.size)) {
+        return;
+    }
+
+    const qint64 size = current.size;
+    auto it = m_fileStats.find(path);
+    if (it != m_fileStats.end()) {
+        // Повторное закрытие без записи не меняет mtime - анализировать нечего
+        if (it.value() == current) {
+            return;
+        }
+        it.value() = current;
+        LOG_DEBUG(QString("Файл изменен: %1 (%2 байт)").arg(path).arg(size));
+        m_fileEvents->schedule(path, EventCoalescer::Change::Modified);
+    } else {
+        m_fileStats.insert(path, current);
+        LOG_DEBUG(QString("Файл создан: %1 (%2 байт)").arg(path).arg(size));
+        m_fileEvents->schedule(path, EventCoalescer::Change::Created);
+    }
+}
 
-            // Удаленные файлы
-            QSet<QString> deletedFiles = oldFiles - currentFiles;
-            for (const QString& filePath : deletedFiles) {
-                m_fileSizes.remove(filePath);
-                m_allMonitoredFiles.remove(filePath);
 
-                LOG_DEBUG(QString("Файл удален: %1").arg(filePath));
-                emit fileDeleted(filePath);
+void FileMonitor::onContentModified(const QString &path) {
+    if (!m_monitoring) {
+        return;
+    }
+
+    // Запись идет в открытый файл, закрытия может долго не быть. Событие уже
+    // ждет в планировщике - достаточно продлить серию без stat: итог выдается
+    // не позже максимальной задержки от первой записи, поэтому непрерывно
+    // растущий файл анализируется раз в max_latency_ms
+    if (m_fileEvents->isPending(path)) {
+        m_fileEvents->schedule(path, EventCoalescer::Change::Modified);
+        return;
+    }
+    onFileWritten(path);
+}
+
+
+void FileMonitor::onEntryDeleted(const QString &path, bool isDir) {
+    if (!m_monitoring) {
+        return;
+    }
+
+    if (isDir) {
+        forgetDirectory(path);
+        return;
+    }
+
+    if (m_fileStats.remove(path)) {
+
+        LOG_DEBUG(QString("Файл удален: %1").arg(path));
+        m_fileEvents->schedule(path, EventCoalescer::Change::Deleted);
+    }
+}
+
+
+void FileMonitor::onEntryMovedFrom(const QString &path, bool isDir, quint32 cookie) {
+    if (!m_monitoring) {
+        return;
+    }
+
+    // fanotify не сообщает cookie - перемещение видно как удаление и создание
+    if (cookie == 0) {
+        onEntryDeleted(path, isDir);
+        return;
+    }
+
+    m_pendingMoves.insert(cookie, PendingMove{path, isDir, m_moveClock.elapsed() + kMovePairTimeoutMs});
+    if (!m_moveTimer->isActive()) {
+        m_moveTimer->start(kMovePairTimeoutMs);
+    }
+}
+
+
+void FileMonitor::onEntryMovedTo(const QString &path, bool isDir, quint32 cookie) {
+    if (!m_monitoring) {
+        return;
+    }
+
+    if (cookie != 0) {
+        auto it = m_pendingMoves.find(cookie);
+        if (it != m_pendingMoves.end()) {
+            const PendingMove move = it.value();
+            m_pendingMoves.erase(it);
+            if (move.isDir) {
+                renameDirectory(move.path, path);
+            } else {
+                renameFile(move.path, path);
             }
+            return;
+        }
+    }
+
+    // Перемещенный файл уже записан целиком, IN_CLOSE_WRITE для него не будет
+    if (isDir) {
+        if (m_recursive) {
+            scanNewDirectory(path);
+        }
+    } else {
+        onFileWritten(path);
+    }
+}
 
-            // Модифицированные файлы
-            QSet<QString> existingFiles = currentFiles & oldFiles;
-            for (const QString& filePath : existingFiles) {
-                QFileInfo info(filePath);
-                qint64 newSize = info.size();
-                qint64 oldSize = m_fileSizes.value(filePath, -1);
 
-                if (newSize != oldSize && oldSize != -1) {
-                    m_fileSizes[filePath] = newSize;
+void FileMonitor::onMoveTimeout() {
+    const qint64 now = m_moveClock.elapsed();
+    qint64 nextExpiry = -1;
 
-                    LOG_DEBUG(QString("Файл изменен: %1 (%2 -> %3 байт)")
-                              .arg(filePath).arg(oldSize).arg(newSize));
-                    emit fileModified(filePath, newSize);
-                }
+    QList<PendingMove> expired;
+    for (auto it = m_pendingMoves.begin(); it != m_pendingMoves.end(); ) {
+        if (it->expiresAt <= now) {
+            expired.append(it.value());
+            it = m_pendingMoves.erase(it);
+        } else {
+            if (nextExpiry < 0 || it->expiresAt < nextExpiry) {
+                nextExpiry = it->expiresAt;
             }
+            ++it;
+        }
+    }
+
+    for (const PendingMove& move : std::as_const(expired)) {
+        onEntryDeleted(move.path, move.isDir);
+    }
+
+    if (nextExpiry >= 0) {
+        m_moveTimer->start(static_cast<int>(nextExpiry - now));
+    }
+}
 
-            QStringList files = getDirectoryFiles(path, m_recursive);
-            QSet<QString> fileSet(files.begin(), files.end());
-            m_dirFiles[path] = fileSet;
+
+void FileMonitor::renameFile(const QString &oldPath, const QString &newPath) {
+    FileStat current;
+    const bool monitored = FileStat::read(newPath, current) && shouldMonitorFile(newPath, current.size);
+
+    auto it = m_fileStats.find(oldPath);
+    if (it == m_fileStats.end()) {
+        // Прежний путь не отслеживался (исключен или слишком велик)
+        if (monitored) {
+            onFileWritten(newPath);
         }
-    });
+        return;
+    }
+
+    const FileStat previous = it.value();
+    m_fileStats.erase(it);
+
+    if (!monitored) {
+        LOG_DEBUG(QString("Файл перемещен в исключенный путь: %1 -> %2").arg(oldPath, newPath));
+        m_fileEvents->schedule(oldPath, EventCoalescer::Change::Deleted);
+        return;
+    }
+
+    // Файл на месте назначения заменен перемещаемым
+    m_fileEvents->cancel(newPath);
+    m_fileStats.insert(newPath, current);
+
+    // Несообщенное создание или изменение переносится на новый путь целиком
+    if (m_fileEvents->cancel(oldPath)) {
+        LOG_DEBUG(QString("Файл перемещен до анализа: %1 -> %2").arg(oldPath, newPath));
+        m_fileEvents->schedule(newPath, EventCoalescer::Change::Created);
+        return;
+    }
+
+    LOG_DEBUG(QString("Файл переименован: %1 -> %2").arg(oldPath, newPath));
+    emit fileRenamed(oldPath, newPath);
+
+    // rename меняет только ctime; другие отличия означают пропущенную запись
+    if (previous.size != current.size || previous.mtimeNs != current.mtimeNs) {
+        m_fileEvents->schedule(newPath, EventCoalescer::Change::Modified);
+    }
 }
 
 
-void FileMonitor::onFileChanged(const QString& path) {
-    LOG_DEBUG(QString("Файл изменен: %1").arg(path));
+void FileMonitor::renameDirectory(const QString &oldPath, const QString &newPath) {
+    if (!m_recursive || m_excludes.isExcludedDirectory(newPath)) {
+        forgetDirectory(oldPath);
+        return;
+    }
 
-    if (m_allMonitoredFiles.contains(path)) {
-        QFileInfo info(path);
-        if (info.exists()) {
-            qint64 newSize = info.size();
-            qint64 oldSize = m_fileSizes.value(path, -1);
+    const QString prefix = oldPath + "/";
 
-            if (newSize != oldSize) {
-                m_fileSizes[path] = newSize;
-                emit fileModified(path, newSize);
-            }
+    // Дескрипторы inotify следуют за inode каталога, меняются только пути
+    m_inotify->renameWatches(oldPath, newPath);
+    m_scanScheduler->removeUnder(oldPath);
+
+    QStringList movedDirs;
+    for (auto it = m_monitoredDirs.begin(); it != m_monitoredDirs.end(); ) {
+        if (*it == oldPath || it->startsWith(prefix)) {
+            movedDirs.append(newPath + it->mid(oldPath.size()));
+            it = m_monitoredDirs.erase(it);
         } else {
-            m_allMonitoredFiles.remove(path);
-            m_fileSizes.remove(path);
-            emit fileDeleted(path);
+            ++it;
+        }
+    }
+    for (const QString& dir : std::as_const(movedDirs)) {
+        registerDirectory(dir);
+    }
+
+    QStringList movedFiles;
+    for (auto it = m_fileStats.constBegin(); it != m_fileStats.constEnd(); ++it) {
+        if (it.key().startsWith(prefix)) {
+            movedFiles.append(it.key());
+        }
+    }
+
+    LOG_DEBUG(QString("Директория переименована: %1 -> %2 (файлов: %3)")
+              .arg(oldPath, newPath).arg(movedFiles.size()));
+
+    for (const QString& oldFile : std::as_const(movedFiles)) {
+        const QString newFile = newPath + oldFile.mid(oldPath.size());
+        const FileStat stat = m_fileStats.take(oldFile);
+
+        // Новые компоненты пути могут попасть под исключения
+        if (isExcluded(newFile)) {
+            m_fileEvents->schedule(oldFile, EventCoalescer::Change::Deleted);
+            continue;
+        }
+
+        m_fileStats.insert(newFile, stat);
+        if (m_fileEvents->cancel(oldFile)) {
+            m_fileEvents->schedule(newFile, EventCoalescer::Change::Created);
+        } else {
+            emit fileRenamed(oldFile, newFile);
         }
     }
+
+    // Каталог мог прийти из неотслеживаемого места вместе с новыми файлами
+    if (movedDirs.isEmpty()) {
+        scanNewDirectory(newPath);
+    }
 }
 
-void FileMonitor::performFullScan() {
+
+void FileMonitor::onQueueOverflow() {
     if (!m_monitoring) {
         return;
     }
 
-    LOG_DEBUG("Выполнение полного сканирования...");
+    // События потеряны: каждый каталог сверяется отдельно, работа идет квантами.
+    // Под fanotify в списке только корни, их поддеревья проверяются целиком
+    LOG_WARNING("Очередь событий переполнена, каталоги поставлены на проверку");
+    for (const QString& dir : std::as_const(m_monitoredDirs)) {
+        m_scanScheduler->requestScan(dir, isFanotifyCovered(dir));
+    }
+}
+
 
-    QSet<QString> currentFiles;
-    for (const QString& dir : m_monitoredDirs) {
-        QStringList files = getDirectoryFiles(dir, m_recursive);
-        currentFiles.unite(QSet<QString>(files.begin(), files.end()));
+void FileMonitor::scanNewDirectory(const QString &directory) {
+    QString canonPath = QDir(directory).canonicalPath();
+    if (canonPath.isEmpty() || m_excludes.isExcludedDirectory(canonPath)) {
+        return;
     }
 
-    QSet<QString> oldFiles = m_allMonitoredFiles;
+    // Файлы могли появиться до установки наблюдения (mkdir -p && cp);
+    // подкаталоги и файлы находятся одним обходом
+    QHash<QString, FileStat> files;
+    if (!isFanotifyCovered(canonPath)) {
+        if (!m_monitoredDirs.contains(canonPath) && watchPath(canonPath)) {
+            registerDirectory(canonPath);
+        }
+        files = watchSubtree(canonPath);
+    } else {
+        files = getDirectoryFiles({canonPath}, true);
+    }
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it) {
+        const QString& filePath = it.key();
+        if (m_fileStats.contains(filePath)) {
+            continue;
+        }
 
-    // Новые файлы
-    QSet<QString> createdFiles = currentFiles - oldFiles;
-    for (const QString& filePath : createdFiles) {
-        QFileInfo info(filePath);
-        qint64 size = info.size();
-        m_fileSizes[filePath] = size;
-        m_allMonitoredFiles.insert(filePath);
+        qint64 size = it.value().size;
+        m_fileStats.insert(filePath, it.value());
 
         LOG_DEBUG(QString("Файл создан: %1 (%2 байт)").arg(filePath).arg(size));
-        emit fileCreated(filePath, size);
+        m_fileEvents->schedule(filePath, EventCoalescer::Change::Created);
+    }
+}
+
+
+void FileMonitor::forgetDirectory(const QString &directory) {
+    const QString prefix = directory + "/";
+
+    unwatchDirectories(directory);
+
+    QStringList removedFiles;
+    for (auto it = m_fileStats.constBegin(); it != m_fileStats.constEnd(); ++it) {
+        if (it.key().startsWith(prefix)) {
+            removedFiles.append(it.key());
+        }
+    }
+
+    for (const QString& filePath : removedFiles) {
+        m_fileStats.remove(filePath);
+
+        LOG_DEBUG(QString("Файл удален: %1").arg(filePath));
+        m_fileEvents->schedule(filePath, EventCoalescer::Change::Deleted);
+    }
+}
+
+
+void FileMonitor::registerDirectory(const QString &directory) {
+    m_monitoredDirs.insert(directory);
+    if (needsPolling(directory)) {
+        m_scanScheduler->addPolled(directory);
+    }
+}
+
+
+void FileMonitor::unwatchDirectories(const QString &directory) {
+    const QString prefix = directory + "/";
+
+    m_inotify->removeWatchesUnder(directory);
+    m_scanScheduler->removeUnder(directory);
+
+    QStringList qtWatched;
+    for (auto it = m_monitoredDirs.begin(); it != m_monitoredDirs.end(); ) {
+        if (*it == directory || it->startsWith(prefix)) {
+            if (!m_useInotify && !isFanotifyCovered(*it)) {
+                qtWatched.append(*it);
+            }
+            it = m_monitoredDirs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (!qtWatched.isEmpty()) {
+        m_watcher->removePaths(qtWatched);
+    }
+}
+
+
+bool FileMonitor::verifyDirectory(const QString &directory, bool recursive) {
+    if (!m_monitoring) {
+        return false;
+    }
+
+    // Изменения определяются по числу событий, порожденных проверкой
+    const quint64 before = m_fileEvents->receivedCount();
+    if (recursive) {
+        verifySubtree(directory);
+    } else {
+        rescanDirectory(directory);
+    }
+    return m_fileEvents->receivedCount() != before;
+}
+
+
+void FileMonitor::verifySubtree(const QString &directory) {
+    // Наблюдение ставится заново: после монтирования старые дескрипторы
+    // указывают на скрытый каталог, а не на новую файловую систему
+    const bool covered = isFanotifyCovered(directory);
+    const bool isRoot = m_rootDirs.contains(directory);
+    if (!covered || isRoot) {
+        unwatchDirectories(directory);
+    }
+
+    if (!QFileInfo(directory).isDir()) {
+        forgetDirectory(directory);
+        return;
+    }
+
+    if (covered) {
+        // Новая файловая система внутри корня требует собственной метки
+        m_fanotify->addRoot(directory);
+        if (isRoot) {
+            registerDirectory(directory);
+        }
+    } else {
+        if (watchPath(directory)) {
+            registerDirectory(directory);
+        }
+        if (m_recursive) {
+            applyScanResult(watchSubtree(directory), directory, true);
+            return;
+        }
+    }
+
+    applyScanResult(getDirectoryFiles({directory}, m_recursive), directory, true);
+}
+
+
+void FileMonitor::onMountsChanged() {
+    const QHash<QString, QString> mounts = readMountTable();
+
+    QStringList changed;
+    for (auto it = mounts.constBegin(); it != mounts.constEnd(); ++it) {
+        if (m_mounts.value(it.key()) != it.value()) {
+            changed.append(it.key());
+        }
+    }
+    for (auto it = m_mounts.constBegin(); it != m_mounts.constEnd(); ++it) {
+        if (!mounts.contains(it.key())) {
+            changed.append(it.key());
+        }
+    }
+    m_mounts = mounts;
+
+    if (!m_monitoring) {
+        return;
+    }
+
+    // Смонтированное или отмонтированное поддерево внутри корня проверяется целиком
+    for (const QString& mountPoint : std::as_const(changed)) {
+        for (const QString& root : std::as_const(m_rootDirs)) {
+            if (mountPoint == root || mountPoint.startsWith(root + "/")) {
+                LOG_INFO(QString("Изменена точка монтирования: %1").arg(mountPoint));
+                m_scanScheduler->requestScan(mountPoint, true);
+                break;
+            }
+        }
+    }
+}
+
+
+QHash<QString, QString> FileMonitor::readMountTable() const {
+    QHash<QString, QString> mounts;
+
+#ifdef Q_OS_LINUX
+    QFile file("/proc/self/mountinfo");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return mounts;
+    }
+
+    // Формат: id parent major:minor root mount_point options [поля] - fstype source ...
+    const QList<QByteArray> lines = file.readAll().split('\n');
+    for (const QByteArray& line : lines) {
+        const QList<QByteArray> fields = line.split(' ');
+        const int separator = fields.indexOf("-");
+        if (fields.size() < 5 || separator < 0 || separator + 1 >= fields.size()) {
+            continue;
+        }
+        mounts.insert(unescapeMountPath(QFile::decodeName(fields.at(4))),
+                      QString::fromLatin1(fields.at(separator + 1)));
+    }
+#endif
+
+    return mounts;
+}
+
+
+bool FileMonitor::needsPolling(const QString &directory) const {
+    // QFileSystemWatcher не сообщает об изменении содержимого файлов
+    if (!m_useInotify && !isFanotifyCovered(directory)) {
+        return true;
+    }
+    return isOnNetworkFilesystem(directory);
+}
+
+
+bool FileMonitor::isOnNetworkFilesystem(const QString &directory) const {
+    // Ближайшая точка монтирования вверх по пути
+    QString path = directory;
+    while (!path.isEmpty()) {
+        auto it = m_mounts.constFind(path);
+        if (it != m_mounts.constEnd()) {
+            return kNetworkFilesystems.contains(it.value());
+        }
+        const int slash = path.lastIndexOf('/');
+        if (slash <= 0) {
+            break;
+        }
+        path.truncate(slash);
+    }
+
+    auto root = m_mounts.constFind("/");
+    return root != m_mounts.constEnd() && kNetworkFilesystems.contains(root.value());
+}
+
+
+
+void FileMonitor::applyScanResult(const QHash<QString, FileStat> &currentFiles, const QString &scopeDir,
+                                  bool scopeRecursive) {
+    // Удаленные файлы; при сканировании части дерева - только из нее
+    const QString scopePrefix = scopeDir + "/";
+    QStringList deletedFiles;
+    for (auto it = m_fileStats.constBegin(); it != m_fileStats.constEnd(); ++it) {
+        const QString& filePath = it.key();
+        if (!scopeDir.isEmpty()) {
+            const bool inScope = scopeRecursive
+                ? filePath.startsWith(scopePrefix)
+                : QStringView(filePath).left(filePath.lastIndexOf('/')) == scopeDir;
+            if (!inScope) {
+                continue;
+            }
+        }
+        if (!currentFiles.contains(filePath)) {
+            deletedFiles.append(filePath);
+        }
     }
 
-    // Удаленные файлы
-    QSet<QString> deletedFiles = oldFiles - currentFiles;
     for (const QString& filePath : deletedFiles) {
-        m_fileSizes.remove(filePath);
-        m_allMonitoredFiles.remove(filePath);
+        m_fileStats.remove(filePath);
 
         LOG_DEBUG(QString("Файл удален: %1").arg(filePath));
-        emit fileDeleted(filePath);
+        m_fileEvents->schedule(filePath, EventCoalescer::Change::Deleted);
     }
 
-    // Модифицированные файлы
-    QSet<QString> existingFiles = currentFiles & oldFiles;
-    for (const QString& filePath : existingFiles) {
-        QFileInfo info(filePath);
-        qint64 newSize = info.size();
-        qint64 oldSize = m_fileSizes.value(filePath, -1);
+    for (auto it = currentFiles.constBegin(); it != currentFiles.constEnd(); ++it) {
+        const QString& filePath = it.key();
+        const FileStat& current = it.value();
+
+        // Новые файлы
+        auto known = m_fileStats.find(filePath);
+        if (known == m_fileStats.end()) {
+            m_fileStats.insert(filePath, current);
 
-        if (newSize != oldSize && oldSize != -1) {
-            m_fileSizes[filePath] = newSize;
+            LOG_DEBUG(QString("Файл создан: %1 (%2 байт)").arg(filePath).arg(current.size));
+            m_fileEvents->schedule(filePath, EventCoalescer::Change::Created);
+            continue;
+        }
 
+        // Модифицированные файлы: любое расхождение stat, а не только размера
+        if (known.value() != current) {
             LOG_DEBUG(QString("Файл изменен: %1 (%2 -> %3 байт)")
-                      .arg(filePath).arg(oldSize).arg(newSize));
-            emit fileModified(filePath, newSize);
+                      .arg(filePath).arg(known.value().size).arg(current.size));
+            known.value() = current;
+            m_fileEvents->schedule(filePath, EventCoalescer::Change::Modified);
         }
     }
+}
+
 
-    m_dirFiles.clear();
-    for (const QString& dir : m_monitoredDirs) {
-        QStringList files = getDirectoryFiles(dir, m_recursive);
-        QSet<QString> fileSet(files.begin(), files.end());
-        m_dirFiles[dir] = fileSet;
+void FileMonitor::rescanDirectory(const QString &directory) {
+    if (!QFileInfo(directory).isDir()) {
+        forgetDirectory(directory);
+        return;
     }
 
-    LOG_DEBUG(QString("Полное сканирование завершено. Файлов в мониторинге: %1")
-              .arg(m_allMonitoredFiles.size()));
+    const QHash<QString, FileStat> files = getDirectoryFiles({directory}, false);
+    applyScanResult(files, directory);
+
+    // Новые подкаталоги ставятся под наблюдение вместе с содержимым
+    if (m_recursive) {
+        const QStringList subdirs = QDir(directory).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for (const QString& name : subdirs) {
+            const QString subdirPath = directory + "/" + name;
+            if (!m_monitoredDirs.contains(subdirPath)) {
+                scanNewDirectory(subdirPath);
+            }
+        }
+    }
 }
 
 
+void FileMonitor::onCoalescedChange(const QString &path, EventCoalescer::Change change) {
+    if (!m_monitoring) {
+        return;
+    }
+
+    // Состояние обновлено сразу при получении события, здесь только итог серии
+    if (change == EventCoalescer::Change::Deleted) {
+        if (!m_fileStats.contains(path)) {
+            emit fileDeleted(path);
+        }
+        return;
+    }
+
+    auto it = m_fileStats.find(path);
+    if (it == m_fileStats.end()) {
+        return;
+    }
+
+    // Записи в серии после первой не читали stat: размер берется на момент выдачи
+    FileStat current;
+    if (FileStat::read(path, current)) {
+        it.value() = current;
+    }
+    const qint64 size = it.value().size;
+    if (change == EventCoalescer::Change::Created) {
+        emit fileCreated(path, size);
+    } else {
+        emit fileModified(path, size);
+    }
+}
+
 
 QStringList FileMonitor::monitoredDirectories() const {
     return m_monitoredDirs.values();
 }
 
 int FileMonitor::monitoredFilesCount() const {
-    return m_allMonitoredFiles.size();
+    return m_fileStats.size();
+}
+
+
+bool FileStat::read(const QString &filePath, FileStat &stat) {
+    struct stat st;
+    if (::stat(QFile::encodeName(filePath).constData(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    stat.size = static_cast<qint64>(st.st_size);
+    stat.mtimeNs = static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    stat.ctimeNs = static_cast<qint64>(st.st_ctim.tv_sec) * 1000000000LL + st.st_ctim.tv_nsec;
+    stat.inode = static_cast<quint64>(st.st_ino);
+    return true;
 }
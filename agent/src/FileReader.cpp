@@ -0,0 +1,159 @@
+#include "../include/FileReader.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr size_t kBufferAlignment = 4096;
+constexpr qint64 kInitialBuffer = 64 * 1024;
+}
+
+FileReader::FileReader()
+    : m_fd(-1)
+    , m_fileSize(0)
+    , m_device(0)
+    , m_inode(0)
+    , m_mtimeNs(0)
+    , m_pathEncoder(QStringEncoder::System)
+    , m_buffer(nullptr)
+    , m_bufferCapacity(0)
+    , m_lastErrno(0)
+{
+}
+
+FileReader::~FileReader() {
+    release();
+    std::free(m_buffer);
+}
+
+bool FileReader::open(const QString& filePath) {
+    release();
+    m_fileSize = 0;
+    m_device = 0;
+    m_inode = 0;
+    m_mtimeNs = 0;
+    m_lastErrno = 0;
+
+    // Путь кодируется в переиспользуемый буфер, как QFile::encodeName, но без выделения памяти
+    m_pathBuffer.resize(m_pathEncoder.requiredSpace(filePath.size()) + 1);
+    char* end = m_pathEncoder.appendToBuffer(m_pathBuffer.data(), filePath);
+    *end = '\0';
+
+    // O_NOATIME не обновляет время доступа, но разрешен только владельцу файла
+    m_fd = ::open(m_pathBuffer.constData(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (m_fd < 0 && errno == EPERM) {
+        m_fd = ::open(m_pathBuffer.constData(), O_RDONLY | O_CLOEXEC);
+    }
+    if (m_fd < 0) {
+        m_lastErrno = errno;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        m_lastErrno = errno;
+        release();
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        m_lastErrno = EINVAL;
+        release();
+        return false;
+    }
+
+    m_fileSize = static_cast<qint64>(st.st_size);
+    m_device = static_cast<quint64>(st.st_dev);
+    m_inode = static_cast<quint64>(st.st_ino);
+    m_mtimeNs = static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool FileReader::read(qint64 maxBytes, QByteArrayView& data) {
+    data = QByteArrayView();
+    if (m_fd < 0) {
+        m_lastErrno = EBADF;
+        return false;
+    }
+
+    const qint64 length = maxBytes > 0 ? qMin(m_fileSize, maxBytes) : m_fileSize;
+    if (length == 0) {
+        return true;
+    }
+
+    return readChunk(0, length, data);
+}
+
+bool FileReader::readChunk(qint64 offset, qint64 length, QByteArrayView& data) {
+    data = QByteArrayView();
+    if (m_fd < 0) {
+        m_lastErrno = EBADF;
+        return false;
+    }
+
+    if (!ensureBuffer(length)) {
+        m_lastErrno = ENOMEM;
+        return false;
+    }
+
+    if (offset == 0 && length < m_fileSize) {
+        // Файл читается фрагментами подряд: ядро может читать с опережением
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    // Файл мог уменьшиться после fstat - берется столько, сколько прочитано
+    qint64 total = 0;
+    while (total < length) {
+        const ssize_t n = pread(m_fd, m_buffer + total, static_cast<size_t>(length - total), offset + total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            m_lastErrno = errno;
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+
+    data = QByteArrayView(m_buffer, total);
+    return true;
+}
+
+void FileReader::release() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+QString FileReader::lastError() const {
+    return m_lastErrno ? QString::fromLocal8Bit(strerror(m_lastErrno)) : QString();
+}
+
+bool FileReader::ensureBuffer(qint64 bytes) {
+    if (bytes <= m_bufferCapacity) {
+        return true;
+    }
+
+    // Буфер только растет: после первых файлов выделений памяти больше нет
+    qint64 capacity = qMax(m_bufferCapacity, kInitialBuffer);
+    while (capacity < bytes) {
+        capacity *= 2;
+    }
+
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, kBufferAlignment, static_cast<size_t>(capacity)) != 0) {
+        return false;
+    }
+
+    std::free(m_buffer);
+    m_buffer = static_cast<char*>(buffer);
+    m_bufferCapacity = capacity;
+    return true;
+}
@@ -0,0 +1,423 @@
+#include "../include/FileStateIndex.h"
+#include "../include/Logger.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr quint64 kMagic = 0x0031584449504C44ULL; // "DLPIDX1"
+constexpr quint32 kFormatVersion = 1;
+constexpr quint32 kInitialSlots = 1 << 16;
+constexpr quint64 kInitialArena = 8ULL * 1024 * 1024;
+
+enum SlotState : quint8 {
+    SlotEmpty    = 0,
+    SlotOccupied = 1,
+    SlotDeleted  = 2
+};
+
+inline quint64 mixKey(quint64 device, quint64 inode) {
+    quint64 x = inode ^ ((device << 32) | (device >> 32));
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+}
+
+struct FileStateIndex::Header {
+    quint64 magic;
+    quint32 formatVersion;
+    quint32 slotCount;
+    quint32 usedSlots;   // занятые + удаленные, для коэффициента заполнения
+    quint32 liveSlots;
+    quint64 arenaCapacity;
+    quint64 arenaUsed;
+    quint64 reserved[3];
+};
+
+struct FileStateIndex::Slot {
+    quint64 device;
+    quint64 inode;
+    qint64 size;
+    qint64 mtimeNs;
+    quint64 contentHash;
+    quint64 policyVersion;
+    quint32 pathOffset;
+    quint32 pathLength;
+    quint8 state;
+    quint8 verdict;
+    quint8 reserved[6];
+};
+
+FileStateIndex::FileStateIndex()
+    : m_fd(-1)
+    , m_base(nullptr)
+    , m_mappedSize(0)
+{
+    static_assert(sizeof(Header) == 64, "Неверный размер заголовка индекса");
+    static_assert(sizeof(Slot) == 64, "Неверный размер записи индекса");
+}
+
+FileStateIndex::~FileStateIndex() {
+    close();
+}
+
+bool FileStateIndex::open(const QString& filePath) {
+    close();
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    m_filePath = filePath;
+
+    m_fd = ::open(QFile::encodeName(filePath).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (m_fd < 0) {
+        LOG_ERROR(QString("Не удалось открыть индекс состояний: %1").arg(filePath));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        close();
+        return false;
+    }
+
+    bool valid = st.st_size >= static_cast<off_t>(sizeof(Header)) && mapFile(m_fd, st.st_size);
+    if (valid) {
+        const Header* hdr = header();
+        const quint64 expectedSize = sizeof(Header) + quint64(hdr->slotCount) * sizeof(Slot) +
+                                     hdr->arenaCapacity;
+        valid = hdr->magic == kMagic && hdr->formatVersion == kFormatVersion &&
+                hdr->slotCount > 0 && (hdr->slotCount & (hdr->slotCount - 1)) == 0 &&
+                expectedSize == static_cast<quint64>(st.st_size) &&
+                hdr->arenaUsed <= hdr->arenaCapacity;
+    }
+
+    if (!valid) {
+        if (st.st_size > 0) {
+            LOG_WARNING(QString("Индекс состояний поврежден или устарел, создается заново: %1")
+                        .arg(filePath));
+        }
+        unmap();
+        if (!initializeFile(m_fd, kInitialSlots, kInitialArena)) {
+            close();
+            return false;
+        }
+    }
+
+    LOG_INFO(QString("Индекс состояний файлов открыт: %1 (записей: %2)").arg(filePath).arg(size()));
+    return true;
+}
+
+void FileStateIndex::close() {
+    if (m_base) {
+        msync(m_base, m_mappedSize, MS_ASYNC);
+    }
+    unmap();
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool FileStateIndex::lookup(quint64 device, quint64 inode, FileStateRecord& record) const {
+    if (!m_base) {
+        return false;
+    }
+
+    qint64 index = findSlot(device, inode, false);
+    if (index < 0) {
+        return false;
+    }
+
+    const Slot& slot = slotTable()[index];
+    if (!hasValidPath(slot)) {
+        // Запись считается отсутствующей: update() перепишет путь,
+        // перестройка индекса ее отбросит
+        LOG_WARNING(QString("Запись индекса состояний с неверным путем: inode %1").arg(inode));
+        return false;
+    }
+    record.device = slot.device;
+    record.inode = slot.inode;
+    record.size = slot.size;
+    record.mtimeNs = slot.mtimeNs;
+    record.contentHash = slot.contentHash;
+    record.policyVersion = slot.policyVersion;
+    record.verdict = static_cast<ScanVerdict>(slot.verdict);
+    record.path = QString::fromUtf8(arena() + slot.pathOffset, slot.pathLength);
+    return true;
+}
+
+bool FileStateIndex::update(const FileStateRecord& record) {
+    if (!m_base) {
+        return false;
+    }
+
+    const QByteArray path = record.path.toUtf8();
+    qint64 index = findSlot(record.device, record.inode, false);
+    bool reusePath = false;
+
+    if (index >= 0) {
+        const Slot& slot = slotTable()[index];
+        reusePath = hasValidPath(slot) && slot.pathLength == static_cast<quint32>(path.size()) &&
+                    memcmp(arena() + slot.pathOffset, path.constData(), path.size()) == 0;
+    } else if ((quint64(header()->usedSlots) + 1) * 10 > quint64(header()->slotCount) * 7) {
+        // Если таблицу заполняют в основном удаленные записи, достаточно перестроить ее
+        const quint32 count = header()->slotCount;
+        const bool mostlyLive = quint64(header()->liveSlots) * 2 > count;
+        if (!grow(mostlyLive ? count * 2 : count, header()->arenaCapacity)) {
+            return false;
+        }
+    }
+
+    if (!reusePath && header()->arenaUsed + path.size() > header()->arenaCapacity) {
+        const quint64 needed = header()->arenaUsed + path.size();
+        if (!grow(header()->slotCount, qMax(header()->arenaCapacity * 2, needed * 2))) {
+            return false;
+        }
+    }
+
+    // После перестройки позиции записей меняются
+    index = findSlot(record.device, record.inode, false);
+
+    Header* hdr = header();
+    if (index < 0) {
+        index = findSlot(record.device, record.inode, true);
+        if (index < 0) {
+            return false;
+        }
+        if (slotTable()[index].state == SlotEmpty) {
+            hdr->usedSlots++;
+        }
+        hdr->liveSlots++;
+    }
+
+    Slot& slot = slotTable()[index];
+
+    // Версия политик обнуляется первой: недописанная запись не будет признана актуальной
+    slot.policyVersion = 0;
+    slot.device = record.device;
+    slot.inode = record.inode;
+    if (!reusePath) {
+        memcpy(arena() + hdr->arenaUsed, path.constData(), path.size());
+        slot.pathOffset = static_cast<quint32>(hdr->arenaUsed);
+        slot.pathLength = static_cast<quint32>(path.size());
+        hdr->arenaUsed += path.size();
+    }
+    slot.size = record.size;
+    slot.mtimeNs = record.mtimeNs;
+    slot.contentHash = record.contentHash;
+    slot.verdict = static_cast<quint8>(record.verdict);
+    slot.state = SlotOccupied;
+    slot.policyVersion = record.policyVersion;
+    return true;
+}
+
+void FileStateIndex::remove(quint64 device, quint64 inode) {
+    if (!m_base) {
+        return;
+    }
+
+    qint64 index = findSlot(device, inode, false);
+    if (index >= 0) {
+        slotTable()[index].state = SlotDeleted;
+        header()->liveSlots--;
+    }
+}
+
+void FileStateIndex::sync() {
+    if (m_base) {
+        msync(m_base, m_mappedSize, MS_ASYNC);
+    }
+}
+
+int FileStateIndex::size() const {
+    return m_base ? static_cast<int>(header()->liveSlots) : 0;
+}
+
+bool FileStateIndex::statFile(const QString& path, FileStateRecord& record) {
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return false;
+    }
+
+    record.device = static_cast<quint64>(st.st_dev);
+    record.inode = static_cast<quint64>(st.st_ino);
+    record.size = static_cast<qint64>(st.st_size);
+    record.mtimeNs = static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    record.path = path;
+    return true;
+}
+
+bool FileStateIndex::mapFile(int fd, quint64 fileSize) {
+    void* base = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        LOG_ERROR("Не удалось отобразить индекс состояний в память");
+        return false;
+    }
+
+    // Доступ к записям случайный, упреждающее чтение только мешает
+    madvise(base, fileSize, MADV_RANDOM);
+    m_base = static_cast<char*>(base);
+    m_mappedSize = fileSize;
+    return true;
+}
+
+void FileStateIndex::unmap() {
+    if (m_base) {
+        munmap(m_base, m_mappedSize);
+        m_base = nullptr;
+        m_mappedSize = 0;
+    }
+}
+
+bool FileStateIndex::initializeFile(int fd, quint32 slotCount, quint64 arenaCapacity) {
+    const quint64 fileSize = sizeof(Header) + quint64(slotCount) * sizeof(Slot) + arenaCapacity;
+
+    // Файл разреженный: пустые записи - нули, место выделяется по мере заполнения
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(fileSize)) != 0) {
+        LOG_ERROR("Не удалось выделить место под индекс состояний");
+        return false;
+    }
+
+    if (!mapFile(fd, fileSize)) {
+        return false;
+    }
+
+    Header* hdr = header();
+    hdr->formatVersion = kFormatVersion;
+    hdr->slotCount = slotCount;
+    hdr->usedSlots = 0;
+    hdr->liveSlots = 0;
+    hdr->arenaCapacity = arenaCapacity;
+    hdr->arenaUsed = 0;
+    hdr->magic = kMagic;
+    return true;
+}
+
+bool FileStateIndex::grow(quint32 slotCount, quint64 arenaCapacity) {
+    const QString tmpPath = m_filePath + ".tmp";
+    int tmpFd = ::open(QFile::encodeName(tmpPath).constData(),
+                       O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (tmpFd < 0) {
+        LOG_ERROR(QString("Не удалось создать временный индекс: %1").arg(tmpPath));
+        return false;
+    }
+
+    // Новый индекс строится рядом, старый отображается до успешной замены
+    FileStateIndex rebuilt;
+    rebuilt.m_filePath = m_filePath;
+    rebuilt.m_fd = tmpFd;
+    if (!rebuilt.initializeFile(tmpFd, slotCount, arenaCapacity)) {
+        rebuilt.close();
+        ::unlink(QFile::encodeName(tmpPath).constData());
+        return false;
+    }
+
+    const Slot* oldSlots = slotTable();
+    const quint32 oldCount = header()->slotCount;
+    for (quint32 i = 0; i < oldCount; ++i) {
+        const Slot& oldSlot = oldSlots[i];
+        if (oldSlot.state != SlotOccupied) {
+            continue;
+        }
+        if (!hasValidPath(oldSlot)) {
+            LOG_WARNING(QString("Запись индекса состояний с неверным путем отброшена: inode %1")
+                        .arg(oldSlot.inode));
+            continue;
+        }
+
+        Header* newHeader = rebuilt.header();
+        if (newHeader->arenaUsed + oldSlot.pathLength > newHeader->arenaCapacity) {
+            LOG_ERROR("Недостаточно места при перестройке индекса состояний");
+            rebuilt.close();
+            ::unlink(QFile::encodeName(tmpPath).constData());
+            return false;
+        }
+
+        qint64 index = rebuilt.findSlot(oldSlot.device, oldSlot.inode, true);
+        Slot& newSlot = rebuilt.slotTable()[index];
+        newSlot = oldSlot;
+        newSlot.pathOffset = static_cast<quint32>(newHeader->arenaUsed);
+        memcpy(rebuilt.arena() + newHeader->arenaUsed, arena() + oldSlot.pathOffset, oldSlot.pathLength);
+        newHeader->arenaUsed += oldSlot.pathLength;
+        newHeader->usedSlots++;
+        newHeader->liveSlots++;
+    }
+
+    msync(rebuilt.m_base, rebuilt.m_mappedSize, MS_SYNC);
+    if (::rename(QFile::encodeName(tmpPath).constData(), QFile::encodeName(m_filePath).constData()) != 0) {
+        LOG_ERROR("Не удалось заменить индекс состояний");
+        rebuilt.close();
+        ::unlink(QFile::encodeName(tmpPath).constData());
+        return false;
+    }
+
+    unmap();
+    ::close(m_fd);
+
+    m_fd = rebuilt.m_fd;
+    m_base = rebuilt.m_base;
+    m_mappedSize = rebuilt.m_mappedSize;
+    rebuilt.m_fd = -1;
+    rebuilt.m_base = nullptr;
+    rebuilt.m_mappedSize = 0;
+
+    LOG_DEBUG(QString("Индекс состояний перестроен: %1 слотов, %2 байт путей")
+              .arg(slotCount).arg(header()->arenaUsed));
+    return true;
+}
+
+FileStateIndex::Header* FileStateIndex::header() const {
+    return reinterpret_cast<Header*>(m_base);
+}
+
+FileStateIndex::Slot* FileStateIndex::slotTable() const {
+    return reinterpret_cast<Slot*>(m_base + sizeof(Header));
+}
+
+char* FileStateIndex::arena() const {
+    return m_base + sizeof(Header) + quint64(header()->slotCount) * sizeof(Slot);
+}
+
+bool FileStateIndex::hasValidPath(const Slot& slot) const {
+    // Файл мог быть поврежден: смещения из него не должны выводить за отображение
+    return quint64(slot.pathOffset) + slot.pathLength <= header()->arenaUsed;
+}
+
+qint64 FileStateIndex::findSlot(quint64 device, quint64 inode, bool forInsert) const {
+    const quint32 count = header()->slotCount;
+    const quint32 mask = count - 1;
+    const Slot* table = slotTable();
+
+    quint32 index = static_cast<quint32>(mixKey(device, inode)) & mask;
+    qint64 firstDeleted = -1;
+
+    for (quint32 probe = 0; probe < count; ++probe) {
+        const Slot& slot = table[index];
+        if (slot.state == SlotEmpty) {
+            if (!forInsert) {
+                return -1;
+            }
+            return firstDeleted >= 0 ? firstDeleted : index;
+        }
+        if (slot.state == SlotDeleted) {
+            if (forInsert && firstDeleted < 0) {
+                firstDeleted = index;
+            }
+        } else if (!forInsert && slot.device == device && slot.inode == inode) {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+
+    return forInsert ? firstDeleted : -1;
+}
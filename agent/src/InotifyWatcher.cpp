@@ -0,0 +1,224 @@
+#include "../include/InotifyWatcher.h"
+#include "../include/Logger.h"
+#include <QSocketNotifier>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+namespace {
+// Большой буфер позволяет забирать сотни событий за один read()
+constexpr size_t kReadBufferSize = 256 * 1024;
+
+#ifdef Q_OS_LINUX
+constexpr uint32_t kWatchMask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE |
+                                IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_ONLYDIR | IN_EXCL_UNLINK;
+#endif
+}
+
+InotifyWatcher::InotifyWatcher(QObject* parent)
+    : QObject(parent)
+    , m_fd(-1)
+    , m_notifier(nullptr)
+{
+#ifdef Q_OS_LINUX
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        LOG_WARNING(QString("inotify недоступен: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        return;
+    }
+
+    m_buffer.resize(kReadBufferSize);
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &InotifyWatcher::onReadyRead);
+    LOG_DEBUG("InotifyWatcher инициализирован");
+#endif
+}
+
+InotifyWatcher::~InotifyWatcher() {
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        if (m_notifier) {
+            m_notifier->setEnabled(false);
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+bool InotifyWatcher::isSupported() {
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool InotifyWatcher::addWatch(const QString& directory) {
+#ifdef Q_OS_LINUX
+    if (m_fd < 0) {
+        return false;
+    }
+
+    int wd = inotify_add_watch(m_fd, QFile::encodeName(directory).constData(), kWatchMask);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            LOG_ERROR(QString("Достигнут лимит inotify (max_user_watches): %1").arg(directory));
+        } else {
+            LOG_WARNING(QString("Не удалось добавить inotify наблюдение: %1 (%2)")
+                        .arg(directory).arg(QString::fromLocal8Bit(strerror(errno))));
+        }
+        return false;
+    }
+
+    // Повторное добавление того же inode возвращает прежний дескриптор
+    const QString previous = m_wdToPath.value(wd);
+    if (!previous.isEmpty() && previous != directory) {
+        m_pathToWd.remove(previous);
+    }
+
+    m_wdToPath[wd] = directory;
+    m_pathToWd[directory] = wd;
+    return true;
+#else
+    Q_UNUSED(directory);
+    return false;
+#endif
+}
+
+void InotifyWatcher::removeWatch(const QString& directory) {
+#ifdef Q_OS_LINUX
+    auto it = m_pathToWd.find(directory);
+    if (it == m_pathToWd.end()) {
+        return;
+    }
+
+    int wd = it.value();
+    m_pathToWd.erase(it);
+    m_wdToPath.remove(wd);
+    inotify_rm_watch(m_fd, wd);
+#else
+    Q_UNUSED(directory);
+#endif
+}
+
+void InotifyWatcher::removeWatchesUnder(const QString& directory) {
+    const QString prefix = directory + "/";
+    QStringList toRemove;
+
+    for (auto it = m_pathToWd.constBegin(); it != m_pathToWd.constEnd(); ++it) {
+        if (it.key() == directory || it.key().startsWith(prefix)) {
+            toRemove.append(it.key());
+        }
+    }
+
+    for (const QString& path : toRemove) {
+        removeWatch(path);
+    }
+}
+
+void InotifyWatcher::removeAllWatches() {
+#ifdef Q_OS_LINUX
+    for (auto it = m_wdToPath.constBegin(); it != m_wdToPath.constEnd(); ++it) {
+        inotify_rm_watch(m_fd, it.key());
+    }
+#endif
+    m_wdToPath.clear();
+    m_pathToWd.clear();
+}
+
+void InotifyWatcher::renameWatches(const QString& oldDirectory, const QString& newDirectory) {
+    const QString prefix = oldDirectory + "/";
+    QList<QPair<QString, int>> moved;
+
+    for (auto it = m_pathToWd.begin(); it != m_pathToWd.end(); ) {
+        if (it.key() == oldDirectory || it.key().startsWith(prefix)) {
+            moved.append(qMakePair(newDirectory + it.key().mid(oldDirectory.size()), it.value()));
+            it = m_pathToWd.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const auto& entry : std::as_const(moved)) {
+        m_pathToWd[entry.first] = entry.second;
+        m_wdToPath[entry.second] = entry.first;
+    }
+}
+
+void InotifyWatcher::onReadyRead() {
+#ifdef Q_OS_LINUX
+    for (;;) {
+        ssize_t len = ::read(m_fd, m_buffer.data(), m_buffer.size());
+        if (len <= 0) {
+            if (len < 0 && errno != EAGAIN && errno != EINTR) {
+                LOG_ERROR(QString("Ошибка чтения inotify: %1")
+                          .arg(QString::fromLocal8Bit(strerror(errno))));
+            }
+            break;
+        }
+
+        // События идут подряд, каждое выровнено ядром по границе inotify_event
+        const char* ptr = m_buffer.data();
+        const char* end = ptr + len;
+        while (ptr < end) {
+            const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+            processEvent(event);
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+}
+
+void InotifyWatcher::processEvent(const inotify_event* event) {
+#ifdef Q_OS_LINUX
+    if (event->mask & IN_Q_OVERFLOW) {
+        LOG_WARNING("Переполнение очереди inotify, требуется пересканирование");
+        emit queueOverflow();
+        return;
+    }
+
+    if (event->mask & IN_IGNORED) {
+        const QString path = m_wdToPath.take(event->wd);
+        if (!path.isEmpty() && m_pathToWd.value(path) == event->wd) {
+            m_pathToWd.remove(path);
+        }
+        return;
+    }
+
+    const QString dirPath = m_wdToPath.value(event->wd);
+    if (dirPath.isEmpty() || event->len == 0) {
+        return;
+    }
+
+    const QString path = dirPath + "/" + QFile::decodeName(event->name);
+    const bool isDir = event->mask & IN_ISDIR;
+
+    if (event->mask & IN_CREATE) {
+        emit entryCreated(path, isDir);
+    }
+    if ((event->mask & IN_MODIFY) && !isDir) {
+        emit contentModified(path);
+    }
+    if (event->mask & IN_CLOSE_WRITE) {
+        emit fileWritten(path);
+    }
+    if (event->mask & IN_MOVED_FROM) {
+        emit entryMovedFrom(path, isDir, event->cookie);
+    }
+    if (event->mask & IN_MOVED_TO) {
+        emit entryMovedTo(path, isDir, event->cookie);
+    }
+    if (event->mask & IN_DELETE) {
+        emit entryDeleted(path, isDir);
+    }
+#else
+    Q_UNUSED(event);
+#endif
+}
@@ -0,0 +1,541 @@
+#include "../include/NumericDetector.h"
+#include "../include/Logger.h"
+#include <QDate>
+#include <QStringList>
+#include <QtAlgorithms>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+enum Separator : quint8 {
+    SeparatorSpace = 1,
+    SeparatorDash = 2,
+    SeparatorParen = 4,
+    SeparatorNumberSign = 8
+};
+
+// Разделителей подряд между группами цифр: "+7 (999) 123", "1234 № 567890"
+constexpr int kMaxSeparatorRun = 3;
+
+struct PrefixEntry {
+    const char* low;
+    const char* high;
+    int minLength;
+    int maxLength;
+};
+
+// Префиксы BIN платежных систем
+const PrefixEntry kCardPrefixes[] = {
+    { "4", "4", 13, 19 },           // Visa
+    { "51", "55", 16, 16 },         // Mastercard
+    { "2221", "2720", 16, 16 },     // Mastercard
+    { "34", "34", 15, 15 },         // American Express
+    { "37", "37", 15, 15 },
+    { "2200", "2204", 16, 19 },     // Мир
+    { "62", "62", 16, 19 },         // UnionPay
+    { "3528", "3589", 16, 19 },     // JCB
+    { "6011", "6011", 16, 19 },     // Discover
+    { "644", "649", 16, 19 },
+    { "65", "65", 16, 19 },
+    { "300", "305", 14, 19 },       // Diners Club
+    { "36", "36", 14, 19 },
+    { "38", "39", 14, 19 },
+    { "50", "50", 13, 19 },         // Maestro
+    { "56", "58", 13, 19 },
+    { "67", "67", 13, 19 },
+};
+
+inline bool isAsciiDigit(char16_t c) {
+    return c >= '0' && c <= '9';
+}
+
+inline quint8 separatorKind(char16_t c) {
+    switch (c) {
+    case ' ':
+    case 0x00A0:    // неразрывный пробел
+    case 0x2009:    // тонкий пробел
+    case 0x202F:    // узкий неразрывный пробел
+        return SeparatorSpace;
+    case '-':
+    case 0x2011:    // неразрывный дефис
+    case 0x2013:    // короткое тире
+        return SeparatorDash;
+    case '(':
+    case ')':
+        return SeparatorParen;
+    case 0x2116:    // №
+        return SeparatorNumberSign;
+    default:
+        return 0;
+    }
+}
+
+// Часть слова или дробного числа: такие цифры не считаются отдельным номером
+inline bool isWordChar(char16_t c) {
+    return isAsciiDigit(c) || c == '_' || QChar(c).isLetterOrNumber();
+}
+
+inline bool isNumberJoiner(char16_t c) {
+    return c == '.' || c == ',' || c == '/' || c == ':';
+}
+
+int digitAt(const char* digits, int index) {
+    return digits[index] - '0';
+}
+
+bool luhnValid(const char* digits, int count) {
+    int sum = 0;
+    bool doubled = false;
+    for (int i = count - 1; i >= 0; --i) {
+        int d = digitAt(digits, i);
+        if (doubled) {
+            d *= 2;
+            if (d > 9) {
+                d -= 9;
+            }
+        }
+        sum += d;
+        doubled = !doubled;
+    }
+    return sum % 10 == 0;
+}
+
+int weightedSum(const char* digits, const int* weights, int count) {
+    int sum = 0;
+    for (int i = 0; i < count; ++i) {
+        sum += digitAt(digits, i) * weights[i];
+    }
+    return sum;
+}
+
+bool parseDigits(const QString& text, quint32& value, int& digits) {
+    const QString trimmed = text.trimmed();
+    if (trimmed.isEmpty() || trimmed.size() > 9) {
+        return false;
+    }
+    value = 0;
+    for (QChar c : trimmed) {
+        if (!isAsciiDigit(c.unicode())) {
+            return false;
+        }
+        value = value * 10 + static_cast<quint32>(c.unicode() - '0');
+    }
+    digits = static_cast<int>(trimmed.size());
+    return true;
+}
+}
+
+NumericDetector::NumericDetector()
+    : m_currentYear(QDate::currentDate().year() % 100)
+{
+}
+
+bool NumericDetector::kindFromName(const QString& name, Kind& kind)
+{
+    const QString lower = name.trimmed().toLower();
+    if (lower == "card") {
+        kind = Kind::Card;
+    } else if (lower == "inn") {
+        kind = Kind::Inn;
+    } else if (lower == "snils") {
+        kind = Kind::Snils;
+    } else if (lower == "passport") {
+        kind = Kind::Passport;
+    } else if (lower == "phone") {
+        kind = Kind::Phone;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool NumericDetector::addPolicy(int policyId, Kind kind, const QString& parameters)
+{
+    Policy policy;
+    policy.id = policyId;
+    policy.kind = kind;
+
+    if (kind == Kind::Card && !parsePrefixes(parameters, policy.prefixes)) {
+        LOG_WARNING(QString("Неверные префиксы BIN: %1").arg(parameters));
+        return false;
+    }
+
+    m_policies.append(policy);
+    return true;
+}
+
+bool NumericDetector::parsePrefixes(const QString& parameters, QVector<CardPrefix>& prefixes)
+{
+    prefixes.clear();
+
+    if (parameters.trimmed().isEmpty()) {
+        for (const PrefixEntry& entry : kCardPrefixes) {
+            CardPrefix prefix;
+            parseDigits(entry.low, prefix.low, prefix.digits);
+            parseDigits(entry.high, prefix.high, prefix.digits);
+            prefix.minLength = entry.minLength;
+            prefix.maxLength = entry.maxLength;
+            prefixes.append(prefix);
+        }
+        return true;
+    }
+
+    for (const QString& item : parameters.split(',', Qt::SkipEmptyParts)) {
+        const QStringList bounds = item.split('-');
+        CardPrefix prefix;
+        int highDigits = 0;
+        if (bounds.size() > 2 || !parseDigits(bounds.first(), prefix.low, prefix.digits) ||
+            !parseDigits(bounds.last(), prefix.high, highDigits) ||
+            highDigits != prefix.digits || prefix.low > prefix.high) {
+            return false;
+        }
+        prefix.minLength = 13;
+        prefix.maxLength = kMaxDigits;
+        prefixes.append(prefix);
+    }
+    return !prefixes.isEmpty();
+}
+
+// Следующая ASCII-цифра начиная с from; size, если цифр больше нет
+qsizetype NumericDetector::nextDigit(const char16_t* data, qsizetype from, qsizetype size)
+{
+    qsizetype i = from;
+#if defined(__SSE2__)
+    const __m128i zeroDigit = _mm_set1_epi16('0');
+    const __m128i minusOne = _mm_set1_epi16(-1);
+    const __m128i ten = _mm_set1_epi16(10);
+
+    for (; i + 8 <= size; i += 8) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // Знаковое сравнение: символы от U+8030 после вычитания отрицательны
+        const __m128i shifted = _mm_sub_epi16(block, zeroDigit);
+        const __m128i digits = _mm_and_si128(_mm_cmpgt_epi16(shifted, minusOne), _mm_cmplt_epi16(shifted, ten));
+        const uint mask = static_cast<uint>(_mm_movemask_epi8(digits));
+        if (mask != 0) {
+            // Два бита маски на символ
+            return i + qCountTrailingZeroBits(mask) / 2;
+        }
+    }
+#endif
+
+    for (; i < size; ++i) {
+        if (isAsciiDigit(data[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+// Группы цифр, начиная с цифры в from; возвращает позицию за последней цифрой.
+// Группы сверх kMaxGroups остаются следующей последовательности
+qsizetype NumericDetector::readToken(const char16_t* data, qsizetype from, qsizetype size, Token& token)
+{
+    token.groupCount = 0;
+    token.plus = from > 0 && data[from - 1] == '+';
+
+    qsizetype i = from;
+    while (token.groupCount < kMaxGroups) {
+        const int group = token.groupCount++;
+        token.groupStart[group] = i;
+        while (i < size && isAsciiDigit(data[i])) {
+            ++i;
+        }
+        token.groupEnd[group] = i;
+        token.gap[group] = 0;
+
+        qsizetype j = i;
+        quint8 separators = 0;
+        while (j < size && j - i < kMaxSeparatorRun) {
+            const quint8 kind = separatorKind(data[j]);
+            if (kind == 0) {
+                break;
+            }
+            separators |= kind;
+            ++j;
+        }
+        if (separators == 0 || j >= size || !isAsciiDigit(data[j])) {
+            break;
+        }
+        token.gap[group] = separators;
+        i = j;
+    }
+    return token.groupEnd[token.groupCount - 1];
+}
+
+// Число не продолжает слово и не является частью дроби, даты или времени
+bool NumericDetector::isolated(const char16_t* data, qsizetype size, qsizetype start, qsizetype end)
+{
+    if (start > 0) {
+        const char16_t before = data[start - 1];
+        if (isWordChar(before)) {
+            return false;
+        }
+        if (isNumberJoiner(before) && start > 1 && isAsciiDigit(data[start - 2])) {
+            return false;
+        }
+    }
+    if (end < size) {
+        const char16_t after = data[end];
+        if (isWordChar(after)) {
+            return false;
+        }
+        if (isNumberJoiner(after) && end + 1 < size && isAsciiDigit(data[end + 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NumericDetector::makeNumber(const char16_t* data, const Token& token, int first, int last, Number& number)
+{
+    number.count = 0;
+    number.groupCount = 0;
+    number.separators = 0;
+    number.plus = token.plus && first == 0;
+
+    for (int group = first; group <= last; ++group) {
+        const qsizetype length = token.groupEnd[group] - token.groupStart[group];
+        if (number.count + length > kMaxDigits) {
+            return false;
+        }
+        for (qsizetype i = token.groupStart[group]; i < token.groupEnd[group]; ++i) {
+            number.digits[number.count++] = static_cast<char>(data[i]);
+        }
+        number.groups[number.groupCount++] = static_cast<int>(length);
+        if (group < last) {
+            number.separators |= token.gap[group];
+        }
+    }
+    return true;
+}
+
+void NumericDetector::scan(QStringView text, qsizetype commitLength, QVector<Hit>& hits) const
+{
+    hits.clear();
+    if (m_policies.isEmpty()) {
+        return;
+    }
+
+    const char16_t* data = reinterpret_cast<const char16_t*>(text.utf16());
+    const qsizetype size = text.size();
+    QVector<QVector<Hit>> byPolicy(m_policies.size());
+    Token token;
+
+    qsizetype i = nextDigit(data, 0, size);
+    while (i < commitLength && i < size) {
+        const qsizetype end = readToken(data, i, size, token);
+        const qsizetype start = token.plus ? i - 1 : i;
+        if (isolated(data, size, start, end)) {
+            for (int p = 0; p < m_policies.size(); ++p) {
+                matchToken(m_policies.at(p), data, token, commitLength, byPolicy[p]);
+            }
+        }
+        i = nextDigit(data, end, size);
+    }
+
+    for (const QVector<Hit>& policyHits : std::as_const(byPolicy)) {
+        hits.append(policyHits);
+    }
+}
+
+// Самое длинное подходящее число из соседних групп, затем поиск продолжается
+// за ним: "Итого 100 4276 1234 5678 9012" дает номер карты без "100"
+void NumericDetector::matchToken(const Policy& policy, const char16_t* data, const Token& token,
+                                 qsizetype commitLength, QVector<Hit>& hits) const
+{
+    Number number;
+    int first = 0;
+    while (first < token.groupCount) {
+        const qsizetype start = token.plus && first == 0 ? token.groupStart[0] - 1 : token.groupStart[first];
+        if (start >= commitLength) {
+            return;
+        }
+
+        int matched = -1;
+        for (int last = token.groupCount - 1; last >= first; --last) {
+            if (makeNumber(data, token, first, last, number) && matches(policy, number)) {
+                matched = last;
+                break;
+            }
+        }
+
+        if (matched < 0) {
+            ++first;
+            continue;
+        }
+        hits.append(Hit{policy.id, start, token.groupEnd[matched]});
+        first = matched + 1;
+    }
+}
+
+bool NumericDetector::matches(const Policy& policy, const Number& number) const
+{
+    switch (policy.kind) {
+    case Kind::Card:
+        return isCard(number, policy.prefixes);
+    case Kind::Inn:
+        return isInn(number);
+    case Kind::Snils:
+        return isSnils(number);
+    case Kind::Passport:
+        return isPassport(number);
+    case Kind::Phone:
+        return isPhone(number);
+    }
+    return false;
+}
+
+// 13-19 цифр слитно или группами по 4 (Amex и Diners - 4-6-5, 4-6-4),
+// разделители одного вида, префикс из таблицы, контрольная цифра Луна
+bool NumericDetector::isCard(const Number& number, const QVector<CardPrefix>& prefixes)
+{
+    if (number.count < 13 || number.plus || (number.separators & ~(SeparatorSpace | SeparatorDash)) ||
+        number.separators == (SeparatorSpace | SeparatorDash)) {
+        return false;
+    }
+
+    if (number.groupCount > 1) {
+        bool byFour = true;
+        for (int g = 0; g + 1 < number.groupCount; ++g) {
+            byFour = byFour && number.groups[g] == 4;
+        }
+        const bool amexLike = number.groupCount == 3 && number.groups[0] == 4 && number.groups[1] == 6 &&
+                              (number.groups[2] == 5 || number.groups[2] == 4);
+        if (!(byFour && number.groups[number.groupCount - 1] <= 4) && !amexLike) {
+            return false;
+        }
+    }
+
+    bool known = false;
+    for (const CardPrefix& prefix : prefixes) {
+        if (number.count < prefix.minLength || number.count > prefix.maxLength) {
+            continue;
+        }
+        quint32 value = 0;
+        for (int i = 0; i < prefix.digits; ++i) {
+            value = value * 10 + static_cast<quint32>(digitAt(number.digits, i));
+        }
+        if (value >= prefix.low && value <= prefix.high) {
+            known = true;
+            break;
+        }
+    }
+
+    return known && luhnValid(number.digits, number.count);
+}
+
+// ИНН пишется слитно: 10 цифр с одной контрольной или 12 с двумя
+bool NumericDetector::isInn(const Number& number)
+{
+    if (number.groupCount != 1 || number.plus || (number.count != 10 && number.count != 12)) {
+        return false;
+    }
+    // Код региона 00 не выдается
+    if (number.digits[0] == '0' && number.digits[1] == '0') {
+        return false;
+    }
+
+    static const int kWeights10[] = { 2, 4, 10, 3, 5, 9, 4, 6, 8 };
+    static const int kWeights11[] = { 7, 2, 4, 10, 3, 5, 9, 4, 6, 8 };
+    static const int kWeights12[] = { 3, 7, 2, 4, 10, 3, 5, 9, 4, 6, 8 };
+
+    if (number.count == 10) {
+        return weightedSum(number.digits, kWeights10, 9) % 11 % 10 == digitAt(number.digits, 9);
+    }
+    if (number.count == 12) {
+        return weightedSum(number.digits, kWeights11, 10) % 11 % 10 == digitAt(number.digits, 10) &&
+               weightedSum(number.digits, kWeights12, 11) % 11 % 10 == digitAt(number.digits, 11);
+    }
+    return false;
+}
+
+// 11 цифр: слитно, "123-456-789 01" или "123456789 01".
+// Контрольное число проверяется для номеров больше 001-001-998
+bool NumericDetector::isSnils(const Number& number)
+{
+    if (number.count != 11 || number.plus || (number.separators & ~(SeparatorSpace | SeparatorDash))) {
+        return false;
+    }
+    const bool layout = number.groupCount == 1 ||
+                        (number.groupCount == 2 && number.groups[0] == 9) ||
+                        (number.groupCount == 4 && number.groups[0] == 3 && number.groups[1] == 3 &&
+                         number.groups[2] == 3);
+    if (!layout) {
+        return false;
+    }
+
+    quint32 body = 0;
+    int sum = 0;
+    for (int i = 0; i < 9; ++i) {
+        body = body * 10 + static_cast<quint32>(digitAt(number.digits, i));
+        sum += digitAt(number.digits, i) * (9 - i);
+    }
+    if (body <= 1001998) {
+        return false;
+    }
+
+    int control = sum % 101;
+    if (control == 100) {
+        control = 0;
+    }
+    return control == digitAt(number.digits, 9) * 10 + digitAt(number.digits, 10);
+}
+
+// Серия и номер: слитно, "4508 123456", "45 08 123456", "4508 № 123456".
+// Первые две цифры - код региона, следующие две - год выпуска бланка
+bool NumericDetector::isPassport(const Number& number) const
+{
+    if (number.count != 10 || number.plus || (number.separators & ~(SeparatorSpace | SeparatorNumberSign))) {
+        return false;
+    }
+    const bool layout = number.groupCount == 1 ||
+                        (number.groupCount == 2 && number.groups[0] == 4) ||
+                        (number.groupCount == 3 && number.groups[0] == 2 && number.groups[1] == 2);
+    if (!layout) {
+        return false;
+    }
+
+    if (number.digits[0] == '0' && number.digits[1] == '0') {
+        return false;
+    }
+    // Бланки нового образца выпускаются с 1997 года
+    const int year = digitAt(number.digits, 2) * 10 + digitAt(number.digits, 3);
+    if (year < 97 && year > m_currentYear + 1) {
+        return false;
+    }
+
+    for (int i = 4; i < 10; ++i) {
+        if (number.digits[i] != '0') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// +7 или 8, затем код из 3 цифр (3xx, 4xx, 8xx, 9xx) и 7 цифр номера
+bool NumericDetector::isPhone(const Number& number)
+{
+    if (number.count != 11 || (number.separators & SeparatorNumberSign)) {
+        return false;
+    }
+    const char country = number.digits[0];
+    if (number.plus ? country != '7' : (country != '8' && country != '7')) {
+        return false;
+    }
+    // Без "+" и без разделителей 7XXXXXXXXXX неотличим от произвольного числа
+    if (!number.plus && country == '7' && number.groupCount == 1) {
+        return false;
+    }
+
+    const bool layout = number.groups[0] == 11 ||
+                        (number.groups[0] == 1 && number.groupCount > 1 &&
+                         (number.groups[1] == 3 || number.groups[1] == 10));
+    if (!layout) {
+        return false;
+    }
+
+    const char code = number.digits[1];
+    return code == '3' || code == '4' || code == '8' || code == '9';
+}
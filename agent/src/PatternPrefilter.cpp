@@ -0,0 +1,504 @@
+#include "../include/PatternPrefilter.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+// Короче этого последовательность цифр слишком часто встречается в обычном тексте
+constexpr int kMinUsefulDigitRun = 3;
+// Символы, которые есть почти в любом тексте: берутся, только если других признаков нет
+const QString kCommonSymbols = QStringLiteral(".,-_:;/()'\"!?");
+// Десятичные цифры Unicode, кроме ASCII, начинаются с U+0660 (арабско-индийские);
+// кириллица и латиница ниже этой границы проверяются без обращения к таблицам
+constexpr char16_t kFirstNonAsciiDigit = 0x0660;
+
+enum class AtomKind {
+    Digit,
+    Symbol,
+    Other,
+    ZeroWidth
+};
+
+struct PatternInfo {
+    QVector<QChar> symbols;
+    int bestRun = 0;
+    int currentRun = 0;
+    bool valid = true;
+};
+
+inline bool isDigitChar(QChar c) {
+    const char16_t u = c.unicode();
+    return (u >= '0' && u <= '9') || (u >= kFirstNonAsciiDigit && c.isDigit());
+}
+
+inline bool isSymbolChar(QChar c) {
+    return !c.isLetterOrNumber() && !c.isSpace() && !c.isNull();
+}
+
+// Позиция за парной ')' группы, начинающейся в pos ('(')
+qsizetype skipGroup(QStringView pattern, qsizetype pos) {
+    int depth = 0;
+    bool inClass = false;
+    while (pos < pattern.size()) {
+        const QChar c = pattern.at(pos);
+        if (c == '\\') {
+            pos += 2;
+            continue;
+        }
+        if (inClass) {
+            if (c == ']') {
+                inClass = false;
+            }
+        } else if (c == '[') {
+            inClass = true;
+            if (pos + 1 < pattern.size() && pattern.at(pos + 1) == '^') {
+                ++pos;
+            }
+            if (pos + 1 < pattern.size() && pattern.at(pos + 1) == ']') {
+                ++pos;
+            }
+        } else if (c == '(') {
+            ++depth;
+        } else if (c == ')') {
+            if (--depth == 0) {
+                return pos + 1;
+            }
+        }
+        ++pos;
+    }
+    return -1;
+}
+
+// Класс символов начинается в pos ('['); возвращает позицию за ']'
+qsizetype parseClass(QStringView pattern, qsizetype pos, AtomKind& kind, QChar& symbol) {
+    ++pos;
+    bool negated = false;
+    if (pos < pattern.size() && pattern.at(pos) == '^') {
+        negated = true;
+        ++pos;
+    }
+
+    bool digitsOnly = true;
+    int members = 0;
+    QChar single;
+    bool first = true;
+    while (pos < pattern.size() && (first || pattern.at(pos) != ']')) {
+        first = false;
+        QChar c = pattern.at(pos);
+        if (c == '[' && pos + 1 < pattern.size() && pattern.at(pos + 1) == ':') {
+            // Класс POSIX [:name:]
+            const qsizetype close = pattern.indexOf(QLatin1String(":]"), pos + 2);
+            if (close < 0) {
+                break;
+            }
+            if (pattern.mid(pos + 2, close - pos - 2) != QLatin1String("digit")) {
+                digitsOnly = false;
+            }
+            members += 2;
+            pos = close + 2;
+            continue;
+        }
+        if (c == '\\') {
+            const QChar e = pos + 1 < pattern.size() ? pattern.at(pos + 1) : QChar();
+            pos += 2;
+            if (e == 'd') {
+                members += 2;
+                continue;
+            }
+            if (e.isLetterOrNumber() || e.isNull()) {
+                digitsOnly = false;
+                members += 2;
+                continue;
+            }
+            c = e;
+        } else {
+            ++pos;
+        }
+
+        // Диапазон a-b
+        if (pos + 1 < pattern.size() && pattern.at(pos) == '-' && pattern.at(pos + 1) != ']') {
+            const QChar high = pattern.at(pos + 1);
+            pos += 2;
+            if (!(c >= '0' && c <= '9' && high >= '0' && high <= '9')) {
+                digitsOnly = false;
+            }
+            members += 2;
+            continue;
+        }
+
+        if (!(c >= '0' && c <= '9')) {
+            digitsOnly = false;
+        }
+        single = c;
+        ++members;
+    }
+
+    if (pos >= pattern.size()) {
+        kind = AtomKind::Other;
+        return -1;
+    }
+
+    if (negated) {
+        kind = AtomKind::Other;
+    } else if (digitsOnly && members > 0) {
+        kind = AtomKind::Digit;
+    } else if (members == 1 && isSymbolChar(single)) {
+        kind = AtomKind::Symbol;
+        symbol = single;
+    } else {
+        kind = AtomKind::Other;
+    }
+    return pos + 1;
+}
+
+// Квантификатор после атома: наименьшее число повторений
+qsizetype parseQuantifier(QStringView pattern, qsizetype pos, int& minCount) {
+    minCount = 1;
+    if (pos >= pattern.size()) {
+        return pos;
+    }
+
+    const QChar q = pattern.at(pos);
+    if (q == '*' || q == '?') {
+        minCount = 0;
+        ++pos;
+    } else if (q == '+') {
+        ++pos;
+    } else if (q == '{') {
+        qsizetype p = pos + 1;
+        int low = -1;
+        while (p < pattern.size() && pattern.at(p).isDigit()) {
+            low = qMax(low, 0) * 10 + pattern.at(p).digitValue();
+            ++p;
+        }
+        if (p < pattern.size() && pattern.at(p) == ',') {
+            ++p;
+            while (p < pattern.size() && pattern.at(p).isDigit()) {
+                ++p;
+            }
+        }
+        if (low < 0 || p >= pattern.size() || pattern.at(p) != '}') {
+            // Не квантификатор, а символ '{'
+            return pos;
+        }
+        minCount = low;
+        pos = p + 1;
+    } else {
+        return pos;
+    }
+
+    // Ленивые и захватывающие формы
+    if (pos < pattern.size() && (pattern.at(pos) == '?' || pattern.at(pos) == '+')) {
+        ++pos;
+    }
+    return pos;
+}
+
+void addAtom(PatternInfo& info, AtomKind kind, QChar symbol, int minCount) {
+    if (kind == AtomKind::ZeroWidth) {
+        return;
+    }
+    if (kind == AtomKind::Digit && minCount > 0) {
+        info.currentRun += minCount;
+        info.bestRun = qMax(info.bestRun, info.currentRun);
+        return;
+    }
+
+    // Необязательный или нецифровой атом прерывает последовательность цифр
+    info.currentRun = 0;
+    if (kind == AtomKind::Symbol && minCount > 0 && !info.symbols.contains(symbol)) {
+        info.symbols.append(symbol);
+    }
+}
+}
+
+PatternTrigger PatternPrefilter::analyze(QStringView pattern)
+{
+    PatternInfo info;
+    qsizetype pos = 0;
+
+    while (pos < pattern.size() && info.valid) {
+        const QChar c = pattern.at(pos);
+        AtomKind kind = AtomKind::Other;
+        QChar symbol;
+
+        if (c == '|' || c == ')') {
+            // Альтернатива верхнего уровня: общей обязательной части нет
+            info.valid = false;
+            break;
+        } else if (c == '\\') {
+            const QChar e = pos + 1 < pattern.size() ? pattern.at(pos + 1) : QChar();
+            pos += 2;
+            if (e == 'd') {
+                kind = AtomKind::Digit;
+            } else if (e == 'b' || e == 'B' || e == 'A' || e == 'G') {
+                kind = AtomKind::ZeroWidth;
+            } else if (e == 'z' || e == 'Z' || e == 'K' || e == 'Q' || e.isNull()) {
+                // Конец текста и сдвиг начала совпадения не сочетаются с окнами
+                info.valid = false;
+                break;
+            } else if (e == 'p' || e == 'P' || e == 'x' || e == 'o' || e == 'g' || e == 'k') {
+                if (pos < pattern.size() && (pattern.at(pos) == '{' || pattern.at(pos) == '<')) {
+                    const QChar close = pattern.at(pos) == '{' ? QChar('}') : QChar('>');
+                    while (pos < pattern.size() && pattern.at(pos) != close) {
+                        ++pos;
+                    }
+                    ++pos;
+                } else if (e == 'x') {
+                    pos += qMin<qsizetype>(2, pattern.size() - pos);
+                } else if (e == 'p' || e == 'P') {
+                    ++pos;
+                }
+            } else if (e == 'c') {
+                ++pos;
+            } else if (e.isDigit()) {
+                // Обратная ссылка (\1, \10) или восьмеричный код (\012): длина
+                // и содержимое атома из шаблона не видны
+                info.valid = false;
+                break;
+            } else if (!e.isLetterOrNumber() && isSymbolChar(e)) {
+                kind = AtomKind::Symbol;
+                symbol = e;
+            }
+        } else if (c == '[') {
+            pos = parseClass(pattern, pos, kind, symbol);
+            if (pos < 0) {
+                info.valid = false;
+                break;
+            }
+        } else if (c == '(') {
+            const qsizetype end = skipGroup(pattern, pos);
+            if (end < 0) {
+                info.valid = false;
+                break;
+            }
+            const QStringView group = pattern.mid(pos, end - pos);
+            if (group.startsWith(QLatin1String("(?=")) || group.startsWith(QLatin1String("(?!"))) {
+                // Просмотр вперед может выйти за окно
+                info.valid = false;
+                break;
+            }
+            if (group.startsWith(QLatin1String("(?<=")) || group.startsWith(QLatin1String("(?<!")) ||
+                group.startsWith(QLatin1String("(?#"))) {
+                kind = AtomKind::ZeroWidth;
+            } else if (group.startsWith(QLatin1String("(*"))) {
+                info.valid = false;
+                break;
+            } else if (group.startsWith(QLatin1String("(?")) && group.size() > 2 &&
+                       (group.at(2).isLetter() || group.at(2) == '-') && !group.startsWith(QLatin1String("(?P"))) {
+                // Флаги (?i) или (?i:...); в режиме x пробелы и комментарии меняют разбор
+                qsizetype f = 2;
+                while (f < group.size() && (group.at(f).isLetter() || group.at(f) == '-')) {
+                    if (group.at(f) == 'x') {
+                        info.valid = false;
+                    }
+                    ++f;
+                }
+                kind = f < group.size() && group.at(f) == ')' ? AtomKind::ZeroWidth : AtomKind::Other;
+            }
+            pos = end;
+        } else if (c == '^') {
+            kind = AtomKind::ZeroWidth;
+            ++pos;
+        } else if (c == '$') {
+            info.valid = false;
+            break;
+        } else if (isDigitChar(c)) {
+            kind = AtomKind::Digit;
+            ++pos;
+        } else if (isSymbolChar(c) && c != '.' && c != '*' && c != '+' && c != '?' && c != '{') {
+            kind = AtomKind::Symbol;
+            symbol = c;
+            ++pos;
+        } else {
+            ++pos;
+        }
+
+        if (!info.valid) {
+            break;
+        }
+
+        int minCount = 1;
+        pos = parseQuantifier(pattern, pos, minCount);
+        addAtom(info, kind, symbol, minCount);
+    }
+
+    PatternTrigger trigger;
+    if (!info.valid) {
+        return trigger;
+    }
+
+    QChar common;
+    for (const QChar symbol : std::as_const(info.symbols)) {
+        if (!kCommonSymbols.contains(symbol)) {
+            trigger.symbol = symbol;
+            return trigger;
+        }
+        if (common.isNull()) {
+            common = symbol;
+        }
+    }
+    if (info.bestRun >= kMinUsefulDigitRun) {
+        trigger.digitRun = info.bestRun;
+    } else if (!common.isNull()) {
+        trigger.symbol = common;
+    } else if (info.bestRun > 0) {
+        trigger.digitRun = info.bestRun;
+    }
+    return trigger;
+}
+
+void PatternPrefilter::clear()
+{
+    m_symbols.clear();
+    m_minDigitRun = 0;
+}
+
+void PatternPrefilter::add(const PatternTrigger& trigger)
+{
+    if (!trigger.symbol.isNull()) {
+        if (!m_symbols.contains(trigger.symbol.unicode())) {
+            m_symbols.append(trigger.symbol.unicode());
+        }
+    } else if (trigger.digitRun > 0) {
+        m_minDigitRun = m_minDigitRun == 0 ? trigger.digitRun : qMin(m_minDigitRun, trigger.digitRun);
+    }
+}
+
+void PatternPrefilter::scan(QStringView text, Hits& hits) const
+{
+    hits.symbols.clear();
+    hits.symbols.resize(m_symbols.size());
+    hits.digitRuns.clear();
+
+    const char16_t* data = reinterpret_cast<const char16_t*>(text.utf16());
+    const qsizetype size = text.size();
+    const int symbolCount = static_cast<int>(m_symbols.size());
+    const bool wantDigits = m_minDigitRun > 0;
+    qsizetype runStart = -1;
+
+    auto visit = [&](qsizetype i) {
+        const char16_t u = data[i];
+        for (int s = 0; s < symbolCount; ++s) {
+            if (u == m_symbols[s]) {
+                hits.symbols[s].append(i);
+            }
+        }
+        if (!wantDigits) {
+            return;
+        }
+        if (isDigitChar(QChar(u))) {
+            if (runStart < 0) {
+                runStart = i;
+            }
+        } else if (runStart >= 0) {
+            if (i - runStart >= m_minDigitRun) {
+                hits.digitRuns.append(qMakePair(runStart, i));
+            }
+            runStart = -1;
+        }
+    };
+
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    const __m128i zeroDigit = _mm_set1_epi16('0');
+    const __m128i minusOne = _mm_set1_epi16(-1);
+    const __m128i ten = _mm_set1_epi16(10);
+    const __m128i nonAsciiDigits = _mm_set1_epi16(static_cast<short>(kFirstNonAsciiDigit - 1));
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= size; i += 8) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+        __m128i interesting = zero;
+        for (int s = 0; s < symbolCount; ++s) {
+            interesting = _mm_or_si128(interesting,
+                                       _mm_cmpeq_epi16(block, _mm_set1_epi16(static_cast<short>(m_symbols[s]))));
+        }
+        if (wantDigits) {
+            // Знаковое сравнение: символы от U+8000 отрицательны и отбираются отдельно
+            const __m128i shifted = _mm_sub_epi16(block, zeroDigit);
+            const __m128i ascii = _mm_and_si128(_mm_cmpgt_epi16(shifted, minusOne), _mm_cmplt_epi16(shifted, ten));
+            const __m128i high = _mm_or_si128(_mm_cmpgt_epi16(block, nonAsciiDigits), _mm_cmplt_epi16(block, zero));
+            interesting = _mm_or_si128(interesting, _mm_or_si128(ascii, high));
+        }
+
+        if (_mm_movemask_epi8(interesting) == 0) {
+            // Ни признаков, ни цифр: открытая последовательность цифр закончилась
+            if (runStart >= 0) {
+                if (i - runStart >= m_minDigitRun) {
+                    hits.digitRuns.append(qMakePair(runStart, i));
+                }
+                runStart = -1;
+            }
+            continue;
+        }
+
+        for (qsizetype j = i; j < i + 8; ++j) {
+            visit(j);
+        }
+    }
+#endif
+
+    for (; i < size; ++i) {
+        visit(i);
+    }
+    if (runStart >= 0 && size - runStart >= m_minDigitRun) {
+        hits.digitRuns.append(qMakePair(runStart, size));
+    }
+}
+
+bool PatternPrefilter::candidates(const PatternTrigger& trigger, const Hits& hits, qsizetype commitLength,
+                                  QVector<QPair<qsizetype, qsizetype>>& windows) const
+{
+    windows.clear();
+
+    // Совпадение длиной не больше maxLength, содержащее признак в позиции h,
+    // начинается в [h - maxLength + 1, h]
+    const qsizetype reach = trigger.maxLength > 0 ? trigger.maxLength - 1 : 0;
+    auto addWindow = [&](qsizetype first, qsizetype last) {
+        first = qMax<qsizetype>(0, first - reach);
+        last = qMin(last, commitLength - 1);
+        if (first > last) {
+            return;
+        }
+        if (!windows.isEmpty() && first <= windows.last().second + 1) {
+            windows.last().second = qMax(windows.last().second, last);
+        } else {
+            windows.append(qMakePair(first, last));
+        }
+    };
+
+    bool found = false;
+    if (!trigger.symbol.isNull()) {
+        const int index = static_cast<int>(m_symbols.indexOf(trigger.symbol.unicode()));
+        if (index < 0 || index >= hits.symbols.size()) {
+            return true;
+        }
+        const QVector<qsizetype>& positions = hits.symbols.at(index);
+        found = !positions.isEmpty();
+        if (trigger.maxLength >= 0) {
+            for (qsizetype h : positions) {
+                addWindow(h, h);
+            }
+        }
+    } else if (trigger.digitRun > 0) {
+        for (const QPair<qsizetype, qsizetype>& run : hits.digitRuns) {
+            if (run.second - run.first < trigger.digitRun) {
+                continue;
+            }
+            found = true;
+            if (trigger.maxLength < 0) {
+                break;
+            }
+            addWindow(run.first, run.second - trigger.digitRun);
+        }
+    } else {
+        return true;
+    }
+
+    return found;
+}
@@ -3,27 +3,132 @@
 #include <QJsonDocument>
 #include <QFile>
 #include <QTextStream>
+#include <QThread>
+#include <atomic>
+
+namespace {
+QStringList stringList(const QJsonValue& value) {
+    QStringList result;
+    for (const QJsonValue& item : value.toArray()) {
+        const QString text = item.toString().trimmed();
+        if (!text.isEmpty()) {
+            result.append(text);
+        }
+    }
+    return result;
+}
+
+// Размер текста в UTF-8 без построения копии: max_size областей задан в байтах
+qint64 utf8Length(QStringView text) {
+    qint64 length = 0;
+    for (const QChar c : text) {
+        const char16_t unit = c.unicode();
+        // Суррогатная пара дает 4 байта, по 2 на половину
+        length += unit < 0x80 ? 1 : (unit < 0x800 || c.isSurrogate()) ? 2 : 3;
+    }
+    return length;
+}
+
+// "scope": {"extensions": ["xlsx", ".csv"], "classes": ["spreadsheet"],
+//           "paths": ["/srv/finance/*", "*.min.js"], "max_size": 1048576}
+PolicyScope parseScope(const QJsonObject& json) {
+    PolicyScope scope;
+    for (QString extension : stringList(json["extensions"])) {
+        // Допускаются формы "csv", ".csv" и "*.csv"
+        while (extension.startsWith('*') || extension.startsWith('.')) {
+            extension.remove(0, 1);
+        }
+        if (!extension.isEmpty()) {
+            scope.extensions.append(extension.toLower());
+        }
+    }
+    scope.classes = stringList(json["classes"]);
+    scope.paths = stringList(json["paths"]);
+    scope.maxFileSize = qMax<qint64>(json["max_size"].toInteger(), 0);
+    return scope;
+}
+}
 
 PolicyChecker::PolicyChecker(QObject* parent)
     : QObject(parent)
     , m_caseSensitive(false)
     , m_maxContentSize(10 * 1024 * 1024)
+    , m_current(std::make_shared<const CompiledPolicySet>())
+    , m_loadGeneration(0)
 {
     LOG_DEBUG("PolicyChecker инициализирован");
 }
 
+PolicyChecker::~PolicyChecker()
+{
+    for (QThread* thread : std::as_const(m_loadThreads)) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+PolicySet PolicyChecker::policySet() const
+{
+    return std::atomic_load(&m_current);
+}
+
+// Новый набор заменяет старый одной атомарной записью. Проверки, начатые
+// раньше, держат свой указатель и заканчивают по старому набору; он
+// освобождается вместе с последним таким указателем
+void PolicyChecker::publish(const PolicySet& policies)
+{
+    std::atomic_store(&m_current, policies);
+}
+
+PolicySet PolicyChecker::rebuild()
+{
+    PolicySet policies = std::make_shared<const CompiledPolicySet>(m_policies, m_caseSensitive, m_maxContentSize);
+    publish(policies);
+    return policies;
+}
+
 // Загрузка политик из JSON-массива
 bool PolicyChecker::loadPolicies(const QJsonArray& policies)
 {
-    clearPolicies();
+    quint64 generation;
+    {
+        QMutexLocker locker(&m_updateLock);
+        generation = ++m_loadGeneration;
+    }
+    return loadPolicies(policies, generation);
+}
+
+void PolicyChecker::loadPoliciesAsync(const QJsonArray& policies)
+{
+    quint64 generation;
+    {
+        QMutexLocker locker(&m_updateLock);
+        generation = ++m_loadGeneration;
+    }
 
+    // Предыдущая компиляция, если еще идет, доработает в своем потоке
+    // и будет отброшена по номеру загрузки; цикл событий ее не ждет
+    QThread* thread = QThread::create([this, policies, generation]() {
+        loadPolicies(policies, generation);
+    });
+    thread->setObjectName("policy-load");
+    connect(thread, &QThread::finished, this, [this, thread]() {
+        m_loadThreads.removeOne(thread);
+        thread->deleteLater();
+    });
+    m_loadThreads.append(thread);
+    thread->start(QThread::LowPriority);
+}
+
+// Набор компилируется без блокировок: проверки продолжаются по текущему
+// набору, и промежутка без политик, как при очистке и заполнении на месте, нет
+bool PolicyChecker::loadPolicies(const QJsonArray& policies, quint64 generation)
+{
     if (policies.isEmpty()) {
         LOG_WARNING("Получен пустой список политик");
-        m_lastError = "Пустой список политик";
-        return false;
     }
 
-    int loadedCount = 0;
+    QHash<int, DlpPolicy> parsed;
     int failedCount = 0;
 
     for (const QJsonValue& policyValue : policies) {
@@ -41,87 +146,66 @@ bool PolicyChecker::loadPolicies(const QJsonArray& policies)
             continue;
         }
 
-        // Компилируем регулярное выражение
-        QRegularExpression regex;
-        if (!compilePattern(policy.pattern, regex)) {
-            LOG_WARNING(QString("Не удалось скомпилировать паттерн для политики: %1").arg(policy.name));
-            failedCount++;
-            continue;
+        parsed.insert(policy.id, policy);
+    }
+
+    bool caseSensitive;
+    int maxContentSize;
+    {
+        QMutexLocker locker(&m_updateLock);
+        caseSensitive = m_caseSensitive;
+        maxContentSize = m_maxContentSize;
+    }
+    PolicySet compiled = std::make_shared<const CompiledPolicySet>(parsed, caseSensitive, maxContentSize);
+
+    const int loadedCount = compiled->policyCount();
+    failedCount += compiled->rejected().size();
+    {
+        QMutexLocker locker(&m_updateLock);
+        if (generation != m_loadGeneration) {
+            LOG_DEBUG("Загрузка политик отменена: получен более новый список");
+            return false;
         }
 
-        // Сохраняем политику
-        m_policies[policy.id] = policy;
-        m_compiledPatterns[policy.id] = regex;
-        loadedCount++;
+        m_policies = compiled->policies();
+        if (caseSensitive != m_caseSensitive || maxContentSize != m_maxContentSize) {
+            // Настройки изменились во время компиляции
+            compiled = rebuild();
+        } else {
+            publish(compiled);
+        }
 
+        if (loadedCount == 0) {
+            m_lastError = policies.isEmpty()
+                ? QString("Пустой список политик")
+                : QString("Не удалось загрузить ни одной политики (ошибок: %1)").arg(failedCount);
+        }
+    }
+
+    for (const DlpPolicy& policy : compiled->policies()) {
         LOG_DEBUG(QString("Загружена политика: %1 (ID: %2, Сложность: %3)")
                  .arg(policy.name).arg(policy.id).arg(policy.severity));
     }
-
-    LOG_INFO(QString("Загружено политик: %1 (не удалось: %2)").arg(loadedCount).arg(failedCount));
+    LOG_INFO(QString("Загружено политик: %1 (не удалось: %2), версия набора %3")
+             .arg(loadedCount).arg(failedCount).arg(compiled->version(), 16, 16, QChar('0')));
     emit policiesLoaded(loadedCount);
 
-    if (loadedCount > 0) {
-        return true;
-    } else {
-        m_lastError = QString("Не удалось загрузить ни одной политики (ошибок: %1)").arg(failedCount);
-        return false;
-    }
+    return loadedCount > 0;
 }
 
 // Основной метод проверки содержимого
 QList<PolicyMatch> PolicyChecker::checkContent(const QString& content, const QString& filePath)
 {
-    QList<PolicyMatch> matches;
-
-    if (content.isEmpty()) {
-        LOG_DEBUG("Пустое содержимое для проверки");
-        return matches;
-    }
-
-    if (m_policies.isEmpty()) {
-        LOG_DEBUG("Нет политик для проверки");
-        return matches;
-    }
-
-    // Ограничение размера проверяемого контента
-    QString contentToCheck = content;
-    if (contentToCheck.size() > m_maxContentSize) {
-        contentToCheck = contentToCheck.left(m_maxContentSize);
-        LOG_DEBUG(QString("Содержимое обрезано до %1 байт").arg(m_maxContentSize));
-    }
-
-    LOG_DEBUG(QString("Проверка содержимого (%1 байт), политик: %2")
-             .arg(contentToCheck.size()).arg(m_policies.size()));
-
-    for (auto it = m_policies.constBegin(); it != m_policies.constEnd(); ++it) {
-        int policyId = it.key();
-        const DlpPolicy& policy = it.value();
-        const QRegularExpression& regex = m_compiledPatterns[policyId];
-
-        // Поиск совпадений в тексте
-        QRegularExpressionMatchIterator matchIterator = regex.globalMatch(contentToCheck);
-
-        while (matchIterator.hasNext()) {
-            QRegularExpressionMatch match = matchIterator.next();
-
-            if (match.hasMatch()) {
-                PolicyMatch policyMatch;
-                policyMatch.policyName = policy.name;
-                policyMatch.policyPattern = policy.pattern;
-                policyMatch.severity = policy.severity;
-                policyMatch.matchedContent = match.captured();
-                policyMatch.startPosition = match.capturedStart();
-                policyMatch.endPosition = match.capturedEnd();
-
-                matches.append(policyMatch);
-
-                LOG_DEBUG(QString("Найдено совпадение: %1 -> '%2'")
-                         .arg(policy.name).arg(policyMatch.matchedContent));
-            }
-        }
-    }
+    const PolicySet policies = policySet();
+    const CompiledPolicySet::FileScope scope = filePath.isEmpty()
+        ? policies->allPolicies() : policies->scopeFor(filePath, utf8Length(content));
+    const QList<PolicyMatch> matches = policies->checkContent(content, scope);
+    reportMatches(filePath, matches);
+    return matches;
+}
 
+void PolicyChecker::reportMatches(const QString& filePath, const QList<PolicyMatch>& matches)
+{
     if (!matches.isEmpty()) {
         LOG_WARNING(QString("Найдено %1 нарушений в %2").arg(matches.size())
                    .arg(filePath.isEmpty() ? "содержимом" : filePath));
@@ -142,29 +226,30 @@ QList<PolicyMatch> PolicyChecker::checkContent(const QString& content, const QSt
     if (!filePath.isEmpty()) {
         emit contentChecked(filePath, matches);
     }
-
-    return matches;
 }
 
 // Добавление одной политики
 void PolicyChecker::addPolicy(const DlpPolicy& policy)
 {
+    QMutexLocker locker(&m_updateLock);
     if (!policy.isValid()) {
         LOG_ERROR("Попытка добавить некорректную политику");
         m_lastError = "Некорректная политика";
         return;
     }
 
-    // Компилируем паттерн
-    QRegularExpression regex;
-    if (!compilePattern(policy.pattern, regex)) {
+    QHash<int, DlpPolicy> policies = m_policies;
+    policies.insert(policy.id, policy);
+    PolicySet compiled = std::make_shared<const CompiledPolicySet>(policies, m_caseSensitive, m_maxContentSize);
+    if (!compiled->rejected().isEmpty()) {
         LOG_ERROR(QString("Не удалось скомпилировать паттерн: %1").arg(policy.pattern));
-        m_lastError = "Неверный паттерн регулярного выражения";
+        m_lastError = policy.isRegex() ? "Неверный паттерн регулярного выражения" : "Неверный вид или параметры политики";
         return;
     }
 
-    m_policies[policy.id] = policy;
-    m_compiledPatterns[policy.id] = regex;
+    m_policies = policies;
+    publish(compiled);
+    locker.unlock();
 
     LOG_INFO(QString("Добавлена политика: %1 (ID: %2)").arg(policy.name).arg(policy.id));
     emit policyAdded(policy);
@@ -173,10 +258,12 @@ void PolicyChecker::addPolicy(const DlpPolicy& policy)
 // Удаление политики по id
 void PolicyChecker::removePolicy(int policyId)
 {
+    QMutexLocker locker(&m_updateLock);
     if (m_policies.contains(policyId)) {
         QString policyName = m_policies[policyId].name;
         m_policies.remove(policyId);
-        m_compiledPatterns.remove(policyId);
+        rebuild();
+        locker.unlock();
 
         LOG_INFO(QString("Удалена политика: %1 (ID: %2)").arg(policyName).arg(policyId));
         emit policyRemoved(policyId);
@@ -186,9 +273,10 @@ void PolicyChecker::removePolicy(int policyId)
 // Очистка всех политик
 void PolicyChecker::clearPolicies()
 {
+    QMutexLocker locker(&m_updateLock);
     int count = m_policies.size();
     m_policies.clear();
-    m_compiledPatterns.clear();
+    rebuild();
 
     LOG_INFO(QString("Очищено %1 политик").arg(count));
 }
@@ -196,16 +284,12 @@ void PolicyChecker::clearPolicies()
 // Установка чувствительности к регистру
 void PolicyChecker::setCaseSensitive(bool sensitive)
 {
+    QMutexLocker locker(&m_updateLock);
     if (m_caseSensitive != sensitive) {
         m_caseSensitive = sensitive;
 
         // Перекомпилируем все паттерны с новыми настройками
-        for (auto it = m_policies.begin(); it != m_policies.end(); ++it) {
-            QRegularExpression regex;
-            if (compilePattern(it.value().pattern, regex)) {
-                m_compiledPatterns[it.key()] = regex;
-            }
-        }
+        rebuild();
 
         LOG_DEBUG(QString("Чувствительность к регистру: %1").arg(sensitive ? "да" : "нет"));
     }
@@ -215,32 +299,18 @@ void PolicyChecker::setCaseSensitive(bool sensitive)
 // Установка ограничения размера проверяемого контента
 void PolicyChecker::setMaxContentSize(int bytes)
 {
+    QMutexLocker locker(&m_updateLock);
     if (bytes > 0 && bytes != m_maxContentSize) {
         m_maxContentSize = bytes;
+        rebuild();
         LOG_DEBUG(QString("Макс. размер контента: %1 байт").arg(bytes));
     }
 }
 
-
-// Компиляция регулярного выражения с учетом настроек
-bool PolicyChecker::compilePattern(const QString& pattern, QRegularExpression& regex) const
+QString PolicyChecker::lastError() const
 {
-    QRegularExpression::PatternOptions options = QRegularExpression::UseUnicodePropertiesOption;
-
-    if (!m_caseSensitive) {
-        options |= QRegularExpression::CaseInsensitiveOption;
-    }
-
-    regex.setPattern(pattern);
-    regex.setPatternOptions(options);
-
-    if (!regex.isValid()) {
-        LOG_ERROR(QString("Неверное регулярное выражение: %1 (%2)")
-                 .arg(pattern).arg(regex.errorString()));
-        return false;
-    }
-
-    return true;
+    QMutexLocker locker(&m_updateLock);
+    return m_lastError;
 }
 
 
@@ -274,9 +344,13 @@ DlpPolicy PolicyChecker::parsePolicy(const QJsonObject& json) const
         return policy;
     }
 
+    if (json.contains("kind") && json["kind"].isString() && !json["kind"].toString().isEmpty()) {
+        policy.kind = json["kind"].toString().toLower();
+    }
+
     if (json.contains("pattern") && json["pattern"].isString()) {
         policy.pattern = json["pattern"].toString();
-    } else {
+    } else if (policy.isRegex()) {
         LOG_WARNING("Политика не содержит паттерна");
         return policy;
     }
@@ -287,5 +361,10 @@ DlpPolicy PolicyChecker::parsePolicy(const QJsonObject& json) const
         policy.severity = "medium";
     }
 
+    // Без области политика проверяется на всех файлах
+    if (json.contains("scope") && json["scope"].isObject()) {
+        policy.scope = parseScope(json["scope"].toObject());
+    }
+
     return policy;
-}
\ No newline at end of file
+}
@@ -0,0 +1,317 @@
+#include "../include/ScanCheckpoints.h"
+#include "../include/Logger.h"
+#include "../include/VerdictCache.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+namespace {
+// Журнал переписывается, когда записей в нем вдвое больше емкости
+constexpr int kCompactFactor = 2;
+
+bool sameMatches(const QList<PolicyMatch>& a, const QList<PolicyMatch>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (qsizetype i = 0; i < a.size(); ++i) {
+        if (a.at(i).policyId != b.at(i).policyId ||
+            a.at(i).startPosition != b.at(i).startPosition ||
+            a.at(i).endPosition != b.at(i).endPosition) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameChunk(const ContentChunk& a, const ContentChunk& b) {
+    return a.byteStart == b.byteStart && a.byteLength == b.byteLength && a.hash == b.hash &&
+           a.charStart == b.charStart && a.charLength == b.charLength &&
+           sameMatches(a.matches, b.matches);
+}
+
+// Сколько первых фрагментов уже записано в журнал с прошлой точкой пути
+int commonPrefix(const ScanCheckpoint& previous, const ScanCheckpoint& checkpoint) {
+    if (previous.device != checkpoint.device || previous.inode != checkpoint.inode ||
+        previous.policyVersion != checkpoint.policyVersion) {
+        return 0;
+    }
+    const int count = qMin(previous.chunks.size(), checkpoint.chunks.size());
+    int keep = 0;
+    while (keep < count && sameChunk(previous.chunks.at(keep), checkpoint.chunks.at(keep))) {
+        ++keep;
+    }
+    return keep;
+}
+
+QString hex(quint64 value) {
+    return QString::number(value, 16);
+}
+
+quint64 fromHex(const QJsonValue& value, bool& ok) {
+    bool valid = false;
+    const quint64 result = value.toString().toULongLong(&valid, 16);
+    ok = ok && valid;
+    return result;
+}
+
+QByteArray recordLine(const QString& filePath, const ScanCheckpoint* checkpoint, int keep) {
+    QJsonObject record;
+    record["path"] = filePath;
+    if (!checkpoint) {
+        record["removed"] = true;
+    } else {
+        // Найденный текст и выборка содержимого в журнал не пишутся,
+        // как и еще не свернутые байты отпечатка
+        QJsonArray jsonChunks;
+        for (int i = keep; i < checkpoint->chunks.size(); ++i) {
+            const ContentChunk& chunk = checkpoint->chunks.at(i);
+            QJsonArray jsonMatches;
+            for (const PolicyMatch& match : chunk.matches) {
+                jsonMatches.append(VerdictCache::matchToJson(match));
+            }
+            QJsonObject jsonChunk;
+            jsonChunk["start"] = chunk.byteStart;
+            jsonChunk["length"] = chunk.byteLength;
+            jsonChunk["hash"] = hex(chunk.hash);
+            jsonChunk["char_start"] = chunk.charStart;
+            jsonChunk["char_length"] = chunk.charLength;
+            jsonChunk["matches"] = jsonMatches;
+            jsonChunks.append(jsonChunk);
+        }
+
+        const QByteArray state = checkpoint->hasherState.isEmpty()
+            ? checkpoint->hasher.saveState() : checkpoint->hasherState;
+        record["device"] = hex(checkpoint->device);
+        record["inode"] = hex(checkpoint->inode);
+        record["policy_version"] = hex(checkpoint->policyVersion);
+        record["scanned"] = checkpoint->scannedBytes;
+        record["tail_hash"] = hex(checkpoint->tailHash);
+        record["tail_length"] = checkpoint->tailLength;
+        record["hasher"] = QString::fromLatin1(state.toBase64());
+        record["keep"] = keep;
+        record["chunks"] = jsonChunks;
+    }
+
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    return line;
+}
+}
+
+ScanCheckpoints::ScanCheckpoints(int capacity)
+    : m_checkpoints(qMax(capacity, 0))
+    , m_capacity(qMax(capacity, 0))
+    , m_fileRecords(0)
+{
+}
+
+ScanCheckpoints::~ScanCheckpoints() {
+    close();
+}
+
+bool ScanCheckpoints::open(const QString& filePath) {
+    QMutexLocker locker(&m_lock);
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_filePath = filePath;
+    m_fileRecords = 0;
+
+    if (m_capacity == 0) {
+        return true;
+    }
+
+    QFile reader(filePath);
+    if (reader.open(QIODevice::ReadOnly)) {
+        // Записи применяются по порядку: каждая заменяет прошлую точку пути
+        // или дописывает к ее первым фрагментам новые
+        while (!reader.atEnd()) {
+            applyRecord(reader.readLine());
+            m_fileRecords++;
+        }
+        reader.close();
+    }
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        LOG_ERROR(QString("Не удалось открыть журнал точек продолжения: %1").arg(filePath));
+        return false;
+    }
+
+    LOG_INFO(QString("Точки продолжения загружены: %1").arg(m_checkpoints.size()));
+    if (m_fileRecords > static_cast<qint64>(m_capacity) * kCompactFactor) {
+        compact();
+    }
+    return true;
+}
+
+void ScanCheckpoints::close() {
+    QMutexLocker locker(&m_lock);
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_checkpoints.clear();
+}
+
+bool ScanCheckpoints::lookup(const QString& filePath, ScanCheckpoint& checkpoint) const {
+    QMutexLocker locker(&m_lock);
+    const ScanCheckpoint* stored = m_checkpoints.object(filePath);
+    if (!stored) {
+        return false;
+    }
+    checkpoint = *stored;
+    return true;
+}
+
+void ScanCheckpoints::store(const QString& filePath, const ScanCheckpoint& checkpoint) {
+    QMutexLocker locker(&m_lock);
+    const ScanCheckpoint* previous = m_checkpoints.object(filePath);
+    const int keep = previous ? commonPrefix(*previous, checkpoint) : 0;
+    m_checkpoints.insert(filePath, new ScanCheckpoint(checkpoint), costOf(checkpoint));
+    appendRecord(filePath, &checkpoint, keep);
+}
+
+void ScanCheckpoints::remove(const QString& filePath) {
+    QMutexLocker locker(&m_lock);
+    if (m_checkpoints.remove(filePath)) {
+        appendRecord(filePath, nullptr, 0);
+    }
+}
+
+void ScanCheckpoints::rename(const QString& oldPath, const QString& newPath) {
+    QMutexLocker locker(&m_lock);
+    ScanCheckpoint* checkpoint = m_checkpoints.take(oldPath);
+    if (checkpoint) {
+        appendRecord(oldPath, nullptr, 0);
+        m_checkpoints.insert(newPath, checkpoint, costOf(*checkpoint));
+        // Сжатие журнала при записи переписывает и эту точку
+        if (const ScanCheckpoint* moved = m_checkpoints.object(newPath)) {
+            appendRecord(newPath, moved, 0);
+        }
+    } else if (m_checkpoints.remove(newPath)) {
+        appendRecord(newPath, nullptr, 0);
+    }
+}
+
+void ScanCheckpoints::clear() {
+    QMutexLocker locker(&m_lock);
+    m_checkpoints.clear();
+    if (m_file.isOpen()) {
+        compact();
+    }
+}
+
+qsizetype ScanCheckpoints::costOf(const ScanCheckpoint& checkpoint) {
+    // Большие файлы с множеством фрагментов и совпадений занимают больше места
+    qsizetype matches = 0;
+    for (const ContentChunk& chunk : checkpoint.chunks) {
+        matches += chunk.matches.size();
+    }
+    return 1 + checkpoint.chunks.size() / 16 + matches;
+}
+
+bool ScanCheckpoints::appendRecord(const QString& filePath, const ScanCheckpoint* checkpoint, int keep) {
+    if (!m_file.isOpen()) {
+        return false;
+    }
+
+    const QByteArray line = recordLine(filePath, checkpoint, keep);
+    if (m_file.write(line) != line.size()) {
+        LOG_ERROR(QString("Ошибка записи в журнал точек продолжения: %1").arg(m_filePath));
+        return false;
+    }
+    m_file.flush();
+
+    m_fileRecords++;
+    if (m_fileRecords > static_cast<qint64>(m_capacity) * kCompactFactor) {
+        compact();
+    }
+    return true;
+}
+
+void ScanCheckpoints::applyRecord(const QByteArray& line) {
+    const QJsonObject record = QJsonDocument::fromJson(line).object();
+    const QString filePath = record["path"].toString();
+    if (filePath.isEmpty()) {
+        return;
+    }
+    if (record["removed"].toBool()) {
+        m_checkpoints.remove(filePath);
+        return;
+    }
+
+    // Продолжение прошлой записи без нее (вытеснена при загрузке) не применяется
+    ScanCheckpoint* checkpoint = new ScanCheckpoint();
+    const int keep = record["keep"].toInt();
+    if (keep > 0) {
+        const ScanCheckpoint* previous = m_checkpoints.object(filePath);
+        if (!previous || previous->chunks.size() < keep) {
+            delete checkpoint;
+            m_checkpoints.remove(filePath);
+            return;
+        }
+        checkpoint->chunks = previous->chunks.mid(0, keep);
+    }
+
+    bool ok = true;
+    checkpoint->device = fromHex(record["device"], ok);
+    checkpoint->inode = fromHex(record["inode"], ok);
+    checkpoint->policyVersion = fromHex(record["policy_version"], ok);
+    checkpoint->tailHash = fromHex(record["tail_hash"], ok);
+    checkpoint->scannedBytes = record["scanned"].toVariant().toLongLong();
+    checkpoint->tailLength = record["tail_length"].toVariant().toLongLong();
+    checkpoint->hasherState = QByteArray::fromBase64(record["hasher"].toString().toLatin1());
+
+    const QJsonArray jsonChunks = record["chunks"].toArray();
+    for (const QJsonValue& value : jsonChunks) {
+        const QJsonObject jsonChunk = value.toObject();
+        ContentChunk chunk;
+        chunk.byteStart = jsonChunk["start"].toVariant().toLongLong();
+        chunk.byteLength = jsonChunk["length"].toVariant().toLongLong();
+        chunk.hash = fromHex(jsonChunk["hash"], ok);
+        chunk.charStart = jsonChunk["char_start"].toVariant().toLongLong();
+        chunk.charLength = jsonChunk["char_length"].toVariant().toLongLong();
+        const QJsonArray jsonMatches = jsonChunk["matches"].toArray();
+        for (const QJsonValue& match : jsonMatches) {
+            chunk.matches.append(VerdictCache::matchFromJson(match.toObject()));
+        }
+        checkpoint->chunks.append(chunk);
+    }
+
+    if (!ok || checkpoint->hasherState.isEmpty() || checkpoint->tailLength > checkpoint->scannedBytes) {
+        delete checkpoint;
+        m_checkpoints.remove(filePath);
+        return;
+    }
+    m_checkpoints.insert(filePath, checkpoint, costOf(*checkpoint));
+}
+
+void ScanCheckpoints::compact() {
+    // В журнал переписываются полные записи точек, оставшихся в памяти
+    QSaveFile writer(m_filePath);
+    if (!writer.open(QIODevice::WriteOnly)) {
+        LOG_ERROR(QString("Не удалось переписать журнал точек продолжения: %1").arg(m_filePath));
+        return;
+    }
+
+    const QList<QString> paths = m_checkpoints.keys();
+    for (const QString& filePath : paths) {
+        const ScanCheckpoint* checkpoint = m_checkpoints.object(filePath);
+        if (checkpoint) {
+            writer.write(recordLine(filePath, checkpoint, 0));
+        }
+    }
+
+    m_file.close();
+    if (!writer.commit()) {
+        LOG_ERROR(QString("Не удалось переписать журнал точек продолжения: %1").arg(m_filePath));
+    } else {
+        m_fileRecords = paths.size();
+        LOG_DEBUG(QString("Журнал точек продолжения сжат до %1 записей").arg(m_fileRecords));
+    }
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        LOG_ERROR(QString("Не удалось открыть журнал точек продолжения: %1").arg(m_filePath));
+    }
+}
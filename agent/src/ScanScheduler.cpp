@@ -0,0 +1,193 @@
+#include "../include/ScanScheduler.h"
+#include "../include/Logger.h"
+#include <QTimer>
+
+namespace {
+// Наибольшая длительность одного кванта работы
+constexpr qint64 kSliceMsec = 50;
+}
+
+ScanScheduler::ScanScheduler(QObject* parent)
+    : QObject(parent)
+    , m_timer(new QTimer(this))
+    , m_minInterval(300000)
+    , m_maxInterval(3600000)
+    , m_resumeAt(0)
+    , m_budgetPercent(5)
+    , m_polledCount(0)
+{
+    m_clock.start();
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &ScanScheduler::onTimeout);
+}
+
+void ScanScheduler::setIntervals(int minMsec, int maxMsec) {
+    if (minMsec > 0) {
+        m_minInterval = minMsec;
+        m_maxInterval = qMax<qint64>(minMsec, maxMsec);
+        LOG_DEBUG(QString("Интервал проверочного сканирования: %1..%2 мс")
+                  .arg(m_minInterval).arg(m_maxInterval));
+    }
+}
+
+void ScanScheduler::setBudget(int percent) {
+    m_budgetPercent = qBound(1, percent, 100);
+    LOG_DEBUG(QString("Бюджет сканирования: %1%").arg(m_budgetPercent));
+}
+
+void ScanScheduler::addPolled(const QString& directory) {
+    auto it = m_entries.find(directory);
+    if (it == m_entries.end()) {
+        it = m_entries.insert(directory, Entry{});
+    }
+
+    Entry& entry = it.value();
+    if (entry.polled) {
+        return;
+    }
+
+    entry.polled = true;
+    entry.interval = m_minInterval;
+    m_polledCount++;
+
+    // Первые проверки разносятся по интервалу, чтобы не сканировать все каталоги разом
+    if (!entry.once) {
+        const qint64 offset = static_cast<qint64>(qHash(directory) % static_cast<size_t>(m_minInterval));
+        reschedule(directory, entry, m_clock.elapsed() + offset);
+        arm();
+    }
+}
+
+void ScanScheduler::requestScan(const QString& directory, bool recursive) {
+    auto it = m_entries.find(directory);
+    if (it == m_entries.end()) {
+        it = m_entries.insert(directory, Entry{});
+    }
+
+    Entry& entry = it.value();
+    entry.once = true;
+    entry.recursive = entry.recursive || recursive;
+    reschedule(directory, entry, m_clock.elapsed());
+    arm();
+}
+
+void ScanScheduler::remove(const QString& directory) {
+    auto it = m_entries.find(directory);
+    if (it != m_entries.end()) {
+        removeEntry(it);
+    }
+}
+
+void ScanScheduler::removeUnder(const QString& directory) {
+    const QString prefix = directory + "/";
+    for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+        if (it.key() == directory || it.key().startsWith(prefix)) {
+            if (it->due >= 0) {
+                m_queue.remove(it->due, it.key());
+            }
+            if (it->polled) {
+                m_polledCount--;
+            }
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ScanScheduler::clear() {
+    m_entries.clear();
+    m_queue.clear();
+    m_polledCount = 0;
+    m_timer->stop();
+}
+
+void ScanScheduler::onTimeout() {
+    const qint64 sliceStart = m_clock.elapsed();
+    int scanned = 0;
+    int changedCount = 0;
+
+    while (!m_queue.isEmpty()) {
+        auto first = m_queue.begin();
+        if (first.key() > m_clock.elapsed()) {
+            break;
+        }
+
+        const QString directory = first.value();
+        m_queue.erase(first);
+
+        auto it = m_entries.find(directory);
+        if (it == m_entries.end()) {
+            continue;
+        }
+
+        const bool recursive = it->once && it->recursive;
+        it->due = -1;
+
+        const bool changed = m_scanFunction && m_scanFunction(directory, recursive);
+        scanned++;
+        if (changed) {
+            changedCount++;
+        }
+
+        // Функция сканирования могла удалить каталог или снова запросить проверку
+        it = m_entries.find(directory);
+        if (it != m_entries.end() && it->due < 0) {
+            Entry& entry = it.value();
+            entry.once = false;
+            entry.recursive = false;
+
+            if (entry.polled) {
+                // Нет изменений - опрашиваем реже, есть - возвращаемся к минимальному интервалу
+                entry.interval = changed ? m_minInterval : qMin(entry.interval * 2, m_maxInterval);
+                reschedule(directory, entry, m_clock.elapsed() + entry.interval);
+            } else {
+                m_entries.erase(it);
+            }
+        }
+
+        if (m_clock.elapsed() - sliceStart >= kSliceMsec) {
+            break;
+        }
+    }
+
+    // Пауза после кванта пропорциональна затраченному времени и бюджету
+    const qint64 spent = m_clock.elapsed() - sliceStart;
+    m_resumeAt = m_clock.elapsed() + spent * (100 - m_budgetPercent) / m_budgetPercent;
+
+    if (scanned > 0) {
+        LOG_DEBUG(QString("Проверено каталогов: %1 за %2 мс, с изменениями: %3, в очереди: %4")
+                  .arg(scanned).arg(spent).arg(changedCount).arg(m_queue.size()));
+    }
+
+    arm();
+}
+
+void ScanScheduler::reschedule(const QString& directory, Entry& entry, qint64 due) {
+    if (entry.due >= 0) {
+        m_queue.remove(entry.due, directory);
+    }
+    entry.due = due;
+    m_queue.insert(due, directory);
+}
+
+void ScanScheduler::removeEntry(QHash<QString, Entry>::iterator it) {
+    if (it->due >= 0) {
+        m_queue.remove(it->due, it.key());
+    }
+    if (it->polled) {
+        m_polledCount--;
+    }
+    m_entries.erase(it);
+}
+
+void ScanScheduler::arm() {
+    if (m_queue.isEmpty()) {
+        m_timer->stop();
+        return;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    const qint64 next = qMax(m_queue.firstKey(), m_resumeAt);
+    m_timer->start(static_cast<int>(qMax<qint64>(0, next - now)));
+}
@@ -0,0 +1,250 @@
+#include "../include/VerdictCache.h"
+#include "../include/Logger.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+namespace {
+// Журнал переписывается, когда записей в нем вдвое больше емкости кэша
+constexpr int kCompactFactor = 2;
+
+QByteArray recordLine(const VerdictCache::Key& key, const QList<PolicyMatch>& matches) {
+    QJsonArray jsonMatches;
+    for (const PolicyMatch& match : matches) {
+        jsonMatches.append(VerdictCache::matchToJson(match));
+    }
+
+    QJsonObject record;
+    record["hash"] = QString::number(key.contentHash, 16);
+    record["length"] = key.length;
+    record["policy_version"] = QString::number(key.policyVersion, 16);
+    record["matches"] = jsonMatches;
+
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    return line;
+}
+}
+
+QJsonObject VerdictCache::matchToJson(const PolicyMatch& match) {
+    QJsonObject json;
+    json["policy_id"] = match.policyId;
+    json["name"] = match.policyName;
+    json["pattern"] = match.policyPattern;
+    json["severity"] = match.severity;
+    json["start"] = match.startPosition;
+    json["end"] = match.endPosition;
+    return json;
+}
+
+PolicyMatch VerdictCache::matchFromJson(const QJsonObject& json) {
+    PolicyMatch match;
+    // Записи журнала до появления policy_id: -1
+    match.policyId = json["policy_id"].toInt(-1);
+    match.policyName = json["name"].toString();
+    match.policyPattern = json["pattern"].toString();
+    match.severity = json["severity"].toString();
+    match.startPosition = json["start"].toVariant().toLongLong();
+    match.endPosition = json["end"].toVariant().toLongLong();
+    return match;
+}
+
+VerdictCache::VerdictCache(int capacity)
+    : m_capacity(qMax(capacity, 0))
+    , m_fileRecords(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_inserts(0)
+    , m_bytesSaved(0)
+{
+    m_cache.setMaxCost(m_capacity);
+}
+
+VerdictCache::~VerdictCache() {
+    close();
+}
+
+bool VerdictCache::open(const QString& filePath) {
+    QMutexLocker locker(&m_lock);
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+    m_filePath = filePath;
+    m_fileRecords = 0;
+
+    if (m_capacity == 0) {
+        return true;
+    }
+
+    QFile reader(filePath);
+    if (reader.open(QIODevice::ReadOnly)) {
+        // Более поздние записи вытесняют ранние, как при обычной работе
+        while (!reader.atEnd()) {
+            const QJsonObject record = QJsonDocument::fromJson(reader.readLine()).object();
+            if (record.isEmpty()) {
+                continue;
+            }
+
+            Key key;
+            bool hashOk = false;
+            bool versionOk = false;
+            key.contentHash = record["hash"].toString().toULongLong(&hashOk, 16);
+            key.length = record["length"].toVariant().toLongLong();
+            key.policyVersion = record["policy_version"].toString().toULongLong(&versionOk, 16);
+            if (!hashOk || !versionOk) {
+                continue;
+            }
+
+            QList<PolicyMatch> matches;
+            const QJsonArray jsonMatches = record["matches"].toArray();
+            for (const QJsonValue& value : jsonMatches) {
+                matches.append(matchFromJson(value.toObject()));
+            }
+            insertLocked(key, matches);
+            m_fileRecords++;
+        }
+        reader.close();
+    }
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        LOG_ERROR(QString("Не удалось открыть журнал кэша вердиктов: %1").arg(filePath));
+        return false;
+    }
+
+    LOG_INFO(QString("Кэш вердиктов загружен: %1 записей").arg(m_cache.size()));
+    if (m_fileRecords > static_cast<qint64>(m_capacity) * kCompactFactor) {
+        compact();
+    }
+    return true;
+}
+
+void VerdictCache::close() {
+    QMutexLocker locker(&m_lock);
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+void VerdictCache::setCapacity(int entries) {
+    QMutexLocker locker(&m_lock);
+    m_capacity = qMax(entries, 0);
+    m_cache.setMaxCost(m_capacity);
+}
+
+bool VerdictCache::lookup(const Key& key, QList<PolicyMatch>& matches, qint64 bytesSaved) {
+    if (m_capacity == 0) {
+        return false;
+    }
+
+    {
+        QMutexLocker locker(&m_lock);
+        const Entry* entry = m_cache.object(key);
+        if (!entry) {
+            locker.unlock();
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        matches = entry->matches;
+    }
+
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    m_bytesSaved.fetch_add(bytesSaved, std::memory_order_relaxed);
+    return true;
+}
+
+void VerdictCache::insert(const Key& key, const QList<PolicyMatch>& matches) {
+    if (m_capacity == 0) {
+        return;
+    }
+
+    QMutexLocker locker(&m_lock);
+    insertLocked(key, matches);
+    m_inserts.fetch_add(1, std::memory_order_relaxed);
+
+    if (appendRecord(key, matches)) {
+        m_fileRecords++;
+        if (m_fileRecords > static_cast<qint64>(m_capacity) * kCompactFactor) {
+            compact();
+        }
+    }
+}
+
+void VerdictCache::insertLocked(const Key& key, const QList<PolicyMatch>& matches) {
+    // Найденный текст (номера карт, пароли) не хранится ни в памяти, ни в журнале:
+    // при попадании он берется из самого файла
+    Entry* entry = new Entry{matches};
+    for (PolicyMatch& match : entry->matches) {
+        match.matchedContent.clear();
+    }
+    // Файл с большим числом совпадений занимает в кэше больше места
+    const qsizetype cost = 1 + matches.size();
+    m_cache.insert(key, entry, cost);
+}
+
+bool VerdictCache::appendRecord(const Key& key, const QList<PolicyMatch>& matches) {
+    if (!m_file.isOpen()) {
+        return false;
+    }
+
+    const QByteArray line = recordLine(key, matches);
+    if (m_file.write(line) != line.size()) {
+        LOG_ERROR(QString("Ошибка записи в журнал кэша вердиктов: %1").arg(m_filePath));
+        return false;
+    }
+    m_file.flush();
+    return true;
+}
+
+void VerdictCache::compact() {
+    // В журнал переписывается только то, что осталось в памяти
+    QSaveFile writer(m_filePath);
+    if (!writer.open(QIODevice::WriteOnly)) {
+        LOG_ERROR(QString("Не удалось переписать журнал кэша вердиктов: %1").arg(m_filePath));
+        return;
+    }
+
+    const QList<Key> keys = m_cache.keys();
+    for (const Key& key : keys) {
+        const Entry* entry = m_cache.object(key);
+        if (entry) {
+            writer.write(recordLine(key, entry->matches));
+        }
+    }
+
+    m_file.close();
+    if (!writer.commit()) {
+        LOG_ERROR(QString("Не удалось переписать журнал кэша вердиктов: %1").arg(m_filePath));
+    } else {
+        m_fileRecords = keys.size();
+        LOG_DEBUG(QString("Журнал кэша вердиктов сжат до %1 записей").arg(m_fileRecords));
+    }
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        LOG_ERROR(QString("Не удалось открыть журнал кэша вердиктов: %1").arg(m_filePath));
+    }
+}
+
+VerdictCache::Stats VerdictCache::stats() const {
+    Stats result;
+    {
+        QMutexLocker locker(&m_lock);
+        result.entries = static_cast<int>(m_cache.size());
+    }
+    result.hits = m_hits.load(std::memory_order_relaxed);
+    result.misses = m_misses.load(std::memory_order_relaxed);
+    result.inserts = m_inserts.load(std::memory_order_relaxed);
+    result.bytesSaved = m_bytesSaved.load(std::memory_order_relaxed);
+    return result;
+}
+
+void VerdictCache::logStats(const QString& reason) const {
+    const Stats s = stats();
+    const quint64 lookups = s.hits + s.misses;
+    const int hitRate = lookups > 0 ? static_cast<int>(s.hits * 100 / lookups) : 0;
+    LOG_INFO(QString("Кэш вердиктов (%1): записей %2, попаданий %3 (%4%), промахов %5, "
+                     "добавлено %6, не проверено повторно %7 байт")
+             .arg(reason).arg(s.entries).arg(s.hits).arg(hitRate).arg(s.misses)
+             .arg(s.inserts).arg(s.bytesSaved));
+}
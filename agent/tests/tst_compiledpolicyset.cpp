@@ -0,0 +1,121 @@
+#include <QtTest>
+#include <algorithm>
+#include <tuple>
+#include "../include/CompiledPolicySet.h"
+
+using Found = QVector<std::tuple<int, qint64, qint64>>;
+
+class TestCompiledPolicySet : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void canCombine_data();
+    void canCombine();
+    void maxMatchLength_data();
+    void maxMatchLength();
+    void groupMatches();
+
+private:
+    static DlpPolicy regexPolicy(int id, const QString& pattern);
+};
+
+DlpPolicy TestCompiledPolicySet::regexPolicy(int id, const QString& pattern)
+{
+    DlpPolicy policy;
+    policy.id = id;
+    policy.name = QString("policy %1").arg(id);
+    policy.pattern = pattern;
+    policy.severity = "high";
+    return policy;
+}
+
+void TestCompiledPolicySet::canCombine_data()
+{
+    QTest::addColumn<QString>("pattern");
+    QTest::addColumn<bool>("combinable");
+
+    QTest::newRow("plain") << R"(\b\d{10}\b)" << true;
+    QTest::newRow("flags") << R"((?i)\bpassword\b)" << true;
+    QTest::newRow("scoped flags") << R"((?i:top)\s+secret)" << true;
+    QTest::newRow("named group") << R"((?<year>\d{4})-\d{2})" << true;
+    QTest::newRow("non-capturing") << R"((?:vk\.com/|id)\d{1,10})" << true;
+    QTest::newRow("lookbehind") << R"((?<=№)\s*\d{6})" << true;
+    QTest::newRow("backreference") << R"((\w)\1)" << false;
+    QTest::newRow("relative backreference") << R"((\w)\g{-1})" << false;
+    QTest::newRow("match start") << R"(\Gabc)" << false;
+    QTest::newRow("subroutine") << R"((\d{3})-(?1))" << false;
+    QTest::newRow("relative subroutine") << R"((\d{3})-(?-1))" << false;
+    QTest::newRow("recursion") << R"(\((?:[^()]|(?R))*\))" << false;
+    QTest::newRow("named subroutine") << R"((?<n>\d{2})(?&n))" << false;
+    QTest::newRow("python subroutine") << R"((?P<n>\d{2})(?P>n))" << false;
+    QTest::newRow("branch reset") << R"((?|(a)|(b)))" << false;
+    QTest::newRow("verb") << R"((*UCP)\w+)" << false;
+    QTest::newRow("extended") << R"((?x) \d{4} \s \d{6})" << false;
+    QTest::newRow("extended scoped") << R"((?ix:a b))" << false;
+}
+
+void TestCompiledPolicySet::canCombine()
+{
+    QFETCH(QString, pattern);
+    QFETCH(bool, combinable);
+    QCOMPARE(CompiledPolicySet::canCombine(pattern), combinable);
+}
+
+void TestCompiledPolicySet::maxMatchLength_data()
+{
+    QTest::addColumn<QString>("pattern");
+    QTest::addColumn<int>("length");
+
+    QTest::newRow("fixed") << R"(\b\d{10}\b)" << 10;
+    QTest::newRow("optional group") << R"(\b4[0-9]{12}(?:[0-9]{3})?\b)" << 16;
+    QTest::newRow("range") << R"(\b\d{6,10}\b)" << 10;
+    QTest::newRow("optional separators") << R"(\b\d{2}\s?\d{2}\s?\d{6}\b)" << 12;
+    QTest::newRow("phone") << R"(\+7\s?\(?9\d{2}\)?\s?\d{3}[-]?\d{2}[-]?\d{2}\b)" << 18;
+    QTest::newRow("alternation") << R"((?i)\b(?:СЕКРЕТНО|ДСП)\b)" << 8;
+    QTest::newRow("named group") << R"((?<series>\d{4})\s\d{6})" << 11;
+    QTest::newRow("lookbehind") << R"((?<=\d)abc)" << 3;
+    QTest::newRow("class with bracket") << R"([]a]{3})" << 3;
+    QTest::newRow("plus") << R"(\w+@)" << -1;
+    QTest::newRow("open range") << R"(\d{3,})" << -1;
+    QTest::newRow("backreference") << R"((\w)\1)" << -1;
+}
+
+void TestCompiledPolicySet::maxMatchLength()
+{
+    QFETCH(QString, pattern);
+    QFETCH(int, length);
+
+    QHash<int, DlpPolicy> policies;
+    policies.insert(1, regexPolicy(1, pattern));
+    const CompiledPolicySet set(policies, true, 1 << 20);
+    QVERIFY(set.rejected().isEmpty());
+    QCOMPARE(set.maxMatchLength(), length);
+}
+
+// Политики одной группы совпадают в одной позиции: после совпадения первой
+// альтернативы остальные проверяются с той же позиции
+void TestCompiledPolicySet::groupMatches()
+{
+    QHash<int, DlpPolicy> policies;
+    policies.insert(1, regexPolicy(1, "secret"));
+    policies.insert(2, regexPolicy(2, R"(secret\w+)"));
+    policies.insert(3, regexPolicy(3, R"((\w)\1)"));
+    const CompiledPolicySet set(policies, true, 1 << 20);
+    QVERIFY(set.rejected().isEmpty());
+
+    const QString text = "a secretary keeps secret";
+    Found found;
+    for (const PolicyMatch& match : set.checkContent(text, set.allPolicies())) {
+        found.append({match.policyId, match.startPosition, match.endPosition});
+        QCOMPARE(match.matchedContent, text.mid(match.startPosition, match.endPosition - match.startPosition));
+    }
+    std::sort(found.begin(), found.end());
+
+    const Found expected = {{1, 2, 8}, {1, 18, 24}, {2, 2, 11}, {3, 13, 15}};
+    QCOMPARE(found, expected);
+}
+
+QTEST_APPLESS_MAIN(TestCompiledPolicySet)
+
+#include "tst_compiledpolicyset.moc"
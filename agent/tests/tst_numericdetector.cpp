@@ -0,0 +1,181 @@
+#include <QtTest>
+#include <QDate>
+#include "../include/NumericDetector.h"
+
+using Hits = QVector<QPair<qsizetype, qsizetype>>;
+
+class TestNumericDetector : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void card_data();
+    void card();
+    void cardPrefixes();
+    void inn_data();
+    void inn();
+    void snils_data();
+    void snils();
+    void passport_data();
+    void passport();
+    void phone_data();
+    void phone();
+
+private:
+    static Hits scan(NumericDetector::Kind kind, const QString& parameters, const QString& text);
+    static void addRows();
+};
+
+Hits TestNumericDetector::scan(NumericDetector::Kind kind, const QString& parameters, const QString& text)
+{
+    NumericDetector detector;
+    if (!detector.addPolicy(1, kind, parameters)) {
+        return {{-1, -1}};
+    }
+    QVector<NumericDetector::Hit> hits;
+    detector.scan(text, text.size(), hits);
+
+    Hits result;
+    for (const NumericDetector::Hit& hit : std::as_const(hits)) {
+        result.append({hit.start, hit.end});
+    }
+    return result;
+}
+
+void TestNumericDetector::addRows()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<Hits>("expected");
+}
+
+void TestNumericDetector::card_data()
+{
+    addRows();
+    QTest::newRow("visa") << "4111111111111111" << Hits{{0, 16}};
+    QTest::newRow("visa spaces") << "карта 4111 1111 1111 1111." << Hits{{6, 25}};
+    QTest::newRow("visa dashes") << "4111-1111-1111-1111" << Hits{{0, 19}};
+    QTest::newRow("visa 13") << "4000001234562" << Hits{{0, 13}};
+    QTest::newRow("luhn") << "4111111111111112" << Hits{};
+    QTest::newRow("mastercard") << "5500 0000 0000 0004" << Hits{{0, 19}};
+    QTest::newRow("mir") << "2200000000000004" << Hits{{0, 16}};
+    QTest::newRow("amex 4-6-5") << "3782 822463 10005" << Hits{{0, 17}};
+    QTest::newRow("amex length") << "3782822463100050" << Hits{};
+    QTest::newRow("mixed separators") << "4111 1111-1111 1111" << Hits{};
+    QTest::newRow("groups of five") << "41111 11111 111111" << Hits{};
+    QTest::newRow("unknown prefix") << "1111111111111117" << Hits{};
+    QTest::newRow("leading amount") << "Итого 100 4111 1111 1111 1111" << Hits{{10, 29}};
+    QTest::newRow("inside word") << "x4111111111111111" << Hits{};
+    QTest::newRow("decimal tail") << "1.4111111111111111" << Hits{};
+    QTest::newRow("plus sign") << "+4111111111111111" << Hits{};
+}
+
+void TestNumericDetector::card()
+{
+    QFETCH(QString, text);
+    QFETCH(Hits, expected);
+    QCOMPARE(scan(NumericDetector::Kind::Card, QString(), text), expected);
+}
+
+void TestNumericDetector::cardPrefixes()
+{
+    const QString parameters = "4,51-55,2200-2204";
+    QCOMPARE(scan(NumericDetector::Kind::Card, parameters, "2200000000000004"), (Hits{{0, 16}}));
+    QCOMPARE(scan(NumericDetector::Kind::Card, parameters, "378282246310005"), Hits{});
+    QCOMPARE(scan(NumericDetector::Kind::Card, parameters, "6011111111111117"), Hits{});
+
+    NumericDetector detector;
+    QVERIFY(!detector.addPolicy(1, NumericDetector::Kind::Card, "22-2204"));
+    QVERIFY(!detector.addPolicy(1, NumericDetector::Kind::Card, "55-51"));
+    QVERIFY(!detector.addPolicy(1, NumericDetector::Kind::Card, "4a"));
+    QVERIFY(detector.isEmpty());
+}
+
+void TestNumericDetector::inn_data()
+{
+    addRows();
+    QTest::newRow("legal") << "ИНН 7707083893" << Hits{{4, 14}};
+    QTest::newRow("legal check") << "7707083894" << Hits{};
+    QTest::newRow("personal") << "500100732259" << Hits{{0, 12}};
+    QTest::newRow("personal check") << "500100732258" << Hits{};
+    QTest::newRow("region 00") << "0012345673" << Hits{};
+    QTest::newRow("grouped") << "7707 083893" << Hits{};
+    QTest::newRow("eleven digits") << "77070838931" << Hits{};
+}
+
+void TestNumericDetector::inn()
+{
+    QFETCH(QString, text);
+    QFETCH(Hits, expected);
+    QCOMPARE(scan(NumericDetector::Kind::Inn, QString(), text), expected);
+}
+
+void TestNumericDetector::snils_data()
+{
+    addRows();
+    QTest::newRow("dashes") << "СНИЛС 112-233-445 95" << Hits{{6, 20}};
+    QTest::newRow("solid") << "11223344595" << Hits{{0, 11}};
+    QTest::newRow("body and control") << "112233445 95" << Hits{{0, 12}};
+    QTest::newRow("control") << "112-233-445 94" << Hits{};
+    QTest::newRow("layout") << "11-2233-445 95" << Hits{};
+    QTest::newRow("before 001-001-998") << "001-001-998 64" << Hits{};
+    QTest::newRow("after 001-001-998") << "001-001-999 65" << Hits{{0, 14}};
+}
+
+void TestNumericDetector::snils()
+{
+    QFETCH(QString, text);
+    QFETCH(Hits, expected);
+    QCOMPARE(scan(NumericDetector::Kind::Snils, QString(), text), expected);
+}
+
+void TestNumericDetector::passport_data()
+{
+    addRows();
+    // Год бланка в серии: с 97 до следующего за текущим
+    const int year = QDate::currentDate().year() % 100;
+    auto series = [](int value) { return QString("45%1").arg(value % 100, 2, 10, QChar('0')); };
+
+    QTest::newRow("1997") << series(97) + " 123456" << Hits{{0, 11}};
+    QTest::newRow("1999") << series(99) + " 123456" << Hits{{0, 11}};
+    QTest::newRow("2000") << series(0) + " 123456" << Hits{{0, 11}};
+    QTest::newRow("current year") << series(year) + " 123456" << Hits{{0, 11}};
+    QTest::newRow("next year") << series(year + 1) + " 123456" << Hits{{0, 11}};
+    if (year + 2 < 97) {
+        QTest::newRow("after next year") << series(year + 2) + " 123456" << Hits{};
+        QTest::newRow("1996") << series(96) + " 123456" << Hits{};
+    }
+    QTest::newRow("pairs") << "45 08 123456" << Hits{{0, 12}};
+    QTest::newRow("number sign") << "4508 № 123456" << Hits{{0, 13}};
+    QTest::newRow("solid") << "4508123456" << Hits{{0, 10}};
+    QTest::newRow("region 00") << "0008 123456" << Hits{};
+    QTest::newRow("zero number") << "4508 000000" << Hits{};
+    QTest::newRow("dash") << "4508-123456" << Hits{};
+}
+
+void TestNumericDetector::passport()
+{
+    QFETCH(QString, text);
+    QFETCH(Hits, expected);
+    QCOMPARE(scan(NumericDetector::Kind::Passport, QString(), text), expected);
+}
+
+void TestNumericDetector::phone_data()
+{
+    addRows();
+    QTest::newRow("plus") << "+7 (999) 123-45-67" << Hits{{0, 18}};
+    QTest::newRow("eight") << "8 999 123 45 67" << Hits{{0, 15}};
+    QTest::newRow("solid eight") << "89991234567" << Hits{{0, 11}};
+    QTest::newRow("solid seven") << "79991234567" << Hits{};
+    QTest::newRow("code") << "+7 555 123-45-67" << Hits{};
+}
+
+void TestNumericDetector::phone()
+{
+    QFETCH(QString, text);
+    QFETCH(Hits, expected);
+    QCOMPARE(scan(NumericDetector::Kind::Phone, QString(), text), expected);
+}
+
+QTEST_APPLESS_MAIN(TestNumericDetector)
+
+#include "tst_numericdetector.moc"
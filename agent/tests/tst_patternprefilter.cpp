@@ -0,0 +1,94 @@
+#include <QtTest>
+#include "../include/PatternPrefilter.h"
+
+class TestPatternPrefilter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void analyze_data();
+    void analyze();
+    void unsupported_data();
+    void unsupported();
+};
+
+// Шаблоны политик из database/init.sql
+void TestPatternPrefilter::analyze_data()
+{
+    QTest::addColumn<QString>("pattern");
+    QTest::addColumn<QString>("symbol");
+    QTest::addColumn<int>("digitRun");
+
+    QTest::newRow("visa") << R"(\b4[0-9]{12}(?:[0-9]{3})?\b)" << "" << 13;
+    QTest::newRow("mastercard") << R"(\b5[1-5][0-9]{14}\b)" << "" << 16;
+    QTest::newRow("amex") << R"(\b3[47][0-9]{13}\b)" << "" << 15;
+    QTest::newRow("passport") << R"(\b\d{4}\s+\d{6}\b)" << "" << 6;
+    QTest::newRow("passport old") << R"(\b\d{4}\s*№\s*\d{6}\b)" << "№" << 0;
+    QTest::newRow("email") << R"(\b[A-Za-z0-9._%+-]+@[A-Za-z0-9.-]+\.[A-Z|a-z]{2,}\b)" << "@" << 0;
+    QTest::newRow("corporate email")
+        << R"(\b[A-Za-z0-9._%+-]+@(?:company|corp|enterprise|business)\.(?:com|ru|net|org)\b)" << "@" << 0;
+    QTest::newRow("mobile") << R"(\+7\s?\(?9\d{2}\)?\s?\d{3}[-]?\d{2}[-]?\d{2}\b)" << "+" << 0;
+    QTest::newRow("city phone") << R"(\+7\s?\(?\d{3,5}\)?\s?\d{1,3}[-]?\d{2}[-]?\d{2}\b)" << "+" << 0;
+    QTest::newRow("account") << R"(\b\d{20}\b)" << "" << 20;
+    QTest::newRow("correspondent") << R"(\b301\d{17}\b)" << "" << 20;
+    QTest::newRow("bik") << R"(\b\d{9}\b)" << "" << 9;
+    QTest::newRow("inn 10") << R"(\b\d{10}\b)" << "" << 10;
+    QTest::newRow("ogrnip") << R"(\b\d{15}\b)" << "" << 15;
+    QTest::newRow("snils") << R"(\b\d{3}-\d{3}-\d{3}\s\d{2}\b)" << "" << 3;
+    QTest::newRow("series number") << R"(\b\d{2}\s?\d{2}\s?\d{6}\b)" << "" << 6;
+    QTest::newRow("policy number") << R"(\b\d{2}\s?\d{7}\b)" << "" << 7;
+    QTest::newRow("date") << R"(\b\d{2}\.\d{2}\.\d{4}\b)" << "" << 4;
+    QTest::newRow("coordinates") << R"(\b\d{1,3}\.\d{4,6},\s*\d{1,3}\.\d{4,6}\b)" << "" << 4;
+    QTest::newRow("digit range") << R"(\b\d{6,10}\b)" << "" << 6;
+    // Коротких последовательностей цифр нет - признаком остается частый символ
+    QTest::newRow("full name") << R"(\b[А-ЯЁ][а-яё]+\s+[А-ЯЁ]\.\s*[А-ЯЁ]\.\b)" << "." << 0;
+    QTest::newRow("address")
+        << R"((?i)\b(?:ул|улица|проспект|пр|бульвар|б-р|переулок|пер)\.?\s+[^,]+,\s*(?:д|дом)\.?\s*\d+[^,]*,\s*(?:кв|квартира)\.?\s*\d+\b)"
+        << "," << 0;
+    // Ни символа, ни длинной последовательности: годится и одна цифра
+    QTest::newRow("vk id") << R"(\b(?:vk\.com/|id)\d{1,10}\b)" << "" << 1;
+    QTest::newRow("ethereum") << R"(\b0x[a-fA-F0-9]{40}\b)" << "" << 1;
+    QTest::newRow("bitcoin") << R"(\b[13][a-km-zA-HJ-NP-Z1-9]{25,34}\b)" << "" << 1;
+    QTest::newRow("rubles") << R"(\b\d{1,3}(?:[ ,]\d{3})*(?:\.\d{2})?\s*(?:руб|р\.|RUB)\b)" << "" << 1;
+    QTest::newRow("contract")
+        << R"(\b(?:договор|контракт|contract|agreement)\s*№?\s*\d{1,5}(?:[/\-]\d{2,4})?\b)" << "" << 1;
+}
+
+void TestPatternPrefilter::analyze()
+{
+    QFETCH(QString, pattern);
+    QFETCH(QString, symbol);
+    QFETCH(int, digitRun);
+
+    const PatternTrigger trigger = PatternPrefilter::analyze(pattern);
+    QVERIFY(trigger.isValid());
+    QCOMPARE(trigger.symbol.isNull() ? QString() : QString(trigger.symbol), symbol);
+    QCOMPARE(trigger.digitRun, digitRun);
+}
+
+// Шаблоны без обязательного признака проверяются по всему тексту
+void TestPatternPrefilter::unsupported_data()
+{
+    QTest::addColumn<QString>("pattern");
+
+    QTest::newRow("secrecy") << R"(\b(?:СЕКРЕТНО|КОНФИДЕНЦИАЛЬНО|ДСП|ОВ|ОСОБОЙ\s+ВАЖНОСТИ)\b)";
+    QTest::newRow("password") << R"((?i)\b(?:пароль|password|pwd|pass)\s*[:=]\s*[^\s]{6,}\b)";
+    QTest::newRow("api key") << R"(\b(?:sk|pk|AKIA|SG\.|Bearer\s)[a-zA-Z0-9_\-\.]{20,}\b)";
+    QTest::newRow("telegram") << R"(\b(?:t\.me/|telegram\.me/|@)[A-Za-z0-9_]{5,32}\b)";
+    QTest::newRow("marking") << R"(\b(?:internal|внутренний|for office use only|служебная записка)\b)";
+    QTest::newRow("top level alternation") << R"(\d{10}|\d{12})";
+    QTest::newRow("lookahead") << R"(\d{4}(?=\s*руб))";
+    QTest::newRow("backreference") << R"((\d{3})-\1)";
+    QTest::newRow("end anchor") << R"(\d{6}$)";
+    QTest::newRow("extended mode") << R"((?x) \d{6} \s @)";
+}
+
+void TestPatternPrefilter::unsupported()
+{
+    QFETCH(QString, pattern);
+    QVERIFY(!PatternPrefilter::analyze(pattern).isValid());
+}
+
+QTEST_APPLESS_MAIN(TestPatternPrefilter)
+
+#include "tst_patternprefilter.moc"
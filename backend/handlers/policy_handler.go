@@ -2,10 +2,12 @@ package handlers
 
 import (
 	"DLP_Server/models"
+	"DLP_Server/utils"
 	"encoding/json"
 	"github.com/go-chi/chi/v5"
 	"net/http"
 	"strconv"
+	"strings"
 )
 
 // GetPolicies - получение списка политик
@@ -31,10 +33,12 @@ func (h *Handler) GetPoliciesForAgent(w http.ResponseWriter, r *http.Request) {
 	}
 
 	type AgentPolicy struct {
-		ID       int64  `json:"id"`
-		Name     string `json:"name"`
-		Pattern  string `json:"pattern"`
-		Severity string `json:"severity"`
+		ID       int64               `json:"id"`
+		Name     string              `json:"name"`
+		Pattern  string              `json:"pattern"`
+		Kind     string              `json:"kind"`
+		Scope    *models.PolicyScope `json:"scope,omitempty"`
+		Severity string              `json:"severity"`
 	}
 
 	agentPolicies := make([]AgentPolicy, len(policies))
@@ -43,8 +47,14 @@ func (h *Handler) GetPoliciesForAgent(w http.ResponseWriter, r *http.Request) {
 			ID:       p.ID,
 			Name:     p.Name,
 			Pattern:  p.Pattern,
+			Kind:     p.Kind,
 			Severity: p.Severity,
 		}
+		// Без области агент проверяет политику на всех файлах
+		if !p.Scope.IsEmpty() {
+			scope := p.Scope
+			agentPolicies[i].Scope = &scope
+		}
 	}
 
 	w.Header().Set("Content-Type", "application/json")
@@ -59,15 +69,22 @@ func (h *Handler) CreatePolicy(w http.ResponseWriter, r *http.Request) {
 		return
 	}
 
-	if req.Name == "" || req.Pattern == "" {
-		http.Error(w, "Обязательные поля: name, pattern", http.StatusBadRequest)
+	if errs := utils.ValidatePolicyCreate(req.Name, req.Kind, req.Pattern, req.Severity); len(errs) > 0 {
+		http.Error(w, strings.Join(errs, "; "), http.StatusBadRequest)
 		return
 	}
 
+	kind := req.Kind
+	if kind == "" {
+		kind = "regex"
+	}
+
 	policy := models.Policy{
 		Name:        req.Name,
 		Description: req.Description,
 		Pattern:     req.Pattern,
+		Kind:        kind,
+		Scope:       req.Scope,
 		Severity:    req.Severity,
 		IsActive:    req.IsActive,
 	}
@@ -102,14 +119,24 @@ func (h *Handler) UpdatePolicy(w http.ResponseWriter, r *http.Request) {
 		return
 	}
 
+	if req.Kind != "" && !utils.ValidatePolicyKind(req.Kind) {
+		http.Error(w, "Неверный вид политики", http.StatusBadRequest)
+		return
+	}
+
 	policy := models.Policy{
 		ID:          id,
 		Name:        req.Name,
 		Description: req.Description,
 		Pattern:     req.Pattern,
+		Kind:        req.Kind,
 		Severity:    req.Severity,
 	}
 
+	if req.Scope != nil {
+		policy.Scope = *req.Scope
+	}
+
 	if req.IsActive != nil {
 		policy.IsActive = *req.IsActive
 	}
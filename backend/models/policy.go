@@ -1,37 +1,85 @@
 package models
 
 import (
+	"database/sql/driver"
+	"encoding/json"
+	"errors"
 	"time"
 )
 
-// Policy - DLP-политика
+// PolicyScope - область действия политики; пустые поля не ограничивают.
+// Хранится в jsonb и передается агенту в том же виде
+type PolicyScope struct {
+	Extensions []string `json:"extensions,omitempty"`
+	Classes    []string `json:"classes,omitempty"`
+	Paths      []string `json:"paths,omitempty"`
+	MaxSize    int64    `json:"max_size,omitempty"`
+}
+
+// IsEmpty - политика проверяется на всех файлах
+func (s PolicyScope) IsEmpty() bool {
+	return len(s.Extensions) == 0 && len(s.Classes) == 0 && len(s.Paths) == 0 && s.MaxSize == 0
+}
+
+// Value - запись в jsonb; пустая область хранится как NULL
+func (s PolicyScope) Value() (driver.Value, error) {
+	if s.IsEmpty() {
+		return nil, nil
+	}
+	return json.Marshal(s)
+}
+
+// Scan - чтение из jsonb
+func (s *PolicyScope) Scan(value interface{}) error {
+	switch v := value.(type) {
+	case nil:
+		*s = PolicyScope{}
+		return nil
+	case []byte:
+		return json.Unmarshal(v, s)
+	case string:
+		return json.Unmarshal([]byte(v), s)
+	default:
+		return errors.New("неверный тип области политики")
+	}
+}
+
+// Policy - DLP-политика. Kind "regex" - регулярное выражение в Pattern;
+// иначе встроенный детектор агента (card, inn, snils, passport, phone),
+// Pattern - его параметры
 type Policy struct {
-	ID          int64     `json:"id" gorm:"primaryKey;autoIncrement"`
-	Name        string    `json:"name" gorm:"size:100;not null"`
-	Description string    `json:"description" gorm:"type:text"`
-	Pattern     string    `json:"pattern" gorm:"type:text;not null"`
-	Severity    string    `json:"severity" gorm:"size:20;check:severity IN ('info', 'low', 'medium', 'high', 'critical');not null"`
-	IsActive    bool      `json:"is_active" gorm:"default:true"`
-	CreatedAt   time.Time `json:"created_at" gorm:"autoCreateTime"`
-	UpdatedAt   time.Time `json:"updated_at" gorm:"autoUpdateTime"`
+	ID          int64       `json:"id" gorm:"primaryKey;autoIncrement"`
+	Name        string      `json:"name" gorm:"size:100;not null"`
+	Description string      `json:"description" gorm:"type:text"`
+	Pattern     string      `json:"pattern" gorm:"type:text;not null;default:''"`
+	Kind        string      `json:"kind" gorm:"size:20;not null;default:regex"`
+	Scope       PolicyScope `json:"scope" gorm:"type:jsonb"`
+	Severity    string      `json:"severity" gorm:"size:20;check:severity IN ('info', 'low', 'medium', 'high', 'critical');not null"`
+	IsActive    bool        `json:"is_active" gorm:"default:true"`
+	CreatedAt   time.Time   `json:"created_at" gorm:"autoCreateTime"`
+	UpdatedAt   time.Time   `json:"updated_at" gorm:"autoUpdateTime"`
 
 	Incidents []Incident `gorm:"foreignKey:PolicyID"`
 }
 
 // PolicyCreate - запрос создания политики
 type PolicyCreate struct {
-	Name        string `json:"name" validate:"required"`
-	Description string `json:"description"`
-	Pattern     string `json:"pattern" validate:"required"`
-	Severity    string `json:"severity" validate:"required"`
-	IsActive    bool   `json:"is_active"`
+	Name        string      `json:"name" validate:"required"`
+	Description string      `json:"description"`
+	Pattern     string      `json:"pattern"`
+	Kind        string      `json:"kind"`
+	Scope       PolicyScope `json:"scope"`
+	Severity    string      `json:"severity" validate:"required"`
+	IsActive    bool        `json:"is_active"`
 }
 
 // PolicyUpdate - запрос обновления политики
 type PolicyUpdate struct {
-	Name        string `json:"name"`
-	Description string `json:"description"`
-	Pattern     string `json:"pattern"`
-	Severity    string `json:"severity"`
-	IsActive    *bool  `json:"is_active"`
+	Name        string       `json:"name"`
+	Description string       `json:"description"`
+	Pattern     string       `json:"pattern"`
+	Kind        string       `json:"kind"`
+	Scope       *PolicyScope `json:"scope"`
+	Severity    string       `json:"severity"`
+	IsActive    *bool        `json:"is_active"`
 }
@@ -31,8 +31,10 @@ func ValidateAgentRegistration(agentID, hostname, ipAddress string) []string {
 	return errors
 }
 
-// ValidatePolicyCreate - проверка структуры создания политики
-func ValidatePolicyCreate(name, pattern, severity string) []string {
+// ValidatePolicyCreate - проверка структуры создания политики.
+// Пустой kind - регулярное выражение; встроенным детекторам агента
+// шаблон не нужен, pattern - их необязательные параметры
+func ValidatePolicyCreate(name, kind, pattern, severity string) []string {
 	var errors []string
 
 	if name == "" {
@@ -41,7 +43,11 @@ func ValidatePolicyCreate(name, pattern, severity string) []string {
 		errors = append(errors, "название политики не должно превышать 100 символов")
 	}
 
-	if pattern == "" {
+	if kind != "" && !ValidatePolicyKind(kind) {
+		errors = append(errors, "неверный вид политики. Допустимые значения: regex, card, inn, snils, passport, phone")
+	}
+
+	if pattern == "" && (kind == "" || kind == "regex") {
 		errors = append(errors, "шаблон (pattern) обязателен")
 	}
 
@@ -60,6 +66,20 @@ func ValidatePolicyCreate(name, pattern, severity string) []string {
 	return errors
 }
 
+// ValidatePolicyKind - проверка вида политики
+func ValidatePolicyKind(kind string) bool {
+	validKinds := map[string]bool{
+		"regex":    true,
+		"card":     true,
+		"inn":      true,
+		"snils":    true,
+		"passport": true,
+		"phone":    true,
+	}
+
+	return validKinds[kind]
+}
+
 // ValidateEventCreate - проверка структуры создания события
 func ValidateEventCreate(agentID, filePath, fileName, eventType, contentSample string) []string {
 	var errors []string
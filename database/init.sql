@@ -15,13 +15,23 @@ CREATE TABLE IF NOT EXISTS policies (
     id SERIAL PRIMARY KEY,
     name VARCHAR(100) NOT NULL,
     description TEXT,
-    pattern TEXT NOT NULL,
+    -- Для kind = 'regex' - регулярное выражение, для детекторов агента - их параметры
+    pattern TEXT NOT NULL DEFAULT '',
+    kind VARCHAR(20) NOT NULL DEFAULT 'regex' CHECK (kind IN ('regex', 'card', 'inn', 'snils', 'passport', 'phone')),
+    -- Область действия: {"extensions": [...], "classes": [...], "paths": [...], "max_size": N}; NULL - все файлы
+    scope JSONB,
     severity VARCHAR(20) NOT NULL CHECK (severity IN ('info', 'low', 'medium', 'high', 'critical')),
     is_active BOOLEAN DEFAULT true,
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
 );
 
+-- Базы, созданные до появления видов и областей политик
+ALTER TABLE policies ADD COLUMN IF NOT EXISTS kind VARCHAR(20) NOT NULL DEFAULT 'regex'
+    CHECK (kind IN ('regex', 'card', 'inn', 'snils', 'passport', 'phone'));
+ALTER TABLE policies ADD COLUMN IF NOT EXISTS scope JSONB;
+ALTER TABLE policies ALTER COLUMN pattern SET DEFAULT '';
+
 -- Таблица событий
 CREATE TABLE IF NOT EXISTS events (
     id SERIAL PRIMARY KEY,
@@ -223,3 +233,22 @@ INSERT INTO policies (name, description, pattern, severity, is_active) VALUES
 
 ('Номер договора', 'Обнаружение номеров договоров и контрактов',
  '\b(?:договор|контракт|contract|agreement)\s*№?\s*\d{1,5}(?:[/\-]\d{2,4})?\b', 'medium', true);
+
+-- 21. Встроенные детекторы агента: номер подтверждается контрольной суммой
+-- (Луна, контрольные цифры ИНН и СНИЛС, год выдачи паспорта). Точнее
+-- регулярных выражений выше и включаются вместо них
+INSERT INTO policies (name, description, pattern, kind, scope, severity, is_active) VALUES
+('Номер карты (проверка Луна)', 'Номера платежных карт по таблице BIN с проверкой по алгоритму Луна',
+ '', 'card', NULL, 'high', false),
+
+('ИНН (контрольные цифры)', 'ИНН организаций и физлиц с проверкой контрольных цифр',
+ '', 'inn', NULL, 'medium', false),
+
+('СНИЛС (контрольное число)', 'Номера СНИЛС с проверкой контрольного числа',
+ '', 'snils', NULL, 'critical', false),
+
+('Паспорт РФ (год выдачи)', 'Серия и номер паспорта с допустимым годом выдачи в серии',
+ '', 'passport', NULL, 'critical', false),
+
+('Номера карт в выгрузках', 'Номера Visa, MasterCard и МИР в таблицах и выгрузках',
+ '4,51-55,2200-2204', 'card', '{"classes": ["spreadsheet"], "extensions": ["txt"], "max_size": 104857600}', 'critical', true);